@@ -0,0 +1,156 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+/*
+
+Enumeration of all combinations of boolean function outcomes of a step
+over the bits where the outcome is not fixed by the bitconditions.
+
+For each such bit the possible outcomes are precomputed once: the resulting bitconditions on the three input words,
+their number of conditions and their contribution to dF.
+The number of conditions of the three words is the sum over all bits, so the combinations are enumerated depth-first
+with the running number of conditions and dF, and subtrees that cannot stay within maxcond are skipped entirely.
+Combinations are enumerated in the same order as the mixed radix enumeration over bval (with bval[0] the most significant).
+
+*/
+
+#ifndef HASHCLASH_BFEXPANSION_HPP
+#define HASHCLASH_BFEXPANSION_HPP
+
+#include <vector>
+
+#include "types.hpp"
+#include "conditions.hpp"
+#include "booleanfunction.hpp"
+
+namespace hashclash {
+
+class bf_expansion {
+  public:
+    // bval: the bits b with more than one outcome foutcomes[b], most significant first
+    // F(Qtb[b], Qtm1b[b], Qtm2b[b]) uses the forward or backward conditions
+    void prepare(
+        booleanfunction &F,
+        const bitcondition Qtb[32],
+        const bitcondition Qtm1b[32],
+        const bitcondition Qtm2b[32],
+        const bf_outcome foutcomes[32],
+        const std::vector<unsigned> &bval,
+        bool backward
+    ) {
+        levels = unsigned(bval.size());
+        mincost[levels] = 0;
+        for (unsigned j = levels; j-- > 0;) {
+            const unsigned b = bval[j];
+            bit[j] = b;
+            optioncount[j] = foutcomes[b].size();
+            unsigned minc = 3;
+            for (unsigned i = 0; i < optioncount[j]; ++i) {
+                const bf_conditions &c = backward ? F.backwardconditions(Qtb[b], Qtm1b[b], Qtm2b[b], foutcomes[b][i])
+                                                  : F.forwardconditions(Qtb[b], Qtm1b[b], Qtm2b[b], foutcomes[b][i]);
+                option &o = options[j][i];
+                o.first = c.first;
+                o.second = c.second;
+                o.third = c.third;
+                o.cost = unsigned(c.first != bc_constant) + unsigned(c.second != bc_constant) + unsigned(c.third != bc_constant);
+                o.dF = foutcomes[b](i, b);
+                if (o.cost < minc) {
+                    minc = o.cost;
+                }
+            }
+            mincost[j] = mincost[j + 1] + minc;
+        }
+    }
+
+    // the number of conditions of the three words on all bits not in bval
+    unsigned fixedcost(const wordconditions &Q0, const wordconditions &Q1, const wordconditions &Q2) const {
+        uint32 varmask = 0;
+        for (unsigned j = 0; j < levels; ++j) {
+            varmask |= uint32(1) << bit[j];
+        }
+        return hw(Q0.mask() & ~varmask) + hw(Q1.mask() & ~varmask) + hw(Q2.mask() & ~varmask);
+    }
+
+    // the minimal number of conditions on the bits in bval
+    unsigned minimalcost() const { return mincost[0]; }
+
+    // for each combination with basecost + #conditions on the bits in bval <= maxcond:
+    //   set the bitconditions of bits in bval in Q0, Q1, Q2 and call leaf(dFbase + dF, basecost + #conditions)
+    // maxcond is re-read at each node as it may be lowered by leaf
+    template <class Leaf>
+    void enumerate(wordconditions &Q0, wordconditions &Q1, wordconditions &Q2, uint32 dFbase, unsigned basecost, const unsigned &maxcond, Leaf leaf) {
+        if (levels == 0) {
+            if (basecost <= maxcond) {
+                leaf(dFbase, basecost);
+            }
+            return;
+        }
+        unsigned choice[32];
+        uint32 dFacc[32];
+        unsigned costacc[32];
+        unsigned j = 0;
+        choice[0] = 0;
+        dFacc[0] = dFbase;
+        costacc[0] = basecost;
+        while (true) {
+            if (choice[j] == optioncount[j]) {
+                if (j == 0) {
+                    return;
+                }
+                ++choice[--j];
+                continue;
+            }
+            const option &o = options[j][choice[j]];
+            const unsigned cost = costacc[j] + o.cost;
+            if (cost + mincost[j + 1] > maxcond) {
+                ++choice[j];
+                continue;
+            }
+            const unsigned b = bit[j];
+            Q0.set(b, o.first);
+            Q1.set(b, o.second);
+            Q2.set(b, o.third);
+            if (j + 1 < levels) {
+                dFacc[j + 1] = dFacc[j] + o.dF;
+                costacc[j + 1] = cost;
+                choice[++j] = 0;
+                continue;
+            }
+            leaf(dFacc[j] + o.dF, cost);
+            ++choice[j];
+        }
+    }
+
+  private:
+    struct option {
+        bitcondition first, second, third;
+        unsigned cost;
+        uint32 dF;
+    };
+    unsigned levels;
+    unsigned bit[32];
+    unsigned optioncount[32];
+    option options[32][3];
+    // mincost[j]: minimal number of conditions on the bits bval[j],...
+    unsigned mincost[33];
+};
+
+} // namespace hashclash
+
+#endif // HASHCLASH_BFEXPANSION_HPP
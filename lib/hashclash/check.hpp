@@ -0,0 +1,61 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+/*
+
+Reporting for the check programs run by 'make check'.
+
+Each check program calls check(ok, what) for every property it verifies
+and returns check_result(name) from main:
+a failed check is reported on stderr and makes the program exit with status 1.
+
+*/
+
+#ifndef HASHCLASH_CHECK_HPP
+#define HASHCLASH_CHECK_HPP
+
+#include <iostream>
+#include <string>
+
+namespace hashclash {
+
+inline unsigned &check_failures() {
+    static unsigned failures = 0;
+    return failures;
+}
+
+inline void check(bool ok, const std::string &what) {
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++check_failures();
+    }
+}
+
+inline int check_result(const std::string &name) {
+    if (check_failures() != 0) {
+        std::cerr << check_failures() << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << name << ": all checks passed" << std::endl;
+    return 0;
+}
+
+} // namespace hashclash
+
+#endif // HASHCLASH_CHECK_HPP
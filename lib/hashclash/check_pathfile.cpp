@@ -0,0 +1,253 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+// check program for pathfile: round trips, parts of the permutation and truncated or corrupted files
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include "check.hpp"
+#include "pathfile.hpp"
+#include "rng.hpp"
+
+using namespace hashclash;
+using namespace std;
+
+differentialpath random_path() {
+    differentialpath path;
+    path.offset = 3 - int(xrng128() % 20);
+    path.path.resize(xrng128() % 70);
+    for (size_t w = 0; w < path.path.size(); ++w) {
+        for (unsigned k = 0; k < 4; ++k) {
+            path.path[w].bytes[k].val = xrng128();
+        }
+    }
+    return path;
+}
+
+bool same(const differentialpath &l, const differentialpath &r) {
+    return l.tbegin() == r.tbegin() && l.path.size() == r.path.size() && (l.path.empty() || l == r);
+}
+
+bool same(const vector<differentialpath> &l, const vector<differentialpath> &r) {
+    if (l.size() != r.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < l.size(); ++i) {
+        if (!same(l[i], r[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+vector<unsigned char> read_file(const string &filename) {
+    ifstream ifs(filename.c_str(), ios::binary);
+    return vector<unsigned char>(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+}
+
+void write_file(const string &filename, const vector<unsigned char> &data, size_t size) {
+    ofstream ofs(filename.c_str(), ios::binary | ios::trunc);
+    ofs.write(reinterpret_cast<const char *>(data.data()), size);
+}
+
+// true iff reading all paths of the file fails
+bool load_fails(const string &filename) {
+    try {
+        vector<differentialpath> loaded;
+        load_pathfile(loaded, filename);
+    } catch (std::exception &) {
+        return true;
+    }
+    return false;
+}
+
+void check_roundtrip(const string &base, size_t count, unsigned pathsperchunk) {
+    const string filename = base + ".paths";
+    vector<differentialpath> paths;
+    for (size_t i = 0; i < count; ++i) {
+        paths.push_back(random_path());
+    }
+    {
+        pathfile_writer writer(filename, pathsperchunk);
+        for (auto &path : paths) {
+            writer.push_back(path);
+        }
+        writer.close();
+    }
+    check(is_pathfile(filename), "is_pathfile");
+    vector<differentialpath> loaded;
+    load_pathfile(loaded, filename);
+    check(same(loaded, paths), "round trip of " + to_string(count) + " paths");
+
+    pathfile_reader reader(filename);
+    check(reader.size() == count, "reader size");
+    bool ok = true;
+    for (unsigned j = 0; j < 100 && count != 0; ++j) {
+        const uint64 i = xrng128() % count;
+        ok = ok && same(reader[i], paths[size_t(i)]);
+    }
+    check(ok, "random access");
+    differentialpath path;
+    size_t streamed = 0;
+    while (reader.next(path)) {
+        ok = ok && same(path, paths[streamed++]);
+    }
+    check(ok && streamed == count, "streaming");
+    if (reader.chunks() > 1) {
+        loaded.clear();
+        reader.load_chunk(1, loaded);
+        check(same(loaded, vector<differentialpath>(paths.begin() + pathsperchunk,
+                                                    paths.begin() + min<size_t>(count, 2 * pathsperchunk))),
+              "load_chunk");
+    }
+
+    // the parts of a path file are those of the binary archive and together they are all paths
+    save_paths(paths, base, false);
+    const unsigned modn = 3;
+    vector<differentialpath> all;
+    for (unsigned modi = 0; modi < modn; ++modi) {
+        vector<differentialpath> part, partgz;
+        check(load_paths_part(part, filename, modi, modn) == count, "load_paths_part total");
+        load_paths_part(partgz, base + ".bin.gz", modi, modn);
+        check(same(part, partgz), "load_paths_part of a path file and a binary archive");
+        all.insert(all.end(), part.begin(), part.end());
+    }
+    vector<uint64> perm;
+    path_permutation(perm, count);
+    ok = (all.size() == count);
+    for (unsigned modi = 0, j = 0; ok && modi < modn; ++modi) {
+        for (size_t i = modi; i < count; i += modn, ++j) {
+            ok = ok && same(all[j], paths[size_t(perm[i])]);
+        }
+    }
+    check(ok, "parts of the permutation");
+    check(paths_filename(base) == filename, "paths_filename prefers the path file");
+    ::unlink(filename.c_str());
+    check(paths_filename(base) == base + ".bin.gz", "paths_filename falls back to the binary archive");
+    loaded.clear();
+    load_paths(loaded, base + ".bin.gz");
+    check(same(loaded, paths), "save_paths as binary archive");
+    ::unlink((base + ".bin.gz").c_str());
+}
+
+// path_permutation is the swap shuffle that random_permutation did with the global generator seeded with n,
+// so the order of the paths and the modi/modn parts match runs of earlier versions
+void check_permutation(uint64 n) {
+    vector<uint64> perm, old;
+    path_permutation(perm, n);
+    old.resize(perm.size());
+    for (size_t i = 0; i < old.size(); ++i) {
+        old[i] = i;
+    }
+    seed(uint32(n));
+    for (unsigned i = 0; i < old.size(); ++i) {
+        unsigned k = xrng64() % old.size();
+        swap(old[i], old[k]);
+    }
+    check(perm == old, "path_permutation of " + to_string(n) + " paths is the old permutation");
+}
+
+void check_corrupted(const string &base) {
+    const string filename = base + ".paths";
+    vector<differentialpath> paths;
+    for (unsigned i = 0; i < 50; ++i) {
+        paths.push_back(random_path());
+    }
+    save_paths(paths, base, true);
+    const vector<unsigned char> data = read_file(filename);
+
+    // every truncation cuts off (part of) the index at the end
+    bool ok = true;
+    for (size_t size = 0; size < data.size(); size += 1 + size / 16) {
+        write_file(filename, data, size);
+        ok = ok && load_fails(filename);
+    }
+    write_file(filename, data, data.size() - 1);
+    ok = ok && load_fails(filename);
+    check(ok, "truncated path files are rejected");
+
+    // a failed load_paths_part leaves paths as they were
+    vector<differentialpath> part(1, paths[0]);
+    try {
+        load_paths_part(part, filename, 0, 2);
+        check(false, "load_paths_part of a truncated file");
+    } catch (std::exception &) {
+    }
+    check(part.size() == 1, "failed load_paths_part keeps the paths");
+
+    // a damaged chunk or header is detected
+    vector<unsigned char> damaged = data;
+    damaged[pathfile_headersize + 20] ^= 0x5a;
+    write_file(filename, damaged, damaged.size());
+    check(load_fails(filename), "damaged chunk is rejected");
+    damaged = data;
+    damaged[0] ^= 1;
+    write_file(filename, damaged, damaged.size());
+    check(!is_pathfile(filename) && load_fails(filename), "damaged magic is rejected");
+    damaged = data;
+    damaged[8] ^= 1;
+    write_file(filename, damaged, damaged.size());
+    check(load_fails(filename), "damaged header is rejected");
+
+    // an uncompressed chunk size in the index that the chunk cannot have is rejected before it is allocated
+    uint64 indexoffset = 0;
+    for (unsigned k = 0; k < 8; ++k) {
+        indexoffset |= uint64(data[24 + k]) << (8 * k);
+    }
+    damaged = data;
+    for (unsigned k = 0; k < 4; ++k) {
+        damaged[indexoffset + 12 + k] = 0xff;
+    }
+    write_file(filename, damaged, damaged.size());
+    bool rejected = false;
+    try {
+        pathfile_reader reader(filename);
+    } catch (std::exception &) {
+        rejected = true;
+    }
+    check(rejected, "oversized uncompressed chunk size is rejected");
+
+    write_file(filename, data, data.size());
+    vector<differentialpath> loaded;
+    load_paths(loaded, filename);
+    check(same(loaded, paths), "undamaged file after the checks");
+    ::unlink(filename.c_str());
+}
+
+int main(int argc, char **argv) {
+    seed(1);
+    const string dir = argc > 1 ? argv[1] : ".";
+    const string base = dir + "/check_pathfile." + to_string(::getpid());
+    check_roundtrip(base, 0, 16);
+    check_roundtrip(base, 1, 16);
+    check_roundtrip(base, 100, 16);
+    check_roundtrip(base, 1000, 7);
+    check_roundtrip(base, 5000, 1 << 12);
+    check_corrupted(base);
+    check_permutation(1);
+    check_permutation(1000);
+    check_permutation(123457);
+    return check_result("pathfile");
+}
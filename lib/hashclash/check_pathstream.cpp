@@ -0,0 +1,185 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+// check program for pathstream: round trip, incomplete records, truncated files and FIFOs
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "check.hpp"
+#include "pathstream.hpp"
+#include "rng.hpp"
+
+using namespace hashclash;
+using namespace std;
+
+differentialpath random_path(int tbegin, unsigned words) {
+    differentialpath path;
+    path.offset = -tbegin;
+    path.path.resize(words);
+    for (unsigned w = 0; w < words; ++w) {
+        for (unsigned k = 0; k < 4; ++k) {
+            path.path[w].bytes[k].val = xrng128();
+        }
+    }
+    return path;
+}
+
+bool same(const vector<differentialpath> &l, const vector<differentialpath> &r) {
+    if (l.size() != r.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < l.size(); ++i) {
+        if (l[i].tbegin() != r[i].tbegin() || l[i].path.size() != r[i].path.size() || !(l[i] == r[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void check_file(const string &filename) {
+    ::unlink(filename.c_str());
+    const differentialpath a = random_path(-3, 20), b = random_path(-2, 30), c = random_path(0, 5);
+    vector<differentialpath> paths;
+    pathstream_reader reader(filename);
+    check(!reader.update(paths), "file: update before the file exists");
+    {
+        pathstream_writer writer(filename);
+        writer.append(a, false, 10, 2, 300);
+        writer.append(b, false, 11, 3, 301);
+    }
+    check(reader.update(paths) && same(paths, {a, b}), "file: round trip");
+    check(reader.complexity == 11 && reader.tunnel == 3 && reader.cond == 301, "file: quality of the last record");
+    check(!reader.update(paths), "file: no new records");
+
+    // all integers are little-endian
+    ifstream ifs(filename.c_str(), ios::binary);
+    unsigned char magic[4];
+    ifs.read(reinterpret_cast<char *>(magic), 4);
+    check(ifs && magic[0] == 0x48 && magic[1] == 0x43 && magic[2] == 0x50 && magic[3] == 0x53, "file: little-endian magic");
+    ifs.close();
+
+    // an incomplete record is only read once it is complete
+    struct stat st;
+    ::stat(filename.c_str(), &st);
+    const off_t twosize = st.st_size;
+    {
+        pathstream_writer writer(filename);
+        writer.append(c, true, 12, 4, 302);
+    }
+    ::stat(filename.c_str(), &st);
+    const off_t threesize = st.st_size;
+    check(::truncate(filename.c_str(), twosize + 40) == 0, "truncate");
+    check(!reader.update(paths) && same(paths, {a, b}), "file: incomplete record is skipped");
+    check(::truncate(filename.c_str(), twosize) == 0, "truncate");
+    {
+        pathstream_writer writer(filename);
+        writer.append(c, true, 12, 4, 302);
+    }
+    ::stat(filename.c_str(), &st);
+    check(st.st_size == threesize, "file: size after rewriting the record");
+    check(reader.update(paths) && same(paths, {c}), "file: supersede record");
+
+    // a truncated or replaced file is read from the start
+    check(::truncate(filename.c_str(), 0) == 0, "truncate");
+    {
+        pathstream_writer writer(filename);
+        writer.append(b, false, 13, 5, 303);
+    }
+    check(reader.update(paths) && same(paths, {b}), "file: truncated file");
+    ::unlink(filename.c_str());
+    {
+        pathstream_writer writer(filename);
+        writer.append(a, false, 14, 6, 304);
+        writer.append(c, false, 15, 7, 305);
+    }
+    check(reader.update(paths) && same(paths, {a, c}), "file: replaced file");
+    ::unlink(filename.c_str());
+}
+
+// the FIFO writer delivers from its own thread: poll the reader until it has the expected paths
+bool wait_for(pathstream_reader &reader, vector<differentialpath> &paths, const vector<differentialpath> &expected) {
+    for (unsigned i = 0; i < 100; ++i) {
+        reader.update(paths);
+        if (same(paths, expected)) {
+            return true;
+        }
+        ::usleep(50000);
+    }
+    return false;
+}
+
+void check_fifo(const string &filename) {
+    ::unlink(filename.c_str());
+    if (::mkfifo(filename.c_str(), 0600) != 0) {
+        cerr << "mkfifo failed, skipping the FIFO checks" << endl;
+        return;
+    }
+    const differentialpath a = random_path(-3, 20), b = random_path(-2, 30), c = random_path(0, 5), d = random_path(1, 8);
+    vector<differentialpath> paths;
+    pathstream_writer writer(filename);
+    // without a reader the records are kept for the next reader
+    writer.append(a, true, 10, 2, 300);
+    {
+        pathstream_reader reader(filename);
+        check(wait_for(reader, paths, {a}), "fifo: reader receives the current paths");
+        writer.append(b, false, 11, 3, 301);
+        check(wait_for(reader, paths, {a, b}), "fifo: appended record");
+        writer.append(c, false, 12, 4, 302);
+        check(wait_for(reader, paths, {a, b, c}), "fifo: appended record");
+        check(reader.cond == 302, "fifo: quality of the last record");
+    }
+    // the reader went away: once the writer noticed, the next reader is sent all paths again
+    ::usleep(500000);
+    writer.append(d, false, 13, 5, 303);
+    {
+        pathstream_reader reader(filename);
+        paths.clear();
+        paths.push_back(d);
+        check(wait_for(reader, paths, {a, b, c, d}), "fifo: current paths after reconnecting");
+        writer.append(c, false, 14, 6, 304);
+        check(wait_for(reader, paths, {a, b, c, d, c}), "fifo: appended record after reconnecting");
+    }
+    // a reader that does not drain the FIFO must not stall the writer
+    const int stalled = ::open(filename.c_str(), O_RDONLY | O_NONBLOCK);
+    check(stalled >= 0, "fifo: open stalled reader");
+    const differentialpath big = random_path(-3, 64);
+    for (unsigned i = 0; i < 4096; ++i) {
+        writer.append(big, false, 15, 7, 305);
+    }
+    writer.append(b, true, 16, 8, 306);
+    ::close(stalled);
+    pathstream_reader reader(filename);
+    check(wait_for(reader, paths, {b}), "fifo: supersede record replaces the backlog of a stalled reader");
+    ::unlink(filename.c_str());
+}
+
+int main(int argc, char **argv) {
+    const string dir = argc > 1 ? argv[1] : ".";
+    const string base = dir + "/check_pathstream." + to_string(::getpid());
+    check_file(base + ".stream");
+    check_fifo(base + ".fifo");
+    return check_result("pathstream");
+}
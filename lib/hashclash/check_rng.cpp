@@ -0,0 +1,155 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+// check program for the per-thread generators: the main thread draws the stream of the old global generator,
+// worker i draws a fixed stream for a given seed, and every thread derives its state again after seed() and addseed()
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/barrier.hpp>
+
+#include "check.hpp"
+#include "rng.hpp"
+
+using namespace hashclash;
+using namespace std;
+
+const unsigned workers = 4, draws = 64;
+
+// the streams of seed_thread(0..workers-1), drawn on worker threads after the master state was seeded with s
+vector<vector<uint32>> worker_streams(uint32 s) {
+    seed(s);
+    vector<vector<uint32>> streams(workers, vector<uint32>(draws));
+    boost::thread_group threads;
+    for (unsigned w = 0; w < workers; ++w) {
+        threads.create_thread([&streams, w]() {
+            seed_thread(w);
+            for (auto &x : streams[w]) {
+                x = xrng128();
+            }
+        });
+    }
+    threads.join_all();
+    return streams;
+}
+
+// the draws of the random padding of md5_birthdaysearch: seed(0x12345678), then draws with addseed() in between
+vector<uint32> padding_stream() {
+    vector<uint32> out;
+    seed(0x12345678);
+    for (unsigned k = 0; k < 3; ++k) {
+        for (unsigned i = 0; i < 16; ++i) {
+            out.push_back(xrng128() + xrng64());
+        }
+        addseed(0x9e3779b9 * (k + 1));
+    }
+    for (unsigned i = 0; i < 16; ++i) {
+        out.push_back(xrng32() + xrng96());
+    }
+    return out;
+}
+
+// the same draws with a single generator state, as the old global generator made them
+vector<uint32> baseline_padding_stream() {
+    vector<uint32> out;
+    rng_state g;
+    g.seed(0x12345678);
+    for (unsigned k = 0; k < 3; ++k) {
+        for (unsigned i = 0; i < 16; ++i) {
+            out.push_back(g.xrng128() + g.xrng64());
+        }
+        g.addseed(0x9e3779b9 * (k + 1));
+    }
+    for (unsigned i = 0; i < 16; ++i) {
+        out.push_back(g.xrng32() + g.xrng96());
+    }
+    return out;
+}
+
+int main() {
+    check(padding_stream() == baseline_padding_stream(), "seed(0x12345678) stream of the main thread equals the old generator");
+
+    {
+        seed(1);
+        rng_state g;
+        g.seed(1);
+        bool same = true;
+        for (unsigned i = 0; i < draws; ++i) {
+            same = same && xrng128() == g.xrng128();
+        }
+        check(same, "seed(1) stream of the main thread equals rng_state::seed(1)");
+    }
+
+    const vector<vector<uint32>> a = worker_streams(1), b = worker_streams(1), c = worker_streams(2);
+    check(a == b, "worker streams are the same for the same seed");
+    bool distinct = true;
+    for (unsigned w = 0; w < workers; ++w) {
+        distinct = distinct && a[w] != c[w];
+        for (unsigned v = 0; v < w; ++v) {
+            distinct = distinct && a[w] != a[v];
+        }
+    }
+    check(distinct, "worker streams differ between workers and between seeds");
+
+    // draws of the main thread do not change the worker streams derived after the same seed
+    {
+        seed(1);
+        for (unsigned i = 0; i < draws; ++i) {
+            xrng128();
+        }
+        vector<uint32> w0(draws);
+        boost::thread t([&w0]() {
+            seed_thread(0);
+            for (auto &x : w0) {
+                x = xrng128();
+            }
+        });
+        t.join();
+        check(w0 == a[0], "worker stream does not depend on draws of the main thread");
+    }
+
+    // a worker derives its state again after seed(), and keeps its index
+    {
+        vector<uint32> before(draws), after(draws);
+        boost::barrier seeded(2), drawn(2);
+        seed(2);
+        boost::thread t([&]() {
+            seed_thread(1);
+            for (auto &x : before) {
+                x = xrng128();
+            }
+            drawn.wait();
+            seeded.wait();
+            for (auto &x : after) {
+                x = xrng128();
+            }
+        });
+        drawn.wait();
+        seed(1);
+        seeded.wait();
+        t.join();
+        check(before == c[1], "worker stream before seed() is that of the old seed");
+        check(after == a[1], "worker stream after seed() is that of the new seed and the same index");
+    }
+
+    return check_result("check_rng");
+}
@@ -0,0 +1,100 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+// check program for the batch best_rotated_difference:
+// it must equal the scalar best_rotated_difference, which must be a most likely rotated difference of rotate_difference
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <utility>
+
+#include "check.hpp"
+#include "sdr.hpp"
+#include "rng.hpp"
+
+using namespace hashclash;
+using namespace std;
+
+// sparse, dense and edge case differences
+uint32 random_difference(unsigned i) {
+    switch (i % 4) {
+    case 0:
+        return (uint32(1) << (xrng128() & 31)) - (uint32(1) << (xrng128() & 31));
+    case 1:
+        return xrng128();
+    case 2:
+        return uint32(0) - (xrng128() & 7);
+    default:
+        return (xrng128() & 7) << (xrng128() & 31);
+    }
+}
+
+int main() {
+    seed(1);
+    vector<uint32> diffs;
+    for (unsigned i = 0; i < 10000; ++i) {
+        diffs.push_back(random_difference(i));
+    }
+    diffs.push_back(0);
+    diffs.push_back(1);
+    diffs.push_back(uint32(1) << 31);
+    diffs.push_back(~uint32(0));
+
+    for (int rc = 0; rc <= 32; ++rc) {
+        const string rcs = " (rc=" + to_string(rc) + ")";
+        vector<uint32> expected(diffs.size());
+        for (size_t i = 0; i < diffs.size(); ++i) {
+            expected[i] = best_rotated_difference(diffs[i], rc);
+        }
+        // all lengths up to a few vectors and starting offsets that are not vector aligned
+        bool ok = true;
+        for (size_t n = 0; n <= 67; ++n) {
+            for (size_t begin = 0; begin < 3; ++begin) {
+                vector<uint32> out(n + 2, 0x5a5a5a5a);
+                best_rotated_difference(diffs.data() + begin, out.data() + 1, n, rc);
+                for (size_t i = 0; i < n; ++i) {
+                    ok = ok && out[1 + i] == expected[begin + i];
+                }
+                ok = ok && out[0] == 0x5a5a5a5a && out[n + 1] == 0x5a5a5a5a;
+            }
+        }
+        check(ok, "batch equals scalar on short arrays" + rcs);
+        vector<uint32> inplace = diffs;
+        best_rotated_difference(inplace.data(), inplace.data(), inplace.size(), rc);
+        check(inplace == expected, "batch equals scalar in place" + rcs);
+
+        // the scalar result is a most likely rotated difference
+        ok = true;
+        vector<pair<uint32, double>> rotated;
+        for (size_t i = 0; i < diffs.size(); i += 7) {
+            rotate_difference(diffs[i], rc, rotated);
+            double best = 0, pexpected = 0;
+            for (auto &r : rotated) {
+                best = max(best, r.second);
+                if (r.first == expected[i]) {
+                    pexpected = r.second;
+                }
+            }
+            ok = ok && pexpected == best;
+        }
+        check(ok, "scalar result is a most likely rotated difference" + rcs);
+    }
+    return check_result("rotated difference");
+}
@@ -0,0 +1,102 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+// check program for the exact rotation probability of check_rotation:
+// compares the carry/borrow computation with an exhaustive enumeration of Q_t and Q_{t+1} over random bitconditions
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cmath>
+#include <map>
+
+#include "check.hpp"
+#include "differentialpath.hpp"
+#include "md5detail.hpp"
+#include "rng.hpp"
+
+using namespace hashclash;
+using namespace std;
+
+// bitconditions with exactly free random positions left free ('.')
+wordconditions random_conditions(unsigned free, bool withprev) {
+    static const bitcondition fixed[] = {bc_zero, bc_one, bc_plus, bc_minus, bc_prev, bc_prevn};
+    wordconditions w;
+    for (unsigned b = 0; b < 32; ++b) {
+        w.set(b, fixed[xrng128() % (withprev ? 6 : 4)]);
+    }
+    for (unsigned k = 0; k < free; ++k) {
+        w.set(xrng128() & 31, bc_constant);
+    }
+    return w;
+}
+
+// enumerate all subsets of mask
+inline uint32 next_subset(uint32 s, uint32 mask) { return (s - mask) & mask; }
+
+void check_exhaustive(uint32 dT, unsigned n, const wordconditions &Qt, const wordconditions &Qtp1) {
+    const uint32 Q0set0 = Qt.set0(), Q0set1 = Qt.set1();
+    const uint32 Q1set0 = Qtp1.set0(), Q1set1 = Qtp1.set1();
+    const uint32 prev = Qtp1.prev() | Qt.next(), prevn = Qtp1.prevn() | Qt.nextn();
+    // the bits of Q_t and Q_{t+1} that are not fixed by the conditions
+    const uint32 free0 = Q0set0 & ~Q0set1, free1 = Q1set0 & ~prev & ~Q1set1 & ~prevn;
+
+    map<uint32, double> count;
+    double total = 0;
+    uint32 r0 = 0;
+    do {
+        const uint32 Q0 = (r0 & Q0set0) | Q0set1;
+        uint32 r1 = 0;
+        do {
+            const uint32 Q1 = ((r1 & Q1set0 & ~prev) | Q1set1 | prevn | (Q0 & prev)) ^ (Q0 & prevn);
+            const uint32 R = Q1 - Q0;
+            count[rotate_left(rotate_right(R, n) + dT, n) - R] += 1;
+            total += 1;
+            r1 = next_subset(r1, free1);
+        } while (r1 != 0);
+        r0 = next_subset(r0, free0);
+    } while (r0 != 0);
+
+    for (auto &c : count) {
+        const double p = check_rotation(c.first, dT, n, Qt, Qtp1);
+        ostringstream what;
+        what << "dT=" << dT << " n=" << n << " dR=" << c.first << ": check_rotation=" << p << " exhaustive=" << c.second / total;
+        check(fabs(p - c.second / total) <= 1e-9, what.str());
+    }
+    // a difference that never occurs has probability 0
+    const uint32 dR = rotate_left(dT, n) + 12345;
+    if (count.count(dR) == 0) {
+        check(check_rotation(dR, dT, n, Qt, Qtp1) == 0,
+              "dT=" + to_string(dT) + " n=" + to_string(n) + ": impossible dR has non-zero probability");
+    }
+}
+
+int main() {
+    seed(1);
+    for (unsigned i = 0; i < 1000; ++i) {
+        const unsigned n = (i & 1) ? md5_rc[xrng128() & 63] : 1 + xrng128() % 31;
+        // sparse and dense differences
+        const uint32 dT = (i & 2) ? xrng128() : (uint32(1) << (xrng128() & 31)) - (uint32(1) << (xrng128() & 31));
+        const wordconditions Qt = random_conditions(8, false), Qtp1 = random_conditions(8, true);
+        check_exhaustive(dT, n, Qt, Qtp1);
+        // the memoized result of a second call must be the same
+        check_exhaustive(dT, n, Qt, Qtp1);
+    }
+    return check_result("rotation");
+}
@@ -0,0 +1,87 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+// check program for task_pool: every item and every subtask is processed exactly once,
+// and whole tasks, also stolen ones, are never larger than the grain
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "check.hpp"
+#include "taskpool.hpp"
+
+using namespace hashclash;
+using namespace std;
+
+void check_pool(uint64 items, unsigned workers, uint64 grain) {
+    const string name = to_string(items) + " items, " + to_string(workers) + " workers, grain " + to_string(grain);
+    // each item is split in 4 subtasks by the worker that gets it
+    vector<boost::atomic<unsigned>> done(items * 4);
+    for (auto &d : done) {
+        d = 0;
+    }
+    boost::atomic<uint64> oversized(0);
+    task_pool pool(items, workers, grain);
+    boost::thread_group threads;
+    for (unsigned w = 0; w < workers; ++w) {
+        threads.create_thread([&, w]() {
+            task_range task;
+            while (pool.next(w, task)) {
+                if (!task.whole()) {
+                    for (uint32 s = task.subbegin; s < task.subend; ++s) {
+                        ++done[task.begin * 4 + s];
+                    }
+                    continue;
+                }
+                if (task.end - task.begin > grain) {
+                    ++oversized;
+                }
+                for (uint64 i = task.begin; i < task.end; ++i) {
+                    // uneven work per item, so that the workers run out of work at different times
+                    if (i % 7 == 0) {
+                        boost::this_thread::sleep(boost::posix_time::microseconds(200));
+                    }
+                    pool.split(w, task_range(i, i + 1, 2, 4));
+                    ++done[i * 4];
+                    ++done[i * 4 + 1];
+                }
+            }
+        });
+    }
+    threads.join_all();
+    bool ok = true;
+    for (auto &d : done) {
+        ok = ok && d == 1;
+    }
+    check(ok, name + ": every item processed exactly once");
+    check(oversized == 0, name + ": no whole task larger than the grain");
+}
+
+int main() {
+    check_pool(0, 3, 4);
+    check_pool(1, 3, 4);
+    check_pool(1000, 1, 16);
+    check_pool(1000, 4, 1);
+    check_pool(5000, 8, 4);
+    return check_result("taskpool");
+}
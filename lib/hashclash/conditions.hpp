@@ -114,8 +114,7 @@ struct byteconditions {
         : val(0) {}
     byteconditions(uint32 value)
         : val(value) {}
-    byteconditions(const byteconditions &r)
-        : val(r.val) {}
+    byteconditions(const byteconditions &r) = default;
     byteconditions(
         bitcondition b0,
         bitcondition b1 = bc_constant,
@@ -150,7 +149,7 @@ struct byteconditions {
         val = b0 + (b1 << 4) + (b2 << 8) + (b3 << 12) + (b4 << 16) + (b5 << 20) + (b6 << 24) + (b7 << 28);
         return *this;
     }
-    byteconditions &operator=(const byteconditions &r) { return set(r); }
+    byteconditions &operator=(const byteconditions &r) = default;
 
     byteconditions &set(unsigned b, bitcondition cond) {
         b <<= 2;
@@ -215,7 +214,7 @@ struct wordconditions {
     byteconditions bytes[4];
 
     wordconditions() {}
-    wordconditions(const wordconditions &r) { set(r); }
+    wordconditions(const wordconditions &r) = default;
     wordconditions(const sdr &r) { set(r); }
     wordconditions(uint32 diff, uint32 mset0, uint32 mset1) { set(diff, mset0, mset1); }
 
@@ -260,7 +259,7 @@ struct wordconditions {
         }
         return *this;
     }
-    wordconditions &operator=(const wordconditions &r) { return set(r); }
+    wordconditions &operator=(const wordconditions &r) = default;
     wordconditions &operator=(const sdr &r) { return set(r); }
 
     bool operator==(const wordconditions &r) const {
@@ -22,7 +22,6 @@
 #include <map>
 #include <stdexcept>
 
-#include "rng.hpp"
 #include "booleanfunction.hpp"
 #include "differentialpath.hpp"
 
@@ -30,24 +29,113 @@ using namespace std;
 
 namespace hashclash {
 
-double check_rotation(uint32 dR, uint32 dT, unsigned n, const wordconditions &Qt, const wordconditions &Qtp1, unsigned loopcount) {
+// Exact probability that the rotation of dT over n bits results in dR, over uniformly random Q_t, Q_{t+1}
+// satisfying their bitconditions (with the same per-bit distribution as random sampling would use).
+// Let R = Q_{t+1} - Q_t and X = RR(R, n), then RL(X + dT, n) - RL(X, n) = RL(dT, n) + c_l - c_h * 2^n,
+// where c_l is the carry out of the lower 32-n bits of X + dT and c_h the carry out of the upper n bits.
+// Both carry chains are evaluated together with the borrow chain of R in a single pass over the 32 bits of R:
+// bits [0,n) of R form the upper part of X, started with carry c_l, bits [n,32) form the lower part of X.
+double rotation_probability(
+    uint32 dR, uint32 dT, unsigned n, uint32 Q0set0, uint32 Q0set1, uint32 Q1set0, uint32 Q1set1, uint32 prev, uint32 prevn
+) {
+    n &= 31;
+    if (n == 0) {
+        return (dR == dT) ? 1.0 : 0.0;
+    }
+    const uint32 rdT = rotate_left(dT, n);
+    unsigned cl = 2, ch = 0;
+    for (unsigned c = 0; c < 4; ++c) {
+        if (rdT + (c & 1) - ((c >> 1) << n) == dR) {
+            cl = c & 1;
+            ch = c >> 1;
+        }
+    }
+    if (cl == 2) {
+        return 0;
+    }
+
+    // Q_t and Q_{t+1} for all four combinations of the random bits
+    uint32 Q0[4], Q1[4];
+    for (unsigned r = 0; r < 4; ++r) {
+        const uint32 r0 = 0 - uint32(r & 1), r1 = 0 - uint32(r >> 1);
+        Q0[r] = (r0 & Q0set0) | Q0set1;
+        Q1[r] = ((r1 & Q1set0 & ~prev) | Q1set1 | prevn | (Q0[r] & prev)) ^ (Q0[r] & prevn);
+    }
+
+    // probability mass per (borrow, carry) state: p<borrow><carry>
+    double p00 = 0, p01 = 0, p10 = 0, p11 = 0;
+    (cl ? p01 : p00) = 1;
+    for (unsigned j = 0; j < 32; ++j) {
+        if (j == n) {
+            // carry out of the upper part must be c_h, the lower part starts without carry
+            p00 = ch ? p01 : p00;
+            p10 = ch ? p11 : p10;
+            p01 = p11 = 0;
+        }
+        // distribution of (Q_t[j], Q_{t+1}[j])
+        double w[4] = {0, 0, 0, 0};
+        for (unsigned r = 0; r < 4; ++r) {
+            w[(((Q0[r] >> j) & 1) << 1) | ((Q1[r] >> j) & 1)] += 0.25;
+        }
+        // R[j] = Q_{t+1}[j] - Q_t[j] - borrow: mass per (R[j], new borrow), split by incoming carry
+        const double wsame = w[0] + w[3], w01 = w[1], w10 = w[2];
+        const double r0b0c0 = wsame * p00 + w01 * p10, r0b0c1 = wsame * p01 + w01 * p11;
+        const double r1b0c0 = w01 * p00, r1b0c1 = w01 * p01;
+        const double r1b1c0 = w10 * p00 + wsame * p10, r1b1c1 = w10 * p01 + wsame * p11;
+        const double r0b1c0 = w10 * p10, r0b1c1 = w10 * p11;
+        // add dT[(j - n) mod 32] and the carry
+        if ((dT >> ((j + 32 - n) & 31)) & 1) {
+            p00 = r0b0c0;
+            p01 = r0b0c1 + r1b0c0 + r1b0c1;
+            p10 = r0b1c0;
+            p11 = r0b1c1 + r1b1c0 + r1b1c1;
+        } else {
+            p00 = r0b0c0 + r0b0c1 + r1b0c0;
+            p01 = r1b0c1;
+            p10 = r0b1c0 + r0b1c1 + r1b1c0;
+            p11 = r1b1c1;
+        }
+    }
+    // carry out of the lower part must be the assumed c_l
+    return cl ? (p01 + p11) : (p00 + p10);
+}
+
+// per-thread direct-mapped memoization of rotation_probability
+struct rotation_cache_entry {
+    uint32 dR, dT, n, Q0set0, Q0set1, Q1set0, Q1set1, prev, prevn;
+    bool used;
+    double p;
+};
+const unsigned rotation_cache_size = 1 << 10;
+
+double check_rotation(uint32 dR, uint32 dT, unsigned n, const wordconditions &Qt, const wordconditions &Qtp1) {
     uint32 Q0set0 = Qt.set0(), Q0set1 = Qt.set1();
     uint32 Q1set0 = Qtp1.set0(), Q1set1 = Qtp1.set1();
     uint32 prev = Qtp1.prev() | Qt.next(), prevn = Qtp1.prevn() | Qt.nextn();
 
-    unsigned okcount = 0;
-    for (unsigned count = 0; count < loopcount; ++count) {
-        uint32 Q0a = (xrng64() & Q0set0) | Q0set1;
-        uint32 Q1a = ((xrng64() & Q1set0 & ~prev) | Q1set1 | prevn | (Q0a & prev)) ^ (Q0a & prevn);
-        uint32 Ra = Q1a - Q0a;
-        uint32 Ta = rotate_right(Ra, n);
-        uint32 Tb = Ta + dT;
-        uint32 Rb = rotate_left(Tb, n);
-        if (Rb - Ra == dR) {
-            ++okcount;
-        }
-    }
-    return double(okcount) / double(loopcount);
+    static thread_local rotation_cache_entry cache[rotation_cache_size];
+    uint32 h = dR ^ rotate_left(dT, 7) ^ (n << 27) ^ Q0set0 ^ rotate_left(Q0set1, 3) ^ rotate_left(Q1set0, 11) ^ rotate_left(Q1set1, 17) ^
+               rotate_left(prev, 21) ^ rotate_left(prevn, 25);
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    rotation_cache_entry &e = cache[h & (rotation_cache_size - 1)];
+    if (e.used && e.dR == dR && e.dT == dT && e.n == n && e.Q0set0 == Q0set0 && e.Q0set1 == Q0set1 && e.Q1set0 == Q1set0 &&
+        e.Q1set1 == Q1set1 && e.prev == prev && e.prevn == prevn) {
+        return e.p;
+    }
+    e.p = rotation_probability(dR, dT, n, Q0set0, Q0set1, Q1set0, Q1set1, prev, prevn);
+    e.dR = dR;
+    e.dT = dT;
+    e.n = n;
+    e.Q0set0 = Q0set0;
+    e.Q0set1 = Q0set1;
+    e.Q1set0 = Q1set0;
+    e.Q1set1 = Q1set1;
+    e.prev = prev;
+    e.prevn = prevn;
+    e.used = true;
+    return e.p;
 }
 
 void show_path(const differentialpath &path, const uint32 blockdiff[], ostream &o) {
@@ -149,7 +237,7 @@ double test_path(const differentialpath &path, const uint32 blockdiff[]) {
     return totp;
 }
 
-unsigned totaltunnelstrength(const differentialpath &path) {
+template <class path_type> unsigned totaltunnelstrength_tmpl(const path_type &path) {
     unsigned totalstrength = 0;
     for (unsigned b = 0; b < 32; ++b) {
         // best tunnel first
@@ -228,30 +316,20 @@ unsigned totaltunnelstrength(const differentialpath &path) {
     return totalstrength;
 }
 
-bool check_rotation_fast(uint32 dR, uint32 dT, unsigned n, const wordconditions &Qt, const wordconditions &Qtp1, unsigned loopcount) {
-    uint32 Q0set0 = Qt.set0(), Q0set1 = Qt.set1();
-    uint32 Q1set0 = Qtp1.set0(), Q1set1 = Qtp1.set1();
-    uint32 prev = Qtp1.prev() | Qt.next(), prevn = Qtp1.prevn() | Qt.nextn();
+unsigned totaltunnelstrength(const differentialpath &path) {
+    return totaltunnelstrength_tmpl(path);
+}
 
-    unsigned okcount = 0;
-    for (unsigned count = 0; count < loopcount; ++count) {
-        uint32 Q0a = (xrng64() & Q0set0) | Q0set1;
-        uint32 Q1a = ((xrng64() & Q1set0 & ~prev) | Q1set1 | prevn | (Q0a & prev)) ^ (Q0a & prevn);
-        uint32 Ra = Q1a - Q0a;
-        uint32 Ta = rotate_right(Ra, n);
-        uint32 Tb = Ta + dT;
-        uint32 Rb = rotate_left(Tb, n);
-        if (Rb - Ra == dR) {
-            ++okcount;
-            if (okcount >= (loopcount >> 6)) {
-                return true;
-            }
-        }
-    }
-    return false;
+unsigned totaltunnelstrength(const fixeddifferentialpath &path) {
+    return totaltunnelstrength_tmpl(path);
 }
 
-bool test_path_fast(const differentialpath &path, const uint32 blockdiff[], int tbegin, int tend) {
+bool check_rotation_fast(uint32 dR, uint32 dT, unsigned n, const wordconditions &Qt, const wordconditions &Qtp1, unsigned loopcount) {
+    // accept iff on average at least (loopcount >> 6) out of loopcount random samples succeed
+    return check_rotation(dR, dT, n, Qt, Qtp1) * double(loopcount) >= double(std::max<unsigned>(1, loopcount >> 6));
+}
+
+template <class path_type> bool test_path_fast_tmpl(const path_type &path, const uint32 blockdiff[], int tbegin, int tend) {
     if (tbegin < 0) {
         tbegin = 0;
     }
@@ -294,6 +372,14 @@ bool test_path_fast(const differentialpath &path, const uint32 blockdiff[], int
     return true;
 }
 
+bool test_path_fast(const differentialpath &path, const uint32 blockdiff[], int tbegin, int tend) {
+    return test_path_fast_tmpl(path, blockdiff, tbegin, tend);
+}
+
+bool test_path_fast(const fixeddifferentialpath &path, const uint32 blockdiff[], int tbegin, int tend) {
+    return test_path_fast_tmpl(path, blockdiff, tbegin, tend);
+}
+
 void cleanup(differentialpath &path) {
     differentialpath backup;
     bf_conditions backcond;
@@ -405,14 +491,12 @@ bool isstronger(const soltriple &lh, const soltriple &rh) {
     return true;
 }
 
-bool errorinrotation32(
-    const wordconditions &Qt, const wordconditions &Qtp1, uint32 dT, uint32 dR, unsigned rc, uint32 loopcount = (1 << 12)
-) {
+bool errorinrotation32(const wordconditions &Qt, const wordconditions &Qtp1, uint32 dT, uint32 dR, unsigned rc) {
     vector<pair<uint32, double>> rotdiffs;
     rotate_difference(dT, rc, rotdiffs);
     for (unsigned i = 0; i < rotdiffs.size(); ++i) {
         if (naf(rotdiffs[i].first - dR).get(0) != 0) {
-            if (0 < check_rotation(rotdiffs[i].first, dT, rc, Qt, Qtp1, loopcount)) {
+            if (0 < check_rotation(rotdiffs[i].first, dT, rc, Qt, Qtp1)) {
                 return true;
             }
         }
@@ -420,14 +504,12 @@ bool errorinrotation32(
     return false;
 }
 
-bool errorinrotationRC(
-    const wordconditions &Qt, const wordconditions &Qtp1, uint32 dT, uint32 dR, unsigned rc, uint32 loopcount = (1 << 12)
-) {
+bool errorinrotationRC(const wordconditions &Qt, const wordconditions &Qtp1, uint32 dT, uint32 dR, unsigned rc) {
     vector<pair<uint32, double>> rotdiffs;
     rotate_difference(dT, rc, rotdiffs);
     for (unsigned i = 0; i < rotdiffs.size(); ++i) {
         if (naf(rotdiffs[i].first - dR).get(rc) != 0) {
-            if (0 < check_rotation(rotdiffs[i].first, dT, rc, Qt, Qtp1, loopcount)) {
+            if (0 < check_rotation(rotdiffs[i].first, dT, rc, Qt, Qtp1)) {
                 return true;
             }
         }
@@ -448,7 +530,7 @@ void findsolutions32(
 
     // first determine bounds on the range of bits we are going to look at
     vector<vector<triple<bitcondition, bitcondition, unsigned>>> vnbc(32);
-    double prot = check_rotation(dR, dT, rc, Qt, Qtp1, loopcount);
+    double prot = check_rotation(dR, dT, rc, Qt, Qtp1);
     int bmin = int(-(log(prot) / log(double(2)))) + 3;
 
     int bit = 31;
@@ -521,7 +603,7 @@ void findsolutions32(
                 extracond += vnbc[i][index].third;
             }
         }
-        if (!errorinrotation32(newQt, newQtp1, dT, dR, rc, loopcount)) {
+        if (!errorinrotation32(newQt, newQtp1, dT, dR, rc)) {
             solutions.push_back(make_triple(newQt, newQtp1, extracond));
         }
     }
@@ -562,7 +644,7 @@ void findsolutionsRC(
 
     // first determine bounds on the range of bits we are going to look at
     vector<vector<triple<bitcondition, bitcondition, unsigned>>> vnbc(32);
-    double prot = check_rotation(dR, dT, rc, Qt, Qtp1, loopcount);
+    double prot = check_rotation(dR, dT, rc, Qt, Qtp1);
     int bmin = int(-(log(prot) / log(double(2)))) + 3;
 
     int bit;
@@ -625,7 +707,7 @@ void findsolutionsRC(
                     extracond += vnbc[i][index].third;
                 }
             }
-            if (!errorinrotationRC(newQt, newQtp1, dT, dR, rc, loopcount)) {
+            if (!errorinrotationRC(newQt, newQtp1, dT, dR, rc)) {
                 solutions.push_back(make_triple(newQt, newQtp1, extracond));
             }
         }
@@ -745,14 +827,14 @@ void enhancerot(differentialpath &path, int t, const uint32 blockdiff[]) {
     uint32 dQtm3 = path[t - 3].diff();
     uint32 dR = path[t + 1].diff() - path[t].diff();
     uint32 dT = dQtm3 + dF + blockdiff[md5_wt[t]];
-    prot = check_rotation(dR, dT, md5_rc[t], path[t], path[t + 1], 1 << 10);
+    prot = check_rotation(dR, dT, md5_rc[t], path[t], path[t + 1]);
 
     if (prot == 1 || prot == 0) {
         return;
     }
 
-    dev32 = errorinrotation32(path[t], path[t + 1], dT, dR, md5_rc[t], 1 << 10);
-    devrc = errorinrotationRC(path[t], path[t + 1], dT, dR, md5_rc[t], 1 << 10);
+    dev32 = errorinrotation32(path[t], path[t + 1], dT, dR, md5_rc[t]);
+    devrc = errorinrotationRC(path[t], path[t + 1], dT, dR, md5_rc[t]);
     if (dev32) {
         findsolutions32(path[t], path[t + 1], dT, dR, md5_rc[t], solutions32, 1 << 10);
     }
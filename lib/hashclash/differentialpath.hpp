@@ -25,9 +25,11 @@
 #include <stdexcept>
 #include <utility>
 #include <algorithm>
+#include <type_traits>
 
 #ifndef NOSERIALIZATION
 #include <boost/serialization/serialization.hpp>
+#include <boost/serialization/split_free.hpp>
 #endif // NOSERIALIZATION
 
 #include "types.hpp"
@@ -37,12 +39,16 @@
 namespace hashclash {
 
 class differentialpath;
+class fixeddifferentialpath;
 void show_path(const differentialpath &path, const uint32 blockdiff[], std::ostream &o = std::cout);
 double test_path(const differentialpath &path, const uint32 blockdiff[]);
-double
-check_rotation(uint32 dR, uint32 dT, unsigned n, const wordconditions &Qt, const wordconditions &Qtp1, unsigned loopcount = (1 << 10));
+// exact probability that dT rotated over n bits results in dR given the bitconditions of Q_t and Q_{t+1}
+// results are memoized per thread
+double check_rotation(uint32 dR, uint32 dT, unsigned n, const wordconditions &Qt, const wordconditions &Qtp1);
 
 bool test_path_fast(const differentialpath &path, const uint32 blockdiff[], int tbegin = 0, int tend = 64);
+bool test_path_fast(const fixeddifferentialpath &path, const uint32 blockdiff[], int tbegin = 0, int tend = 64);
+// true iff the exact rotation probability is at least (loopcount >> 6) / loopcount
 bool check_rotation_fast(
     uint32 dR, uint32 dT, unsigned n, const wordconditions &Qt, const wordconditions &Qtp1, unsigned loopcount = (1 << 10)
 );
@@ -52,6 +58,7 @@ void cleanup(differentialpath &path);
 
 // requires differential path consisting of backward conditions only!
 unsigned totaltunnelstrength(const differentialpath &path);
+unsigned totaltunnelstrength(const fixeddifferentialpath &path);
 
 // enhance differential path with rotational bitconditions for t=0 up to t=16
 void enhancepath(differentialpath &path, const uint32 blockdiff[]);
@@ -191,6 +198,205 @@ class differentialpath {
     std::vector<wordconditions> path;
 };
 
+
+// differential path with inline storage for Q_{-3},...,Q_{68}
+// it is trivially copyable: copies never allocate, and vectors of them are contiguous
+// convert to and from differentialpath for serialization or any function that requires it
+class fixeddifferentialpath {
+  public:
+    static const int tmin = -3;
+    static const int tmax = 68;
+    static const int capacity = tmax - tmin + 1;
+
+    fixeddifferentialpath()
+        : tb(0), te(0) {}
+    explicit fixeddifferentialpath(const differentialpath &r)
+        : tb(0), te(0) {
+        assign(r);
+    }
+
+    // all words outside [tbegin(), tend()) are kept cleared
+    void clear() {
+        for (int t = tb; t < te; ++t) {
+            path[t - tmin].clear();
+        }
+        tb = te = 0;
+    }
+    int tbegin() const { return tb; }
+    int tend() const { return te; }
+    unsigned nrcond() const {
+        unsigned cond = 0;
+        for (int t = tb; t < te; ++t) {
+            cond += path[t - tmin].hw();
+        }
+        return cond;
+    }
+
+    void assign(const differentialpath &r) {
+        if (r.path.size() == 0) {
+            clear();
+            return;
+        }
+        assign(r.tbegin(), r.tend(), &r.path[0]);
+    }
+    // words are the wordconditions of Q_tbegin,...,Q_{tend-1}
+    void assign(int tbegin, int tend, const wordconditions *words) {
+        clear();
+        if (tbegin >= tend) {
+            return;
+        }
+        if (tbegin < tmin || tend > tmax + 1) {
+            throw std::out_of_range("fixeddifferentialpath::assign(): path does not fit");
+        }
+        tb = tbegin;
+        te = tend;
+        for (int t = tb; t < te; ++t) {
+            path[t - tmin] = words[t - tb];
+        }
+    }
+    // the wordconditions of Q_tbegin(),...,Q_{tend()-1}
+    const wordconditions *data() const { return path + (tb - tmin); }
+    fixeddifferentialpath &operator=(const differentialpath &r) {
+        assign(r);
+        return *this;
+    }
+    void todifferentialpath(differentialpath &r) const {
+        r.offset = -tb;
+        r.path.assign(path + (tb - tmin), path + (te - tmin));
+    }
+    differentialpath todifferentialpath() const {
+        differentialpath r;
+        todifferentialpath(r);
+        return r;
+    }
+
+    const wordconditions &get(int t) const {
+        if (t < tb || t >= te) {
+            throw std::out_of_range("fixeddifferentialpath::operator[] (int t) const: t is out of bounds");
+        }
+        return path[t - tmin];
+    }
+    wordconditions &get(int t) {
+        if (t < tmin || t > tmax) {
+            throw std::out_of_range("fixeddifferentialpath::operator[] (int t): t is out of bounds");
+        }
+        if (tb == te) {
+            tb = t;
+            te = t + 1;
+        } else if (t < tb) {
+            tb = t;
+        } else if (t >= te) {
+            te = t + 1;
+        }
+        return path[t - tmin];
+    }
+    wordconditions &operator[](int t) { return get(t); }
+    const wordconditions &operator[](int t) const { return get(t); }
+    bitcondition operator()(int t, unsigned b) const {
+        if (t < tb || t >= te) {
+            return bc_constant;
+        }
+        return path[t - tmin].get(b);
+    }
+
+    void setbitcondition(int t, unsigned b, bitcondition cond) { get(t).set(b, cond); }
+
+    void swap(fixeddifferentialpath &r) { std::swap(*this, r); }
+
+    // unlike differentialpath the ranges have to be equal as well
+    bool operator==(const fixeddifferentialpath &r) const {
+        if (tb != r.tb || te != r.te) {
+            return false;
+        }
+        for (int t = tb; t < te; ++t) {
+            if (path[t - tmin] != r.path[t - tmin]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    bool operator!=(const fixeddifferentialpath &r) const { return !(*this == r); }
+
+  private:
+    int tb, te;
+    wordconditions path[capacity];
+};
+static_assert(std::is_trivially_copyable<fixeddifferentialpath>::value, "fixeddifferentialpath must be trivially copyable");
+
+// contiguous storage of many paths in which every path only takes the words of its own range
+// used for large sets of paths such as the autobalanced buckets: a path of n words costs 16+16n bytes
+// instead of sizeof(fixeddifferentialpath), and appending a path only allocates when the storage grows
+class packedpaths {
+  public:
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+    // total number of stored words
+    size_t wordcount() const { return words.size(); }
+    void clear() {
+        entries.clear();
+        words.clear();
+    }
+    void reserve(size_t paths, size_t nwords) {
+        entries.reserve(paths);
+        words.reserve(nwords);
+    }
+    void swap(packedpaths &r) {
+        entries.swap(r.entries);
+        words.swap(r.words);
+    }
+
+    void push_back(const fixeddifferentialpath &p) {
+        entry e;
+        e.start = words.size();
+        e.tb = p.tbegin();
+        e.te = p.tend();
+        entries.push_back(e);
+        words.insert(words.end(), p.data(), p.data() + (e.te - e.tb));
+    }
+    void pop_back() {
+        words.resize(entries.back().start);
+        entries.pop_back();
+    }
+    // keep only the first n paths
+    void resize(size_t n) {
+        if (n < entries.size()) {
+            words.resize(entries[n].start);
+            entries.resize(n);
+        }
+    }
+    void append(const packedpaths &r) {
+        const size_t base = words.size();
+        words.insert(words.end(), r.words.begin(), r.words.end());
+        for (entry e : r.entries) {
+            e.start += base;
+            entries.push_back(e);
+        }
+    }
+
+    void get(size_t i, fixeddifferentialpath &p) const {
+        const entry &e = entries[i];
+        p.assign(e.tb, e.te, words.data() + e.start);
+    }
+    void get(size_t i, differentialpath &p) const {
+        const entry &e = entries[i];
+        p.offset = -e.tb;
+        p.path.assign(words.begin() + e.start, words.begin() + e.start + (e.te - e.tb));
+    }
+    differentialpath todifferentialpath(size_t i) const {
+        differentialpath r;
+        get(i, r);
+        return r;
+    }
+
+  private:
+    struct entry {
+        uint64 start;
+        int tb, te;
+    };
+    std::vector<entry> entries;
+    std::vector<wordconditions> words;
+};
+
 } // namespace hashclash
 
 #ifndef NOSERIALIZATION
@@ -202,8 +408,22 @@ template <class Archive> void serialize(Archive &ar, hashclash::differentialpath
     ar &make_nvp("path", p.path);
 }
 
+// stored in the same format as differentialpath
+template <class Archive> void save(Archive &ar, const hashclash::fixeddifferentialpath &p, const unsigned int file_version) {
+    hashclash::differentialpath tmp = p.todifferentialpath();
+    ar &make_nvp("offset", tmp.offset);
+    ar &make_nvp("path", tmp.path);
+}
+template <class Archive> void load(Archive &ar, hashclash::fixeddifferentialpath &p, const unsigned int file_version) {
+    hashclash::differentialpath tmp;
+    ar &make_nvp("offset", tmp.offset);
+    ar &make_nvp("path", tmp.path);
+    p.assign(tmp);
+}
+
 } // namespace serialization
 } // namespace boost
+BOOST_SERIALIZATION_SPLIT_FREE(hashclash::fixeddifferentialpath)
 #endif // NOSERIALIZATION
 
 #endif // HASHCLASH_DIFFERENTIALPATH_HPP
@@ -0,0 +1,199 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <unistd.h>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/array.hpp>
+#include <boost/atomic.hpp>
+
+#include "pathcache.hpp"
+#include "md5detail.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace hashclash {
+
+namespace {
+
+    // incremental MD5 over a byte stream
+    class md5_stream {
+      public:
+        md5_stream()
+            : length(0) {
+            ihv[0] = 0x67452301;
+            ihv[1] = 0xefcdab89;
+            ihv[2] = 0x98badcfe;
+            ihv[3] = 0x10325476;
+        }
+
+        void update(const unsigned char *data, size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                buffer[length & 63] = data[i];
+                if ((++length & 63) == 0) {
+                    compress();
+                }
+            }
+        }
+        void update(uint32 w) {
+            const unsigned char b[4] = {(unsigned char)(w), (unsigned char)(w >> 8), (unsigned char)(w >> 16), (unsigned char)(w >> 24)};
+            update(b, 4);
+        }
+
+        boost::array<uint32, 4> final() {
+            const uint64 bitlength = length << 3;
+            const unsigned char pad = 0x80;
+            update(&pad, 1);
+            const unsigned char zero = 0;
+            while ((length & 63) != 56) {
+                update(&zero, 1);
+            }
+            update(uint32(bitlength));
+            update(uint32(bitlength >> 32));
+            boost::array<uint32, 4> digest;
+            std::copy(ihv, ihv + 4, digest.begin());
+            return digest;
+        }
+
+      private:
+        void compress() {
+            uint32 block[16];
+            for (unsigned i = 0; i < 16; ++i) {
+                block[i] = uint32(buffer[4 * i]) | (uint32(buffer[4 * i + 1]) << 8) | (uint32(buffer[4 * i + 2]) << 16) |
+                           (uint32(buffer[4 * i + 3]) << 24);
+            }
+            md5compress(ihv, block);
+        }
+
+        uint32 ihv[4];
+        unsigned char buffer[64];
+        uint64 length;
+    };
+
+    const char *const cache_version = "hashclash path cache v1";
+
+    // temporary file name next to filepath, unique among processes and threads
+    fs::path temp_path(const fs::path &filepath) {
+        static boost::atomic<unsigned> counter(0);
+        std::ostringstream o;
+        o << filepath.string() << "." << getpid() << "." << counter++ << ".tmp";
+        return fs::path(o.str());
+    }
+
+    // copy from to a temporary file and rename it to to, so to is either absent, the old file or a complete copy
+    void copy_replace(const fs::path &from, const fs::path &to) {
+        const fs::path tmppath = temp_path(to);
+        {
+            std::ifstream ifs(from.string().c_str(), std::ios::binary);
+            std::ofstream ofs(tmppath.string().c_str(), std::ios::binary | std::ios::trunc);
+            bool ok = ifs && ofs;
+            std::vector<char> buf(1 << 16);
+            while (ok && (ifs.read(&buf[0], buf.size()) || ifs.gcount() > 0)) {
+                ok = bool(ofs.write(&buf[0], ifs.gcount()));
+            }
+            if (!ok || ifs.bad() || !ofs.flush()) {
+                ofs.close();
+                boost::system::error_code ec;
+                fs::remove(tmppath, ec);
+                throw std::runtime_error("path_cache: could not copy " + from.string());
+            }
+        }
+        boost::system::error_code ec;
+        fs::rename(tmppath, to, ec);
+        if (ec) {
+            fs::remove(tmppath, ec);
+            throw std::runtime_error("path_cache: could not rename to " + to.string());
+        }
+    }
+
+} // namespace
+
+path_cache::path_cache(const fs::path &dir)
+    : dir(dir) {
+    fs::create_directories(dir);
+    if (!fs::is_directory(dir)) {
+        throw std::runtime_error("path_cache(): could not create cache directory " + dir.string());
+    }
+}
+
+std::string path_cache::key(const std::vector<differentialpath> &paths, const std::string &parameters) {
+    // hash every path, sort the hashes so the key does not depend on the order of the paths
+    std::vector<boost::array<uint32, 4>> digests(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        md5_stream h;
+        h.update(uint32(paths[i].offset));
+        h.update(uint32(paths[i].path.size()));
+        for (size_t j = 0; j < paths[i].path.size(); ++j) {
+            for (unsigned k = 0; k < 4; ++k) {
+                h.update(paths[i].path[j].bytes[k].val);
+            }
+        }
+        digests[i] = h.final();
+    }
+    std::sort(digests.begin(), digests.end());
+
+    md5_stream h;
+    h.update(reinterpret_cast<const unsigned char *>(cache_version), std::strlen(cache_version));
+    h.update(uint32(digests.size()));
+    h.update(uint32(uint64(digests.size()) >> 32));
+    for (size_t i = 0; i < digests.size(); ++i) {
+        for (unsigned k = 0; k < 4; ++k) {
+            h.update(digests[i][k]);
+        }
+    }
+    h.update(reinterpret_cast<const unsigned char *>(parameters.data()), parameters.size());
+    boost::array<uint32, 4> digest = h.final();
+
+    static const char hex[] = "0123456789abcdef";
+    std::string str;
+    for (unsigned k = 0; k < 4; ++k) {
+        for (unsigned b = 0; b < 4; ++b) {
+            const unsigned byte = (digest[k] >> (8 * b)) & 0xFF;
+            str += hex[byte >> 4];
+            str += hex[byte & 15];
+        }
+    }
+    return str;
+}
+
+fs::path path_cache::entry(const std::string &key) const { return dir / (key + ".cache"); }
+
+bool path_cache::lookup(const std::string &key, const fs::path &filepath) const {
+    const fs::path entrypath = entry(key);
+    boost::system::error_code ec;
+    if (!fs::is_regular_file(entrypath, ec)) {
+        return false;
+    }
+    try {
+        copy_replace(entrypath, filepath);
+    } catch (std::exception &) {
+        return false;
+    }
+    return true;
+}
+
+void path_cache::store(const std::string &key, const fs::path &filepath) const { copy_replace(filepath, entry(key)); }
+
+} // namespace hashclash
@@ -0,0 +1,67 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+/*
+
+Persistent content-addressed cache of path search results.
+
+An entry is a single output file stored under a key that identifies the work that produced it:
+the MD5 of the set of input paths (independent of their order) and a string describing all search parameters.
+Entries are files <dir>/<key>.cache holding a copy of the output file in whatever format it was written,
+the format is part of the search parameters. They are copied in under a temporary name and then renamed,
+so concurrent processes sharing a cache directory only ever see complete entries.
+
+*/
+
+#ifndef HASHCLASH_PATHCACHE_HPP
+#define HASHCLASH_PATHCACHE_HPP
+
+#include <vector>
+#include <string>
+
+#include <boost/filesystem/path.hpp>
+
+#include "types.hpp"
+#include "differentialpath.hpp"
+
+namespace hashclash {
+
+class path_cache {
+  public:
+    // creates the cache directory if necessary
+    path_cache(const boost::filesystem::path &dir);
+
+    // key for input paths and the search parameters
+    static std::string key(const std::vector<differentialpath> &paths, const std::string &parameters);
+
+    // copy the entry for key to filepath, returns false if there is no such entry
+    bool lookup(const std::string &key, const boost::filesystem::path &filepath) const;
+
+    // store a copy of filepath as the entry for key
+    void store(const std::string &key, const boost::filesystem::path &filepath) const;
+
+    boost::filesystem::path entry(const std::string &key) const;
+
+  private:
+    boost::filesystem::path dir;
+};
+
+} // namespace hashclash
+
+#endif // HASHCLASH_PATHCACHE_HPP
@@ -0,0 +1,408 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#include <boost/filesystem/operations.hpp>
+
+#include "pathfile.hpp"
+#include "saveload_gz.hpp"
+#include "rng.hpp"
+
+namespace hashclash {
+
+// explicit little-endian encoding of all integers in a path file
+namespace {
+inline void put_le32(unsigned char *p, uint32 v) {
+    p[0] = (unsigned char)(v);
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+inline void put_le64(unsigned char *p, uint64 v) {
+    put_le32(p, uint32(v));
+    put_le32(p + 4, uint32(v >> 32));
+}
+inline uint32 get_le32(const unsigned char *p) {
+    return uint32(p[0]) | (uint32(p[1]) << 8) | (uint32(p[2]) << 16) | (uint32(p[3]) << 24);
+}
+inline uint64 get_le64(const unsigned char *p) { return uint64(get_le32(p)) | (uint64(get_le32(p + 4)) << 32); }
+
+void encode_header(unsigned char *p, const pathfile_header &header) {
+    put_le32(p, header.magic);
+    put_le32(p + 4, header.version);
+    put_le64(p + 8, header.pathcount);
+    put_le32(p + 16, header.pathsperchunk);
+    put_le32(p + 20, header.chunkcount);
+    put_le64(p + 24, header.indexoffset);
+}
+void decode_header(const unsigned char *p, pathfile_header &header) {
+    header.magic = get_le32(p);
+    header.version = get_le32(p + 4);
+    header.pathcount = get_le64(p + 8);
+    header.pathsperchunk = get_le32(p + 16);
+    header.chunkcount = get_le32(p + 20);
+    header.indexoffset = get_le64(p + 24);
+}
+void encode_chunkindex(unsigned char *p, const pathfile_chunkindex &ci) {
+    put_le64(p, ci.offset);
+    put_le32(p + 8, ci.compressedsize);
+    put_le32(p + 12, ci.uncompressedsize);
+    put_le64(p + 16, ci.firstpath);
+}
+void decode_chunkindex(const unsigned char *p, pathfile_chunkindex &ci) {
+    ci.offset = get_le64(p);
+    ci.compressedsize = get_le32(p + 8);
+    ci.uncompressedsize = get_le32(p + 12);
+    ci.firstpath = get_le64(p + 16);
+}
+} // namespace
+
+bool is_pathfile(const boost::filesystem::path &filepath) {
+    std::ifstream ifs(filepath.string().c_str(), std::ios::binary);
+    unsigned char magic[4];
+    if (!ifs || !ifs.read(reinterpret_cast<char *>(magic), sizeof(magic))) {
+        return false;
+    }
+    return get_le32(magic) == pathfile_magic;
+}
+
+/**** pathfile_writer ****/
+
+pathfile_writer::pathfile_writer(const boost::filesystem::path &filepath, unsigned pathsperchunk)
+    : ofs(filepath.string().c_str(), std::ios::binary), closed(false) {
+    if (!ofs) {
+        throw std::runtime_error("pathfile_writer(): could not open file!");
+    }
+    if (pathsperchunk == 0) {
+        pathsperchunk = 1;
+    }
+    header.magic = pathfile_magic;
+    header.version = pathfile_version;
+    header.pathcount = 0;
+    header.pathsperchunk = pathsperchunk;
+    header.chunkcount = 0;
+    header.indexoffset = 0;
+    // the final header is written on close()
+    unsigned char hdr[pathfile_headersize];
+    encode_header(hdr, header);
+    ofs.write(reinterpret_cast<const char *>(hdr), sizeof(hdr));
+    chunk.reserve(pathsperchunk);
+}
+
+pathfile_writer::~pathfile_writer() {
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+void pathfile_writer::push_back(const differentialpath &path) {
+    if (closed) {
+        throw std::runtime_error("pathfile_writer::push_back(): file is closed!");
+    }
+    if (path.tbegin() < -128 || path.tbegin() > 127 || path.path.size() > 255) {
+        throw std::out_of_range("pathfile_writer::push_back(): path does not fit in path file format");
+    }
+    chunk.push_back(path);
+    ++header.pathcount;
+    if (chunk.size() >= header.pathsperchunk) {
+        flush_chunk();
+    }
+}
+
+void pathfile_writer::flush_chunk() {
+    if (chunk.empty()) {
+        return;
+    }
+    const size_t n = chunk.size();
+    size_t words = 0;
+    for (size_t i = 0; i < n; ++i) {
+        words += chunk[i].path.size();
+    }
+    buffer.resize(2 * n + 16 * words);
+    unsigned char *tbegins = &buffer[0];
+    unsigned char *nrwords = tbegins + n;
+    unsigned char *columns = nrwords + n;
+    size_t w = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const differentialpath &path = chunk[i];
+        tbegins[i] = static_cast<unsigned char>(int8(path.tbegin()));
+        nrwords[i] = static_cast<unsigned char>(path.path.size());
+        for (size_t j = 0; j < path.path.size(); ++j, ++w) {
+            for (unsigned k = 0; k < 4; ++k) {
+                put_le32(columns + 4 * (k * words + w), path.path[j].bytes[k].val);
+            }
+        }
+    }
+
+    uLongf compressedsize = compressBound(uLong(buffer.size()));
+    compressed.resize(compressedsize);
+    if (Z_OK != compress2(&compressed[0], &compressedsize, &buffer[0], uLong(buffer.size()), Z_BEST_SPEED)) {
+        throw std::runtime_error("pathfile_writer: compression failed!");
+    }
+
+    pathfile_chunkindex ci;
+    ci.offset = uint64(ofs.tellp());
+    ci.compressedsize = uint32(compressedsize);
+    ci.uncompressedsize = uint32(buffer.size());
+    ci.firstpath = header.pathcount - n;
+    index.push_back(ci);
+    ofs.write(reinterpret_cast<const char *>(&compressed[0]), compressedsize);
+    if (!ofs) {
+        throw std::runtime_error("pathfile_writer: write error!");
+    }
+    chunk.clear();
+}
+
+void pathfile_writer::close() {
+    if (closed) {
+        return;
+    }
+    closed = true;
+    flush_chunk();
+    header.chunkcount = uint32(index.size());
+    header.indexoffset = uint64(ofs.tellp());
+    std::vector<unsigned char> encoded(index.size() * pathfile_chunkindexsize);
+    for (size_t c = 0; c < index.size(); ++c) {
+        encode_chunkindex(&encoded[c * pathfile_chunkindexsize], index[c]);
+    }
+    if (!encoded.empty()) {
+        ofs.write(reinterpret_cast<const char *>(&encoded[0]), encoded.size());
+    }
+    unsigned char hdr[pathfile_headersize];
+    encode_header(hdr, header);
+    ofs.seekp(0);
+    ofs.write(reinterpret_cast<const char *>(hdr), sizeof(hdr));
+    ofs.close();
+    if (!ofs) {
+        throw std::runtime_error("pathfile_writer: write error!");
+    }
+}
+
+/**** pathfile_reader ****/
+
+pathfile_reader::pathfile_reader(const boost::filesystem::path &filepath)
+    : nextpath(0), cachedchunk(~unsigned(0)) {
+    try {
+        file.open(filepath.string());
+    } catch (std::exception &) {
+        throw std::runtime_error("pathfile_reader(): could not open file!");
+    }
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(file.data());
+    if (file.size() < pathfile_headersize) {
+        throw std::runtime_error("pathfile_reader(): file is not a path file!");
+    }
+    decode_header(data, header);
+    if (header.magic != pathfile_magic) {
+        throw std::runtime_error("pathfile_reader(): file is not a path file!");
+    }
+    if (header.version != pathfile_version) {
+        throw std::runtime_error("pathfile_reader(): unsupported path file version!");
+    }
+    // get() divides by pathsperchunk and indexes chunks by path number, so the layout must be exactly as written
+    if (header.pathsperchunk == 0 ||
+        uint64(header.chunkcount) != (header.pathcount + header.pathsperchunk - 1) / header.pathsperchunk) {
+        throw std::runtime_error("pathfile_reader(): path file header is corrupted!");
+    }
+    if (header.indexoffset > file.size() ||
+        uint64(header.chunkcount) * pathfile_chunkindexsize > file.size() - header.indexoffset) {
+        throw std::runtime_error("pathfile_reader(): path file is truncated!");
+    }
+    index.resize(header.chunkcount);
+    for (unsigned c = 0; c < header.chunkcount; ++c) {
+        decode_chunkindex(data + header.indexoffset + uint64(c) * pathfile_chunkindexsize, index[c]);
+        if (index[c].firstpath != uint64(c) * header.pathsperchunk || index[c].firstpath >= header.pathcount) {
+            throw std::runtime_error("pathfile_reader(): path file index is corrupted!");
+        }
+        // decode_chunk() allocates uncompressedsize bytes: it must fit the paths of the chunk (at most 255 words each)
+        // and what zlib can expand compressedsize bytes into (at most 1032:1)
+        const uint64 n = std::min<uint64>(header.pathsperchunk, header.pathcount - index[c].firstpath);
+        if (index[c].uncompressedsize < 2 * n || index[c].uncompressedsize > n * (2 + 16 * 255) ||
+            index[c].uncompressedsize > 1032 * uint64(index[c].compressedsize)) {
+            throw std::runtime_error("pathfile_reader(): path file index is corrupted!");
+        }
+    }
+}
+
+void pathfile_reader::decode_chunk(unsigned c) {
+    if (c == cachedchunk) {
+        return;
+    }
+    if (c >= header.chunkcount) {
+        throw std::out_of_range("pathfile_reader: chunk number out of range");
+    }
+    const pathfile_chunkindex &ci = index[c];
+    if (ci.offset > file.size() || ci.compressedsize > file.size() - ci.offset) {
+        throw std::runtime_error("pathfile_reader: path file is truncated!");
+    }
+    // invalidate the cached chunk first, the buffer is overwritten
+    cachedchunk = ~unsigned(0);
+    buffer.resize(ci.uncompressedsize);
+    uLongf size = ci.uncompressedsize;
+    if (Z_OK != uncompress(&buffer[0], &size, reinterpret_cast<const Bytef *>(file.data() + ci.offset), ci.compressedsize) ||
+        size != ci.uncompressedsize) {
+        throw std::runtime_error("pathfile_reader: chunk is corrupted!");
+    }
+    const uint64 n = std::min<uint64>(header.pathsperchunk, header.pathcount - ci.firstpath);
+    if (size < 2 * n) {
+        throw std::runtime_error("pathfile_reader: chunk is corrupted!");
+    }
+    wordoffset.resize(n + 1);
+    wordoffset[0] = 0;
+    for (uint64 i = 0; i < n; ++i) {
+        wordoffset[i + 1] = wordoffset[i] + buffer[n + i];
+    }
+    if (2 * n + 16 * uint64(wordoffset[n]) != size) {
+        cachedchunk = ~unsigned(0);
+        throw std::runtime_error("pathfile_reader: chunk is corrupted!");
+    }
+    cachedchunk = c;
+}
+
+void pathfile_reader::get(uint64 i, differentialpath &path) {
+    if (i >= header.pathcount) {
+        throw std::out_of_range("pathfile_reader::get(): path number out of range");
+    }
+    decode_chunk(unsigned(i / header.pathsperchunk));
+    const uint64 n = wordoffset.size() - 1;
+    const uint64 words = wordoffset[n];
+    const unsigned j = unsigned(i % header.pathsperchunk);
+    const unsigned char *columns = &buffer[2 * n];
+    path.offset = -int(int8(buffer[j]));
+    path.path.resize(wordoffset[j + 1] - wordoffset[j]);
+    for (size_t w = 0; w < path.path.size(); ++w) {
+        for (unsigned k = 0; k < 4; ++k) {
+            path.path[w].bytes[k].val = get_le32(columns + 4 * (k * words + wordoffset[j] + w));
+        }
+    }
+}
+
+void pathfile_reader::load_chunk(unsigned c, std::vector<differentialpath> &paths) {
+    if (c >= header.chunkcount) {
+        throw std::out_of_range("pathfile_reader::load_chunk(): chunk number out of range");
+    }
+    const uint64 first = index[c].firstpath;
+    const uint64 last = std::min<uint64>(first + header.pathsperchunk, header.pathcount);
+    const size_t oldsize = paths.size();
+    paths.resize(oldsize + size_t(last - first));
+    for (uint64 i = first; i < last; ++i) {
+        get(i, paths[oldsize + size_t(i - first)]);
+    }
+}
+
+void pathfile_reader::load(std::vector<differentialpath> &paths) {
+    paths.reserve(paths.size() + size_t(header.pathcount));
+    for (unsigned c = 0; c < header.chunkcount; ++c) {
+        load_chunk(c, paths);
+    }
+}
+
+void save_pathfile(const std::vector<differentialpath> &paths, const boost::filesystem::path &filepath) {
+    pathfile_writer writer(filepath);
+    for (size_t i = 0; i < paths.size(); ++i) {
+        writer.push_back(paths[i]);
+    }
+    writer.close();
+}
+
+void load_pathfile(std::vector<differentialpath> &paths, const boost::filesystem::path &filepath) {
+    pathfile_reader reader(filepath);
+    paths.clear();
+    reader.load(paths);
+}
+
+void load_paths(std::vector<differentialpath> &paths, const boost::filesystem::path &filepath) {
+    if (is_pathfile(filepath)) {
+        load_pathfile(paths, filepath);
+    } else {
+        load_gz(paths, binary_archive, filepath);
+    }
+}
+
+void save_paths(const std::vector<differentialpath> &paths, const std::string &basename, bool pathfile) {
+    if (pathfile) {
+        save_pathfile(paths, basename + ".paths");
+    } else {
+        save_gz(paths, basename, binary_archive);
+    }
+}
+
+std::string paths_filename(const std::string &basename) {
+    boost::system::error_code ec;
+    if (boost::filesystem::exists(basename + ".paths", ec)) {
+        return basename + ".paths";
+    }
+    return basename + ".bin.gz";
+}
+
+void path_permutation(std::vector<uint64> &perm, uint64 n) {
+    // its own generator, so the generators of the threads are left alone
+    rng_state rng;
+    rng.seed(uint32(n));
+    perm.resize(size_t(n));
+    for (size_t i = 0; i < perm.size(); ++i) {
+        perm[i] = i;
+    }
+    for (unsigned i = 0; i < perm.size(); ++i) {
+        unsigned k = rng.xrng64() % perm.size();
+        std::swap(perm[i], perm[k]);
+    }
+}
+
+uint64 load_paths_part(std::vector<differentialpath> &paths, const boost::filesystem::path &filepath, unsigned modi, unsigned modn) {
+    if (modn == 0) {
+        throw std::invalid_argument("load_paths_part(): modn must be positive");
+    }
+    std::vector<uint64> perm;
+    if (!is_pathfile(filepath)) {
+        std::vector<differentialpath> all;
+        load_gz(all, binary_archive, filepath);
+        path_permutation(perm, all.size());
+        for (size_t j = modi; j < all.size(); j += modn) {
+            paths.push_back(std::move(all[size_t(perm[j])]));
+        }
+        return all.size();
+    }
+    pathfile_reader reader(filepath);
+    path_permutation(perm, reader.size());
+    // read the selected paths in file order, so each chunk is only decompressed once
+    std::vector<std::pair<uint64, size_t>> selected;
+    for (size_t j = modi; j < perm.size(); j += modn) {
+        selected.push_back(std::make_pair(perm[j], selected.size()));
+    }
+    std::sort(selected.begin(), selected.end());
+    const size_t oldsize = paths.size();
+    paths.resize(oldsize + selected.size());
+    try {
+        for (size_t j = 0; j < selected.size(); ++j) {
+            reader.get(selected[j].first, paths[oldsize + selected[j].second]);
+        }
+    } catch (...) {
+        paths.resize(oldsize);
+        throw;
+    }
+    return reader.size();
+}
+
+} // namespace hashclash
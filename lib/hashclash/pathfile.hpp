@@ -0,0 +1,160 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+/*
+
+Indexed, chunk-compressed file format for vectors of MD5 differential paths.
+
+  header: magic, version, #paths, #paths per chunk, #chunks, index offset
+  chunks: zlib compressed columns of up to #paths per chunk paths:
+            int8 tbegin[#paths], unsigned char #words[#paths],
+            followed by one uint32 column per byte of the wordconditions: bytes[k].val of all words, k=0,...,3
+  index:  for each chunk its file offset, compressed size, uncompressed size and first path number
+
+All integers are stored in little-endian byte order, independent of the host byte order.
+Files are memory mapped for reading, chunks are only decompressed when a path in it is accessed,
+so paths can be read by number as well as streamed without loading the whole file.
+
+*/
+
+#ifndef HASHCLASH_PATHFILE_HPP
+#define HASHCLASH_PATHFILE_HPP
+
+#include <vector>
+#include <string>
+#include <fstream>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include "types.hpp"
+#include "differentialpath.hpp"
+
+namespace hashclash {
+
+const uint32 pathfile_magic = 0x50444348; // "HCDP"
+const uint32 pathfile_version = 1;
+// sizes of the encoded header and chunk index entry
+const unsigned pathfile_headersize = 32;
+const unsigned pathfile_chunkindexsize = 24;
+
+struct pathfile_header {
+    uint32 magic;
+    uint32 version;
+    uint64 pathcount;
+    uint32 pathsperchunk;
+    uint32 chunkcount;
+    uint64 indexoffset;
+};
+
+struct pathfile_chunkindex {
+    uint64 offset;
+    uint32 compressedsize;
+    uint32 uncompressedsize;
+    uint64 firstpath;
+};
+
+// true iff the file exists and starts with the path file magic
+bool is_pathfile(const boost::filesystem::path &filepath);
+
+class pathfile_writer {
+  public:
+    pathfile_writer(const boost::filesystem::path &filepath, unsigned pathsperchunk = 1 << 12);
+    ~pathfile_writer();
+
+    void push_back(const differentialpath &path);
+    // writes the last chunk, the index and the final header
+    void close();
+    uint64 size() const { return header.pathcount; }
+
+  private:
+    void flush_chunk();
+
+    std::ofstream ofs;
+    pathfile_header header;
+    std::vector<pathfile_chunkindex> index;
+    std::vector<differentialpath> chunk;
+    std::vector<unsigned char> buffer, compressed;
+    bool closed;
+};
+
+class pathfile_reader {
+  public:
+    pathfile_reader(const boost::filesystem::path &filepath);
+
+    uint64 size() const { return header.pathcount; }
+    unsigned chunks() const { return header.chunkcount; }
+
+    // random access by path number
+    void get(uint64 i, differentialpath &path);
+    differentialpath operator[](uint64 i) {
+        differentialpath path;
+        get(i, path);
+        return path;
+    }
+    // append all paths of chunk c or of the whole file to paths
+    void load_chunk(unsigned c, std::vector<differentialpath> &paths);
+    void load(std::vector<differentialpath> &paths);
+
+    // streaming iteration over all paths in order
+    void rewind() { nextpath = 0; }
+    bool next(differentialpath &path) {
+        if (nextpath >= header.pathcount) {
+            return false;
+        }
+        get(nextpath++, path);
+        return true;
+    }
+
+  private:
+    void decode_chunk(unsigned c);
+
+    boost::iostreams::mapped_file_source file;
+    pathfile_header header;
+    std::vector<pathfile_chunkindex> index;
+    uint64 nextpath;
+    // currently decoded chunk
+    unsigned cachedchunk;
+    std::vector<unsigned char> buffer;
+    std::vector<uint32> wordoffset;
+};
+
+void save_pathfile(const std::vector<differentialpath> &paths, const boost::filesystem::path &filepath);
+void load_pathfile(std::vector<differentialpath> &paths, const boost::filesystem::path &filepath);
+
+// load a vector of paths from either a path file or a binary .bin.gz archive
+void load_paths(std::vector<differentialpath> &paths, const boost::filesystem::path &filepath);
+
+// save paths to basename.paths as a path file or else to basename.bin.gz as a binary archive
+void save_paths(const std::vector<differentialpath> &paths, const std::string &basename, bool pathfile);
+// basename.paths if that exists, otherwise basename.bin.gz
+std::string paths_filename(const std::string &basename);
+
+// the pseudo-random permutation of n paths used to divide work over modn parts,
+// fixed by n: position i of the permuted paths holds path perm[i]
+void path_permutation(std::vector<uint64> &perm, uint64 n);
+
+// append part modi of modn of the paths in a path file or binary .bin.gz archive to paths:
+// the paths at positions modi, modi+modn, ... of the path_permutation of all paths.
+// from a path file only the paths of this part are decoded. returns the total number of paths
+uint64 load_paths_part(std::vector<differentialpath> &paths, const boost::filesystem::path &filepath, unsigned modi, unsigned modn);
+
+} // namespace hashclash
+
+#endif // HASHCLASH_PATHFILE_HPP
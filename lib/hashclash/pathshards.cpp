@@ -0,0 +1,140 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+#include <stdexcept>
+
+#include <boost/thread/locks.hpp>
+
+#include "pathshards.hpp"
+
+namespace hashclash {
+
+path_shards::path_shards(unsigned conds, unsigned maxcond, unsigned ubound)
+    : conds(conds), ubound(ubound), maxcond_(maxcond), size(0), condsize(new boost::atomic<uint64>[conds]), balanced(0) {
+    if (conds == 0) {
+        throw std::runtime_error("path_shards(): no condition counts");
+    }
+    for (unsigned c = 0; c < conds; ++c) {
+        condsize[c] = 0;
+    }
+}
+
+path_shards::shard *path_shards::new_shard() {
+    boost::lock_guard<boost::mutex> lock(shardsmut);
+    shards.emplace_back(new shard(conds, maxcond()));
+    return shards.back().get();
+}
+
+void path_shards::publish(shard &s) {
+    const unsigned mc = maxcond();
+    uint64 added = 0;
+    for (unsigned c = 0; c < conds; ++c) {
+        packedpaths &bucket = s.paths[c];
+        const unsigned n = unsigned(bucket.size()) - s.published[c];
+        if (n == 0) {
+            continue;
+        }
+        if (c <= mc) {
+            condsize[c] += n;
+            s.published[c] += n;
+            added += n;
+        } else {
+            bucket.resize(s.published[c]);
+        }
+    }
+    s.unpublished = 0;
+    if (ubound != 0 && size.fetch_add(added) + added > ubound) {
+        autobalance();
+    }
+
+    s.maxcond = maxcond();
+    for (unsigned c = s.maxcond + 2; c < conds; ++c) {
+        if (!s.paths[c].empty()) {
+            packedpaths().swap(s.paths[c]);
+            s.published[c] = 0;
+        }
+    }
+}
+
+void path_shards::lower_maxcond(unsigned newmaxcond) {
+    boost::lock_guard<boost::mutex> lock(balancemut);
+    if (newmaxcond >= maxcond_.load()) {
+        return;
+    }
+    uint64 newsize = 0;
+    for (unsigned c = 0; c <= newmaxcond && c < conds; ++c) {
+        newsize += condsize[c].load();
+    }
+    size = newsize;
+    maxcond_.store(newmaxcond, boost::memory_order_release);
+}
+
+// same as path_container_autobalance::autobalance() but on the published condition counts
+// counts published concurrently may be missed, they are picked up by the next autobalance
+void path_shards::autobalance() {
+    boost::unique_lock<boost::mutex> lock(balancemut, boost::try_to_lock);
+    if (!lock.owns_lock() || size.load() <= ubound) {
+        return;
+    }
+    ++balanced;
+    unsigned mc = maxcond_.load();
+    uint64 newsize = 0;
+    unsigned k = 0;
+    while (k < conds && k <= mc && newsize + condsize[k].load() <= ubound) {
+        newsize += condsize[k].load();
+        ++k;
+    }
+    if (newsize != 0) {
+        mc = k - 1;
+    } else if (k < conds) {
+        mc = k;
+        newsize = condsize[k].load();
+        if (newsize > ubound && k > 0) {
+            mc = k - 1;
+            newsize = 0;
+        }
+    }
+    for (unsigned j = mc + 2; j < conds; ++j) {
+        condsize[j] = 0;
+    }
+    size = newsize;
+    maxcond_.store(mc, boost::memory_order_release);
+}
+
+void path_shards::merge(buckets_type &pathsout) {
+    boost::lock_guard<boost::mutex> lock(shardsmut);
+    const unsigned mc = maxcond();
+    pathsout.clear();
+    pathsout.resize(conds);
+    for (unsigned c = 0; c < conds && c <= mc + 1; ++c) {
+        size_t total = 0, totalwords = 0;
+        for (auto &s : shards) {
+            total += s->paths[c].size();
+            totalwords += s->paths[c].wordcount();
+        }
+        pathsout[c].reserve(total, totalwords);
+        for (auto &s : shards) {
+            pathsout[c].append(s->paths[c]);
+            packedpaths().swap(s->paths[c]);
+        }
+    }
+    shards.clear();
+}
+
+} // namespace hashclash
@@ -0,0 +1,118 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+/*
+
+Autobalanced storage of differential paths bucketed by condition count, filled by many threads.
+
+Every thread owns a shard with its own buckets and never touches the paths of other threads.
+Threads only share the number of paths per condition count and the resulting maxcond:
+- every 1024 paths a shard publishes its new counts with atomic adds (paths above maxcond are dropped)
+- if the total exceeds the target amount ubound, the publishing thread lowers maxcond (if no other thread is balancing)
+- the new maxcond is published through an atomic, every shard prunes its own buckets above maxcond+1 on its next publish
+All shards are merged in a single pass over the condition counts at the end.
+
+*/
+
+#ifndef HASHCLASH_PATHSHARDS_HPP
+#define HASHCLASH_PATHSHARDS_HPP
+
+#include <vector>
+#include <memory>
+
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "types.hpp"
+#include "differentialpath.hpp"
+
+namespace hashclash {
+
+class path_shards {
+  public:
+    typedef std::vector<packedpaths> buckets_type;
+
+    class shard {
+      public:
+        shard(unsigned conds, unsigned maxcond)
+            : paths(conds), published(conds, 0), unpublished(0), maxcond(maxcond) {}
+
+        // local copy of the global maxcond, updated on each publish
+        unsigned get_maxcond() const { return maxcond; }
+
+      private:
+        friend class path_shards;
+        buckets_type paths;
+        // paths[c][0...published[c]-1] are counted in the global condition counts
+        std::vector<unsigned> published;
+        unsigned unpublished;
+        unsigned maxcond;
+    };
+
+    // conds: number of condition counts 0,...,conds-1, ubound: target amount (0 = no autobalancing)
+    path_shards(unsigned conds, unsigned maxcond, unsigned ubound);
+
+    // create a new shard, the shard is owned by path_shards and must only be used by a single thread
+    shard *new_shard();
+
+    // store path with condition count cond in shard s, returns false if it was rejected
+    bool push_back(shard &s, const fixeddifferentialpath &path, unsigned cond) {
+        if (cond > s.maxcond || cond >= s.paths.size()) {
+            return false;
+        }
+        packedpaths &bucket = s.paths[cond];
+        if (ubound != 0 && condsize[cond].load(boost::memory_order_relaxed) + (bucket.size() - s.published[cond]) >= ubound) {
+            return false;
+        }
+        bucket.push_back(path);
+        if (++s.unpublished >= 1024) {
+            publish(s);
+        }
+        return true;
+    }
+
+    // publish the condition counts of the new paths in shard s and prune s to the global maxcond
+    void publish(shard &s);
+
+    // lower the global maxcond
+    void lower_maxcond(unsigned newmaxcond);
+
+    unsigned maxcond() const { return maxcond_.load(boost::memory_order_acquire); }
+    unsigned count_balanced() const { return balanced.load(boost::memory_order_relaxed); }
+
+    // merge all shards into pathsout: bucket c of pathsout are the paths of bucket c of all shards, for c <= maxcond()+1
+    // all shards are released, all shards must have been published
+    void merge(buckets_type &pathsout);
+
+  private:
+    void autobalance();
+
+    const unsigned conds, ubound;
+    boost::atomic<unsigned> maxcond_;
+    // number of published paths with condition count <= maxcond
+    boost::atomic<uint64> size;
+    std::unique_ptr<boost::atomic<uint64>[]> condsize;
+    boost::atomic<unsigned> balanced;
+    boost::mutex balancemut, shardsmut;
+    std::vector<std::unique_ptr<shard>> shards;
+};
+
+} // namespace hashclash
+
+#endif // HASHCLASH_PATHSHARDS_HPP
@@ -0,0 +1,312 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+#include <cstring>
+#include <stdexcept>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pathstream.hpp"
+
+namespace hashclash {
+
+namespace {
+
+// bytes of the record header
+const size_t pathstream_headersize = 28;
+
+inline void put_le32(unsigned char *p, uint32 v) {
+    p[0] = (unsigned char)(v);
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+inline uint32 get_le32(const unsigned char *p) {
+    return uint32(p[0]) | (uint32(p[1]) << 8) | (uint32(p[2]) << 16) | (uint32(p[3]) << 24);
+}
+
+bool write_all(int fd, const std::vector<unsigned char> &buf) {
+    size_t done = 0;
+    while (done < buf.size()) {
+        const ssize_t n = ::write(fd, &buf[done], buf.size() - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        done += size_t(n);
+    }
+    return true;
+}
+
+} // namespace
+
+/**** pathstream_writer ****/
+
+pathstream_writer::pathstream_writer(const boost::filesystem::path &filepath)
+    : filepath(filepath), fd(-1), fifo(false), stopping(false) {
+    struct stat st;
+    if (::stat(filepath.string().c_str(), &st) == 0 && S_ISFIFO(st.st_mode)) {
+        // a reader that goes away must not terminate the writing process
+        ::signal(SIGPIPE, SIG_IGN);
+        fifo = true;
+        thread = boost::thread(&pathstream_writer::fifo_loop, this);
+        return;
+    }
+    fd = ::open(filepath.string().c_str(), O_WRONLY | O_APPEND | O_CREAT, 0666);
+    if (fd < 0) {
+        throw std::runtime_error("pathstream_writer(): could not open file!");
+    }
+}
+
+pathstream_writer::~pathstream_writer() {
+    if (fifo) {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        thread.join();
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+void pathstream_writer::append(const differentialpath &path, bool supersede, int complexity, unsigned tunnel, unsigned cond) {
+    const size_t words = path.path.size();
+    std::vector<unsigned char> record(pathstream_headersize + 16 * words);
+    put_le32(&record[0], pathstream_magic);
+    put_le32(&record[4], supersede ? pathstream_supersede : 0);
+    put_le32(&record[8], uint32(complexity));
+    put_le32(&record[12], tunnel);
+    put_le32(&record[16], cond);
+    put_le32(&record[20], uint32(path.tbegin()));
+    put_le32(&record[24], uint32(words));
+    for (unsigned k = 0; k < 4; ++k) {
+        for (size_t w = 0; w < words; ++w) {
+            put_le32(&record[pathstream_headersize + 4 * (k * words + w)], path.path[w].bytes[k].val);
+        }
+    }
+    if (!fifo) {
+        if (!write_all(fd, record)) {
+            throw std::runtime_error("pathstream_writer::append(): write error!");
+        }
+        return;
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        if (supersede) {
+            current.clear();
+            queued.clear();
+        }
+        current.insert(current.end(), record.begin(), record.end());
+        queued.insert(queued.end(), record.begin(), record.end());
+    }
+    changed.notify_all();
+}
+
+void pathstream_writer::fifo_loop() {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (!stopping) {
+        if (fd < 0) {
+            fd = ::open(filepath.string().c_str(), O_WRONLY | O_NONBLOCK);
+            if (fd < 0) {
+                // no reader yet (ENXIO), look again shortly
+                changed.timed_wait(lock, boost::posix_time::milliseconds(100));
+                continue;
+            }
+            // the new reader starts with the current paths
+            queued = current;
+            if (!queued.empty()) {
+                put_le32(&queued[4], get_le32(&queued[4]) | pathstream_supersede);
+            }
+        }
+        if (queued.empty()) {
+            changed.timed_wait(lock, boost::posix_time::milliseconds(100));
+            // notice a reader that went away before the next record goes to its successor
+            struct pollfd p = {fd, 0, 0};
+            if (queued.empty() && ::poll(&p, 1, 0) > 0 && (p.revents & (POLLERR | POLLHUP))) {
+                ::close(fd);
+                fd = -1;
+            }
+            continue;
+        }
+        std::vector<unsigned char> chunk;
+        chunk.swap(queued);
+        lock.unlock();
+        const bool ok = write_fifo(chunk);
+        lock.lock();
+        if (!ok) {
+            // the reader went away, the next reader is sent the current paths
+            ::close(fd);
+            fd = -1;
+        }
+    }
+}
+
+// write all of buf to the non-blocking fd, waiting for the reader to drain the FIFO
+// gives up when the reader went away or when the writer is destroyed
+bool pathstream_writer::write_fifo(const std::vector<unsigned char> &buf) {
+    size_t done = 0;
+    while (done < buf.size()) {
+        const ssize_t n = ::write(fd, &buf[done], buf.size() - done);
+        if (n >= 0) {
+            done += size_t(n);
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return false;
+        }
+        {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            if (stopping) {
+                return false;
+            }
+        }
+        struct pollfd p = {fd, POLLOUT, 0};
+        ::poll(&p, 1, 100);
+    }
+    return true;
+}
+
+/**** pathstream_reader ****/
+
+pathstream_reader::pathstream_reader(const boost::filesystem::path &filepath)
+    : complexity(0), tunnel(0), cond(0), filepath(filepath), offset(0), device(0), inode(0), fd(-1), restart(false) {}
+
+pathstream_reader::~pathstream_reader() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+bool pathstream_reader::update(std::vector<differentialpath> &paths) {
+    struct stat st;
+    if (::stat(filepath.string().c_str(), &st) != 0) {
+        return false;
+    }
+    unsigned char buf[1 << 16];
+    if (S_ISFIFO(st.st_mode)) {
+        if (fd < 0) {
+            fd = ::open(filepath.string().c_str(), O_RDONLY | O_NONBLOCK);
+            if (fd < 0) {
+                return false;
+            }
+        }
+        bool writerclosed = false;
+        while (true) {
+            const ssize_t n = ::read(fd, buf, sizeof(buf));
+            if (n > 0) {
+                pending.insert(pending.end(), buf, buf + n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            // n == 0: there is no writer, otherwise EAGAIN: no more data for now
+            writerclosed = (n == 0);
+            break;
+        }
+        const size_t used = pending.empty() ? 0 : apply(&pending[0], pending.size(), paths);
+        pending.erase(pending.begin(), pending.begin() + used);
+        if (writerclosed) {
+            // a writer that went away in the middle of a record resends the current paths on reconnecting
+            pending.clear();
+        }
+        return used != 0;
+    }
+
+    const int file = ::open(filepath.string().c_str(), O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+    if (::fstat(file, &st) != 0) {
+        ::close(file);
+        return false;
+    }
+    if (uint64(st.st_dev) != device || uint64(st.st_ino) != inode || uint64(st.st_size) < offset) {
+        // a new, replaced or truncated file is read from the start and replaces all paths
+        restart = restart || (offset != 0);
+        device = uint64(st.st_dev);
+        inode = uint64(st.st_ino);
+        offset = 0;
+    }
+    std::vector<unsigned char> data;
+    while (true) {
+        const ssize_t n = ::pread(file, buf, sizeof(buf), off_t(offset + data.size()));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        data.insert(data.end(), buf, buf + n);
+    }
+    ::close(file);
+    const size_t used = data.empty() ? 0 : apply(&data[0], data.size(), paths);
+    offset += used;
+    return used != 0;
+}
+
+size_t pathstream_reader::apply(const unsigned char *data, size_t size, std::vector<differentialpath> &paths) {
+    size_t used = 0;
+    while (size - used >= pathstream_headersize) {
+        const unsigned char *p = data + used;
+        if (get_le32(p) != pathstream_magic || get_le32(p + 24) > 255) {
+            throw std::runtime_error("pathstream_reader::update(): stream is corrupted!");
+        }
+        const size_t words = get_le32(p + 24);
+        const size_t recordsize = pathstream_headersize + 16 * words;
+        if (size - used < recordsize) {
+            // record is still being written
+            break;
+        }
+        if ((get_le32(p + 4) & pathstream_supersede) || restart) {
+            paths.clear();
+            restart = false;
+        }
+        paths.push_back(differentialpath());
+        differentialpath &path = paths.back();
+        path.offset = -int(get_le32(p + 20));
+        path.path.resize(words);
+        for (unsigned k = 0; k < 4; ++k) {
+            for (size_t w = 0; w < words; ++w) {
+                path.path[w].bytes[k].val = get_le32(p + pathstream_headersize + 4 * (k * words + w));
+            }
+        }
+        complexity = int(get_le32(p + 8));
+        tunnel = get_le32(p + 12);
+        cond = get_le32(p + 16);
+        used += recordsize;
+    }
+    return used;
+}
+
+} // namespace hashclash
@@ -0,0 +1,112 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+/*
+
+Append-only stream of MD5 differential paths, used to pass improving paths from a running search to a running consumer.
+
+The stream is a sequence of records, each written with a single write:
+  magic, flags, complexity, #tunnels, #conditions, tbegin, #words, followed by bytes[k].val of all words, k=0,...,3
+A record with the supersede flag replaces all paths of the records before it, other records add a path.
+All integers are stored as 32-bit little-endian words.
+
+The stream is a regular file or a FIFO (named pipe).
+A file reader remembers its file offset and on each update only reads the records that have been completely written since,
+so it can follow the file while it is being written. When the file shrinks or is replaced the reader starts over.
+A FIFO reader keeps the FIFO open and buffers incomplete records between updates.
+A FIFO writer only writes while a reader has the FIFO open and a reader that (re)connects
+is first sent the current paths, i.e. the records since the last supersede record.
+FIFO records are written by a thread of the writer, so append never waits for the reader:
+it queues the record and a supersede record drops the queued records it replaces.
+
+*/
+
+#ifndef HASHCLASH_PATHSTREAM_HPP
+#define HASHCLASH_PATHSTREAM_HPP
+
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "types.hpp"
+#include "differentialpath.hpp"
+
+namespace hashclash {
+
+const uint32 pathstream_magic = 0x53504348; // "HCPS"
+const uint32 pathstream_supersede = 1;
+
+class pathstream_writer {
+  public:
+    // opens filepath for appending, creates it if necessary, an existing FIFO is opened once it has a reader
+    pathstream_writer(const boost::filesystem::path &filepath);
+    ~pathstream_writer();
+
+    // if supersede then the paths of all earlier records are replaced by path
+    void append(const differentialpath &path, bool supersede, int complexity, unsigned tunnel, unsigned cond);
+
+  private:
+    // FIFO only: connects to readers and writes the queued records
+    void fifo_loop();
+    bool write_fifo(const std::vector<unsigned char> &buf);
+
+    boost::filesystem::path filepath;
+    int fd;
+    bool fifo;
+    // FIFO only, guarded by mutex: the records since the last supersede record and those not yet taken by the thread
+    std::vector<unsigned char> current, queued;
+    boost::mutex mutex;
+    boost::condition_variable changed;
+    bool stopping;
+    boost::thread thread;
+};
+
+class pathstream_reader {
+  public:
+    pathstream_reader(const boost::filesystem::path &filepath);
+    ~pathstream_reader();
+
+    // apply all complete records written since the last update to paths, returns true if paths changed
+    // the file need not exist yet
+    bool update(std::vector<differentialpath> &paths);
+
+    // quality of the last record read
+    int complexity;
+    unsigned tunnel, cond;
+
+  private:
+    // applies the complete records in data to paths, returns the number of bytes used
+    size_t apply(const unsigned char *data, size_t size, std::vector<differentialpath> &paths);
+
+    boost::filesystem::path filepath;
+    // file: offset of the next record in the file identified by device and inode
+    uint64 offset, device, inode;
+    // FIFO: the open FIFO and the start of an incomplete record
+    int fd;
+    std::vector<unsigned char> pending;
+    // the next record replaces all paths because the stream started over
+    bool restart;
+};
+
+} // namespace hashclash
+
+#endif // HASHCLASH_PATHSTREAM_HPP
@@ -87,7 +87,7 @@ class progress_display : private boost::noncopyable {
             m_os << std::endl;
         }
 
-        if (_tic != 49) {
+        if (_tic < 49) {
             _next_tic_count = static_cast<uint64>((static_cast<double>(_tic + 1) / 50.0) * static_cast<double>(_expected_count));
         } else { // to avoid a precision error at the end
             _next_tic_count = _expected_count;
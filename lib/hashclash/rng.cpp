@@ -22,6 +22,9 @@
 #include <memory>
 #include <exception>
 #include <random>
+
+#include <boost/thread.hpp>
+
 #include "rng.hpp"
 
 namespace hashclash {
@@ -44,13 +47,7 @@ void getosrnd(uint32 buf[256]) {
     }
 }
 
-uint32 seedd;
-uint32 seed32_1;
-uint32 seed32_2;
-uint32 seed32_3;
-uint32 seed32_4;
-
-void seed(uint32 s) {
+void rng_state::seed(uint32 s) {
     seedd = 0;
     seed32_1 = s;
     seed32_2 = 2;
@@ -61,7 +58,7 @@ void seed(uint32 s) {
     }
 }
 
-void seed(uint32 *sbuf, unsigned len) {
+void rng_state::seed(const uint32 *sbuf, unsigned len) {
     seedd = 0;
     seed32_1 = 1;
     seed32_2 = 2;
@@ -76,13 +73,13 @@ void seed(uint32 *sbuf, unsigned len) {
     }
 }
 
-void addseed(uint32 s) {
+void rng_state::addseed(uint32 s) {
     xrng128();
     seed32_1 ^= s;
     xrng128();
 }
 
-void addseed(const uint32 *sbuf, unsigned len) {
+void rng_state::addseed(const uint32 *sbuf, unsigned len) {
     xrng128();
     for (unsigned i = 0; i < len; ++i) {
         seed32_1 ^= sbuf[i];
@@ -90,17 +87,137 @@ void addseed(const uint32 *sbuf, unsigned len) {
     }
 }
 
-struct hashclash_rng__init {
-    hashclash_rng__init() {
-        seed(uint32(time(NULL)));
+boost::atomic<uint32> rng_generation(1);
+
+// master state, the main thread and the number of implicitly seeded threads
+// the master state and the thread counter are only accessed under the master mutex
+// function-local statics avoid depending on the order of global constructors
+struct rng_master {
+    rng_master() : mainthread(boost::this_thread::get_id()), implicitthreads(0) {
+        state.seed(uint32(time(NULL)));
         uint32 rndbuf[256]; // uninitialized on purpose
-        addseed(rndbuf, 256);
+        state.addseed(rndbuf, 256);
         getosrnd(rndbuf);
-        addseed(rndbuf, 256);
+        state.addseed(rndbuf, 256);
     }
+    boost::mutex mut;
+    rng_state state;
+    boost::thread::id mainthread;
+    uint32 implicitthreads;
 };
-hashclash_rng__init hashclash_rng__init__now;
+rng_master &get_rng_master() {
+    static rng_master master;
+    return master;
+}
+
+// construct the master during static initialization, which runs on the main thread
+struct rng_master_init {
+    rng_master_init() { get_rng_master(); }
+} rng_master_init_instance;
+
+// implicitly seeded threads use a separate tag so they never collide with seed_thread() indices
+const uint32 rng_tag_main = 0x6d61696e, rng_tag_implicit = 0x696d706c, rng_tag_thread = 0x74687264;
+
+// derive the state for the tag and index of slot from the master state
+// requires lock on the master mutex
+void derive_thread_rng(thread_rng_slot &slot, const rng_master &master) {
+    if (slot.tag == rng_tag_main) {
+        slot.state = master.state;
+    } else {
+        uint32 buf[7] = {master.state.seedd, master.state.seed32_1, master.state.seed32_2, master.state.seed32_3,
+                         master.state.seed32_4, slot.tag, slot.index};
+        slot.state.seed(buf, 7);
+    }
+    slot.generation = rng_generation.load();
+}
+
+// the main thread draws from the master state itself: carry its draws since the last derivation over into the master state
+// requires lock on the master mutex
+void take_main_draws(rng_master &master) {
+    const thread_rng_slot &slot = this_thread_rng_slot();
+    if (slot.tag == rng_tag_main && slot.generation == rng_generation.load()) {
+        master.state = slot.state;
+    }
+}
+
+void init_thread_rng(thread_rng_slot &slot) {
+    rng_master &master = get_rng_master();
+    boost::lock_guard<boost::mutex> lock(master.mut);
+    if (slot.tag == 0) {
+        if (boost::this_thread::get_id() == master.mainthread) {
+            slot.tag = rng_tag_main;
+        } else {
+            slot.tag = rng_tag_implicit;
+            slot.index = master.implicitthreads++;
+        }
+    }
+    derive_thread_rng(slot, master);
+}
+
+void seed_thread(unsigned threadindex) {
+    rng_master &master = get_rng_master();
+    boost::lock_guard<boost::mutex> lock(master.mut);
+    thread_rng_slot &slot = this_thread_rng_slot();
+    slot.tag = rng_tag_thread;
+    slot.index = threadindex;
+    derive_thread_rng(slot, master);
+}
+
+// changes of the master state are published by a new generation, threads derive their state again on their next draw
+void seed(uint32 s) {
+    rng_master &master = get_rng_master();
+    boost::lock_guard<boost::mutex> lock(master.mut);
+    master.state.seed(s);
+    ++rng_generation;
+}
+
+void seed(const uint32 *sbuf, unsigned len) {
+    rng_master &master = get_rng_master();
+    boost::lock_guard<boost::mutex> lock(master.mut);
+    master.state.seed(sbuf, len);
+    ++rng_generation;
+}
+
+void addseed(uint32 s) {
+    rng_master &master = get_rng_master();
+    boost::lock_guard<boost::mutex> lock(master.mut);
+    take_main_draws(master);
+    master.state.addseed(s);
+    ++rng_generation;
+}
+
+void addseed(const uint32 *sbuf, unsigned len) {
+    rng_master &master = get_rng_master();
+    boost::lock_guard<boost::mutex> lock(master.mut);
+    take_main_draws(master);
+    master.state.addseed(sbuf, len);
+    ++rng_generation;
+}
+
+void seed_string(const std::string &s) {
+    rng_master &master = get_rng_master();
+    boost::lock_guard<boost::mutex> lock(master.mut);
+    master.state.seed(0);
+    for (unsigned i = 0; i < s.size(); ++i) {
+        master.state.seed32_1 ^= s[i];
+        master.state.xrng128();
+    }
+    ++rng_generation;
+}
+
+rng_state master_rng_state() {
+    rng_master &master = get_rng_master();
+    boost::lock_guard<boost::mutex> lock(master.mut);
+    return master.state;
+}
+
+void set_master_rng_state(const rng_state &state) {
+    rng_master &master = get_rng_master();
+    boost::lock_guard<boost::mutex> lock(master.mut);
+    master.state = state;
+    ++rng_generation;
+}
 
-void hashclash_rng_hpp_init() { hashclash_rng__init here; }
+void hashclash_rng_hpp_init() { get_rng_master(); }
 
 } // namespace hashclash
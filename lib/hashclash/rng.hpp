@@ -27,63 +27,137 @@ by G. Marsaglia: http://www.jstatsoft.org/v08/i14/xorshift.pdf
 #ifndef HASHCLASH_XORSHIFT_RNG_HPP
 #define HASHCLASH_XORSHIFT_RNG_HPP
 
+#include <string>
+
+#include <boost/atomic.hpp>
+
 #include "types.hpp"
 
 namespace hashclash {
 
-// seed all generators using 32-bit values
-// seed state is deterministically dependent on the given values
+/******** Generator state ******************************************/
+// Each thread owns an independent rng_state, so generators never share state between threads.
+// A zero-initialized rng_state is unseeded.
+struct rng_state {
+    uint32 seedd;
+    uint32 seed32_1;
+    uint32 seed32_2;
+    uint32 seed32_3;
+    uint32 seed32_4;
+
+    // the xorshift state never becomes all-zero once seeded
+    bool seeded() const { return (seed32_1 | seed32_2 | seed32_3 | seed32_4) != 0; }
+
+    // seed all generators using 32-bit values
+    // seed state is deterministically dependent on the given values
+    void seed(uint32 s);
+    void seed(const uint32 *sbuf, unsigned len);
+    // add seed to the generators
+    // seed state is changed by given values
+    void addseed(uint32 s);
+    void addseed(const uint32 *sbuf, unsigned len);
+
+    /******** Random generator with perdiod (2^32 - 1)*2^32 **********/
+    inline uint32 xrng32() {
+        seed32_1 ^= seed32_1 << 13;
+        seed32_1 ^= seed32_1 >> 17;
+        return (seed32_1 ^= seed32_1 << 5) + (seedd += 789456123);
+    }
+
+    /******** Random generator with perdiod (2^64 - 1)*2^32 **********/
+    inline uint32 xrng64() {
+        uint32 t = seed32_1 ^ (seed32_1 << 10);
+        seed32_1 = seed32_2;
+        seed32_2 = (seed32_2 ^ (seed32_2 >> 10)) ^ (t ^ (t >> 13));
+        return seed32_1 + (seedd += 789456123);
+    }
+
+    /******** Random generator with perdiod (2^96 - 1)*2^32 **********/
+    inline uint32 xrng96() {
+        uint32 t = seed32_1 ^ (seed32_1 << 10);
+        seed32_1 = seed32_2;
+        seed32_2 = seed32_3;
+        seed32_3 = (seed32_3 ^ (seed32_3 >> 26)) ^ (t ^ (t >> 5));
+        return seed32_1 + (seedd += 789456123);
+    }
+
+    /******** Random generator with perdiod (2^128 - 1)*2^32 **********/
+    inline uint32 xrng128() {
+        uint32 t = seed32_1 ^ (seed32_1 << 5);
+        seed32_1 = seed32_2;
+        seed32_2 = seed32_3;
+        seed32_3 = seed32_4;
+        seed32_4 = (seed32_4 ^ (seed32_4 >> 1)) ^ (t ^ (t >> 14));
+        return seed32_1 + (seedd += 789456123);
+    }
+};
+
+// The seed functions below act on a process-wide master state, as the old global generator did.
+// seed() and addseed() update the master state, and every thread draws from a state derived from it by its (tag, index):
+// - the main thread: the master state itself, so its draws are those of the old global generator,
+//   and a following seed() or addseed() of the main thread continues from its draws as it did before,
+// - worker threads that called seed_thread(i): deterministically from the master state and index i,
+// - other threads: from the master state and the order in which they first used a generator.
+// After seed() or addseed() every thread derives its state again on its next draw.
+// So for a given seed the main thread and worker i of a run always draw the same stream.
+
+// the calling thread's state and how it was derived from the master state
+struct thread_rng_slot {
+    rng_state state;
+    // master generation the state was derived from, 0 = not yet derived
+    uint32 generation;
+    // 0 = not yet assigned
+    uint32 tag, index;
+};
+
+// master generation, increased by every seed() or addseed()
+extern boost::atomic<uint32> rng_generation;
+
+// (re)derives a thread's state from the master state
+void init_thread_rng(thread_rng_slot &slot);
+
+inline thread_rng_slot &this_thread_rng_slot() {
+    static thread_local thread_rng_slot slot; // constant (zero) initialized, no guard needed
+    return slot;
+}
+
+// the calling thread's generator state
+inline rng_state &thread_rng() {
+    thread_rng_slot &slot = this_thread_rng_slot();
+    if (slot.generation != rng_generation.load(boost::memory_order_relaxed)) {
+        init_thread_rng(slot);
+    }
+    return slot.state;
+}
+
+// deterministically seed the calling thread's state from the master state and the given thread index
+// worker threads call this with their index, so worker i draws the same stream in every run with the same seed
+void seed_thread(unsigned threadindex);
+
+// seed/addseed the master state and thereby the generators of all threads using 32-bit values
+// the master state is initialized to random values based on the time and the OS randomness source
 void seed(uint32 s);
 void seed(const uint32 *sbuf, unsigned len);
-// add seed to the generators
-// seed state is changed by given values
 void addseed(uint32 s);
 void addseed(const uint32 *sbuf, unsigned len);
 
-// seeds used, these are initialized to random values based on the time
-extern uint32 seedd;
-extern uint32 seed32_1;
-extern uint32 seed32_2;
-extern uint32 seed32_3;
-extern uint32 seed32_4;
-
-/******** Random generator with perdiod (2^32 - 1)*2^32 **********/
-inline uint32 xrng32() {
-    seed32_1 ^= seed32_1 << 13;
-    seed32_1 ^= seed32_1 >> 17;
-    return (seed32_1 ^= seed32_1 << 5) + (seedd += 789456123);
-}
+// seed the master state from a string as the tools' --seed option did with the old global generator:
+// seed(0), then for each character xor it into seed32_1 and draw once
+void seed_string(const std::string &s);
 
-/******** Random generator with perdiod (2^64 - 1)*2^32 **********/
-inline uint32 xrng64() {
-    uint32 t = seed32_1 ^ (seed32_1 << 10);
-    seed32_1 = seed32_2;
-    seed32_2 = (seed32_2 ^ (seed32_2 >> 10)) ^ (t ^ (t >> 13));
-    return seed32_1 + (seedd += 789456123);
-}
+// the master state the threads derived their states from, e.g. to save it in a checkpoint
+rng_state master_rng_state();
+// replace the master state, e.g. by one loaded from a checkpoint, after which every thread derives its state again
+void set_master_rng_state(const rng_state &state);
 
-/******** Random generator with perdiod (2^96 - 1)*2^32 **********/
-inline uint32 xrng96() {
-    uint32 t = seed32_1 ^ (seed32_1 << 10);
-    seed32_1 = seed32_2;
-    seed32_2 = seed32_3;
-    seed32_3 = (seed32_3 ^ (seed32_3 >> 26)) ^ (t ^ (t >> 5));
-    return seed32_1 + (seedd += 789456123);
-}
-
-/******** Random generator with perdiod (2^128 - 1)*2^32 **********/
-inline uint32 xrng128() {
-    uint32 t = seed32_1 ^ (seed32_1 << 5);
-    seed32_1 = seed32_2;
-    seed32_2 = seed32_3;
-    seed32_3 = seed32_4;
-    seed32_4 = (seed32_4 ^ (seed32_4 >> 1)) ^ (t ^ (t >> 14));
-    return seed32_1 + (seedd += 789456123);
-}
+// the calling thread's generators
+inline uint32 xrng32() { return thread_rng().xrng32(); }
+inline uint32 xrng64() { return thread_rng().xrng64(); }
+inline uint32 xrng96() { return thread_rng().xrng96(); }
+inline uint32 xrng128() { return thread_rng().xrng128(); }
 
-// call this in a other global constructor using any xrng (without seeding itself)
-// due to the inpredictable order of which global constructors are called
-// otherwise the correct seeding of xrng is not guaranteed
+// initializes the master seed, it is safe to use any xrng from other global constructors
+// since all generator states are seeded on first use, calling this is no longer required
 void hashclash_rng_hpp_init();
 
 } // namespace hashclash
@@ -169,6 +169,33 @@ uint32 best_rotated_difference(uint32 diff, int rc) {
     return d2;
 }
 
+void best_rotated_difference(const uint32 *diff, uint32 *out, size_t n, int rc) {
+    if ((rc & 31) == 0) {
+        std::copy(diff, diff + n, out);
+        return;
+    }
+    // same computation as best_rotated_difference(uint32,int) with selects instead of branches
+    const int rc2 = 32 - rc;
+    const uint32 bound = 1 << rc2;
+    const uint32 bound2 = 1 << rc;
+    for (size_t i = 0; i < n; ++i) {
+        const uint32 y1 = diff[i] >> rc2;
+        const uint32 x = diff[i] & (bound - 1);
+        const uint32 p1a = (bound - x) * y1;
+        const bool c1 = (y1 << 1) > bound2;
+        const uint32 d1 = ((x << rc) | y1) - (c1 ? bound2 : 0);
+        const uint32 p1 = c1 ? p1a : ((bound - x) << rc) - p1a;
+
+        const uint32 y2 = (y1 + 1) & ~bound2;
+        const uint32 p2a = x * y2;
+        const bool c2 = (y2 << 1) > bound2;
+        const uint32 d2 = ((x << rc) | y2) - (c2 ? bound2 : 0);
+        const uint32 p2 = c2 ? p2a : (x << rc) - p2a;
+
+        out[i] = (x == 0 || p1 > p2) ? d1 : d2;
+    }
+}
+
 void rotate_difference(uint32 diff, int rc, std::vector<uint32> &rotateddiff, uint32 minprob) {
     rotateddiff.clear();
     if (diff == 0 || (rc & 31) == 0) {
@@ -50,6 +50,8 @@ sdr naf(uint32 n);
 void rotate_difference(uint32 diff, int rc, std::vector<uint32> &rotateddiff, uint32 minprob = uint32(1) << 30);
 void rotate_difference(uint32 diff, int rc, std::vector<std::pair<uint32, double>> &rotateddiff);
 uint32 best_rotated_difference(uint32 diff, int rc);
+// out[i] = best_rotated_difference(diff[i], rc) for i < n, branch-free so the compiler can vectorize it (out may equal diff)
+void best_rotated_difference(const uint32 *diff, uint32 *out, size_t n, int rc);
 
 class sdr {
   public:
@@ -0,0 +1,62 @@
+/***
+ * Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow (danshu@microsoft.com)
+ * Distributed under the MIT Software License.
+ * See accompanying file LICENSE.txt or copy at
+ * https://opensource.org/licenses/MIT
+ ***/
+
+/*
+ * this header defines SIMD MACROS for avx512 intrinsics
+ * used to generate avx512 code from generic SIMD code (simd_birthday.cinc)
+ */
+
+#ifndef SIMD_AVX512_HEADER
+#define SIMD_AVX512_HEADER
+
+#ifdef HASHCLASH_HAVE_AVX512_F
+/* requires only AVX512-F */
+#define SIMD_VERSION avx512
+#define SIMD_VECSIZE 16
+
+#include <immintrin.h>
+
+#define SIMD_WORD __m512i
+
+#define SIMD_ZERO _mm512_setzero_si512()
+#define SIMD_WTOV(l) _mm512_set1_epi32(l)
+#define SIMD_ADD_VV(l, r) _mm512_add_epi32(l, r)
+#define SIMD_ADD_VW(l, r) _mm512_add_epi32(l, _mm512_set1_epi32(r))
+#define SIMD_SUB_VV(l, r) _mm512_sub_epi32(l, r)
+#define SIMD_SUB_VW(l, r) _mm512_sub_epi32(l, _mm512_set1_epi32(r))
+#define SIMD_AND_VV(l, r) _mm512_and_si512(l, r)
+#define SIMD_AND_VW(l, r) _mm512_and_si512(l, _mm512_set1_epi32(r))
+#define SIMD_ANDNOT_VV(l, r) _mm512_andnot_si512(l, r)
+#define SIMD_ANDNOT_VW(l, r) _mm512_andnot_si512(l, _mm512_set1_epi32(r))
+#define SIMD_ANDNOT_WV(l, r) _mm512_andnot_si512(_mm512_set1_epi32(l), r)
+#define SIMD_OR_VV(l, r) _mm512_or_si512(l, r)
+#define SIMD_OR_VW(l, r) _mm512_or_si512(l, _mm512_set1_epi32(r))
+#define SIMD_XOR_VV(l, r) _mm512_xor_si512(l, r)
+#define SIMD_XOR_VW(l, r) _mm512_xor_si512(l, _mm512_set1_epi32(r))
+#define SIMD_NOT_V(l) _mm512_ternarylogic_epi32(l, l, l, 0x55)
+#define SIMD_SHL_V(l, i) _mm512_slli_epi32(l, i)
+#define SIMD_SHR_V(l, i) _mm512_srli_epi32(l, i)
+#define SIMD_ROL_V(l, i) _mm512_rol_epi32(l, i)
+#define SIMD_ROR_V(l, i) _mm512_ror_epi32(l, i)
+
+/* comparisons give a mask register, expand it to a vector of all-zero or all-one words */
+#define SIMD_EQ_VV(a, b) _mm512_maskz_set1_epi32(_mm512_cmpeq_epi32_mask(a, b), -1)
+#define SIMD_MIN_VV(a, b) _mm512_min_epu32(a, b)
+/* bitwise m ? a : b */
+#define SIMD_SEL_VVV(m, a, b) _mm512_ternarylogic_epi32(m, a, b, 0xCA)
+#define SIMD_SEL_VWW(m, a, b) SIMD_SEL_VVV(m, SIMD_WTOV(a), SIMD_WTOV(b))
+
+#define SIMD_CLEANUP
+
+/* these are general definitions for lacking SIMD operations */
+
+#ifndef SIMD_NEG_V
+#define SIMD_NEG_V(l) SIMD_SUB_VV(SIMD_ZERO, l)
+#endif
+
+#endif /* HASHCLASH_HAVE_AVX512_F */
+#endif /* SIMD_AVX512_HEADER */
@@ -0,0 +1,121 @@
+/***
+ * Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow (danshu@microsoft.com)
+ * Distributed under the MIT Software License.
+ * See accompanying file LICENSE.txt or copy at
+ * https://opensource.org/licenses/MIT
+ ***/
+
+/*
+ * this header defines SIMD MACROS for plain C
+ * used to generate portable code from generic SIMD code (simd_birthday.cinc)
+ * a SIMD word is emulated by 4 interleaved 32-bit words:
+ * the independent lanes give the compiler instruction level parallelism and the option to auto-vectorize
+ */
+
+#ifndef SIMD_SCALAR_HEADER
+#define SIMD_SCALAR_HEADER
+
+#include <stdint.h>
+
+#define SIMD_VERSION scalar
+#define SIMD_VECSIZE 4
+
+typedef struct {
+    uint32_t w[SIMD_VECSIZE];
+} simd_scalar_word;
+
+#define SIMD_SCALAR_UNARY(name, expr)                         \
+    static inline simd_scalar_word name(simd_scalar_word l) { \
+        simd_scalar_word v;                                   \
+        for (unsigned i = 0; i < SIMD_VECSIZE; ++i) {         \
+            const uint32_t a = l.w[i];                        \
+            v.w[i] = (expr);                                  \
+        }                                                     \
+        return v;                                             \
+    }
+#define SIMD_SCALAR_BINARY(name, expr)                                            \
+    static inline simd_scalar_word name(simd_scalar_word l, simd_scalar_word r) { \
+        simd_scalar_word v;                                                       \
+        for (unsigned i = 0; i < SIMD_VECSIZE; ++i) {                             \
+            const uint32_t a = l.w[i], b = r.w[i];                                \
+            v.w[i] = (expr);                                                      \
+        }                                                                         \
+        return v;                                                                 \
+    }
+
+static inline simd_scalar_word simd_scalar_wtov(uint32_t l) {
+    simd_scalar_word v;
+    for (unsigned i = 0; i < SIMD_VECSIZE; ++i) {
+        v.w[i] = l;
+    }
+    return v;
+}
+SIMD_SCALAR_BINARY(simd_scalar_add, a + b)
+SIMD_SCALAR_BINARY(simd_scalar_sub, a - b)
+SIMD_SCALAR_BINARY(simd_scalar_and, a & b)
+SIMD_SCALAR_BINARY(simd_scalar_andnot, ~a & b)
+SIMD_SCALAR_BINARY(simd_scalar_or, a | b)
+SIMD_SCALAR_BINARY(simd_scalar_xor, a ^ b)
+SIMD_SCALAR_BINARY(simd_scalar_eq, a == b ? 0xFFFFFFFF : 0)
+SIMD_SCALAR_BINARY(simd_scalar_min, a < b ? a : b)
+SIMD_SCALAR_UNARY(simd_scalar_not, ~a)
+static inline simd_scalar_word simd_scalar_shl(simd_scalar_word l, unsigned n) {
+    for (unsigned i = 0; i < SIMD_VECSIZE; ++i) {
+        l.w[i] <<= n;
+    }
+    return l;
+}
+static inline simd_scalar_word simd_scalar_shr(simd_scalar_word l, unsigned n) {
+    for (unsigned i = 0; i < SIMD_VECSIZE; ++i) {
+        l.w[i] >>= n;
+    }
+    return l;
+}
+static inline simd_scalar_word simd_scalar_rol(simd_scalar_word l, unsigned n) {
+    for (unsigned i = 0; i < SIMD_VECSIZE; ++i) {
+        l.w[i] = (l.w[i] << n) | (l.w[i] >> (32 - n));
+    }
+    return l;
+}
+static inline simd_scalar_word simd_scalar_sel(simd_scalar_word m, simd_scalar_word l, simd_scalar_word r) {
+    for (unsigned i = 0; i < SIMD_VECSIZE; ++i) {
+        l.w[i] = (m.w[i] & l.w[i]) | (~m.w[i] & r.w[i]);
+    }
+    return l;
+}
+
+#define SIMD_WORD simd_scalar_word
+
+#define SIMD_ZERO simd_scalar_wtov(0)
+#define SIMD_WTOV(l) simd_scalar_wtov(l)
+#define SIMD_ADD_VV(l, r) simd_scalar_add(l, r)
+#define SIMD_ADD_VW(l, r) simd_scalar_add(l, simd_scalar_wtov(r))
+#define SIMD_SUB_VV(l, r) simd_scalar_sub(l, r)
+#define SIMD_SUB_VW(l, r) simd_scalar_sub(l, simd_scalar_wtov(r))
+#define SIMD_AND_VV(l, r) simd_scalar_and(l, r)
+#define SIMD_AND_VW(l, r) simd_scalar_and(l, simd_scalar_wtov(r))
+#define SIMD_ANDNOT_VV(l, r) simd_scalar_andnot(l, r)
+#define SIMD_ANDNOT_VW(l, r) simd_scalar_andnot(l, simd_scalar_wtov(r))
+#define SIMD_ANDNOT_WV(l, r) simd_scalar_andnot(simd_scalar_wtov(l), r)
+#define SIMD_OR_VV(l, r) simd_scalar_or(l, r)
+#define SIMD_OR_VW(l, r) simd_scalar_or(l, simd_scalar_wtov(r))
+#define SIMD_XOR_VV(l, r) simd_scalar_xor(l, r)
+#define SIMD_XOR_VW(l, r) simd_scalar_xor(l, simd_scalar_wtov(r))
+#define SIMD_NOT_V(l) simd_scalar_not(l)
+#define SIMD_SHL_V(l, i) simd_scalar_shl(l, i)
+#define SIMD_SHR_V(l, i) simd_scalar_shr(l, i)
+#define SIMD_ROL_V(l, i) simd_scalar_rol(l, i)
+#define SIMD_ROR_V(l, i) simd_scalar_rol(l, 32 - i)
+
+#define SIMD_EQ_VV(a, b) simd_scalar_eq(a, b)
+#define SIMD_MIN_VV(a, b) simd_scalar_min(a, b)
+#define SIMD_SEL_VWW(m, a, b) simd_scalar_sel(m, simd_scalar_wtov(a), simd_scalar_wtov(b))
+#define SIMD_SEL_VVV(m, a, b) simd_scalar_sel(m, a, b)
+
+#define SIMD_CLEANUP
+
+#ifndef SIMD_NEG_V
+#define SIMD_NEG_V(l) SIMD_SUB_VV(SIMD_ZERO, l)
+#endif
+
+#endif /* SIMD_SCALAR_HEADER */
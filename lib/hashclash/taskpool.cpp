@@ -0,0 +1,134 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+#include <stdexcept>
+
+#include <boost/thread/locks.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "taskpool.hpp"
+
+namespace hashclash {
+
+task_pool::task_pool(uint64 items, unsigned workers, uint64 grain)
+    : outstanding(0), idle(0), grain(grain == 0 ? 1 : grain) {
+    if (workers == 0) {
+        throw std::runtime_error("task_pool(): no workers");
+    }
+    queues.reserve(workers);
+    for (unsigned w = 0; w < workers; ++w) {
+        queues.emplace_back(new task_queue);
+        const uint64 begin = items * w / workers, end = items * (w + 1) / workers;
+        if (begin < end) {
+            queues[w]->tasks.emplace_back(begin, end);
+            ++outstanding;
+        }
+    }
+}
+
+void task_pool::done(unsigned w) {
+    task_queue &q = *queues[w];
+    if (q.running) {
+        q.running = false;
+        --outstanding;
+    }
+}
+
+void task_pool::split(unsigned w, const task_range &task) {
+    task_queue &q = *queues[w];
+    ++outstanding;
+    boost::lock_guard<boost::mutex> lock(q.mut);
+    q.tasks.push_back(task);
+}
+
+// take from the back of the own queue, at most grain items at once
+bool task_pool::take(task_queue &q, task_range &task) {
+    boost::lock_guard<boost::mutex> lock(q.mut);
+    if (q.tasks.empty()) {
+        return false;
+    }
+    task_range &back = q.tasks.back();
+    if (back.whole() && back.end - back.begin > grain) {
+        task = task_range(back.begin, back.begin + grain);
+        back.begin += grain;
+        ++outstanding;
+    } else {
+        task = back;
+        q.tasks.pop_back();
+    }
+    return true;
+}
+
+// steal from the front of another queue, half of a range of items at once (next() puts it on the own queue)
+bool task_pool::steal(task_queue &q, task_range &task) {
+    boost::lock_guard<boost::mutex> lock(q.mut);
+    if (q.tasks.empty()) {
+        return false;
+    }
+    task_range &front = q.tasks.front();
+    if (front.whole() && front.end - front.begin > grain) {
+        const uint64 half = (front.end - front.begin) / 2;
+        task = task_range(front.end - half, front.end);
+        front.end -= half;
+        ++outstanding;
+    } else {
+        task = front;
+        q.tasks.pop_front();
+    }
+    return true;
+}
+
+bool task_pool::next(unsigned w, task_range &task) {
+    done(w);
+    task_queue &q = *queues[w];
+    if (take(q, task)) {
+        q.running = true;
+        return true;
+    }
+    ++idle;
+    const unsigned n = workers();
+    while (true) {
+        for (unsigned i = 1; i < n; ++i) {
+            if (steal(*queues[(w + i) % n], task)) {
+                // a stolen range goes on the own queue, so that it is taken in grains and can be stolen again
+                if (task.whole() && task.end - task.begin > grain) {
+                    {
+                        boost::lock_guard<boost::mutex> lock(q.mut);
+                        q.tasks.push_back(task);
+                    }
+                    if (!take(q, task)) {
+                        // it was stolen from us in the meantime
+                        continue;
+                    }
+                }
+                --idle;
+                q.running = true;
+                return true;
+            }
+        }
+        // other workers may still split off subtasks of their running tasks
+        if (outstanding.load() == 0) {
+            --idle;
+            return false;
+        }
+        boost::this_thread::yield();
+    }
+}
+
+} // namespace hashclash
@@ -0,0 +1,111 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+/*
+
+Work-stealing pool for processing items 0,...,n-1 with a fixed number of worker threads.
+
+Each worker starts with its own contiguous range of items in its own task queue.
+A worker takes pieces of at most 'grain' items from its own queue,
+when its queue is empty it steals half of the first range in the queue of another worker
+and puts it on its own queue, so it is also processed in pieces of at most 'grain' items and can be stolen again.
+A worker can split off part of the work on a single item as a subtask (e.g. part of the SDR loop of a heavy path)
+when other workers are idle (hungry()), subtasks are pushed on its own queue and can be stolen.
+The meaning of the sub range [subbegin,subend) of a subtask is up to the user,
+subparam carries any state the sub range depends on (e.g. the SDR weight the sub range indexes into)
+that the worker running the subtask could otherwise compute differently.
+
+Typical use by worker w:
+    task_range task;
+    while (pool.next(w, task)) {
+        if (task.whole()) { process items task.begin,...,task.end-1 }
+        else { process part [task.subbegin,task.subend) of item task.begin }
+    }
+
+*/
+
+#ifndef HASHCLASH_TASKPOOL_HPP
+#define HASHCLASH_TASKPOOL_HPP
+
+#include <vector>
+#include <deque>
+#include <memory>
+
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "types.hpp"
+
+namespace hashclash {
+
+struct task_range {
+    task_range()
+        : begin(0), end(0), subbegin(0), subend(~uint32(0)), subparam(0) {}
+    task_range(uint64 b, uint64 e, uint32 sb = 0, uint32 se = ~uint32(0), uint32 sp = 0)
+        : begin(b), end(e), subbegin(sb), subend(se), subparam(sp) {}
+
+    // true if this task is all of items begin,...,end-1, otherwise it is part of item begin
+    bool whole() const { return subbegin == 0 && subend == ~uint32(0); }
+
+    uint64 begin, end;
+    uint32 subbegin, subend, subparam;
+};
+
+class task_pool {
+  public:
+    task_pool(uint64 items, unsigned workers, uint64 grain = 16);
+
+    // finish the current task of worker w and get its next task
+    // returns false when all work is done
+    bool next(unsigned w, task_range &task);
+
+    // finish the current task of worker w without getting a new one, e.g. after an exception
+    void done(unsigned w);
+
+    // add a subtask split off by worker w from its current task
+    void split(unsigned w, const task_range &task);
+
+    // true if there are idle workers looking for work to steal
+    bool hungry() const { return idle.load(boost::memory_order_relaxed) != 0; }
+
+    unsigned workers() const { return unsigned(queues.size()); }
+
+  private:
+    struct task_queue {
+        task_queue()
+            : running(false) {}
+        boost::mutex mut;
+        std::deque<task_range> tasks;
+        // only accessed by the owner
+        bool running;
+    };
+
+    bool take(task_queue &q, task_range &task);
+    bool steal(task_queue &q, task_range &task);
+
+    std::vector<std::unique_ptr<task_queue>> queues;
+    // number of tasks queued or running
+    boost::atomic<uint64> outstanding;
+    boost::atomic<unsigned> idle;
+    const uint64 grain;
+};
+
+} // namespace hashclash
+
+#endif // HASHCLASH_TASKPOOL_HPP
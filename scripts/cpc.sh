@@ -7,6 +7,11 @@ export HELPER=$BINDIR/md5_diffpathhelper
 export FORWARD=$BINDIR/md5_diffpathforward
 export BACKWARD=$BINDIR/md5_diffpathbackward
 export CONNECT=$BINDIR/md5_diffpathconnect
+# Backward path searches are cached here and reused by later runs, set to empty to disable
+export BACKWARDCACHE=${BACKWARDCACHE-${XDG_CACHE_HOME:-$HOME/.cache}/hashclash/md5backward}
+# Set BIRTHDAYDISK to a directory on a fast disk to store birthday search trails there (BIRTHDAYMAXDISK GB, default 100)
+export BIRTHDAYDISKOPTS=${BIRTHDAYDISK:+--diskstorage $BIRTHDAYDISK --maxdisk ${BIRTHDAYMAXDISK:-100}}
+# The birthday search uses 7 instead of 9 near-collision blocks if it is predicted to take at most BIRTHDAYMAXHOURS (default 3)
 export CPUS=$(grep -c "^processor" /proc/cpuinfo || echo 0)
 if [[ -n "$MAXCPUS" ]]; then
 	if (( !CPUS || CPUS > MAXCPUS )); then
@@ -40,16 +45,28 @@ else
 	exit 1
 fi
 
+function calibrate {
+	# a stale file from an earlier run must not be mistaken for this calibration
+	rm -f data/birthdaycalibration.txt
+	$BIRTHDAYSEARCH --inputfile1 "$file1" --inputfile2 "$file2" --pathtyperange 2 --maxblocks $1 --maxmemory $2 $BIRTHDAYDISKOPTS --threads "$CPUS" --cuda_enable --calibrate data/birthdaycalibration.txt | grep "^Predicted"
+	if [[ ! -s data/birthdaycalibration.txt ]]; then
+		echo "Calibration with $1 blocks failed: data/birthdaycalibration.txt not written"
+		exit 1
+	fi
+}
+
 if [[ -z "$3" ]]; then
-	# check for CUDA / AVX256 threads
-	echo -n "Detecting worklevel..."
-	worklevel=$($BIRTHDAYSEARCH --inputfile1 "$file1" --inputfile2 "$file2" --hybridbits 0 --pathtyperange 2 --maxblocks 9 --maxmemory 100 --threads "$CPUS" --cuda_enable |& grep "^Work" -m1 | head -n1 | cut -d'(' -f2 | cut -d'.' -f1)
-	echo ": $worklevel"
-	if (( worklevel >= 31 )); then
-		$BIRTHDAYSEARCH --inputfile1 "$file1" --inputfile2 "$file2" --hybridbits 0 --pathtyperange 2 --maxblocks 7 --maxmemory 4000 --threads "$CPUS" --cuda_enable
+	# measure CUDA / SIMD speed: use 7 near-collision blocks if that is predicted to take at most BIRTHDAYMAXHOURS
+	echo "Calibrating..."
+	calibrate 7 4000
+	predicted=$(head -n1 data/birthdaycalibration.txt | cut -d':' -f2)
+	if (( predicted > 0 && predicted <= ${BIRTHDAYMAXHOURS:-3} * 3600 )); then
+		maxblocks=7
 	else
-		$BIRTHDAYSEARCH --inputfile1 "$file1" --inputfile2 "$file2" --hybridbits 0 --pathtyperange 2 --maxblocks 9 --maxmemory 100 --threads "$CPUS" --cuda_enable
+		maxblocks=9
+		calibrate 9 100
 	fi
+	$BIRTHDAYSEARCH --inputfile1 "$file1" --inputfile2 "$file2" --pathtyperange 2 --maxblocks $maxblocks $(tail -n1 data/birthdaycalibration.txt) $BIRTHDAYDISKOPTS --threads "$CPUS" --cuda_enable
 	notify "Birthday search completed."
 
 	PREFIX1=file1.bin
@@ -76,10 +93,10 @@ function doforward {
 }
 
 function dobackward {
-	$BACKWARD -w "$1" -f "$1"/upperpath.bin.gz -t 36 --trange 6 -a 65536 -q 128 --threads "$CPUS" || return 1
-	$BACKWARD -w "$1" -t 29 -a 100000 --trange 8 --threads "$CPUS" || return 1
-	$BACKWARD -w "$1" -t 20 -a 16384 --threads "$CPUS" || return 1
-	$BACKWARD -w "$1" -t 19 -a 500000 --trange $((18-TTT-3)) --threads "$CPUS" || return 1
+	$BACKWARD -w "$1" ${BACKWARDCACHE:+--cachedir "$BACKWARDCACHE"} -f "$1"/upperpath.bin.gz -t 36 --trange 6 -a 65536 -q 128 --threads "$CPUS" || return 1
+	$BACKWARD -w "$1" ${BACKWARDCACHE:+--cachedir "$BACKWARDCACHE"} -t 29 -a 100000 --trange 8 --threads "$CPUS" || return 1
+	$BACKWARD -w "$1" ${BACKWARDCACHE:+--cachedir "$BACKWARDCACHE"} -t 20 -a 16384 --threads "$CPUS" || return 1
+	$BACKWARD -w "$1" ${BACKWARDCACHE:+--cachedir "$BACKWARDCACHE"} -t 19 -a 500000 --trange $((18-TTT-3)) --threads "$CPUS" || return 1
 }
 
 function testcoll {
@@ -91,19 +108,8 @@ function testcoll {
 
 function doconnect {
 	mkdir "$1"/connect
-	$CONNECT -w "$1"/connect -t $TTT --inputfilelow "$1"/paths$((TTT-1))_0of1.bin.gz --inputfilehigh "$1"/paths$((TTT+4))_0of1.bin.gz --threads "$CPUS" &
-	local CPID="$!"
-
-	contime=0
-	while true; do
-		sleep 5
-		ps -p $CPID &>/dev/null || break
-		(( contime = contime + 5*CPUS ))
-		if (( contime > 10000 )); then
-			kill $CPID &>/dev/null
-			break
-		fi
-	done
+	# budget of 10000 CPU seconds
+	$CONNECT -w "$1"/connect -t $TTT --inputfilelow "$1"/paths$((TTT-1))_0of1.bin.gz --inputfilehigh "$1"/paths$((TTT+4))_0of1.bin.gz --threads "$CPUS" --timelimit $((10000/CPUS))
 }
 
 function docollfind {
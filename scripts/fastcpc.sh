@@ -7,6 +7,8 @@ MAXBLOCKS=7
 MAXMEMORY=8000
 UPPERPATHCOUNT=1000000
 TTT=12
+# Backward path searches are cached here and reused by later runs, set to empty to disable
+BACKWARDCACHE=${BACKWARDCACHE-${XDG_CACHE_HOME:-$HOME/.cache}/hashclash/md5backward}
 
 # Block timeout: Once a near-collision block lasts more than this number of second
 #                the whole attack is aborted
@@ -27,6 +29,11 @@ VERBOSE_LOG=2
 
 BIRTHDAY_CONTROLLER_NODES=1
 BIRTHDAY_GENERATOR_NODES=0
+# exchange trails over TCP instead of through birthday_workdir: host:port of each controller node, e.g.
+# BIRTHDAY_EXCHANGE=node0:45600,node1:45600
+BIRTHDAY_EXCHANGE=
+# key all birthday search processes have to present to the exchange
+BIRTHDAY_EXCHANGEKEY=
 
 BIRTHDAY_LOCAL_CONFIG=(--cuda_enable --saveloadwait 1)
 BIRTHDAY_GLOBAL_CONFIG=(--pathtyperange $PATHTYPERANGE --hybridbits $HYBRIDBITS --maxblocks $MAXBLOCKS --maxmemory $MAXMEMORY)
@@ -71,6 +78,7 @@ function precompute
 			echo "diffm11 = $1" >> $f
 			echo "workdir = $PRECOMPDIR" >> $f
 		done
+		[[ -n "$BACKWARDCACHE" ]] && echo "cachedir = $BACKWARDCACHE" >> md5diffpathbackward.cfg
 		[[ ! -f "$PRECOMPDIR/paths30_0of1.bin.gz" ]] && ( "$HASHCLASHBIN/md5_diffpathbackward" -n -t 34 --trange 4 -a 65536 -q 128 > "$PRECOMPDIR/backward.log" 2>&1 )
 		if [[ ! -f "$PRECOMPDIR/paths21_0of1.bin.gz" ]]; then
 			for ((x=40; ; ++x)); do
@@ -113,6 +121,12 @@ function allprecompute
 	precompute $diff false
 }
 
+# find a collision in the background using the best paths streamed by connect in workdir $1
+function startcollfind
+{
+	"$HASHCLASHBIN/md5_diffpathhelper" -w "$1" --pathstream "$1/bestpaths.stream" --inputfile2 "$1/upperpath.bin.gz" --findcollision --threads $HALFTHREADS >> "$1/collfind.log" 2>&1 &
+}
+
 function asyncstartprocessonhost
 {
 	nodeidx=$1
@@ -147,11 +161,11 @@ function asyncstartbirthdaysearch
 
 	# example single process on a single machine (uses all CUDA devices and all threads)
 	for (( i=0 ; i < BIRTHDAY_CONTROLLER_NODES ; ++i )); do
-		asyncstartprocessonhost $i birthday_workdir/birthday_con_node$i.log "$HASHCLASHBIN/md5_birthdaysearch" -w birthday_workdir -i $i -m $BIRTHDAY_CONTROLLER_NODES "${BIRTHDAY_LOCAL_CONFIG[@]}" "${BIRTHDAY_GLOBAL_CONFIG[@]}" "$@"
+		asyncstartprocessonhost $i birthday_workdir/birthday_con_node$i.log "$HASHCLASHBIN/md5_birthdaysearch" -w birthday_workdir -i $i -m $BIRTHDAY_CONTROLLER_NODES ${BIRTHDAY_EXCHANGE:+--exchange "$BIRTHDAY_EXCHANGE"} ${BIRTHDAY_EXCHANGEKEY:+--exchangekey "$BIRTHDAY_EXCHANGEKEY"} "${BIRTHDAY_LOCAL_CONFIG[@]}" "${BIRTHDAY_GLOBAL_CONFIG[@]}" "$@"
 	done
 	for (( j=0 ; j < BIRTHDAY_GENERATOR_NODES ; ++j )); do
 		(( i = j + BIRTHDAY_GENERATOR_NODES ))
-		asyncstartprocessonhost $i birthday_workdir/birthday_gen_node$i.log "$HASHCLASHBIN/md5_birthdaysearch" -w birthday_workdir --generatormode -m $BIRTHDAY_CONTROLLER_NODES "${BIRTHDAY_LOCAL_CONFIG[@]}" "${BIRTHDAY_GLOBAL_CONFIG[@]}" "$@"
+		asyncstartprocessonhost $i birthday_workdir/birthday_gen_node$i.log "$HASHCLASHBIN/md5_birthdaysearch" -w birthday_workdir --generatormode -m $BIRTHDAY_CONTROLLER_NODES ${BIRTHDAY_EXCHANGE:+--exchange "$BIRTHDAY_EXCHANGE"} ${BIRTHDAY_EXCHANGEKEY:+--exchangekey "$BIRTHDAY_EXCHANGEKEY"} "${BIRTHDAY_LOCAL_CONFIG[@]}" "${BIRTHDAY_GLOBAL_CONFIG[@]}" "$@"
 	done
 }
 function asyncstopbirthdaysearch
@@ -273,9 +287,9 @@ for (( i=0; ; ++i)); do
 
 	logthis 0 "NC-BLOCK $i" "Starting connect process in background ..."
 	HALFTHREADS=$(($(nproc)/2))
-	logthis 2 "NC-BLOCK $i" "Running command: $HASHCLASHBIN/md5_diffpathconnect --threads $HALFTHREADS -w $workdir -t $TTT --inputfilelow $workdir/paths$((TTT-1))_0of1.bin.gz.done --inputfilehigh $UPPERPATH > $workdir/connect.log &"
+	logthis 2 "NC-BLOCK $i" "Running command: $HASHCLASHBIN/md5_diffpathconnect --threads $HALFTHREADS -w $workdir -t $TTT --inputfilelow $workdir/paths$((TTT-1))_0of1.bin.gz.done --inputfilehigh $UPPERPATH --beststream $workdir/bestpaths.stream > $workdir/connect.log &"
 	INPUTFILELOW=$workdir/paths$((TTT-1))_0of1.bin.gz
-	"$HASHCLASHBIN/md5_diffpathconnect" --threads $HALFTHREADS -w "$workdir" -t $TTT --inputfilelow "$INPUTFILELOW.done" --inputfilehigh "$UPPERPATH" > "$workdir/connect.log" 2>&1 &
+	"$HASHCLASHBIN/md5_diffpathconnect" --threads $HALFTHREADS -w "$workdir" -t $TTT --inputfilelow "$INPUTFILELOW.done" --inputfilehigh "$UPPERPATH" --beststream "$workdir/bestpaths.stream" > "$workdir/connect.log" 2>&1 &
 
 	logthis 0 "NC-BLOCK $i" "Forward phase ..."
 	logthis 2 "NC-BLOCK $i" "Running command: $HASHCLASHBIN/md5_diffpathforward -w $workdir -f $workdir/lowerpath.bin.gz --normalt01 -t 1 --trange $((TTT-2)) > $workdir/forward.log"
@@ -299,11 +313,10 @@ for (( i=0; ; ++i)); do
 	done
 
 	PATHQUALITY=$(cat "$workdir/connect.log" | grep "tottunnel" | tail -n1 | grep -o "tottunnel=[0-9]*, totcond=[0-9]*")
-	cp "$workdir/bestpaths.bin.gz" "$workdir/latest_bestpaths.bin.gz"
 	logthis 0 "NC-BLOCK $i" "Starting collision finding: $PATHQUALITY"
-	"$HASHCLASHBIN/md5_diffpathhelper" -w "$workdir" --combinepaths --outputfile1 "$workdir/collfindpaths.bin.gz" --inputfile1 "$workdir/latest_bestpaths.bin.gz" --inputfile2 "$workdir/upperpath.bin.gz" >> "$workdir/collfindpath.log" 2>&1
-	"$HASHCLASHBIN/md5_diffpathhelper" -w "$workdir" --inputfile1 "$workdir/collfindpaths.bin.gz" --findcollision --threads $HALFTHREADS >> "$workdir/collfind.log" 2>&1 &
-	lastw=0
+	# collision finding follows the best paths streamed by connect and switches to better paths as they are found,
+	# including those connect also saves as bestpaths_t*, so it is never restarted
+	startcollfind "$workdir"
 	for (( ; ; ++w )); do
 		sleep 1
 		if (( w > BLOCK_TIMEOUT )); then
@@ -318,23 +331,6 @@ for (( i=0; ; ++i)); do
 			killall md5_diffpathhelper
 			break
 		fi
-		if (( w - lastw >= 10 )); then
-		if [[ "$workdir/bestpaths.bin.gz" -nt "$workdir/latest_bestpaths.bin.gz" ]]; then
-			lastw=$w
-			PATHQUALITY=$(cat "$workdir/connect.log" | grep "tottunnel" | tail -n1 | grep -o "tottunnel=[0-9]*, totcond=[0-9]*")
-			cp "$workdir/bestpaths.bin.gz" "$workdir/latest_bestpaths.bin.gz"
-			JOIN="-j '$workdir/latest_bestpaths.bin.gz'"
-			for f in "$workdir/bestpaths_t3"[789]* "$workdir/bestpaths_t"[456]* ; do
-				if [[ -f "$f" ]]; then
-					JOIN="$JOIN -j '$f'"
-				fi
-			done
-			"$HASHCLASHBIN/md5_diffpathhelper" -w "$workdir" --outputfile1 "$workdir/joint_bestpaths.bin.gz" "$JOIN" >> "$workdir/join.log" 2>&1
-			"$HASHCLASHBIN/md5_diffpathhelper" -w "$workdir" --combinepaths --outputfile1 $workdir/collfindpaths.bin.gz --inputfile1 "$workdir/joint_bestpaths.bin.gz" --inputfile2 $workdir/upperpath.bin.gz >> "$workdir/collfindpath.log" 2>&1
-			killall md5_diffpathhelper
-			logthis 0 "NC-BLOCK $i" "Starting collision finding: $PATHQUALITY"
-			"$HASHCLASHBIN/md5_diffpathhelper" -w "$workdir" --inputfile1 "$workdir/collfindpaths.bin.gz" --findcollision --threads $HALFTHREADS >> "$workdir/collfind.log" 2>&1 &
-		fi fi
 	done
 
 	TIMELAPSED=$(($(date +%s) - TIMESTART))
@@ -53,7 +53,7 @@ void md5_backward_thread::md5_backward_differential_step(const differentialpath
         F = &MD5_I_data;
     }
 
-    newpath = path;
+    newpath.assign(path);
     newpath[int(t) - 3].clear();
     newpath[t + 1];
 
@@ -94,7 +94,12 @@ void md5_backward_thread::md5_backward_differential_step(const differentialpath
         }
     }
 
-    for (unsigned pr = 0; pr < rotateddiff.size(); ++pr) {
+    unsigned prbegin = 0, prend = unsigned(rotateddiff.size());
+    if (!task.whole()) {
+        prbegin = task.subbegin >> 24;
+        prend = std::min(prend, prbegin + 1);
+    }
+    for (unsigned pr = prbegin; pr < prend; ++pr) {
         if (rotateddiff[pr].second < bestprob * 0.75) {
             continue;
         }
@@ -111,11 +116,25 @@ void md5_backward_thread::md5_backward_differential_step(const differentialpath
                (count_sdrs(Qtm2diff, w + 1) - mincount <= maxsdrs)) {
             ++w;
         }
+        // maxcond can decrease meanwhile, a subtask uses the weight of the sdr list its range was taken from
+        if (!task.whole()) {
+            w = task.subparam;
+        }
         table_sdrs(sdrs, Qtm2diff, w);
 
-        vector<sdr>::const_iterator cit = sdrs.begin(), citend = sdrs.end();
-        for (; cit != citend; ++cit) {
-            sdr sdrQtm2 = *cit;
+        size_t sdrbegin = 0, sdrend = sdrs.size();
+        if (!task.whole()) {
+            sdrbegin = std::min<size_t>(task.subbegin & 0xFFFFFF, sdrend);
+            sdrend = std::min<size_t>(task.subend & 0xFFFFFF, sdrend);
+        }
+        for (size_t si = sdrbegin; si < sdrend; ++si) {
+            // hand over the second half of the remaining sdrs to idle threads
+            if (pool != nullptr && sdrend - si >= 2 && sdrend <= 0xFFFFFF && pool->hungry()) {
+                const size_t mid = si + (sdrend - si) / 2;
+                pool->split(poolworker, task_range(task.begin, task.begin + 1, (pr << 24) | uint32(mid), (pr << 24) | uint32(sdrend), w));
+                sdrend = mid;
+            }
+            sdr sdrQtm2 = sdrs[si];
             unsigned hwQtm2 = sdrQtm2.hw();
             if (hwQtm2 < minweight) {
                 continue;
@@ -134,7 +153,6 @@ void md5_backward_thread::md5_backward_differential_step(const differentialpath
                 foutcomes[b] = F->outcome(Qtb[b], Qtm1b[b], Qtm2b[b]);
                 unsigned fsize = foutcomes[b].size();
                 if (fsize > 1) {
-                    fdiv[b] = cnt;
                     if (fsize == 2) {
                         cnt <<= 1;
                     } else if (fsize == 3) {
@@ -158,24 +176,10 @@ void md5_backward_thread::md5_backward_differential_step(const differentialpath
             newpathQtm1 = path[int(t) - 1];
 
             std::reverse(bval.begin(), bval.end());
-            for (uint32 k = 0; k < cnt; ++k) {
-                uint32 m = k;
-                uint32 dF = dF_fixed;
-                for (unsigned j = 0; j < bval.size(); ++j) {
-                    const unsigned b = bval[j];
-                    unsigned i = 0;
-                    while (m >= fdiv[b]) {
-                        m -= fdiv[b];
-                        ++i;
-                    }
-                    const bf_conditions &newconditions = F->backwardconditions(Qtb[b], Qtm1b[b], Qtm2b[b], foutcomes[b][i]);
-                    newpathQt.set(b, newconditions.first);
-                    newpathQtm1.set(b, newconditions.second);
-                    newpathQtm2.set(b, newconditions.third);
-                    dF += foutcomes[b](i, b);
-                }
+            expansion.prepare(*F, Qtb, Qtm1b, Qtm2b, foutcomes, bval, true);
+            const unsigned basecost = totprecond + expansion.fixedcost(newpathQt, newpathQtm1, newpathQtm2);
+            expansion.enumerate(newpathQt, newpathQtm1, newpathQtm2, dF_fixed, basecost, maxcond, [&](uint32 dF, unsigned ncond) {
                 newpathQtm3 = naf(dT2 - dF);
-                unsigned ncond = totprecond + newpathQt.hw() + newpathQtm1.hw() + newpathQtm2.hw();
                 if (outpaths.includenaf) {
                     if (outpaths.halfnafweight) {
                         ncond += (newpathQtm3.hw() >> 1);
@@ -186,7 +190,7 @@ void md5_backward_thread::md5_backward_differential_step(const differentialpath
                 if (ncond <= maxcond) {
                     outpaths.push_back(newpath, ncond);
                 }
-            } // for cnt
+            });
         } // for sdrs
     } // for rotateddiff
 }
@@ -30,6 +30,7 @@
 #include <boost/lexical_cast.hpp>
 
 #include <hashclash/saveload_gz.hpp>
+#include <hashclash/pathfile.hpp>
 #include <hashclash/md5detail.hpp>
 #include <hashclash/rng.hpp>
 #include <hashclash/differentialpath.hpp>
@@ -42,13 +43,15 @@ using namespace hashclash;
 using namespace std;
 
 void random_permutation(vector<differentialpath> &paths) {
-    // use a pseudo-random permutation fixed by the number of paths
-    seed(paths.size());
-    for (unsigned i = 0; i < paths.size(); ++i) {
-        unsigned k = xrng64() % paths.size();
-        paths[i].swap(paths[k]);
+    // the pseudo-random permutation fixed by the number of paths that load_paths_part() also uses,
+    // the same swap shuffle as earlier versions, so paths keep their order and modi/modn part
+    vector<uint64> perm;
+    path_permutation(perm, paths.size());
+    vector<differentialpath> permuted(paths.size());
+    for (size_t i = 0; i < perm.size(); ++i) {
+        permuted[i].swap(paths[size_t(perm[i])]);
     }
-    addseed(time(NULL));
+    paths.swap(permuted);
 }
 
 inline std::string pathsstring(const std::string &basepath, unsigned modi, unsigned modn) {
@@ -56,44 +59,51 @@ inline std::string pathsstring(const std::string &basepath, unsigned modi, unsig
 }
 
 progress_display *dostep_progress = 0;
-volatile unsigned dostep_index = 0;
+task_pool *dostep_pool = 0;
 struct dostep_thread {
-    dostep_thread(vector<differentialpath> &in, path_container_autobalance &out)
-        : pathsin(in), container(out) {}
+    dostep_thread(vector<differentialpath> &in, path_container_autobalance &out, unsigned index)
+        : pathsin(in), container(out), threadindex(index) {}
     vector<differentialpath> &pathsin;
     path_container_autobalance &container;
+    unsigned threadindex;
     md5_backward_thread worker;
     void operator()() {
         try {
-            while (true) {
-                mut.lock();
-
-                unsigned i = dostep_index;
-                if (i >= pathsin.size()) {
-                    mut.unlock();
-                    break;
+            seed_thread(threadindex);
+            worker.pool = dostep_pool;
+            worker.poolworker = threadindex;
+            unsigned progress = 0;
+            while (dostep_pool->next(threadindex, worker.task)) {
+                if (!worker.task.whole()) {
+                    worker.md5_backward_differential_step(pathsin[worker.task.begin], container);
+                    continue;
                 }
-                unsigned cnt = std::max<unsigned>(1, std::min<unsigned>(16, (pathsin.size() - i) / 128));
-                unsigned iend = i + cnt;
-
-                if (cnt != 0) {
-                    (*dostep_progress) += cnt;
-                }
-                dostep_index = iend;
-                mut.unlock();
-
-                for (; i < iend; ++i) {
+                const task_range task = worker.task;
+                for (uint64 i = task.begin; i < task.end; ++i) {
+                    worker.task = task_range(i, i + 1);
                     worker.md5_backward_differential_step(pathsin[i], container);
                 }
+                progress += unsigned(task.end - task.begin);
+                if (mut.try_lock()) {
+                    (*dostep_progress) += progress;
+                    mut.unlock();
+                    progress = 0;
+                }
+            }
+            if (progress != 0) {
+                boost::lock_guard<boost::mutex> lock(mut);
+                (*dostep_progress) += progress;
             }
+            container.push_back_flush_main();
         } catch (std::exception &e) {
+            dostep_pool->done(threadindex);
             cerr << "Worker thread: caught exception:" << endl << e.what() << endl;
         } catch (...) {
+            dostep_pool->done(threadindex);
         }
     }
 };
 void dostep_threaded(vector<differentialpath> &in, path_container_autobalance &out) {
-    dostep_index = 0;
     std::string tstring = "t=" + boost::lexical_cast<std::string>(out.t) + ": ";
     if (tstring.size() == 5) {
         tstring += " ";
@@ -103,31 +113,37 @@ void dostep_threaded(vector<differentialpath> &in, path_container_autobalance &o
     } else {
         dostep_progress = new progress_display(in.size(), true, cout, tstring, "      ", "      ");
     }
+    task_pool pool(in.size(), out.threads, std::max<uint64>(1, std::min<uint64>(16, in.size() / (128 * out.threads))));
+    dostep_pool = &pool;
+    // the estimate is done directly on out, otherwise each thread uses a helper container with its own shard
+    vector<path_container_autobalance> helpcontainers;
+    if (out.estimatefactor == 0) {
+        out.begin_shards();
+        helpcontainers.resize(out.threads, out);
+        for (auto &helper : helpcontainers) {
+            helper.main_container = &out;
+            helper.shard = out.shards->new_shard();
+        }
+    }
     boost::thread_group mythreads;
     for (unsigned i = 0; i < out.threads; ++i) {
-        mythreads.create_thread(dostep_thread(in, out));
+        mythreads.create_thread(dostep_thread(in, helpcontainers.empty() ? out : helpcontainers[i], i));
     }
     mythreads.join_all();
+    dostep_pool = 0;
     if (dostep_progress->expected_count() != dostep_progress->count()) {
         *dostep_progress += dostep_progress->expected_count() - dostep_progress->count();
     }
     delete dostep_progress;
 }
 
-vector<differentialpath> pathscache;
-void dostep(path_container_autobalance &container, bool savetocache) {
+void load_inputpaths(path_container_autobalance &container, vector<differentialpath> &pathsin) {
     const unsigned t = container.t;
     const unsigned modn = container.modn;
     const unsigned modi = container.modi;
 
-    cout << endl;
-    cout << "==================== Step " << t << " ====================" << endl;
-
-    vector<differentialpath> pathsin, pathstmp, pathsout;
-    if (pathscache.size() != 0) {
-        pathsin.swap(pathscache);
-        random_permutation(pathsin);
-    } else if (container.newinputpath) {
+    vector<differentialpath> pathstmp;
+    if (container.newinputpath) {
         differentialpath path;
         path.offset = -int(t) + 3;
         path.path.resize(4);
@@ -136,15 +152,11 @@ void dostep(path_container_autobalance &container, bool savetocache) {
     } else if (container.inputfile.size() == 0) {
         for (unsigned k = 0; k < modn; ++k) {
             try {
-                std::string filename = pathsstring("paths" + boost::lexical_cast<std::string>(t + 1), k, modn);
+                std::string filename = paths_filename(pathsstring("paths" + boost::lexical_cast<std::string>(t + 1), k, modn));
                 hashclash::timer loadtime(true);
                 cout << "Loading " << filename << "..." << flush;
-                load_gz(pathstmp, filename, binary_archive);
-                random_permutation(pathstmp);
-                for (unsigned j = modi; j < pathstmp.size(); j += modn) {
-                    pathsin.push_back(pathstmp[j]);
-                }
-                cout << "done: " << pathstmp.size() << " (work:" << pathsin.size() << "). (" << loadtime.time() << "s)" << endl;
+                uint64 total = load_paths_part(pathsin, filename, modi, modn);
+                cout << "done: " << total << " (work:" << pathsin.size() << "). (" << loadtime.time() << "s)" << endl;
             } catch (...) {
                 cout << "failed." << endl;
             }
@@ -154,11 +166,7 @@ void dostep(path_container_autobalance &container, bool savetocache) {
         try {
             hashclash::timer loadtime(true);
             cout << "Loading " << container.inputfile << "..." << flush;
-            load_gz(pathstmp, binary_archive, container.inputfile);
-            random_permutation(pathstmp);
-            for (unsigned j = modi; j < pathstmp.size(); j += modn) {
-                pathsin.push_back(pathstmp[j]);
-            }
+            load_paths_part(pathsin, container.inputfile, modi, modn);
             cout << "done: " << pathsin.size() << ". (" << loadtime.time() << "s)" << endl;
         } catch (...) {
             failed = true;
@@ -179,6 +187,27 @@ void dostep(path_container_autobalance &container, bool savetocache) {
             }
         }
     }
+}
+
+vector<differentialpath> pathscache;
+void dostep(path_container_autobalance &container, bool savetocache, vector<differentialpath> *inputpaths) {
+    const unsigned t = container.t;
+    const unsigned modn = container.modn;
+    const unsigned modi = container.modi;
+
+    cout << endl;
+    cout << "==================== Step " << t << " ====================" << endl;
+
+    vector<differentialpath> pathsin, pathstmp, pathsout;
+    if (inputpaths != 0 && inputpaths->size() != 0) {
+        // loaded and permuted by load_inputpaths already
+        pathsin.swap(*inputpaths);
+    } else if (pathscache.size() != 0) {
+        pathsin.swap(pathscache);
+        random_permutation(pathsin);
+    } else {
+        load_inputpaths(container, pathsin);
+    }
     if (container.showinputpaths) {
         for (unsigned r = 0; r < pathsin.size(); ++r) {
             show_path(pathsin[r], container.m_diff);
@@ -234,7 +263,7 @@ void dostep(path_container_autobalance &container, bool savetocache) {
     if (savetocache) {
         pathsout.swap(pathscache);
     } else {
-        save_gz(pathsout, filenameout, binary_archive);
+        save_paths(pathsout, filenameout, container.pathfile);
     }
     cout << "done. (" << savetime.time() << "s)" << endl;
 }
@@ -29,6 +29,8 @@
 #include <hashclash/sdr.hpp>
 #include <hashclash/timer.hpp>
 #include <hashclash/booleanfunction.hpp>
+#include <hashclash/rng.hpp>
+#include <hashclash/pathcache.hpp>
 
 #include "main.hpp"
 
@@ -50,6 +52,7 @@ int main(int argc, char **argv) {
 
     try {
         path_container_autobalance container;
+        uint32 rngseed = 0;
         vector<vector<int>> msgdiff(16);
 
         // Define program options
@@ -76,11 +79,20 @@ int main(int argc, char **argv) {
 
 			("inputfile,f"
 				, po::value<string>(&container.inputfile)->default_value("")
-				, "Use specified inputfile.")
+				, "Use specified inputfile (.bin.gz or .paths).")
+
+			("cachedir"
+				, po::value<string>(&container.cachedir)->default_value("")
+				, "Reuse and store results in path cache directory.")
 
 			("showinputpaths,s"
 				, po::bool_switch(&container.showinputpaths)
-				, "Show all input paths.\n")
+				, "Show all input paths.")
+
+			("pathfile"
+				, po::bool_switch(&container.pathfile)
+				, "Save output paths as indexed path files (.paths) instead of .bin.gz,\n"
+				  "the next step then only decodes its own part of them.\n")
 
 			("tstep,t"
 				, po::value<unsigned>(&container.t)
@@ -144,6 +156,13 @@ int main(int argc, char **argv) {
 			("threads"
 				, po::value<int>(&container.threads)->default_value(-1)
 				, "Number of worker threads")
+			("seed"
+				, po::value<uint32>(&rngseed)
+				, "Seed for the random generators of all threads. Default is random.\n"
+				  "  Runs with the same seed and --threads 1 are reproducible.\n"
+				  "  Worker i always draws the same stream, but threads\n"
+				  "  take work as they become idle, so with more threads\n"
+				  "  the outcome also depends on the thread scheduling.")
 
 			("uct"
 				, po::value<int>(&container.uct)->default_value(-4)
@@ -221,16 +240,41 @@ int main(int argc, char **argv) {
         if (container.threads <= 0 || container.threads > boost::thread::hardware_concurrency()) {
             container.threads = boost::thread::hardware_concurrency();
         }
+        if (vm.count("seed")) {
+            seed(rngseed);
+        }
 
         // Start job with given parameters
         container.set_parameters();
+        std::unique_ptr<path_cache> cache;
+        std::string cachekey;
+        const fs::path cachefile = workdir + "/paths" + boost::lexical_cast<std::string>(container.t - container.trange) + "_" +
+                                   boost::lexical_cast<std::string>(container.modi) + "of" +
+                                   boost::lexical_cast<std::string>(container.modn) + (container.pathfile ? ".paths" : ".bin.gz");
+        // the input paths are loaded once, for the cache key and for the first step
+        vector<differentialpath> inputpaths;
+        if (!container.cachedir.empty()) {
+            cache.reset(new path_cache(container.cachedir));
+            load_inputpaths(container, inputpaths);
+            cachekey = path_cache::key(inputpaths, container.cache_parameters());
+            if (cache->lookup(cachekey, cachefile)) {
+                cout << "Found result in path cache: " << cache->entry(cachekey).string() << " => " << cachefile.string() << endl;
+                cout << "Runtime: " << runtime.time() << endl;
+                return 0;
+            }
+            cout << "Path cache key: " << cachekey << endl;
+        }
         for (unsigned tt = container.t; tt > container.t - container.trange; --tt) {
             path_container_autobalance containertmp = container;
             containertmp.t = tt;
-            dostep(containertmp, true);
+            dostep(containertmp, true, &inputpaths);
         }
         container.t -= container.trange;
-        dostep(container);
+        dostep(container, false, &inputpaths);
+        if (cache) {
+            cache->store(cachekey, cachefile);
+            cout << "Stored result in path cache: " << cache->entry(cachekey).string() << endl;
+        }
 
     } catch (exception &e) {
         cout << "Runtime: " << runtime.time() << endl;
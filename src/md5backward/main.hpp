@@ -23,12 +23,17 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <memory>
+#include <sstream>
 
 #include <boost/filesystem/operations.hpp>
 #include <boost/thread.hpp>
 
 #include <hashclash/differentialpath.hpp>
 #include <hashclash/booleanfunction.hpp>
+#include <hashclash/bfexpansion.hpp>
+#include <hashclash/pathshards.hpp>
+#include <hashclash/taskpool.hpp>
 
 using namespace hashclash;
 using namespace std;
@@ -36,17 +41,29 @@ using namespace std;
 extern boost::mutex mut;
 extern std::string workdir;
 class path_container_autobalance;
-void dostep(path_container_autobalance &container, bool savetocache = false);
+// inputpaths: if non-empty, the already loaded input paths for this step
+void dostep(path_container_autobalance &container, bool savetocache = false, vector<differentialpath> *inputpaths = 0);
+void load_inputpaths(path_container_autobalance &container, vector<differentialpath> &pathsin);
+extern vector<differentialpath> pathscache;
 
 struct md5_backward_thread {
+    md5_backward_thread()
+        : pool(nullptr), poolworker(0) {}
     void md5_backward_differential_step(const hashclash::differentialpath &path, path_container_autobalance &container);
-    differentialpath newpath;
+    fixeddifferentialpath newpath;
     vector<sdr> sdrs;
     bitcondition Qtb[32], Qtm1b[32], Qtm2b[32];
     vector<unsigned> bval;
-    uint32 fdiv[32];
     bf_outcome foutcomes[32];
+    bf_expansion expansion;
     std::vector<std::pair<uint32, double>> rotateddiff;
+
+    // if pool is set then task is the current task (item) of worker poolworker:
+    // for a split task subbegin and subend are (rotation index << 24) | (sdr index),
+    // only the sdrs [subbegin,subend) of Q_t-2 for that rotation are processed, part of them may be split off again
+    task_pool *pool;
+    unsigned poolworker;
+    task_range task;
 };
 
 class path_container_autobalance {
@@ -55,6 +72,7 @@ class path_container_autobalance {
         : modn(1),
           modi(0),
           inputfile(),
+          cachedir(),
           showinputpaths(false),
           t(0),
           trange(0),
@@ -68,6 +86,7 @@ class path_container_autobalance {
           includenaf(false),
           nafestweight(0),
           halfnafweight(false),
+          pathfile(false),
           newinputpath(false),
           pathsout(0),
           size(0),
@@ -82,7 +101,9 @@ class path_container_autobalance {
           threads(1),
           uct(-4),
           ucb(-1),
-          ucc('.') {
+          ucc('.'),
+          main_container(nullptr),
+          shard(nullptr) {
         if (uct < -3 || uct > 64 || ucb < 0 || ucb > 32 ||
             (ucc != '0' && ucc != '1' && ucc != '^' && ucc != '!' && ucc != 'm' && ucc != '#')) {
             uct = -4;
@@ -95,6 +116,9 @@ class path_container_autobalance {
     }
 
     ~path_container_autobalance() {
+        if (main_container != nullptr) {
+            return;
+        }
         cerr << "Autobalance parameters: maxcond=" << maxcond << endl;
         if (!noverify) {
             cerr << "Verified: " << verifiedbad << " bad out of " << verified << endl;
@@ -108,6 +132,20 @@ class path_container_autobalance {
         condcount.resize(maxcond + 1);
     }
 
+    // all parameters that determine the output paths for given input paths, used as path cache key
+    std::string cache_parameters() const {
+        std::ostringstream o;
+        o << "md5_diffpathbackward t=" << t << " trange=" << trange << " maxcond=" << maxcond << " tend=" << tend
+          << " maxQ26upcond=" << maxQ26upcond << " includenaf=" << includenaf << " halfnafweight=" << halfnafweight
+          << " maxweight=" << maxweight << " minweight=" << minweight << " maxsdrs=" << maxsdrs << " ubound=" << ubound
+          << " fillfraction=" << fillfraction << " estimate=" << estimatefactor << " nafestimate=" << nafestweight
+          << " noverify=" << noverify << " pathfile=" << pathfile << " uc=" << uct << "," << ucb << "," << ucc << " m=" << modi << "of" << modn << " diffm=";
+        for (unsigned k = 0; k < 16; ++k) {
+            o << m_diff[k] << ",";
+        }
+        return o.str();
+    }
+
     void estimate(unsigned cond, unsigned amount) {
         if (cond > maxcond) {
             return;
@@ -158,7 +196,7 @@ class path_container_autobalance {
         condcount.resize(maxcond + 1);
     }
 
-    void push_back(const differentialpath &path, unsigned cond = 0) {
+    void push_back(const fixeddifferentialpath &path, unsigned cond = 0) {
         if (!test_uc(path)) {
             return;
         }
@@ -190,6 +228,21 @@ class path_container_autobalance {
             }
         }
 
+        if (shard != nullptr) {
+            // helper container: no locking, counts are passed to the main container by push_back_flush_main()
+            if (!noverify) {
+                ++verified;
+                if (!test_path_fast(path, m_diff, t - 3, t + 1)) {
+                    ++verifiedbad;
+                    return;
+                }
+            }
+            if (shards->push_back(*shard, path, cond)) {
+                ++count;
+            }
+            maxcond = std::min(maxcond, shard->get_maxcond());
+            return;
+        }
         if (!noverify) {
             if (!test_path_fast(path, m_diff, t - 3, t + 1)) {
                 mut.lock();
@@ -217,6 +270,44 @@ class path_container_autobalance {
         mut.unlock();
     }
 
+    // use per-thread shards for the paths of the helper containers, see begin_shards()
+    void begin_shards() {
+        shards = std::make_shared<path_shards>(unsigned(pathsout.size()), maxcond, ubound);
+    }
+
+    // merge the shards of all helper containers into pathsout
+    void merge_shards() {
+        if (!shards) {
+            return;
+        }
+        shards->merge(pathsout);
+        maxcond = std::min(maxcond, shards->maxcond());
+        count_balanced += shards->count_balanced();
+        size = 0;
+        for (unsigned c = 0; c <= maxcond && c < pathsout.size(); ++c) {
+            size += unsigned(pathsout[c].size());
+        }
+        shards.reset();
+    }
+
+    // publish the remaining paths of this helper container and pass its statistics to the main container
+    void push_back_flush_main() {
+        if (main_container == nullptr) {
+            return;
+        }
+        if (shard != nullptr) {
+            shards->publish(*shard);
+            maxcond = std::min(maxcond, shard->get_maxcond());
+        }
+        boost::lock_guard<boost::mutex> lock(mut);
+        main_container->count += count;
+        count = 0;
+        main_container->verified += verified;
+        verified = 0;
+        main_container->verifiedbad += verifiedbad;
+        verifiedbad = 0;
+    }
+
     void autobalance() {
         if (size > ubound) {
             ++count_balanced;
@@ -239,29 +330,30 @@ class path_container_autobalance {
         }
     }
 
-    void export_results(vector<differentialpath> &outpaths) const {
+    void export_results(vector<differentialpath> &outpaths) {
+        merge_shards();
         outpaths.clear();
         outpaths.reserve(ubound);
         for (unsigned k = 0; k < pathsout.size() && k <= maxcond; ++k) {
-            unsigned index = unsigned(outpaths.size());
-            outpaths.resize(index + pathsout[k].size());
-            std::copy(pathsout[k].begin(), pathsout[k].end(), outpaths.begin() + index);
+            for (size_t i = 0; i < pathsout[k].size(); ++i) {
+                outpaths.emplace_back(pathsout[k].todifferentialpath(i));
+            }
         }
         unsigned hbound = unsigned(double(ubound) * fillfraction);
         unsigned k = maxcond + 1;
         while (outpaths.size() < hbound && k < pathsout.size()) {
-            unsigned index = unsigned(outpaths.size());
             unsigned length = hbound - outpaths.size();
             if (length > pathsout[k].size()) {
                 length = pathsout[k].size();
             }
-            outpaths.resize(index + length);
-            std::copy(pathsout[k].begin(), pathsout[k].begin() + length, outpaths.begin() + index);
+            for (size_t i = 0; i < length; ++i) {
+                outpaths.emplace_back(pathsout[k].todifferentialpath(i));
+            }
             ++k;
         }
     }
 
-    bool test_uc(const differentialpath &path) {
+    bool test_uc(const fixeddifferentialpath &path) {
         if (ucb != -1 && uct >= path.tbegin() + 1 && uct < path.tend() - 1) {
             switch (ucc) {
             default:
@@ -382,7 +474,9 @@ class path_container_autobalance {
     unsigned modn;
     unsigned modi;
     std::string inputfile;
+    std::string cachedir;
     bool showinputpaths;
+    bool pathfile;
     bool newinputpath;
 
     double estimatefactor;
@@ -390,7 +484,7 @@ class path_container_autobalance {
     unsigned size;
     unsigned count, count_balanced;
     vector<unsigned> condcount;
-    vector<vector<differentialpath>> pathsout;
+    vector<packedpaths> pathsout;
 
     double fillfraction;
 
@@ -398,6 +492,13 @@ class path_container_autobalance {
 
     int uct, ucb;
     char ucc;
+
+    path_container_autobalance *main_container;
+
+    // shared by the main container and its helper containers during dostep_threaded,
+    // each helper container stores its paths in its own shard
+    std::shared_ptr<path_shards> shards;
+    path_shards::shard *shard;
 };
 
 #endif // MAIN_HPP
@@ -22,6 +22,8 @@
 #include <map>
 #include <cmath>
 #include <algorithm>
+#include <memory>
+#include <fstream>
 
 #include <hashclash/saveload_bz2.hpp>
 
@@ -31,6 +33,8 @@
 #include <boost/filesystem.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
 
 #include <hashclash/sdr.hpp>
 #include <hashclash/rng.hpp>
@@ -39,11 +43,14 @@
 
 #include "distribution.hpp" // distribution tables
 #include "storage.hpp"
+#include "exchange.hpp"
 
 void determine_nrblocks_distribution(birthday_parameters &parameters);
 
 boost::mutex global_mutex;
 #define LOCK_GLOBAL_MUTEX boost::mutex::scoped_lock lock(global_mutex);
+boost::mutex distribution_mutex;
+#define LOCK_DISTRIBUTION_MUTEX boost::mutex::scoped_lock lock(distribution_mutex);
 
 using namespace hashclash;
 using namespace std;
@@ -61,16 +68,24 @@ vector<pair<uint32, uint32>> singleblockdata;
 
 /* LOCK_GLOBAL_MUTEX required */
 uint32 colla1, collb1, collc1, colla2, collb2, collc2;
-uint64 totwork = 0, totworkallproc = 0;
 unsigned bestnrblocks = 64;
-bool quit = false;
-unsigned collrobinhoods = 0, collequalihvs = 0, collusefull = 0;
-vector<vector<trail_type>> trail_distribution(0);
+unsigned collrobinhoods = 0, collnomerge = 0, collequalihvs = 0, collusefull = 0;
+// generator state of birthday thread i+1 after the starting points of its last batch, for the checkpoint
+vector<rng_state> thread_rng_states;
 // vector< pair<trail_type, trail_type> > collisions_queue(0);
 /**/
 
+/* atomic: LOCK_GLOBAL_MUTEX not needed */
+boost::atomic<uint64> totwork(0), totworkallproc(0);
+boost::atomic<bool> quit(false);
+/**/
+
+/* LOCK_DISTRIBUTION_MUTEX required */
+vector<vector<trail_type>> trail_distribution(0);
+/**/
+
 // LOCK_GLOBAL_MUTEX required
-void status_line() {
+void status_line(trail_exchange *exchange = nullptr) {
     unsigned totcoll = main_storage.get_totcoll();
     unsigned collqueue = main_storage.get_collqueuesize();
     if (procmodn > 1) {
@@ -80,8 +95,9 @@ void status_line() {
         cout << "Work: 2^(" << log(double(totwork)) / log(double(2)) << ")";
     }
     cout << ", Coll.: " << main_storage.get_totcoll() << "(uf=" << collusefull << ",nuf=" << collequalihvs
-         << ",?=" << (totcoll - collusefull - collequalihvs - collrobinhoods - collqueue) << ",q=" << collqueue << ",rh=" << collrobinhoods
-         << "), Blocks: " << bestnrblocks << endl; //"     \r" << flush;
+         << ",?=" << (totcoll - collusefull - collequalihvs - collrobinhoods - collnomerge - collqueue) << ",q=" << collqueue
+         << ",rh=" << collrobinhoods << ",nm=" << collnomerge << "), Blocks: " << bestnrblocks << main_storage.disk_status()
+         << (exchange ? exchange->status() : std::string()) << endl; //"     \r" << flush;
 }
 
 // LOCK_GLOBAL_MUTEX not needed
@@ -253,9 +269,9 @@ std::set<trail_type> check;
 size_t doubles = 0;
 */
 
-// do not use LOCK_GLOBAL_MUTEX
-// function possibly calls LOCK_GLOBAL_MUTEX
-void find_collision(const trail_type &trail1, const trail_type &trail2) {
+// LOCK_GLOBAL_MUTEX not needed
+// scalar version of simd_device::walk_collisions
+void walk_collision(const trail_type &trail1, const trail_type &trail2, collision_walk_type &walk) {
     uint32 a1 = trail1.start[0];
     uint32 b1 = trail1.start[1];
     uint32 c1 = trail1.start[2];
@@ -302,8 +318,11 @@ void find_collision(const trail_type &trail1, const trail_type &trail2) {
 
     // check for robin hood
     if (a1 == a2 && b1 == b2 && c1 == c2) {
-        LOCK_GLOBAL_MUTEX;
-        ++collrobinhoods;
+        walk.x1 = walk.x2 = a1;
+        walk.y1 = walk.y2 = b1;
+        walk.z1 = walk.z2 = c1;
+        walk.len = len1;
+        walk.status = collision_walk_type::walk_robinhood;
         return;
     }
 
@@ -319,12 +338,32 @@ void find_collision(const trail_type &trail1, const trail_type &trail2) {
         birthday_step(a2, b2, c2);
         --len1;
     }
-    if (len1 == 0 && (a1 != a2 || b1 != b2 || c1 != c2)) {
+    walk.x1 = oa1;
+    walk.y1 = ob1;
+    walk.z1 = oc1;
+    walk.x2 = oa2;
+    walk.y2 = ob2;
+    walk.z2 = oc2;
+    walk.len = len1;
+    walk.status = (a1 != a2 || b1 != b2 || c1 != c2) ? collision_walk_type::walk_nomerge : collision_walk_type::walk_merged;
+}
+
+// do not use LOCK_GLOBAL_MUTEX
+// function possibly calls LOCK_GLOBAL_MUTEX
+void process_collision(const collision_walk_type &walk) {
+    if (walk.status == collision_walk_type::walk_robinhood) {
         LOCK_GLOBAL_MUTEX;
-        cerr << "find_collision(): len=0 (len1=" << trail1.len << ",len2=" << trail2.len << ")           " << endl;
         ++collrobinhoods;
         return;
     }
+    if (walk.status == collision_walk_type::walk_nomerge) {
+        // with compact storage slots a rare false match of end points is expected
+        LOCK_GLOBAL_MUTEX;
+        ++collnomerge;
+        return;
+    }
+    uint32 oa1 = walk.x1, ob1 = walk.y1, oc1 = walk.z1;
+    uint32 oa2 = walk.x2, ob2 = walk.y2, oc2 = walk.z2;
 
     // check for same ihv birthday collision
     if ((oa1 <= ob1) == (oa2 <= ob2)) {
@@ -446,23 +485,54 @@ void find_collision(const trail_type &trail1, const trail_type &trail2) {
     }
 }
 
-// LOCK_GLOBAL_MUTEX required
-vector<trail_type> main_storage_buffer;
-void distribute_trail(const trail_type &newtrail) {
-    totwork += newtrail.len;
-    totworkallproc += newtrail.len;
-    uint32 procindex = newtrail.end[1] % procmodn;
-    if (procindex == procmodi && !generatormode) {
-        //		main_storage.insert_trail(newtrail);
-        main_storage_buffer.emplace_back(newtrail);
-    } else {
-        trail_distribution[procindex].push_back(newtrail);
-    }
+// do not use LOCK_GLOBAL_MUTEX
+// function possibly calls LOCK_GLOBAL_MUTEX
+void find_collision(const trail_type &trail1, const trail_type &trail2) {
+    collision_walk_type walk;
+    walk_collision(trail1, trail2, walk);
+    process_collision(walk);
 }
-// LOCK_GLOBAL_MUTEX required
-void distribute_trail_flush() {
-    main_storage.insert_trails(main_storage_buffer);
-    main_storage_buffer.clear();
+
+// LOCK_GLOBAL_MUTEX not needed
+// trails of this process go directly into the storage, which is safe for concurrent insertion
+// trails of other processes are collected in the thread's outgoing buffers
+// and handed to trail_distribution for the saver or the trail exchange once per batch
+void distribute_trails(const vector<trail_type> &work, vector<vector<trail_type>> &outgoing) {
+    outgoing.resize(procmodn);
+    uint64 len = 0;
+    bool wide = false;
+    for (unsigned i = 0; i < work.size(); ++i) {
+        len += work[i].len;
+        wide |= (work[i].start[2] != 0);
+        outgoing[work[i].end[1] % procmodn].push_back(work[i]);
+    }
+    if (wide) {
+        // the storage only keeps trails from 64-bit starting points and would drop these
+        LOCK_GLOBAL_MUTEX;
+        cerr << "Trail with a 96-bit starting point generated!!" << endl;
+    }
+    totwork += len;
+    totworkallproc += len;
+    if (!generatormode) {
+        main_storage.insert_trails(outgoing[procmodi]);
+        outgoing[procmodi].clear();
+    }
+    bool pending = false;
+    for (unsigned i = 0; i < procmodn; ++i) {
+        pending |= !outgoing[i].empty();
+    }
+    if (!pending) {
+        return;
+    }
+    LOCK_DISTRIBUTION_MUTEX;
+    for (unsigned i = 0; i < procmodn; ++i) {
+        if (trail_distribution[i].empty()) {
+            trail_distribution[i].swap(outgoing[i]);
+        } else {
+            trail_distribution[i].insert(trail_distribution[i].end(), outgoing[i].begin(), outgoing[i].end());
+        }
+        outgoing[i].clear();
+    }
 }
 
 // LOCK_GLOBAL_MUTEX required
@@ -550,7 +620,7 @@ void load_save_trails(bool dosave = true) {
             for (unsigned i = 0; i < procmodn; ++i) {
                 traildata.trails.clear();
                 {
-                    LOCK_GLOBAL_MUTEX;
+                    LOCK_DISTRIBUTION_MUTEX;
                     swap(traildata.trails, trail_distribution[i]);
                 }
                 if (traildata.trails.size()) {
@@ -578,10 +648,131 @@ void load_save_trails(bool dosave = true) {
     }
     LOCK_GLOBAL_MUTEX;
     workothers[procmodi] = totwork;
-    totworkallproc = 0;
+    uint64 workall = 0;
     for (unsigned i = 0; i < workothers.size(); ++i) {
-        totworkallproc += workothers[i];
+        workall += workothers[i];
     }
+    totworkallproc = workall;
+}
+
+// LOCK_GLOBAL_MUTEX required
+struct birthday_checkpoint_type {
+    vector<uint32> fingerprint;
+    uint64 totwork, totworkallproc;
+    unsigned bestnrblocks, collrobinhoods, collnomerge, collequalihvs, collusefull, totcoll;
+    vector<vector<trail_type>> distribution;
+    vector<trail_type> trails;
+    vector<pair<trail_type, trail_type>> collisions;
+    rng_state masterrng;
+    vector<rng_state> threadrngs;
+    uint32 check;
+
+    template <class Archive> void serialize(Archive &ar, const unsigned int file_version) {
+        ar &boost::serialization::make_nvp("fingerprint", fingerprint);
+        ar &boost::serialization::make_nvp("totwork", totwork);
+        ar &boost::serialization::make_nvp("totworkallproc", totworkallproc);
+        ar &boost::serialization::make_nvp("bestnrblocks", bestnrblocks);
+        ar &boost::serialization::make_nvp("collrobinhoods", collrobinhoods);
+        ar &boost::serialization::make_nvp("collnomerge", collnomerge);
+        ar &boost::serialization::make_nvp("collequalihvs", collequalihvs);
+        ar &boost::serialization::make_nvp("collusefull", collusefull);
+        ar &boost::serialization::make_nvp("totcoll", totcoll);
+        ar &boost::serialization::make_nvp("distribution", distribution);
+        ar &boost::serialization::make_nvp("trails", trails);
+        ar &boost::serialization::make_nvp("collisions", collisions);
+        ar &boost::serialization::make_nvp("masterrng", masterrng);
+        ar &boost::serialization::make_nvp("threadrngs", threadrngs);
+        ar &boost::serialization::make_nvp("check", check);
+    }
+};
+
+// LOCK_GLOBAL_MUTEX not needed
+// a checkpoint can only be resumed with the same search parameters
+vector<uint32> checkpoint_fingerprint() {
+    vector<uint32> fp(ihv1, ihv1 + 4);
+    fp.insert(fp.end(), ihv2, ihv2 + 4);
+    fp.insert(fp.end(), msg1, msg1 + 16);
+    fp.insert(fp.end(), msg2, msg2 + 16);
+    fp.push_back(hybridmask);
+    fp.push_back(distinguishedpointmask);
+    fp.push_back(maximumpathlength);
+    fp.push_back(maxblocks);
+    fp.push_back(parameterspathtyperange);
+    fp.push_back(procmodn);
+    fp.push_back(procmodi);
+    fp.push_back(generatormode);
+    return fp;
+}
+
+string checkpoint_filename(const string &extension) {
+    return workdir + "/birthdaycheckpoint" + boost::lexical_cast<string>(procmodi) + extension;
+}
+
+// do not use LOCK_GLOBAL_MUTEX
+// function possibly calls LOCK_GLOBAL_MUTEX
+// the trail table is written incrementally, the state file is replaced by a complete new one
+void save_checkpoint() {
+    timer sw(true);
+    birthday_checkpoint_type cp;
+    cp.fingerprint = checkpoint_fingerprint();
+    boost::filesystem::create_directories(workdir);
+    if (!generatormode) {
+        main_storage.checkpoint(checkpoint_filename(".table"), cp.trails, cp.collisions);
+    }
+    cp.totcoll = main_storage.get_totcoll();
+    {
+        LOCK_GLOBAL_MUTEX;
+        cp.totwork = totwork;
+        cp.totworkallproc = totworkallproc;
+        cp.bestnrblocks = bestnrblocks;
+        cp.collrobinhoods = collrobinhoods;
+        cp.collnomerge = collnomerge;
+        cp.collequalihvs = collequalihvs;
+        cp.collusefull = collusefull;
+        cp.threadrngs = thread_rng_states;
+    }
+    cp.masterrng = master_rng_state();
+    {
+        LOCK_DISTRIBUTION_MUTEX;
+        cp.distribution = trail_distribution;
+    }
+    cp.check = 0x56139081;
+    const string statefile = checkpoint_filename(".state");
+    save(cp, binary_archive, statefile + ".tmp");
+    boost::filesystem::rename(statefile + ".tmp", statefile);
+    cout << "Checkpoint saved in " << sw.time() << "s." << endl;
+}
+
+// LOCK_GLOBAL_MUTEX not needed
+// called before the threads are started
+void load_checkpoint() {
+    const string statefile = checkpoint_filename(".state");
+    if (!boost::filesystem::exists(statefile)) {
+        cout << "No checkpoint found in " << workdir << ", starting a new search." << endl;
+        return;
+    }
+    timer sw(true);
+    birthday_checkpoint_type cp;
+    cp.check = 0;
+    load(cp, binary_archive, statefile);
+    if (cp.check != 0x56139081 || cp.fingerprint != checkpoint_fingerprint() || cp.distribution.size() != procmodn) {
+        throw std::runtime_error("load_checkpoint(): " + statefile + " does not match the search parameters");
+    }
+    if (!generatormode && !main_storage.restore(checkpoint_filename(".table"), cp.trails, cp.collisions, cp.totcoll)) {
+        throw std::runtime_error("load_checkpoint(): " + checkpoint_filename(".table") + " does not match the trail storage");
+    }
+    totwork = cp.totwork;
+    totworkallproc = cp.totworkallproc;
+    bestnrblocks = cp.bestnrblocks;
+    collrobinhoods = cp.collrobinhoods;
+    collnomerge = cp.collnomerge;
+    collequalihvs = cp.collequalihvs;
+    collusefull = cp.collusefull;
+    trail_distribution.swap(cp.distribution);
+    // the threads continue their streams after the batches of the checkpoint instead of drawing those starting points again
+    set_master_rng_state(cp.masterrng);
+    thread_rng_states.swap(cp.threadrngs);
+    cout << "Resumed from checkpoint in " << sw.time() << "s: work 2^(" << log(double(totwork)) / log(double(2)) << ")." << endl;
 }
 
 struct coll_less : public std::binary_function<pair<trail_type, trail_type>, pair<trail_type, trail_type>, bool> {
@@ -595,35 +786,52 @@ struct birthday_thread {
     uint32 id;
     int _cuda_device_nr;
     cuda_device _cuda_device;
-    simd_device_avx256 _simd_device;
+    std::unique_ptr<simd_device> _simd_device;
     bool _nosimd;
+    // trails for other processes, see distribute_trails
+    vector<vector<trail_type>> _outgoing;
 
     birthday_thread(int cuda_device_nr = -1)
         : _cuda_device_nr(cuda_device_nr), id(id_counter++), _nosimd(false) {}
 
+    // the thread's stream is derived from the master state and its id, or continues from the checkpoint
+    void init_rng() {
+        seed_thread(id);
+        LOCK_GLOBAL_MUTEX;
+        if (id <= thread_rng_states.size() && thread_rng_states[id - 1].seeded()) {
+            thread_rng() = thread_rng_states[id - 1];
+        }
+    }
+
+    // LOCK_GLOBAL_MUTEX not needed
+    void save_rng_state() {
+        LOCK_GLOBAL_MUTEX;
+        if (thread_rng_states.size() < id) {
+            thread_rng_states.resize(id);
+        }
+        thread_rng_states[id - 1] = thread_rng();
+    }
+
     void loop_cuda(bool single = false) {
         vector<trail_type> work;
         vector<pair<trail_type, trail_type>> collisions;
         bool haveenoughcoll = false;
         while (true) {
-            uint64 seed;
-            {
-                LOCK_GLOBAL_MUTEX;
-                seed = uint64(xrng128()) + (uint64(xrng128()) << 32) + 1111 * procmodi;
-                xrng128();
-                xrng128();
-
-                /*
+            // the thread's own random stream, no lock needed
+            const uint64 seed = uint64(xrng128()) + (uint64(xrng128()) << 32) + 1111 * procmodi;
+            xrng128();
+            xrng128();
+            save_rng_state();
+            /*
                                                 if (_cuda_device_nr == 0 && (haveenoughcoll || main_storage.get_collqueuesize() >= 2048))
                                                 {
                                                         if (!haveenoughcoll)
                                                                 std::cout << "Thread " << id << " (CUDA): started processing colliding
                    trails on GPU" << std::endl; main_storage.get_birthdaycollisions(collisions); haveenoughcoll = true;
                                                 }
-                */
-                if (quit) {
-                    return;
-                }
+            */
+            if (quit) {
+                return;
             }
 #ifdef HAVE_CUDA
             if (_cuda_device_nr >= 0) {
@@ -643,11 +851,7 @@ struct birthday_thread {
                 }
                 collisions.clear();
             } else {
-                LOCK_GLOBAL_MUTEX;
-                for (unsigned i = 0; i < work.size(); ++i) {
-                    distribute_trail(work[i]);
-                }
-                distribute_trail_flush();
+                distribute_trails(work, _outgoing);
             }
             if (single) {
                 break;
@@ -658,32 +862,48 @@ struct birthday_thread {
     void loop_simd(bool single = false) {
         vector<trail_type> work;
         vector<pair<trail_type, trail_type>> collisions;
-        bool verified = false;
+        vector<collision_walk_type> walks;
+        bool verified = false, walkverified = false;
         size_t workamount = (size_t(1) << 26) / size_t(distinguishedpointmask + 1);
         while (true) {
-            uint64 seed;
-            {
-                LOCK_GLOBAL_MUTEX;
-                seed = uint64(xrng128()) + (uint64(xrng128()) << 32) + 1111 * procmodi;
-                xrng128();
-                xrng128();
-                main_storage.get_birthdaycollisions(collisions);
-
-                if (quit) {
-                    return;
-                }
+            // the thread's own random stream, no lock needed
+            const uint64 seed = uint64(xrng128()) + (uint64(xrng128()) << 32) + 1111 * procmodi;
+            xrng128();
+            xrng128();
+            save_rng_state();
+            main_storage.get_birthdaycollisions(collisions);
+            if (quit) {
+                return;
             }
 
-            // insert the trails into the trail hash
+            // walk all colliding trails in SIMD lanes
             if (collisions.size() > 0) {
-                for (unsigned i = 0; i < collisions.size(); ++i) {
-                    find_collision(collisions[i].first, collisions[i].second);
+                _simd_device->walk_collisions(collisions, walks, bool(maxblocks == 1));
+                if (!walkverified) {
+                    collision_walk_type tmp;
+                    walk_collision(collisions[0].first, collisions[0].second, tmp);
+                    const collision_walk_type &w = walks[0];
+                    if (tmp.status != w.status || tmp.len != w.len ||
+                        (w.status == collision_walk_type::walk_merged &&
+                         (tmp.x1 != w.x1 || tmp.y1 != w.y1 || tmp.z1 != w.z1 || tmp.x2 != w.x2 || tmp.y2 != w.y2 || tmp.z2 != w.z2))) {
+                        // found an error: disable SIMD and switch back to normal loop
+                        _nosimd = true;
+                        for (unsigned i = 0; i < collisions.size(); ++i) {
+                            find_collision(collisions[i].first, collisions[i].second);
+                        }
+                        loop(single);
+                        return;
+                    }
+                    walkverified = true;
+                }
+                for (unsigned i = 0; i < walks.size(); ++i) {
+                    process_collision(walks[i]);
                 }
             }
             // if little work has been done processing trail collisions then still do some work
             if (collisions.size() * size_t(4) < workamount) {
                 work.clear();
-                _simd_device.fill_trail_buffer(seed, work, bool(maxblocks == 1));
+                _simd_device->fill_trail_buffer(seed, work, bool(maxblocks == 1));
                 if (!verified && !work.empty()) {
                     trail_type tmp = work[0];
                     tmp.len = 0;
@@ -696,11 +916,7 @@ struct birthday_thread {
                     }
                     verified = true;
                 }
-                LOCK_GLOBAL_MUTEX;
-                for (unsigned i = 0; i < work.size(); ++i) {
-                    distribute_trail(work[i]);
-                }
-                distribute_trail_flush();
+                distribute_trails(work, _outgoing);
             }
             collisions.clear();
             if (single) {
@@ -726,22 +942,22 @@ struct birthday_thread {
         vector<pair<trail_type, trail_type>> collisions;
         while (true) {
             collisions.clear();
-            // generate a batch of new trail starting points
-            {
-                LOCK_GLOBAL_MUTEX;
-                if (quit) {
-                    return;
-                }
-                main_storage.get_birthdaycollisions(collisions);
-                work.resize(workamount);
-                for (unsigned i = 0; i < work.size(); ++i) {
-                    work[i].start[0] = xrng128();
-                    work[i].start[1] = xrng128();
-                    work[i].start[2] = xrng128() & hybridmask;
-                    work[i].len = 0;
-                    xrng128();
-                    xrng128();
-                }
+            // the thread's own random stream, no lock needed
+            uint64 seed = uint64(xrng128()) + (uint64(xrng128()) << 32) + 1111 * procmodi;
+            xrng128();
+            xrng128();
+            save_rng_state();
+            if (quit) {
+                return;
+            }
+            main_storage.get_birthdaycollisions(collisions);
+            // generate a batch of new trail starting points as the SIMD backends do: the 64-bit counter value itself
+            work.resize(workamount);
+            for (unsigned i = 0; i < work.size(); ++i) {
+                work[i].start[0] = uint32(++seed);
+                work[i].start[1] = uint32((seed += (uint64(1) << 32)) >> 32);
+                work[i].start[2] = 0;
+                work[i].len = 0;
             }
             if (collisions.size() > 0) {
                 for (unsigned i = 0; i < collisions.size(); ++i) {
@@ -760,13 +976,7 @@ struct birthday_thread {
             }
 
             // insert the trails into the trail hash
-            {
-                LOCK_GLOBAL_MUTEX;
-                for (unsigned i = 0; i < work.size(); ++i) {
-                    distribute_trail(work[i]);
-                }
-                distribute_trail_flush();
-            }
+            distribute_trails(work, _outgoing);
 
             if (single) {
                 break;
@@ -776,6 +986,7 @@ struct birthday_thread {
 
     void thread_run() {
         try {
+            init_rng();
             {
                 LOCK_GLOBAL_MUTEX;
 #ifdef HAVE_CUDA
@@ -789,14 +1000,17 @@ struct birthday_thread {
                     //					_cuda_device.benchmark();
                 } else
 #endif // CUDA
-                    if (_simd_device.init(
-                            ihv1, ihv2, ihv2mod, precomp1, precomp2, msg1, msg2, hybridmask, distinguishedpointmask, maximumpathlength
-                        )) {
-                        cout << "Thread " << id << " created (AVX256)." << endl;
+                {
+                    _simd_device.reset(create_simd_device(
+                        ihv1, ihv2, ihv2mod, precomp1, precomp2, msg1, msg2, hybridmask, distinguishedpointmask, maximumpathlength
+                    ));
+                    if (_simd_device) {
+                        cout << "Thread " << id << " created (" << _simd_device->name() << ")." << endl;
                     } else {
                         _nosimd = true;
                         cout << "Thread " << id << " created." << endl;
                     }
+                }
             }
             loop();
             cout << "Thread " << id << " exited.          " << endl;
@@ -818,6 +1032,267 @@ struct birthday_thread_shell {
     void operator()() { bt->operator()(); }
 };
 
+// LOCK_GLOBAL_MUTEX not needed
+// called from the connection threads of the trail exchange
+// the storage takes concurrent insertions, the global mutex only guards the diagnostic output
+void receive_trails(const vector<trail_type> &trails) {
+    for (unsigned i = 0; i < trails.size(); ++i) {
+        if (trails[i].end[1] % procmodn != procmodi) {
+            LOCK_GLOBAL_MUTEX;
+            cerr << "False trail received!!" << endl;
+        }
+    }
+    main_storage.insert_trails(trails);
+}
+
+// LOCK_GLOBAL_MUTEX not needed
+// the token of the trail exchange: an md5 of the search and the exchange key, equal for all processes of the search
+vector<uint32> exchange_token(const string &key) {
+    vector<uint32> words(ihv1, ihv1 + 4);
+    words.insert(words.end(), ihv2, ihv2 + 4);
+    words.insert(words.end(), msg1, msg1 + 16);
+    words.insert(words.end(), msg2, msg2 + 16);
+    words.push_back(hybridmask);
+    words.push_back(distinguishedpointmask);
+    words.push_back(maximumpathlength);
+    words.push_back(maxblocks);
+    words.push_back(parameterspathtyperange);
+    words.push_back(procmodn);
+    words.push_back(uint32(key.size()));
+    words.insert(words.end(), key.begin(), key.end());
+    words.resize((words.size() + 16) / 16 * 16, 0);
+    words.back() = uint32(words.size());
+    vector<uint32> token(md5_iv, md5_iv + 4);
+    for (size_t i = 0; i < words.size(); i += 16) {
+        md5compress(&token[0], &words[i]);
+    }
+    return token;
+}
+
+// LOCK_GLOBAL_MUTEX not needed
+// send the trails of other processes over the trail exchange in batches of at most maxbatch trails,
+// trails that could not be delivered are kept for the next call
+void exchange_trails(trail_exchange &exchange) {
+    const uint64 mywork = totwork;
+    exchange.set_work(procmodi, mywork);
+    for (unsigned i = 0; i < procmodn; ++i) {
+        if (i == procmodi && !generatormode) {
+            continue;
+        }
+        // an empty batch still exchanges the work counters
+        for (bool first = true; first || !exchange.undelivered(i); first = false) {
+            vector<trail_type> trails;
+            {
+                LOCK_DISTRIBUTION_MUTEX;
+                if (!first && trail_distribution[i].empty()) {
+                    break;
+                }
+                swap(trails, trail_distribution[i]);
+                if (trails.size() > trail_exchange::maxbatch) {
+                    trail_distribution[i].assign(trails.begin() + trail_exchange::maxbatch, trails.end());
+                    trails.resize(trail_exchange::maxbatch);
+                }
+            }
+            if (!exchange.send(i, trails, mywork)) {
+                LOCK_DISTRIBUTION_MUTEX;
+                trail_distribution[i].insert(trail_distribution[i].end(), trails.begin(), trails.end());
+                break;
+            }
+        }
+    }
+    vector<uint64> workothers;
+    exchange.get_work(workothers);
+    LOCK_GLOBAL_MUTEX;
+    workothers[procmodi] = totwork;
+    uint64 workall = 0;
+    for (unsigned i = 0; i < workothers.size(); ++i) {
+        workall += workothers[i];
+    }
+    totworkallproc = workall;
+}
+
+// streams the trails every second on its own thread, so a slow or unreachable process does not hold up the main loop
+void exchange_loop(trail_exchange *exchange) {
+    while (!quit) {
+        boost::this_thread::sleep(boost::posix_time::seconds(1));
+        exchange_trails(*exchange);
+    }
+}
+
+// measured rates of this machine in steps (or trails) per second
+struct calibration_rates {
+    double generate, walk, insert;
+};
+
+// LOCK_GLOBAL_MUTEX not needed
+// called before the threads are started, uses the global search parameters with short benchmark trails
+calibration_rates measure_rates(const birthday_parameters &parameters) {
+    const uint32 dpmask = 0xFF, maxlen = 256 * 20;
+    calibration_rates rates = {0, 0, 0};
+    vector<trail_type> trails;
+
+    unsigned threads = parameters.threads;
+    if (threads == 0 || threads > boost::thread::hardware_concurrency()) {
+        threads = boost::thread::hardware_concurrency();
+    }
+#ifdef HAVE_CUDA
+    if (parameters.cuda_enabled) {
+        int cuda_dev_cnt = 0;
+        try {
+            cuda_dev_cnt = get_num_cuda_devices();
+        } catch (std::exception &e) {
+            std::cerr << "CUDA ERROR: " << e.what() << std::endl;
+        }
+        for (int i = 0; i < cuda_dev_cnt; ++i) {
+            cuda_device device;
+            if (!device.init(i, ihv1, ihv2, ihv2mod, msg1, msg2, hybridmask, dpmask, maxlen)) {
+                continue;
+            }
+            vector<trail_type> work;
+            vector<pair<trail_type, trail_type>> collisions;
+            uint64 steps = 0;
+            timer sw(true);
+            for (unsigned k = 0; k < 4 || sw.time() < 2; ++k) {
+                work.clear();
+                device.cuda_fill_trail_buffer(0, uint64(k) << 40, work, collisions, bool(maxblocks == 1));
+                for (unsigned j = 0; j < work.size(); ++j) {
+                    steps += work[j].len;
+                }
+            }
+            const double rate = double(steps) / sw.time();
+            cout << "CUDA device " << i << ": 2^(" << log(rate) / log(2.0) << ") steps/s" << endl;
+            rates.generate += rate;
+        }
+        // the same thread count as birthday() for the CPU threads
+        if (threads > unsigned(cuda_dev_cnt)) {
+            threads -= cuda_dev_cnt;
+        }
+    }
+#endif
+
+    // one call of each SIMD backend, the fastest is used by all CPU threads
+    unique_ptr<simd_device> devices[] = {
+        unique_ptr<simd_device>(new simd_device_avx512),
+        unique_ptr<simd_device>(new simd_device_avx256),
+        unique_ptr<simd_device>(new simd_device_scalar)
+    };
+    double bestgenerate = 0, bestwalk = 0;
+    for (auto &device : devices) {
+        if (!device->init(ihv1, ihv2, ihv2mod, precomp1, precomp2, msg1, msg2, hybridmask, dpmask, maxlen)) {
+            cout << device->name() << ": not supported" << endl;
+            continue;
+        }
+        vector<trail_type> work;
+        timer sw(true);
+        device->fill_trail_buffer(xrng128() + (uint64(xrng128()) << 32), work, bool(maxblocks == 1));
+        const double gentime = sw.time();
+        uint64 steps = 0;
+        for (unsigned j = 0; j < work.size(); ++j) {
+            steps += work[j].len;
+        }
+        const double generate = double(steps) / gentime;
+
+        // walks of unrelated trails do not merge: both trails are walked completely
+        vector<pair<trail_type, trail_type>> collisions;
+        vector<collision_walk_type> walks;
+        steps = 0;
+        for (unsigned j = 0; j + 1 < work.size() && collisions.size() < (1 << 16); j += 2) {
+            collisions.push_back(make_pair(work[j], work[j + 1]));
+            steps += work[j].len + work[j + 1].len;
+        }
+        sw.start();
+        device->walk_collisions(collisions, walks, bool(maxblocks == 1));
+        const double walk = double(steps) / sw.time();
+        cout << device->name() << ": trails 2^(" << log(generate) / log(2.0) << ") steps/s, collision walks 2^("
+             << log(walk) / log(2.0) << ") steps/s" << endl;
+        if (generate > bestgenerate) {
+            bestgenerate = generate;
+            bestwalk = walk;
+            trails.swap(work);
+        }
+    }
+    rates.generate += bestgenerate * threads;
+    rates.walk = bestwalk * threads;
+
+    // trails are inserted by all threads concurrently, into a table of the size of the run (at most 1GB, far beyond the caches)
+    birthday_parameters storageparameters = parameters;
+    storageparameters.diskstorage.clear();
+    storageparameters.resume = false;
+    storage_type storage;
+    storage.set_parameters(storageparameters, dpmask, maxlen);
+    const uint64 tablebytes = std::min<uint64>(uint64(parameters.maxmemory) << 20, uint64(1) << 30) / parameters.modn;
+    storage.reserve_memory(std::max<uint64>(tablebytes / storage_type::bytes_per_trail, storage_type::slots_for_trails(trails.size())));
+    boost::thread_group inserters;
+    timer sw(true);
+    for (unsigned t = 0; t < threads; ++t) {
+        inserters.create_thread([&storage, &trails, t, threads]() {
+            for (size_t j = t; j < trails.size(); j += threads) {
+                storage.insert_trail(trails[j]);
+            }
+        });
+    }
+    inserters.join_all();
+    rates.insert = double(trails.size()) / sw.time();
+    cout << "Trail storage with " << threads << " CPU threads: 2^(" << log(rates.insert) / log(2.0) << ") trails/s" << endl;
+    cout << "Total with " << threads << " CPU threads: trails 2^(" << log(rates.generate) / log(2.0) << ") steps/s, collision walks 2^("
+         << log(rates.walk) / log(2.0) << ") steps/s" << endl;
+    return rates;
+}
+
+// LOCK_GLOBAL_MUTEX not needed
+// choose hybridbits and logtraillength with the least expected time for the memory budget maxtrails
+// logprob is the (given) log2 success probability of a collision for maxblocks == 1
+void calibrate(const birthday_parameters &parameters, uint64 maxtrails, double logprob) {
+    cout << "Calibrating..." << endl;
+    const calibration_rates rates = measure_rates(parameters);
+
+    double besttime = 0;
+    unsigned besthybridbits = 0, bestlogpathlength = 0;
+    // with maxblocks == 1 the probability is only known for the given hybridbits
+    const unsigned hmin = (maxblocks == 1) ? parameters.hybridbits : 0, hmax = (maxblocks == 1) ? parameters.hybridbits : 32;
+    for (unsigned h = hmin; h <= hmax; ++h) {
+        if (maxblocks != 1) {
+            if (dist[h][parameters.pathtyperange][maxblocks] <= 0) {
+                continue;
+            }
+            logprob = log(dist[h][parameters.pathtyperange][maxblocks]) / log(double(2));
+        }
+        // the same estimates as birthday()
+        const double estcomplexity = 32.825748 - 0.5 * logprob + 0.5 * double(h);
+        const double estcollisions = 1 - logprob;
+        const unsigned minlogpathlength = unsigned(std::max(0.0, log(pow(double(2), estcomplexity) / double(maxtrails)) / log(double(2)) + 0.9));
+        for (unsigned l = minlogpathlength; l < 32; ++l) {
+            const double time = pow(double(2), estcomplexity) / rates.generate + pow(double(2), estcomplexity - l) / rates.insert +
+                                pow(double(2), l + estcollisions + 1.321928) / rates.walk;
+            if (besttime == 0 || time < besttime) {
+                besttime = time;
+                besthybridbits = h;
+                bestlogpathlength = l;
+            }
+        }
+    }
+    if (besttime == 0) {
+        throw std::runtime_error("calibrate(): no parameters possible for this maxblocks and pathtyperange");
+    }
+    // memory for twice the trails that will be stored, as a run can take longer than expected, but not more than the budget
+    unsigned maxmemory = parameters.maxmemory;
+    if (parameters.diskstorage.empty()) {
+        const double logprobbest = (maxblocks == 1) ? logprob : log(dist[besthybridbits][parameters.pathtyperange][maxblocks]) / log(double(2));
+        const double trails = 2 * pow(double(2), 32.825748 - 0.5 * logprobbest + 0.5 * double(besthybridbits) - bestlogpathlength);
+        const double tablebytes = double(storage_type::slots_for_trails(uint64(trails))) * storage_type::bytes_per_trail;
+        maxmemory = std::min<unsigned>(maxmemory, unsigned(tablebytes / double(1 << 20)) + 1);
+    }
+
+    cout << "Chosen: hybridbits " << besthybridbits << ", logtraillength " << bestlogpathlength << ", maxmemory " << maxmemory << endl;
+    cout << "Predicted time: " << besttime << "s (" << besttime / 3600 << " hours)" << endl;
+    std::ofstream ofs(parameters.calibrate.c_str());
+    ofs << "# predicted time in seconds: " << uint64(besttime) << endl;
+    ofs << "--hybridbits " << besthybridbits << " --logtraillength " << bestlogpathlength << " --maxmemory " << maxmemory << endl;
+    if (!ofs) {
+        throw std::runtime_error("calibrate(): could not write " + parameters.calibrate);
+    }
+}
+
 void birthday(birthday_parameters &parameters) {
     procmodn = parameters.modn;
     procmodi = parameters.modi;
@@ -866,9 +1341,16 @@ void birthday(birthday_parameters &parameters) {
     double estcomplexity = 32.825748 - 0.5 * logprob + 0.5 * double(parameters.hybridbits);
     double estcollisions = 1 - logprob;
 
+    uint64 ramtrails = 0;
     if (parameters.maxmemory != 0) {
-        maxtrails = uint64(parameters.maxmemory) << 19;
-        maxtrails /= sizeof(trail_type);
+        // the table holds more slots than the planned trails, so a run that stores its estimated trails does not overflow
+        maxtrails = storage_type::trails_for_memory(uint64(parameters.maxmemory) << 20);
+        ramtrails = (uint64(parameters.maxmemory) << 20) / storage_type::bytes_per_trail;
+        if (!parameters.diskstorage.empty()) {
+            // RAM only buffers trails, they are stored on disk
+            ramtrails = (uint64(parameters.maxmemory) << 20) / storage_type::bytes_per_buffered_trail;
+            maxtrails = ramtrails + (uint64(parameters.maxdisk) << 30) / storage_type::bytes_per_disk_trail;
+        }
     }
     if (parameters.logpathlength < 0) {
         double comppertrail = pow(double(2), estcomplexity) / double(maxtrails);
@@ -877,7 +1359,8 @@ void birthday(birthday_parameters &parameters) {
     }
     if (parameters.maxmemory == 0) {
         maxtrails = pow(double(2), estcomplexity - double(parameters.logpathlength));
-        uint64 tmp = (maxtrails * sizeof(trail_type)) >> 19;
+        ramtrails = storage_type::slots_for_trails(maxtrails);
+        uint64 tmp = (ramtrails * storage_type::bytes_per_trail) >> 20;
         parameters.maxmemory = unsigned(tmp);
     }
     cout << "Maximum of near-collision blocks: " << parameters.maxblocks << endl;
@@ -885,6 +1368,9 @@ void birthday(birthday_parameters &parameters) {
     cout << "Hybrid bits: " << parameters.hybridbits << endl;
     cout << "Maximum amount of memory in MB for trails: " << parameters.maxmemory << " (local: " << parameters.maxmemory / parameters.modn
          << ")" << endl;
+    if (!parameters.diskstorage.empty()) {
+        cout << "Maximum amount of disk space in GB for trails: " << parameters.maxdisk << " (in " << parameters.diskstorage << ")" << endl;
+    }
     cout << "Estimated number of trails that will be stored:    " << maxtrails << " (local: " << maxtrails / parameters.modn << ")" << endl;
     cout << "Estimated number of trails that will be generated: " << uint64(pow(double(2), estcomplexity - parameters.logpathlength))
          << endl;
@@ -921,8 +1407,22 @@ void birthday(birthday_parameters &parameters) {
     precomputestate(precomp1, msg1);
     precomputestate(precomp2, msg2);
 
-    main_storage.set_parameters(parameters);
-    main_storage.reserve_memory(maxtrails / parameters.modn);
+    if (!parameters.calibrate.empty()) {
+        calibrate(parameters, maxtrails, logprob);
+        return;
+    }
+
+    main_storage.set_parameters(parameters, distinguishedpointmask, maximumpathlength);
+    main_storage.reserve_memory(ramtrails / parameters.modn);
+    if (parameters.resume) {
+        load_checkpoint();
+    }
+
+    std::unique_ptr<trail_exchange> exchange;
+    if (!parameters.exchange.empty()) {
+        exchange.reset(new trail_exchange(parameters.exchange, procmodn, procmodi, !generatormode, receive_trails,
+                                          exchange_token(parameters.exchangekey)));
+    }
 
     if (parameters.threads == 0 || parameters.threads > boost::thread::hardware_concurrency()) {
         parameters.threads = boost::thread::hardware_concurrency();
@@ -963,20 +1463,36 @@ void birthday(birthday_parameters &parameters) {
         quit = true;
     }
 
-    timer save_timer(true);
+    boost::thread exchange_thread;
+    if (exchange) {
+        exchange_thread = boost::thread(exchange_loop, exchange.get());
+    }
+
+    timer save_timer(true), checkpoint_timer(true);
     while (!quit) {
         boost::this_thread::sleep(boost::posix_time::seconds(10));
-        if (procmodn > 1 || generatormode) {
+        if (!exchange && (procmodn > 1 || generatormode)) {
             if (save_timer.time() > parameters.saveloadwait) {
                 load_save_trails();
                 save_timer.start();
             } // else load_save_trails(false);
         }
+        if (parameters.checkpointwait != 0 && checkpoint_timer.time() > parameters.checkpointwait) {
+            try {
+                save_checkpoint();
+            } catch (exception &e) {
+                cerr << "Checkpoint failed: " << e.what() << endl;
+            }
+            checkpoint_timer.start();
+        }
         LOCK_GLOBAL_MUTEX;
-        status_line();
+        status_line(exchange.get());
     }
     cout << endl << "Waiting for threads to finish..." << flush;
     threads.join_all();
+    if (exchange_thread.joinable()) {
+        exchange_thread.join();
+    }
     cout << "done." << endl;
 
     for (unsigned i = 0; i < threads_data.size(); ++i) {
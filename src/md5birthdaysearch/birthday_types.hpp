@@ -39,6 +39,13 @@ struct birthday_parameters {
           sputhreads(0),
           saveloadwait(60),
           memhardlimit(false),
+          diskstorage(),
+          maxdisk(0),
+          exchange(),
+          exchangekey(),
+          checkpointwait(0),
+          resume(false),
+          calibrate(),
           distribution(false),
           cuda_enabled(false) {}
     unsigned threads;
@@ -53,6 +60,13 @@ struct birthday_parameters {
     unsigned maxmemory; // in MB, this is NOT a hard limit
     unsigned saveloadwait;
     bool memhardlimit;
+    std::string diskstorage; // directory for trails on disk, empty = RAM only
+    unsigned maxdisk;        // in GB
+    std::string exchange;    // host:port of each process for the TCP trail exchange, empty = through workdir
+    std::string exchangekey; // shared by all processes of the trail exchange, part of its token
+    unsigned checkpointwait; // in seconds, 0 = no checkpoints
+    bool resume;             // continue from the last checkpoint in workdir
+    std::string calibrate;   // file to write the calibrated parameters to, empty = no calibration
     bool distribution;
     bool cuda_enabled;
     uint32 ihv1[4];
@@ -80,6 +94,21 @@ struct trail_type {
     bool operator!=(const trail_type &rhs) const { return !(*this == rhs); }
 };
 
+// walk of a pair of colliding trails: both are walked from their start until they merge
+struct collision_walk_type {
+    // after a merged walk: the points of both trails just before they merge
+    uint32 x1, y1, z1;
+    uint32 x2, y2, z2;
+    uint32 len; // number of steps left to walk after aligning both trails
+    uint32 status;
+
+    enum {
+        walk_merged = 0,    // the trails merge, the points above are the birthday collision
+        walk_robinhood = 1, // one trail starts on the other trail
+        walk_nomerge = 2    // the trails do not merge: the trails did not have the same end point
+    };
+};
+
 class cuda_device_detail;
 class cuda_device {
   public:
@@ -103,9 +132,63 @@ class cuda_device {
     cuda_device_detail *detail;
 };
 
+// SIMD backend for trail generation and collision walks, one trail or walk per lane
+// a lane that finishes its trail or walk immediately continues with a new one
+class simd_device {
+  public:
+    virtual ~simd_device() {}
+    // returns false if the backend is not compiled in or not supported by the CPU
+    virtual bool init(
+        const uint32 ihv1[4],
+        const uint32 ihv2[4],
+        const uint32 ihv2mod[4],
+        const uint32 precomp1[4],
+        const uint32 precomp2[4],
+        const uint32 msg1[16],
+        const uint32 msg2[16],
+        uint32 hmask,
+        uint32 dpmask,
+        uint32 maxlen
+    ) = 0;
+    // generate trails whose starting points are the 64-bit counter value itself, counting up from seed, with start[2] = 0
+    virtual void fill_trail_buffer(uint64 seed, vector<trail_type> &buffer, bool mod = false) = 0;
+    // walk all pairs of colliding trails
+    virtual void walk_collisions(const vector<pair<trail_type, trail_type>> &collisions, vector<collision_walk_type> &walks, bool mod = false) = 0;
+    virtual const char *name() const = 0;
+};
+
+class simd_avx512_detail;
+class simd_device_avx512 : public simd_device {
+  public:
+    simd_device_avx512()
+        : detail(0) {}
+    ~simd_device_avx512();
+    bool init(
+        const uint32 ihv1[4],
+        const uint32 ihv2[4],
+        const uint32 ihv2mod[4],
+        const uint32 precomp1[4],
+        const uint32 precomp2[4],
+        const uint32 msg1[16],
+        const uint32 msg2[16],
+        uint32 hmask,
+        uint32 dpmask,
+        uint32 maxlen
+    );
+    void fill_trail_buffer(uint64 seed, vector<trail_type> &buffer, bool mod = false);
+    void walk_collisions(const vector<pair<trail_type, trail_type>> &collisions, vector<collision_walk_type> &walks, bool mod = false);
+    const char *name() const { return "AVX512"; }
+
+  private:
+    simd_avx512_detail *detail;
+};
+
 class simd_avx256_detail;
-class simd_device_avx256 {
+class simd_device_avx256 : public simd_device {
   public:
+    simd_device_avx256()
+        : detail(0) {}
+    ~simd_device_avx256();
     bool init(
         const uint32 ihv1[4],
         const uint32 ihv2[4],
@@ -119,9 +202,51 @@ class simd_device_avx256 {
         uint32 maxlen
     );
     void fill_trail_buffer(uint64 seed, vector<trail_type> &buffer, bool mod = false);
+    void walk_collisions(const vector<pair<trail_type, trail_type>> &collisions, vector<collision_walk_type> &walks, bool mod = false);
+    const char *name() const { return "AVX256"; }
 
   private:
     simd_avx256_detail *detail;
 };
 
+class simd_scalar_detail;
+class simd_device_scalar : public simd_device {
+  public:
+    simd_device_scalar()
+        : detail(0) {}
+    ~simd_device_scalar();
+    bool init(
+        const uint32 ihv1[4],
+        const uint32 ihv2[4],
+        const uint32 ihv2mod[4],
+        const uint32 precomp1[4],
+        const uint32 precomp2[4],
+        const uint32 msg1[16],
+        const uint32 msg2[16],
+        uint32 hmask,
+        uint32 dpmask,
+        uint32 maxlen
+    );
+    void fill_trail_buffer(uint64 seed, vector<trail_type> &buffer, bool mod = false);
+    void walk_collisions(const vector<pair<trail_type, trail_type>> &collisions, vector<collision_walk_type> &walks, bool mod = false);
+    const char *name() const { return "SCALAR"; }
+
+  private:
+    simd_scalar_detail *detail;
+};
+
+// returns the initialized backend with the widest SIMD words the CPU supports (simd_device::init for the parameters)
+simd_device *create_simd_device(
+    const uint32 ihv1[4],
+    const uint32 ihv2[4],
+    const uint32 ihv2mod[4],
+    const uint32 precomp1[4],
+    const uint32 precomp2[4],
+    const uint32 msg1[16],
+    const uint32 msg2[16],
+    uint32 hmask,
+    uint32 dpmask,
+    uint32 maxlen
+);
+
 #endif // BIRTHDAY_TYPES_HPP
@@ -0,0 +1,237 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+// check program for the SIMD backends of md5_birthdaysearch: the trails and collision walks of every backend
+// supported by the CPU must be exactly those of a scalar reference step computed with the MD5 step functions,
+// and their starting points must be 64-bit counter values, which is all the trail storage keeps
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <boost/cstdint.hpp>
+
+using namespace std;
+
+typedef boost::uint32_t uint32;
+typedef boost::uint64_t uint64;
+
+#include <hashclash/config.h>
+#include <hashclash/check.hpp>
+#include <hashclash/md5detail.hpp>
+#include <hashclash/rng.hpp>
+#include "birthday_types.hpp"
+
+using hashclash::check;
+using hashclash::check_result;
+
+uint32 ihv1[4], ihv2[4], ihv2mod[4], msg1[16], msg2[16], precomp1[4], precomp2[4];
+const uint32 hmask = 0x3F, dpmask = 0x7F, maxlen = 1000;
+
+// birthday_step of birthday.cpp: MD5 steps 13 to 63 from the precomputed state with x, y, z as message words 14, 15, 13
+void reference_step(uint32 &x, uint32 &y, uint32 &z, bool mod) {
+    const bool first = (x <= y);
+    const uint32 *precomp = first ? precomp1 : precomp2, *ihv = first ? ihv1 : ihv2mod;
+    uint32 W[16];
+    for (unsigned i = 0; i < 16; ++i) {
+        W[i] = first ? msg1[i] : msg2[i];
+    }
+    W[13] = z;
+    W[14] = x;
+    W[15] = y;
+    // Q[3 + t] = Q_t, the precomputed state is (Q_13, Q_12, Q_11, Q_10)
+    uint32 Q[68];
+    Q[3 + 13] = precomp[0];
+    Q[3 + 12] = precomp[1];
+    Q[3 + 11] = precomp[2];
+    Q[3 + 10] = precomp[3];
+    for (unsigned t = 13; t < 64; ++t) {
+        Q[3 + t + 1] = hashclash::md5_step(t, Q[3 + t], Q[3 + t - 1], Q[3 + t - 2], Q[3 + t - 3], W[hashclash::md5_wt[t]]);
+    }
+    const uint32 a = Q[3 + 61] + ihv[0], b = Q[3 + 64] + ihv[1], c = Q[3 + 63] + ihv[2], d = Q[3 + 62] + ihv[3];
+    if (!mod) {
+        x = a;
+        y = d - c;
+        z = (d - b) & hmask;
+    } else {
+        x = a;
+        y = d;
+        z = c & hmask;
+    }
+}
+
+// walk_collision of birthday.cpp
+void reference_walk(const trail_type &trail1, const trail_type &trail2, collision_walk_type &walk, bool mod) {
+    uint32 a1 = trail1.start[0], b1 = trail1.start[1], c1 = trail1.start[2];
+    uint32 a2 = trail2.start[0], b2 = trail2.start[1], c2 = trail2.start[2];
+    uint32 len1 = trail1.len, len2 = trail2.len;
+    for (; len1 > len2; --len1) {
+        reference_step(a1, b1, c1, mod);
+    }
+    for (; len2 > len1; --len2) {
+        reference_step(a2, b2, c2, mod);
+    }
+    if (a1 == a2 && b1 == b2 && c1 == c2) {
+        walk.x1 = walk.x2 = a1;
+        walk.y1 = walk.y2 = b1;
+        walk.z1 = walk.z2 = c1;
+        walk.len = len1;
+        walk.status = collision_walk_type::walk_robinhood;
+        return;
+    }
+    uint32 oa1 = a1, oa2 = a2, ob1 = b1, ob2 = b2, oc1 = c1, oc2 = c2;
+    while ((a1 != a2 || b1 != b2 || c1 != c2) && len1 > 0) {
+        oa1 = a1;
+        oa2 = a2;
+        ob1 = b1;
+        ob2 = b2;
+        oc1 = c1;
+        oc2 = c2;
+        reference_step(a1, b1, c1, mod);
+        reference_step(a2, b2, c2, mod);
+        --len1;
+    }
+    walk.x1 = oa1;
+    walk.y1 = ob1;
+    walk.z1 = oc1;
+    walk.x2 = oa2;
+    walk.y2 = ob2;
+    walk.z2 = oc2;
+    walk.len = len1;
+    walk.status = (a1 != a2 || b1 != b2 || c1 != c2) ? collision_walk_type::walk_nomerge : collision_walk_type::walk_merged;
+}
+
+// the trail from start, its end is the first distinguished point
+bool reference_trail(const trail_type &trail, bool mod) {
+    uint32 x = trail.start[0], y = trail.start[1], z = trail.start[2];
+    for (uint32 len = 1; len <= maxlen; ++len) {
+        reference_step(x, y, z, mod);
+        if ((x & dpmask) == 0) {
+            return len == trail.len && x == trail.end[0] && y == trail.end[1] && z == trail.end[2];
+        }
+    }
+    return false;
+}
+
+trail_type trail_from(uint32 x, uint32 y, uint32 z, uint32 len, uint32 steps, bool mod) {
+    trail_type trail;
+    for (uint32 k = 0; k < steps; ++k) {
+        reference_step(x, y, z, mod);
+    }
+    trail.start[0] = x;
+    trail.start[1] = y;
+    trail.start[2] = z;
+    trail.len = len;
+    return trail;
+}
+
+bool same(const collision_walk_type &l, const collision_walk_type &r) {
+    return l.status == r.status && l.len == r.len && l.x1 == r.x1 && l.y1 == r.y1 && l.z1 == r.z1 && l.x2 == r.x2 && l.y2 == r.y2 &&
+           l.z2 == r.z2;
+}
+
+void check_device(simd_device &device, bool mod) {
+    const string name = string(device.name()) + (mod ? " (mod)" : "");
+    vector<trail_type> trails;
+    const uint64 seed = hashclash::xrng128() + (uint64(hashclash::xrng128()) << 32);
+    device.fill_trail_buffer(seed, trails, mod);
+    check(trails.size() > 1000, name + ": trails generated");
+    // the storage drops trails with start[2] != 0
+    bool counter = true;
+    for (size_t j = 0; j < trails.size(); ++j) {
+        const uint64 start = trails[j].start[0] + (uint64(trails[j].start[1]) << 32), step = (uint64(1) << 32) + 1;
+        counter = counter && trails[j].start[2] == 0 && (start - seed) % step == 0 && (start - seed) / step <= (uint64(1) << 32);
+    }
+    check(counter, name + ": trails start from the counter with start[2] = 0");
+    bool ok = true;
+    for (size_t j = 0; j < trails.size(); j += 1 + trails.size() / 500) {
+        ok = ok && reference_trail(trails[j], mod);
+    }
+    check(ok, name + ": trails equal the reference trails");
+
+    // pairs of unrelated trails, of the same trail, of a trail and a later part of it (robin hoods),
+    // and with inconsistent lengths, in an order that mixes aligned and unaligned pairs over the lanes
+    vector<pair<trail_type, trail_type>> collisions;
+    for (size_t j = 0; j + 1 < trails.size() && collisions.size() < 400; j += 2) {
+        const trail_type &tr = trails[j];
+        const uint32 k = tr.len > 1 ? 1 + hashclash::xrng128() % (tr.len - 1) : 0;
+        switch (collisions.size() % 5) {
+        case 0:
+            collisions.push_back(make_pair(tr, trails[j + 1]));
+            break;
+        case 1:
+            collisions.push_back(make_pair(tr, tr));
+            break;
+        case 2:
+            collisions.push_back(make_pair(tr, trail_from(tr.start[0], tr.start[1], tr.start[2], tr.len - k, k, mod)));
+            break;
+        case 3:
+            collisions.push_back(make_pair(trail_from(tr.start[0], tr.start[1], tr.start[2], tr.len - k, k, mod), tr));
+            break;
+        default:
+            collisions.push_back(make_pair(tr, trail_from(tr.start[0], tr.start[1], tr.start[2], tr.len, k, mod)));
+            break;
+        }
+    }
+    vector<collision_walk_type> walks;
+    device.walk_collisions(collisions, walks, mod);
+    check(walks.size() == collisions.size(), name + ": one walk per pair");
+    unsigned robinhoods = 0, nomerges = 0;
+    ok = true;
+    for (size_t j = 0; j < collisions.size() && j < walks.size(); ++j) {
+        collision_walk_type walk;
+        reference_walk(collisions[j].first, collisions[j].second, walk, mod);
+        ok = ok && same(walk, walks[j]);
+        robinhoods += (walk.status == collision_walk_type::walk_robinhood);
+        nomerges += (walk.status == collision_walk_type::walk_nomerge);
+    }
+    check(ok, name + ": collision walks equal the reference walks");
+    check(robinhoods != 0 && nomerges != 0, name + ": robin hoods and walks that do not merge are covered");
+}
+
+int main() {
+    hashclash::seed(1);
+    for (unsigned k = 0; k < 4; ++k) {
+        ihv1[k] = hashclash::xrng128();
+        ihv2[k] = hashclash::xrng128();
+        ihv2mod[k] = hashclash::xrng128();
+        precomp1[k] = hashclash::xrng128();
+        precomp2[k] = hashclash::xrng128();
+    }
+    for (unsigned k = 0; k < 16; ++k) {
+        msg1[k] = hashclash::xrng128();
+        msg2[k] = hashclash::xrng128();
+    }
+    unique_ptr<simd_device> devices[] = {
+        unique_ptr<simd_device>(new simd_device_avx512),
+        unique_ptr<simd_device>(new simd_device_avx256),
+        unique_ptr<simd_device>(new simd_device_scalar)
+    };
+    for (auto &device : devices) {
+        if (!device->init(ihv1, ihv2, ihv2mod, precomp1, precomp2, msg1, msg2, hmask, dpmask, maxlen)) {
+            cout << device->name() << ": not supported, skipped" << endl;
+            continue;
+        }
+        check_device(*device, false);
+        // init drops the trails in progress, these were walked without mod
+        device->init(ihv1, ihv2, ihv2mod, precomp1, precomp2, msg1, msg2, hmask, dpmask, maxlen);
+        check_device(*device, true);
+    }
+    return check_result("collision walks");
+}
@@ -0,0 +1,123 @@
+#!/usr/bin/env bash
+# Three md5_birthdaysearch processes exchange trails over TCP on 127.0.0.1 (--mod 3 --exchange).
+# Process 1 reaches process 0 through a proxy that drops the reply to the first batch it forwards,
+# so process 1 resends that batch and process 0 has to drop it as a duplicate by its session and sequence number.
+# The proxy then sends a copy of that batch with a wrong token, which process 0 has to refuse without a reply.
+
+command -v python3 >/dev/null || exit 77
+# make check runs the tests from the top build directory
+bin="$PWD/bin/md5_birthdaysearch"
+[[ -x "$bin" ]] || exit 77
+
+tmp=$(mktemp -d)
+trap 'kill $(jobs -p) 2>/dev/null; wait 2>/dev/null; rm -rf "$tmp"' EXIT
+cd "$tmp" || exit 1
+printf 'prefix one\n' > in1
+printf 'prefix two!\n' > in2
+
+base=$(( 20000 + RANDOM % 20000 ))
+p0=$base p1=$(( base + 1 )) p2=$(( base + 2 )) proxy=$(( base + 3 ))
+
+python3 - "$proxy" "$p0" > proxy.log 2>&1 <<'EOF' &
+import socket, struct, sys, threading
+listen, upstream = int(sys.argv[1]), int(sys.argv[2])
+header_size, reply_size, record_size = 44, 32, 24
+state = {"dropped": False}
+
+def recv_all(s, n):
+    data = b""
+    while len(data) < n:
+        part = s.recv(n - len(data))
+        if not part:
+            raise EOFError()
+        data += part
+    return data
+
+def wrong_token(batch):
+    s = socket.create_connection(("127.0.0.1", upstream))
+    s.settimeout(10)
+    bad = bytearray(batch)
+    bad[28] ^= 1
+    s.sendall(bytes(bad))
+    try:
+        reply = s.recv(reply_size)
+    except OSError:
+        reply = b""
+    print("wrong token: " + ("no reply" if not reply else "replied"), flush=True)
+    s.close()
+
+def forward(client):
+    up = socket.create_connection(("127.0.0.1", upstream))
+    try:
+        while True:
+            header = recv_all(client, header_size)
+            count = struct.unpack_from("<I", header, 16)[0]
+            batch = header + recv_all(client, count * record_size)
+            up.sendall(batch)
+            reply = recv_all(up, reply_size)
+            if count > 0 and not state["dropped"]:
+                state["dropped"] = True
+                print("dropped the reply to a batch of %d trails" % count, flush=True)
+                client.close()
+                up.close()
+                wrong_token(batch)
+                return
+            client.sendall(reply)
+    except (EOFError, OSError):
+        pass
+    client.close()
+    up.close()
+
+server = socket.socket()
+server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+server.bind(("127.0.0.1", listen))
+server.listen(8)
+while True:
+    conn, _ = server.accept()
+    threading.Thread(target=forward, args=(conn,), daemon=True).start()
+EOF
+
+direct="127.0.0.1:$p0,127.0.0.1:$p1,127.0.0.1:$p2"
+viaproxy="127.0.0.1:$proxy,127.0.0.1:$p1,127.0.0.1:$p2"
+for i in 0 1 2; do
+	endpoints=$direct
+	[[ $i == 1 ]] && endpoints=$viaproxy
+	mkdir w$i
+	(cd w$i && exec timeout 25 "$bin" --inputfile1 ../in1 --inputfile2 ../in2 --mod 3 --index $i \
+		--exchange "$endpoints" --exchangekey check --threads 1 --logtraillength 8 --maxmemory 10 --maxblocks 16 \
+		> ../log$i 2>&1) &
+done
+sleep 24
+
+failures=0
+fail() {
+	echo "FAILED: $1"
+	(( ++failures ))
+}
+# the last status line of process i: received <trails> trails in <batches> batches (dup=<d>,refused=<r>)
+exchange_status() {
+	grep -o 'Exchange: received [0-9]* trails in [0-9]* batches (dup=[0-9]*,refused=[0-9]*)' log$1 | tail -n 1 | tr -c '0-9\n' ' '
+}
+for i in 0 1 2; do
+	read -r trails batches dup refused <<< "$(exchange_status $i)"
+	[[ -n "$trails" ]] || { fail "process $i reports no exchange status"; continue; }
+	(( trails > 0 && batches > 0 )) || fail "process $i received no trails"
+	if [[ $i == 0 ]]; then
+		(( dup >= 1 )) || fail "process 0 did not drop the resent batch"
+		(( refused >= 1 )) || fail "process 0 did not refuse the wrong token"
+	else
+		(( dup == 0 && refused == 0 )) || fail "process $i dropped or refused batches without cause"
+	fi
+done
+grep -q "dropped the reply" proxy.log || fail "no batch of process 1 passed the proxy"
+grep -q "wrong token: no reply" proxy.log || fail "a batch with a wrong token was answered"
+
+if (( failures != 0 )); then
+	for f in proxy.log log0 log1 log2; do
+		echo "== $f"
+		tail -n 5 $f
+	done
+	echo "$failures checks failed"
+	exit 1
+fi
+echo "trail exchange: all checks passed"
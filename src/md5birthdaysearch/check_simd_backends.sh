@@ -0,0 +1,24 @@
+#!/usr/bin/env bash
+# The SIMD backends of md5_birthdaysearch are compiled for the baseline CPU, only their kernels carry a target attribute.
+# Check that the code they share with other objects (weak symbols: inline and template code) and the init method,
+# which runs before the CPU support is known, contain no VEX or EVEX encoded instructions.
+
+command -v nm >/dev/null && command -v objdump >/dev/null || exit 77
+objdump --help | grep -q -- "--disassemble=" || exit 77
+
+dir=$(dirname "$0")/.libs
+failures=0
+for obj in "$dir"/libsimd_avx*.o; do
+	[[ -f "$obj" ]] || exit 77
+	for sym in $(nm "$obj" | awk '$2 == "W" || ($2 == "T" && $3 ~ /4initE/) { print $3 }'); do
+		if objdump -d --no-show-raw-insn --disassemble="$sym" "$obj" | grep -qP '\tv[a-z0-9]+\s'; then
+			echo "$(basename "$obj"): $(echo "$sym" | c++filt) uses instructions of the backend"
+			(( ++failures ))
+		fi
+	done
+done
+if (( failures != 0 )); then
+	echo "$failures checks failed"
+	exit 1
+fi
+echo "simd backends: all checks passed"
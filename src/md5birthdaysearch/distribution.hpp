@@ -17,57 +17,171 @@
 |
 \**************************************************************************/
 
+// LOCK_GLOBAL_MUTEX not needed
+// number of near-collision blocks for a batch of random birthday collisions: samples are processed in arrays
+// one operation at a time, so the compiler vectorizes every loop over the batch
+class nrblocks_sampler {
+  public:
+    static const unsigned batch = 1024;
+
+    nrblocks_sampler(unsigned hybridbits, unsigned pathtyperange)
+        : pathtyperange(pathtyperange), ptrmaskt2(0) {
+        const unsigned N = 32 - hybridbits;
+        mask = (N == 0) ? 0 : uint32(~0) << (32 - N);
+        for (unsigned j = 0; j < pathtyperange; ++j) {
+            ptrmaskt2 |= 2 << j;
+        }
+    }
+
+    void sample(vector<uint64> &counts) {
+        for (unsigned i = 0; i < batch; ++i) {
+            x1[i] = xrng64() + xrng64() * 11;
+            x2[i] = xrng64() & mask;
+        }
+        // naf masks: n ^ (n >> 1) + (n >> 1)
+        for (unsigned i = 0; i < batch; ++i) {
+            const uint32 a1 = x1[i] >> 1, a2 = x2[i] >> 1;
+            p1[i] = a1 ^ (a1 + x1[i]);
+            const uint32 n2 = a2 ^ (a2 + x2[i]);
+            p2[i] = (n2 >> 21) | (n2 << 11);
+            p1mask[i] = p1[i];
+        }
+        for (unsigned j = 0; j < pathtyperange; ++j) {
+            for (unsigned i = 0; i < batch; ++i) {
+                p1mask[i] |= p1[i] << (j + 1);
+            }
+        }
+        for (unsigned i = 0; i < batch; ++i) {
+            p2[i] &= ~p1mask[i];
+        }
+        // from the least significant bit up, a bit of p2 removes the next pathtyperange bits
+        if (ptrmaskt2 != 0) {
+            for (unsigned b = 0; b < 32; ++b) {
+                const uint32 m = ptrmaskt2 << b;
+                for (unsigned i = 0; i < batch; ++i) {
+                    p2[i] &= ~(m & (0 - ((p2[i] >> b) & 1)));
+                }
+            }
+        }
+        for (unsigned i = 0; i < batch; ++i) {
+            uint32 q1 = p1[i] & ~(p2[i] << 1);
+            q1 &= ~(q1 >> 31);
+            weight[i] = __builtin_popcount(q1) + 2 * __builtin_popcount(p2[i]);
+        }
+        for (unsigned i = 0; i < batch; ++i) {
+            ++counts[weight[i]];
+        }
+    }
+
+  private:
+    unsigned pathtyperange;
+    uint32 mask, ptrmaskt2;
+    uint32 x1[batch], x2[batch], p1[batch], p2[batch], p1mask[batch], weight[batch];
+};
+
+// LOCK_GLOBAL_MUTEX not needed
+struct nrblocks_counts_type {
+    vector<uint64> counts;
+    uint64 totcount;
+
+    template <class Archive> void serialize(Archive &ar, const unsigned int file_version) {
+        ar &boost::serialization::make_nvp("counts", counts);
+        ar &boost::serialization::make_nvp("totcount", totcount);
+    }
+};
+
+// LOCK_GLOBAL_MUTEX not needed
+// sample until stop is set, adding to the shared counts every 2^20 samples
+void nrblocks_distribution_worker(
+    unsigned hybridbits, unsigned pathtyperange, const boost::atomic<bool> &stop, nrblocks_counts_type &shared, boost::mutex &mut
+) {
+    std::unique_ptr<nrblocks_sampler> sampler(new nrblocks_sampler(hybridbits, pathtyperange));
+    vector<uint64> counts(shared.counts.size(), 0);
+    while (!stop) {
+        for (unsigned k = 0; k < (1 << 20) / nrblocks_sampler::batch; ++k) {
+            sampler->sample(counts);
+        }
+        boost::mutex::scoped_lock lock(mut);
+        for (unsigned i = 0; i < counts.size(); ++i) {
+            shared.counts[i] += counts[i];
+            counts[i] = 0;
+        }
+        shared.totcount += 1 << 20;
+    }
+}
+
 // LOCK_GLOBAL_MUTEX not needed
 /* function to determine the cumulative probability distribution
    of the number of near-collision blocks required
    and the estimated complexity to find such an birthday collision
+
+   Sampling runs on all threads and stops when every cumulative probability for at most 16 blocks
+   is known within 5% (95% confidence), or is confidently below 2^-20 where the complexity is beyond 2^42 anyway.
+   The counts are cached in nrblockscounts_hb<hybridbits>_tr<pathtyperange>.bin and later runs continue from them.
 */
 void determine_nrblocks_distribution(birthday_parameters &parameters) {
-    uint64 totcount = 0;
-    vector<uint64> counts(64, 0);
-    timer sw(true);
-    uint32 dihv[4] = {0};
-    unsigned N = 32 - parameters.hybridbits;
-    uint32 mask = (N == 0) ? 0 : uint32(~0) << (32 - N);
-    uint32 ptrmaskt2 = 0;
-    for (unsigned j = 0; j < parameters.pathtyperange; ++j) {
-        ptrmaskt2 |= 2 << j;
+    const double z = 1.96, precision = 0.05, minprob = pow(double(2), -20);
+    const uint64 maxcount = uint64(1) << 40;
+    const unsigned N = 32 - parameters.hybridbits;
+
+    const string countsfilename = "nrblockscounts_hb" + boost::lexical_cast<std::string>(parameters.hybridbits) + "_tr" +
+                                  boost::lexical_cast<std::string>(parameters.pathtyperange) + ".bin";
+    nrblocks_counts_type data;
+    try {
+        load(data, binary_archive, countsfilename);
+        cout << "Continuing from " << data.totcount << " cached samples in " << countsfilename << endl;
+    } catch (exception &) {
+    } catch (...) {
     }
-    while (true) {
-        totcount += 0x10000;
-        for (unsigned i = 0; i < 0x10000; ++i) {
-            sdr p1naf = naf(xrng64() + xrng64() * 11);
-            sdr p2naf = naf(xrng64() & mask);
-            uint32 p1nafmask = p1naf.mask;
-            uint32 p2nafmask = rotate_right(p2naf.mask, 21);
-            uint32 p1mask = p1nafmask;
-            for (unsigned j = 0; j < parameters.pathtyperange; ++j) {
-                p1mask |= p1nafmask << (j + 1);
-            }
-            p2nafmask &= ~p1mask;
-            for (unsigned b = 0; b < 32; ++b) {
-                if (p2nafmask & (1 << b)) {
-                    p2nafmask &= ~(ptrmaskt2 << b);
+    if (data.counts.size() != 65) {
+        data.counts.assign(65, 0);
+        data.totcount = 0;
+    }
+
+    unsigned threads = parameters.threads;
+    if (threads == 0 || threads > boost::thread::hardware_concurrency()) {
+        threads = boost::thread::hardware_concurrency();
+    }
+    boost::mutex mut;
+    boost::atomic<bool> stop(false);
+    boost::thread_group workers;
+    timer sw(true);
+    bool done = false;
+    while (!done) {
+        nrblocks_counts_type snapshot;
+        {
+            boost::mutex::scoped_lock lock(mut);
+            snapshot = data;
+        }
+        // stopping rule on the cumulative counts for at most 16 blocks
+        done = snapshot.totcount >= maxcount;
+        if (!done && snapshot.totcount > 0) {
+            done = true;
+            uint64 cumcount = 0;
+            for (unsigned i = 0; i <= 16; ++i) {
+                cumcount += snapshot.counts[i];
+                const double prob = double(cumcount) / double(snapshot.totcount);
+                const bool precise = cumcount > 0 && z * sqrt((1 - prob) / double(cumcount)) <= precision;
+                const double upper = (double(cumcount) + z * sqrt(double(cumcount) + 1) + z * z) / double(snapshot.totcount);
+                if (!precise && upper >= minprob) {
+                    done = false;
                 }
             }
-            p1nafmask &= ~(p2nafmask << 1);
-            p1nafmask &= ~(p1nafmask >> 31);
-            ++counts[hw(p1nafmask) + 2 * hw(p2nafmask)];
         }
-        if (sw.time() > 10) {
+        if (done || sw.time() > 10) {
             sw.start();
-            cout << "#NC\tComplexity\tMinMemory\tProbability\tCumCount" << endl;
+            cout << "#NC\tComplexity\tMinMemory\tProbability\tCumCount\t95% interval" << endl;
             vector<double> probs;
-            for (int i = counts.size() - 1; i >= 0; --i) {
+            for (int i = 64; i >= 0; --i) {
                 uint64 cumcount = 0;
                 for (int j = 0; j <= i; ++j) {
-                    cumcount += counts[j];
+                    cumcount += snapshot.counts[j];
                 }
-                double prob = double(cumcount) / double(totcount);
+                double prob = double(cumcount) / double(snapshot.totcount);
                 if (cumcount == 0) {
                     prob = pow(double(2), -double(N + 32));
                 }
-                if (cumcount != totcount || counts[i] > 0) {
+                if (cumcount != snapshot.totcount || snapshot.counts[i] > 0) {
                     if (i >= probs.size()) {
                         probs.resize(i + 1);
                     }
@@ -75,22 +189,34 @@ void determine_nrblocks_distribution(birthday_parameters &parameters) {
                     cout << i << ": \t2^(" << 48 - (0.5 * N) + (log(sqrt(double(3.14159) / prob)) / log(double(2))) << ")";
                     cout << "\t" << ceil((140 / prob) / (1024 * 1024)) << "MB";
                     cout << "\t\t2^(" << log(prob) / log(double(2)) << ")";
-                    cout << "\t" << cumcount << endl;
+                    cout << "\t" << cumcount;
+                    if (cumcount > 0) {
+                        cout << "\t\t+-" << 100 * z * sqrt((1 - prob) / double(cumcount)) << "%";
+                    }
+                    cout << endl;
                 }
             }
-            cout << "hybridbits=" << parameters.hybridbits << ", pathtyperange=" << parameters.pathtyperange << endl;
+            cout << "hybridbits=" << parameters.hybridbits << ", pathtyperange=" << parameters.pathtyperange
+                 << ", samples=" << snapshot.totcount << endl;
             string probsfilename = "probabilities_hb" + boost::lexical_cast<std::string>(parameters.hybridbits) + "_tr" +
                                    boost::lexical_cast<std::string>(parameters.pathtyperange);
             save(probs, probsfilename, xml_archive);
-
-#if 1
-            // exit after some reasonable time
-            if (totcount >> 34) {
-                return;
+            save(snapshot, binary_archive, countsfilename);
+        }
+        if (!done) {
+            if (workers.size() == 0) {
+                for (unsigned t = 0; t < threads; ++t) {
+                    workers.create_thread(boost::bind(
+                        nrblocks_distribution_worker, parameters.hybridbits, parameters.pathtyperange, boost::cref(stop), boost::ref(data),
+                        boost::ref(mut)
+                    ));
+                }
             }
-#endif
+            boost::this_thread::sleep(boost::posix_time::milliseconds(250));
         }
     }
+    stop = true;
+    workers.join_all();
 }
 
 double dist[33][8][17] = {
@@ -0,0 +1,395 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <random>
+
+#include <sys/socket.h>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "main.hpp"
+#include "exchange.hpp"
+
+using boost::asio::ip::tcp;
+
+namespace {
+
+void put_word(vector<unsigned char> &buf, uint32 w) {
+    buf.push_back((unsigned char)(w));
+    buf.push_back((unsigned char)(w >> 8));
+    buf.push_back((unsigned char)(w >> 16));
+    buf.push_back((unsigned char)(w >> 24));
+}
+uint32 get_word(const unsigned char *p) { return uint32(p[0]) | (uint32(p[1]) << 8) | (uint32(p[2]) << 16) | (uint32(p[3]) << 24); }
+uint64 get_dword(const unsigned char *p) { return uint64(get_word(p)) | (uint64(get_word(p + 4)) << 32); }
+
+const unsigned header_size = 44, reply_size = 32, record_size = 24;
+
+bool same_token(const unsigned char *p, const vector<uint32> &token) {
+    for (unsigned k = 0; k < 4; ++k) {
+        if (get_word(p + 4 * k) != token[k]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// runs the asynchronous operation started on socket until it sets done,
+// after seconds the socket is closed to abort it
+void run_until_timeout(boost::asio::io_service &ios, tcp::socket &socket, const bool &done, unsigned seconds) {
+    bool expired = false;
+    boost::asio::deadline_timer timer(ios);
+    timer.expires_from_now(boost::posix_time::seconds(seconds));
+    timer.async_wait([&](const boost::system::error_code &e) {
+        if (!e) {
+            expired = true;
+            boost::system::error_code ec;
+            socket.close(ec);
+        }
+    });
+    ios.reset();
+    while (!done && ios.run_one()) {
+    }
+    timer.cancel();
+    ios.run();
+    if (expired) {
+        throw std::runtime_error("timed out");
+    }
+}
+
+// read or write all of buffer on socket within seconds
+template <typename Buffer>
+void read_until_timeout(boost::asio::io_service &ios, tcp::socket &socket, const Buffer &buffer, unsigned seconds) {
+    boost::system::error_code ec;
+    bool done = false;
+    boost::asio::async_read(socket, buffer, [&](const boost::system::error_code &e, size_t) {
+        ec = e;
+        done = true;
+    });
+    run_until_timeout(ios, socket, done, seconds);
+    if (ec) {
+        throw boost::system::system_error(ec);
+    }
+}
+template <typename Buffer>
+void write_until_timeout(boost::asio::io_service &ios, tcp::socket &socket, const Buffer &buffer, unsigned seconds) {
+    boost::system::error_code ec;
+    bool done = false;
+    boost::asio::async_write(socket, buffer, [&](const boost::system::error_code &e, size_t) {
+        ec = e;
+        done = true;
+    });
+    run_until_timeout(ios, socket, done, seconds);
+    if (ec) {
+        throw boost::system::system_error(ec);
+    }
+}
+
+} // namespace
+
+class trail_exchange::service {
+  public:
+    service()
+        : acceptor(ioc) {}
+    boost::asio::io_service ioc;
+    tcp::acceptor acceptor;
+};
+
+// every connection runs its operations on its own io_service, so each thread only runs its own handlers
+class trail_exchange::connection {
+  public:
+    connection()
+        : socket(ios) {}
+    // wakes up a thread waiting on the socket
+    void shutdown() {
+        boost::system::error_code ec;
+        socket.shutdown(tcp::socket::shutdown_both, ec);
+    }
+    boost::asio::io_service ios;
+    tcp::socket socket;
+};
+
+trail_exchange::trail_exchange(const std::string &endpoints, unsigned modn, unsigned modi, bool listen, receive_function receive,
+                               const vector<uint32> &token)
+    : modi(modi), receive(receive), token(token), io(new service), peers(modn), unreachable(modn, false), unsent(modn),
+      sequence(modn, 0), session(std::random_device()()), received(modn, std::make_pair(uint32(0), uint32(0))), works(modn, 0),
+      storedtrails(0), storedbatches(0), duplicates(0), refused(0), stopping(false) {
+    if (token.size() != 4) {
+        throw std::runtime_error("trail_exchange(): expected a token of 4 words");
+    }
+    std::string::size_type pos = 0;
+    while (pos <= endpoints.size()) {
+        std::string::size_type end = endpoints.find(',', pos);
+        if (end == std::string::npos) {
+            end = endpoints.size();
+        }
+        const std::string endpoint = endpoints.substr(pos, end - pos);
+        const std::string::size_type colon = endpoint.rfind(':');
+        if (colon == std::string::npos || colon == 0 || colon + 1 == endpoint.size()) {
+            throw std::runtime_error("trail_exchange(): expected host:port instead of '" + endpoint + "'");
+        }
+        hosts.emplace_back(endpoint.substr(0, colon), endpoint.substr(colon + 1));
+        pos = end + 1;
+    }
+    if (hosts.size() != modn) {
+        throw std::runtime_error("trail_exchange(): expected " + boost::lexical_cast<std::string>(modn) + " endpoints");
+    }
+    // resolved once: a lookup cannot be aborted, so it would not keep to the timeout of a delivery
+    tcp::resolver resolver(io->ioc);
+    addresses.resize(modn);
+    for (unsigned i = 0; i < modn; ++i) {
+        boost::system::error_code ec;
+        tcp::resolver::iterator it = resolver.resolve(tcp::resolver::query(hosts[i].first, hosts[i].second), ec);
+        for (; !ec && it != tcp::resolver::iterator(); ++it) {
+            addresses[i].push_back(it->endpoint());
+        }
+        if (addresses[i].empty()) {
+            throw std::runtime_error("trail_exchange(): cannot resolve " + hosts[i].first + ":" + hosts[i].second);
+        }
+    }
+    if (listen) {
+        const tcp::endpoint local = addresses[modi].front();
+        io->acceptor.open(local.protocol());
+        io->acceptor.set_option(tcp::acceptor::reuse_address(true));
+        io->acceptor.bind(local);
+        io->acceptor.listen();
+        threads.create_thread(boost::bind(&trail_exchange::accept_loop, this));
+    }
+}
+
+trail_exchange::~trail_exchange() {
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        stopping = true;
+        for (auto &client : clients) {
+            client->shutdown();
+        }
+    }
+    if (io->acceptor.is_open()) {
+        // closing does not wake up a blocking accept
+        ::shutdown(io->acceptor.native_handle(), SHUT_RDWR);
+    }
+    threads.join_all();
+    boost::mutex::scoped_lock lock(mutex);
+    while (!clients.empty()) {
+        finished.wait(lock);
+    }
+}
+
+void trail_exchange::accept_loop() {
+    while (true) {
+        std::shared_ptr<connection> conn(new connection);
+        boost::system::error_code ec;
+        io->acceptor.accept(conn->socket, ec);
+        boost::mutex::scoped_lock lock(mutex);
+        if (stopping) {
+            return;
+        }
+        if (ec) {
+            cerr << "Trail exchange: accept failed: " << ec.message() << endl;
+            continue;
+        }
+        clients.push_back(conn);
+        boost::thread(boost::bind(&trail_exchange::serve, this, conn)).detach();
+    }
+}
+
+void trail_exchange::serve(std::shared_ptr<connection> conn) {
+    try {
+        vector<unsigned char> buf;
+        vector<trail_type> trails;
+        while (true) {
+            unsigned char header[header_size];
+            read_until_timeout(conn->ios, conn->socket, boost::asio::buffer(header), idle_timeout);
+            const unsigned proci = get_word(header + 4);
+            const uint32 count = get_word(header + 16);
+            if (get_word(header) != magic || !same_token(header + 28, token) || proci >= works.size() || count > maxbatch) {
+                boost::mutex::scoped_lock lock(mutex);
+                ++refused;
+                cerr << "Trail exchange: refused a connection with a bad batch header" << endl;
+                throw std::runtime_error("bad batch header");
+            }
+            const std::pair<uint32, uint32> batchid(get_word(header + 20), get_word(header + 24));
+            buf.resize(size_t(count) * record_size);
+            read_until_timeout(conn->ios, conn->socket, boost::asio::buffer(buf), timeout);
+            trails.resize(count);
+            for (uint32 j = 0; j < count; ++j) {
+                const unsigned char *p = &buf[size_t(j) * record_size];
+                trails[j].start[0] = get_word(p);
+                trails[j].start[1] = get_word(p + 4);
+                trails[j].start[2] = 0;
+                trails[j].end[0] = get_word(p + 8);
+                trails[j].end[1] = get_word(p + 12);
+                trails[j].end[2] = get_word(p + 16);
+                trails[j].len = get_word(p + 20);
+            }
+            set_work(proci, get_dword(header + 8));
+            bool duplicate = false;
+            if (count > 0) {
+                // marked before storing: a resent batch can arrive on a new connection while this one is still being stored
+                boost::mutex::scoped_lock lock(mutex);
+                duplicate = (received[proci] == batchid);
+                received[proci] = batchid;
+                if (duplicate) {
+                    ++duplicates;
+                } else {
+                    storedtrails += count;
+                    ++storedbatches;
+                }
+            }
+            if (count > 0 && !duplicate) {
+                receive(trails);
+            }
+
+            buf.clear();
+            put_word(buf, magic);
+            put_word(buf, modi);
+            uint64 mywork;
+            {
+                boost::mutex::scoped_lock lock(mutex);
+                mywork = works[modi];
+            }
+            put_word(buf, uint32(mywork));
+            put_word(buf, uint32(mywork >> 32));
+            for (unsigned k = 0; k < 4; ++k) {
+                put_word(buf, token[k]);
+            }
+            write_until_timeout(conn->ios, conn->socket, boost::asio::buffer(buf), timeout);
+        }
+    } catch (std::exception &e) {
+        // connection closed, broken or refused: the sender reconnects
+        boost::system::error_code ec;
+        conn->socket.close(ec);
+    }
+    boost::mutex::scoped_lock lock(mutex);
+    for (size_t i = 0; i < clients.size(); ++i) {
+        if (clients[i] == conn) {
+            clients[i] = clients.back();
+            clients.pop_back();
+            break;
+        }
+    }
+    finished.notify_all();
+}
+
+bool trail_exchange::send(unsigned i, const vector<trail_type> &trails, uint64 totwork) {
+    if (trails.size() > maxbatch) {
+        throw std::runtime_error("trail_exchange::send(): batch too large");
+    }
+    // the receiver may have stored a batch whose reply got lost, so it is resent unchanged before anything new
+    if (!unsent[i].empty()) {
+        if (!deliver(i, unsent[i])) {
+            return false;
+        }
+        unsent[i].clear();
+        if (trails.empty()) {
+            return true;
+        }
+    }
+    vector<unsigned char> buf;
+    buf.reserve(header_size + trails.size() * record_size);
+    put_word(buf, magic);
+    put_word(buf, modi);
+    put_word(buf, uint32(totwork));
+    put_word(buf, uint32(totwork >> 32));
+    put_word(buf, uint32(trails.size()));
+    put_word(buf, session);
+    put_word(buf, trails.empty() ? 0 : ++sequence[i]);
+    for (unsigned k = 0; k < 4; ++k) {
+        put_word(buf, token[k]);
+    }
+    for (size_t j = 0; j < trails.size(); ++j) {
+        put_word(buf, trails[j].start[0]);
+        put_word(buf, trails[j].start[1]);
+        put_word(buf, trails[j].end[0]);
+        put_word(buf, trails[j].end[1]);
+        put_word(buf, trails[j].end[2]);
+        put_word(buf, trails[j].len);
+    }
+    if (!deliver(i, buf) && !trails.empty()) {
+        unsent[i].swap(buf);
+    }
+    return true;
+}
+
+bool trail_exchange::deliver(unsigned i, const std::vector<unsigned char> &batch) {
+    std::shared_ptr<connection> &peer = peers[i];
+    try {
+        if (!peer) {
+            peer.reset(new connection);
+            boost::system::error_code ec;
+            bool done = false;
+            boost::asio::async_connect(peer->socket, addresses[i].begin(), addresses[i].end(),
+                                       [&](const boost::system::error_code &e, std::vector<tcp::endpoint>::iterator) {
+                                           ec = e;
+                                           done = true;
+                                       });
+            run_until_timeout(peer->ios, peer->socket, done, timeout);
+            if (ec) {
+                throw boost::system::system_error(ec);
+            }
+            peer->socket.set_option(tcp::no_delay(true));
+        }
+        write_until_timeout(peer->ios, peer->socket, boost::asio::buffer(batch), timeout);
+
+        unsigned char reply[reply_size];
+        read_until_timeout(peer->ios, peer->socket, boost::asio::buffer(reply), timeout);
+        if (get_word(reply) != magic || get_word(reply + 4) != i || !same_token(reply + 16, token)) {
+            throw std::runtime_error("bad reply");
+        }
+        set_work(i, get_dword(reply + 8));
+        if (unreachable[i]) {
+            cout << "Trail exchange: connected to " << hosts[i].first << ":" << hosts[i].second << endl;
+            unreachable[i] = false;
+        }
+        return true;
+    } catch (std::exception &e) {
+        if (!unreachable[i]) {
+            cerr << "Trail exchange: " << hosts[i].first << ":" << hosts[i].second << ": " << e.what() << endl;
+            unreachable[i] = true;
+        }
+        peer.reset();
+        return false;
+    }
+}
+
+void trail_exchange::set_work(unsigned i, uint64 work) {
+    boost::mutex::scoped_lock lock(mutex);
+    if (works[i] < work) {
+        works[i] = work;
+    }
+}
+
+void trail_exchange::get_work(vector<uint64> &work) {
+    boost::mutex::scoped_lock lock(mutex);
+    work = works;
+}
+
+std::string trail_exchange::status() {
+    boost::mutex::scoped_lock lock(mutex);
+    return ", Exchange: received " + boost::lexical_cast<std::string>(storedtrails) + " trails in " +
+           boost::lexical_cast<std::string>(storedbatches) + " batches (dup=" + boost::lexical_cast<std::string>(duplicates) +
+           ",refused=" + boost::lexical_cast<std::string>(refused) + ")";
+}
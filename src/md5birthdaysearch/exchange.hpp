@@ -0,0 +1,125 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+#ifndef EXCHANGE_HPP
+#define EXCHANGE_HPP
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <utility>
+
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+
+/*
+
+TCP exchange of trails between the processes of a distributed birthday search (--exchange),
+replacing the birthdaydata files in workdir/<i>/.
+
+The processes are given a list of host:port endpoints, one for each index i < modn, resolved once at startup.
+Every process that is not a generator listens on the address and port of its own endpoint and stores the trails it receives.
+Trails with end[1] % modn == i are streamed to endpoint i over a persistent connection that is re-established when it fails.
+Connecting, sending a batch and waiting for the reply each give up after timeout seconds,
+a receiver closes a connection that sends no batch for idle_timeout seconds or stalls within one for timeout seconds.
+
+A batch is a header (magic, sender index, 64-bit work of the sender, number of trails, session, sequence number, token)
+followed by compact 24-byte trails: start[0], start[1], end[0], end[1], end[2], len (start[2] is always 0).
+The receiver stores the trails and replies with (magic, receiver index, 64-bit work of the receiver, token),
+so the work counters of all processes flow both ways. All words are sent little-endian.
+The 4-word token is derived from the search and the --exchangekey of all processes: a connection whose token,
+sender index or batch size (at most maxbatch trails) does not match is closed before anything of it is stored.
+The token is sent in the clear, so it keeps out processes of other searches and stray connections, not eavesdroppers.
+
+A batch without a reply may have been stored anyway, so it is resent unchanged until it is acknowledged
+and the receiver drops a batch with the same session and sequence number as the last one it stored from that sender.
+The session is chosen randomly by every process, sequence numbers count the non-empty batches to each receiver from 1.
+
+*/
+
+class trail_exchange {
+  public:
+    typedef boost::function<void(const vector<trail_type> &)> receive_function;
+
+    // endpoints: comma separated host:port for each index < modn
+    // listen: accept trails for index modi, received trails are passed to receive from the connection threads
+    // token: the 4 words every process of the search has to send
+    trail_exchange(const std::string &endpoints, unsigned modn, unsigned modi, bool listen, receive_function receive,
+                   const vector<uint32> &token);
+    ~trail_exchange();
+
+    // send trails to process i (an empty batch only exchanges the work counters)
+    // returns false if the trails were not taken because an earlier batch to i is still undelivered,
+    // once taken they are delivered by this or a later call
+    bool send(unsigned i, const vector<trail_type> &trails, uint64 totwork);
+    // whether a batch to process i still waits for delivery
+    bool undelivered(unsigned i) const { return !unsent[i].empty(); }
+
+    // the last reported work of every process, set_work updates the work of process i
+    void get_work(vector<uint64> &work);
+    void set_work(unsigned i, uint64 work);
+
+    // for the status line: the stored trails and batches, the dropped resent batches and the refused connections
+    std::string status();
+
+    static const uint32 magic = 0x5613907a;
+    static const uint32 maxbatch = 1 << 16;
+    // seconds
+    static const unsigned timeout = 30;
+    static const unsigned idle_timeout = 600;
+
+  private:
+    class service;
+    class connection;
+    void accept_loop();
+    void serve(std::shared_ptr<connection> conn);
+    bool deliver(unsigned i, const std::vector<unsigned char> &batch);
+
+    std::vector<std::pair<std::string, std::string>> hosts;
+    std::vector<std::vector<boost::asio::ip::tcp::endpoint>> addresses;
+    unsigned modi;
+    receive_function receive;
+    vector<uint32> token;
+
+    std::unique_ptr<service> io;
+    // outgoing connections by index and incoming connections
+    std::vector<std::shared_ptr<connection>> peers;
+    std::vector<bool> unreachable;
+    // per receiver: the encoded batch that still has to be acknowledged and the last sequence number
+    std::vector<std::vector<unsigned char>> unsent;
+    std::vector<uint32> sequence;
+    uint32 session;
+    // per sender: session and sequence number of the last stored batch
+    std::vector<std::pair<uint32, uint32>> received;
+    // connections served by a detached thread each, finished is notified when one is removed
+    std::vector<std::shared_ptr<connection>> clients;
+    boost::condition_variable finished;
+    std::vector<uint64> works;
+    uint64 storedtrails, storedbatches, duplicates, refused;
+    boost::mutex mutex;
+    // the accept thread
+    boost::thread_group threads;
+    bool stopping;
+};
+
+#endif // EXCHANGE_HPP
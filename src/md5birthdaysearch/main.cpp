@@ -109,6 +109,14 @@ int main(int argc, char **argv) {
 			("memhardlimit"
 				, po::bool_switch(&parameters.memhardlimit)
 				, "Hard limit max. memory instead of average.")
+
+			("diskstorage"
+				, po::value<string>(&parameters.diskstorage)->default_value("")
+				, "Store trails in sorted runs in this directory,\n\tmaxmemory is used as buffer.")
+
+			("maxdisk"
+				, po::value<unsigned>(&parameters.maxdisk)->default_value(100)
+				, "Max. disk space in GB used for storing trails.")
 			("threads"
 				, po::value<unsigned>(&parameters.threads)->default_value(0)
 				, "Number of computing threads to start.")
@@ -118,6 +126,21 @@ int main(int argc, char **argv) {
 			("saveloadwait"
 				, po::value<unsigned>(&parameters.saveloadwait)->default_value(60)
 				, "Number of seconds to wait between procedure calls to save/load trails")
+			("exchange"
+				, po::value<string>(&parameters.exchange)->default_value("")
+				, "Exchange trails over TCP instead of through the workdir:\n\thost:port,... for each index < mod.")
+			("exchangekey"
+				, po::value<string>(&parameters.exchangekey)->default_value("")
+				, "Key shared by all processes of the trail exchange,\n\tconnections without it are refused.")
+			("checkpointwait"
+				, po::value<unsigned>(&parameters.checkpointwait)->default_value(0)
+				, "Number of seconds between checkpoints of the search\n\tin the workdir, 0 = no checkpoints.")
+			("resume"
+				, po::bool_switch(&parameters.resume)
+				, "Continue from the last checkpoint in the workdir.")
+			("calibrate"
+				, po::value<string>(&parameters.calibrate)->default_value("")
+				, "Measure the speed of this machine, choose hybridbits,\n\tlogtraillength and maxmemory (at most the given value)\n\tand write them as options to this file.")
 			;
 
 #ifdef HAVE_CUDA
@@ -27,6 +27,7 @@
 #include <boost/filesystem/operations.hpp>
 
 #include <hashclash/types.hpp>
+#include <hashclash/rng.hpp>
 #include <hashclash/saveload_gz.hpp>
 #include <hashclash/saveload_bz2.hpp>
 
@@ -46,6 +47,13 @@ template <class Archive> void serialize(Archive &ar, trail_type &t, const unsign
     ar &boost::serialization::make_nvp("end2", t.end[2]);
     ar &boost::serialization::make_nvp("len", t.len);
 }
+template <class Archive> void serialize(Archive &ar, hashclash::rng_state &g, const unsigned int file_version) {
+    ar &boost::serialization::make_nvp("seedd", g.seedd);
+    ar &boost::serialization::make_nvp("seed32_1", g.seed32_1);
+    ar &boost::serialization::make_nvp("seed32_2", g.seed32_2);
+    ar &boost::serialization::make_nvp("seed32_3", g.seed32_3);
+    ar &boost::serialization::make_nvp("seed32_4", g.seed32_4);
+}
 } // namespace serialization
 } // namespace boost
 
@@ -0,0 +1,69 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdexcept>
+#include <boost/cstdint.hpp>
+
+using namespace std;
+
+typedef boost::uint32_t uint32;
+typedef boost::uint64_t uint64;
+
+#include <hashclash/config.h>
+#include "birthday_types.hpp"
+
+// this backend is compiled whenever the compiler supports avx512f (HASHCLASH_BACKEND_AVX512), whatever the host supports,
+// and only used if the CPU supports it: only its kernels are compiled for avx512f, by a target attribute
+#if defined(HASHCLASH_BACKEND_AVX512) && !defined(HASHCLASH_HAVE_AVX512_F)
+#define HASHCLASH_HAVE_AVX512_F 1
+#endif
+
+#ifndef HASHCLASH_BACKEND_AVX512
+simd_device_avx512::~simd_device_avx512() {}
+bool simd_device_avx512::init(
+    const uint32 ihv1b[4],
+    const uint32 ihv2b[4],
+    const uint32 ihv2modb[4],
+    const uint32 precomp1b[4],
+    const uint32 precomp2b[4],
+    const uint32 msg1b[16],
+    const uint32 msg2b[16],
+    uint32 hmask,
+    uint32 dpmask,
+    uint32 maxlen
+) {
+    return false;
+}
+void simd_device_avx512::fill_trail_buffer(uint64 seed, vector<trail_type> &buf, bool mod) {}
+void simd_device_avx512::walk_collisions(const vector<pair<trail_type, trail_type>> &collisions, vector<collision_walk_type> &walks, bool mod) {}
+#else
+
+#include <hashclash/simd/simd_avx512.h>
+
+#define SIMD_TARGET __attribute__((target("avx512f")))
+#define SIMD_CPU_SUPPORTED __builtin_cpu_supports("avx512f")
+#include "simd_birthday.cinc"
+
+#endif
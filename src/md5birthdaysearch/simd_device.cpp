@@ -0,0 +1,57 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <boost/cstdint.hpp>
+
+using namespace std;
+
+typedef boost::uint32_t uint32;
+typedef boost::uint64_t uint64;
+
+#include <hashclash/config.h>
+#include "birthday_types.hpp"
+
+simd_device *create_simd_device(
+    const uint32 ihv1[4],
+    const uint32 ihv2[4],
+    const uint32 ihv2mod[4],
+    const uint32 precomp1[4],
+    const uint32 precomp2[4],
+    const uint32 msg1[16],
+    const uint32 msg2[16],
+    uint32 hmask,
+    uint32 dpmask,
+    uint32 maxlen
+) {
+    // in order of preference
+    unique_ptr<simd_device> devices[] = {
+        unique_ptr<simd_device>(new simd_device_avx512),
+        unique_ptr<simd_device>(new simd_device_avx256),
+        unique_ptr<simd_device>(new simd_device_scalar)
+    };
+    for (auto &device : devices) {
+        if (device->init(ihv1, ihv2, ihv2mod, precomp1, precomp2, msg1, msg2, hmask, dpmask, maxlen)) {
+            return device.release();
+        }
+    }
+    return 0;
+}
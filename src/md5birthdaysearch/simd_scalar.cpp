@@ -0,0 +1,40 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdexcept>
+#include <boost/cstdint.hpp>
+
+using namespace std;
+
+typedef boost::uint32_t uint32;
+typedef boost::uint64_t uint64;
+
+#include <hashclash/config.h>
+#include "birthday_types.hpp"
+
+#include <hashclash/simd/simd_scalar.h>
+
+#define SIMD_CPU_SUPPORTED true
+#include "simd_birthday.cinc"
@@ -23,11 +23,15 @@
 #include <cmath>
 #include <algorithm>
 #include <stdexcept>
+#include <fstream>
+#include <memory>
 
 #include <boost/lexical_cast.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/bind.hpp>
 
 #include "main.hpp"
 #include "storage.hpp"
@@ -41,60 +45,608 @@ using namespace std;
 // service for CUDA part
 void boost_thread_yield() { boost::this_thread::sleep(boost::posix_time::milliseconds(1)); }
 
+// external memory tier for trails, see storage.hpp
+class trail_disk_tier {
+  public:
+    trail_disk_tier(storage_type &storage, const std::string &dir, unsigned procmodi, uint64 maxbytes, bool resume);
+    ~trail_disk_tier();
+
+    void reserve(uint64 buffertrails);
+    void append(const trail_type &tr);
+    // the trails that are not yet in a run on disk
+    void buffered_trails(vector<trail_type> &trails);
+    // for the status line
+    std::string status() const;
+
+    static const unsigned partitions = 256;
+    // merge all runs of a partition when it has more runs
+    static const unsigned maxruns = 8;
+    static const char *const run_extension;
+
+  private:
+    // the full end point as key, sorted on end[1] first; start[2] of a stored trail is always 0
+    struct record {
+        uint32 key[3]; // key[0] = end[1], key[1] = end[0], key[2] = end[2]
+        uint32 start[2];
+        uint32 len;
+
+        bool operator<(const record &r) const {
+            return key[0] < r.key[0] || (key[0] == r.key[0] && (key[1] < r.key[1] || (key[1] == r.key[1] && key[2] < r.key[2])));
+        }
+        bool samekey(const record &r) const { return key[0] == r.key[0] && key[1] == r.key[1] && key[2] == r.key[2]; }
+        bool sametrail(const record &r) const { return start[0] == r.start[0] && start[1] == r.start[1] && len == r.len; }
+        trail_type trail() const {
+            trail_type tr;
+            tr.start[0] = start[0];
+            tr.start[1] = start[1];
+            tr.start[2] = 0;
+            tr.end[0] = key[1];
+            tr.end[1] = key[0];
+            tr.end[2] = key[2];
+            tr.len = len;
+            return tr;
+        }
+    };
+    struct run_type {
+        boost::filesystem::path file;
+        uint64 count;
+    };
+    // sequential block reader of a run
+    class run_reader {
+      public:
+        run_reader(const run_type &run);
+        bool done() const { return pos == buf.size() && left == 0; }
+        const record &front() const { return buf[pos]; }
+        void pop() {
+            if (++pos == buf.size()) {
+                fill();
+            }
+        }
+
+      private:
+        void fill();
+        std::ifstream ifs;
+        vector<record> buf;
+        size_t pos;
+        uint64 left;
+    };
+
+    void flusher();
+    void flush(vector<record> &buf);
+    void report(const record &r1, const record &r2);
+    void join(const record *begin, const record *end, const run_type &run);
+    run_type write_run(unsigned part, const record *begin, const record *end);
+    void merge_runs(unsigned part);
+
+    storage_type &storage;
+    const boost::filesystem::path dir;
+    const std::string prefix;
+    const uint64 maxbytes;
+    uint64 diskbytes;
+    unsigned serial;
+    vector<vector<run_type>> runs;
+    // shown in the status line
+    boost::atomic<uint64> storedtrails, losttrails;
+    boost::atomic<unsigned> failedflushes;
+    boost::atomic<bool> diskfull;
+
+    boost::mutex mut;
+    boost::condition_variable cond;
+    vector<record> buffer, flushing;
+    size_t capacity;
+    bool flushpending, stop;
+    boost::thread thread;
+};
+
+const char *const trail_disk_tier::run_extension = ".run2";
+
+trail_disk_tier::trail_disk_tier(storage_type &storage, const std::string &dir, unsigned procmodi, uint64 maxbytes, bool resume)
+    : storage(storage),
+      dir(dir),
+      prefix("trails" + boost::lexical_cast<std::string>(procmodi) + "_"),
+      maxbytes(maxbytes),
+      diskbytes(0),
+      serial(0),
+      runs(partitions),
+      storedtrails(0),
+      losttrails(0),
+      failedflushes(0),
+      diskfull(false),
+      capacity(0),
+      flushpending(false),
+      stop(false) {
+    boost::filesystem::create_directories(this->dir);
+    // start from scratch: remove old runs of this process, or on resume continue with them
+    vector<boost::filesystem::path> old;
+    for (boost::filesystem::directory_iterator dit(this->dir), ditend; dit != ditend; ++dit) {
+        const std::string filename = dit->path().filename().string();
+        if (filename.compare(0, prefix.size(), prefix) == 0 && (dit->path().extension() == run_extension || dit->path().extension() == ".run")) {
+            old.push_back(dit->path());
+        }
+    }
+    for (unsigned i = 0; i < old.size(); ++i) {
+        if (!resume) {
+            boost::filesystem::remove(old[i]);
+            continue;
+        }
+        // .run files hold the older records with a 64-bit key and cannot be used
+        if (old[i].extension() != run_extension) {
+            cerr << "Disk storage: ignoring run in old format " << old[i].string() << endl;
+            continue;
+        }
+        // <prefix><part>_<serial>.run: runs are sorted, so an incomplete run is still a valid run of its complete records
+        // records that are in more than one run (an interrupted merge) are identical trails, which are never reported
+        const std::string name = old[i].stem().string().substr(prefix.size());
+        const size_t sep = name.find('_');
+        unsigned part, runserial;
+        try {
+            part = boost::lexical_cast<unsigned>(name.substr(0, sep));
+            runserial = boost::lexical_cast<unsigned>(name.substr(sep + 1));
+        } catch (boost::bad_lexical_cast &) {
+            continue;
+        }
+        if (sep == std::string::npos || part >= partitions) {
+            continue;
+        }
+        run_type run;
+        run.file = old[i];
+        run.count = boost::filesystem::file_size(old[i]) / sizeof(record);
+        runs[part].push_back(run);
+        diskbytes += run.count * sizeof(record);
+        serial = std::max(serial, runserial + 1);
+    }
+    storedtrails = diskbytes / sizeof(record);
+    if (resume) {
+        cout << "Disk storage: continuing with " << storedtrails << " stored trails." << endl;
+    }
+    thread = boost::thread(boost::bind(&trail_disk_tier::flusher, this));
+}
+
+trail_disk_tier::~trail_disk_tier() {
+    {
+        boost::lock_guard<boost::mutex> lock(mut);
+        stop = true;
+    }
+    cond.notify_all();
+    thread.join();
+}
+
+void trail_disk_tier::reserve(uint64 buffertrails) {
+    boost::lock_guard<boost::mutex> lock(mut);
+    capacity = buffertrails < 1024 ? 1024 : buffertrails;
+    buffer.reserve(capacity);
+}
+
+void trail_disk_tier::append(const trail_type &tr) {
+    record r;
+    r.key[0] = tr.end[1];
+    r.key[1] = tr.end[0];
+    r.key[2] = tr.end[2];
+    r.start[0] = tr.start[0];
+    r.start[1] = tr.start[1];
+    r.len = tr.len;
+    boost::unique_lock<boost::mutex> lock(mut);
+    if (capacity == 0) {
+        throw std::logic_error("trail_disk_tier::append(): called before reserve()");
+    }
+    // a full buffer is being handed over
+    while (buffer.size() >= capacity) {
+        cond.wait(lock);
+    }
+    buffer.push_back(r);
+    if (buffer.size() >= capacity) {
+        // hand over the full buffer, wait if the previous one is still being flushed
+        while (flushpending) {
+            cond.wait(lock);
+        }
+        buffer.swap(flushing);
+        buffer.clear();
+        buffer.reserve(capacity);
+        flushpending = true;
+        cond.notify_all();
+    }
+}
+
+void trail_disk_tier::buffered_trails(vector<trail_type> &trails) {
+    boost::lock_guard<boost::mutex> lock(mut);
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        trails.push_back(buffer[i].trail());
+    }
+    if (flushpending) {
+        for (size_t i = 0; i < flushing.size(); ++i) {
+            trails.push_back(flushing[i].trail());
+        }
+    }
+}
+
+void trail_disk_tier::flusher() {
+    boost::unique_lock<boost::mutex> lock(mut);
+    while (true) {
+        while (!flushpending && !stop) {
+            cond.wait(lock);
+        }
+        if (!flushpending) {
+            return;
+        }
+        lock.unlock();
+        const uint64 stored = storedtrails;
+        try {
+            flush(flushing);
+        } catch (std::exception &e) {
+            // the trails of this buffer that did not make it into a run are lost
+            ++failedflushes;
+            if (!diskfull) {
+                losttrails += flushing.size() - (storedtrails - stored);
+            }
+            cerr << "Disk storage: flush failed, trails lost: " << e.what() << endl;
+        }
+        lock.lock();
+        flushing.clear();
+        flushpending = false;
+        cond.notify_all();
+    }
+}
+
+std::string trail_disk_tier::status() const {
+    std::string str = ", Disk: " + boost::lexical_cast<std::string>(storedtrails.load());
+    if (diskfull) {
+        str += " FULL";
+    }
+    if (failedflushes != 0) {
+        str += " (" + boost::lexical_cast<std::string>(failedflushes.load()) + " failed flushes, " +
+               boost::lexical_cast<std::string>(losttrails.load()) + " trails lost)";
+    }
+    return str;
+}
+
+void trail_disk_tier::report(const record &r1, const record &r2) {
+    if (!r1.sametrail(r2)) {
+        storage.add_collision(r1.trail(), r2.trail());
+    }
+}
+
+trail_disk_tier::run_reader::run_reader(const run_type &run)
+    : ifs(run.file.string().c_str(), std::ios::binary), pos(0), left(run.count) {
+    if (!ifs) {
+        throw std::runtime_error("trail_disk_tier: could not open " + run.file.string());
+    }
+    fill();
+}
+
+void trail_disk_tier::run_reader::fill() {
+    const uint64 n = std::min<uint64>(left, 1 << 16);
+    buf.resize(size_t(n));
+    pos = 0;
+    if (n > 0) {
+        ifs.read(reinterpret_cast<char *>(&buf[0]), std::streamsize(n * sizeof(record)));
+        if (!ifs) {
+            throw std::runtime_error("trail_disk_tier: read error");
+        }
+    }
+    left -= n;
+}
+
+// report all pairs of equal keys between the sorted records [begin,end) and a run
+void trail_disk_tier::join(const record *begin, const record *end, const run_type &run) {
+    run_reader reader(run);
+    while (begin != end && !reader.done()) {
+        if (*begin < reader.front()) {
+            ++begin;
+        } else if (reader.front() < *begin) {
+            reader.pop();
+        } else {
+            const record *groupend = begin;
+            while (groupend != end && groupend->samekey(*begin)) {
+                ++groupend;
+            }
+            const record r = reader.front();
+            for (; !reader.done() && reader.front().samekey(r); reader.pop()) {
+                for (const record *it = begin; it != groupend; ++it) {
+                    report(*it, reader.front());
+                }
+            }
+            begin = groupend;
+        }
+    }
+}
+
+trail_disk_tier::run_type trail_disk_tier::write_run(unsigned part, const record *begin, const record *end) {
+    run_type run;
+    run.file = dir / (prefix + boost::lexical_cast<std::string>(part) + "_" + boost::lexical_cast<std::string>(serial++) + run_extension);
+    run.count = uint64(end - begin);
+    std::ofstream ofs(run.file.string().c_str(), std::ios::binary);
+    if (run.count > 0) {
+        ofs.write(reinterpret_cast<const char *>(begin), std::streamsize(run.count * sizeof(record)));
+    }
+    if (!ofs) {
+        throw std::runtime_error("trail_disk_tier: write error on " + run.file.string());
+    }
+    return run;
+}
+
+void trail_disk_tier::flush(vector<record> &buf) {
+    std::sort(buf.begin(), buf.end());
+    // collisions within the buffer
+    for (size_t i = 0; i < buf.size();) {
+        size_t j = i + 1;
+        while (j < buf.size() && buf[j].samekey(buf[i])) {
+            for (size_t k = i; k < j; ++k) {
+                report(buf[j], buf[k]);
+            }
+            ++j;
+        }
+        i = j;
+    }
+    if (!diskfull && diskbytes + buf.size() * sizeof(record) > maxbytes) {
+        diskfull = true;
+        cerr << "Disk storage full: new trails are only checked against stored trails." << endl;
+    }
+    // the records are sorted on end[1] first, so partitions are consecutive ranges
+    const record *begin = buf.empty() ? nullptr : &buf[0], *end = begin + buf.size();
+    for (unsigned part = 0; part < partitions; ++part) {
+        const record *partend = begin;
+        while (partend != end && (partend->key[0] >> 24) == part) {
+            ++partend;
+        }
+        for (unsigned r = 0; r < runs[part].size(); ++r) {
+            join(begin, partend, runs[part][r]);
+        }
+        if (!diskfull && partend != begin) {
+            runs[part].push_back(write_run(part, begin, partend));
+            diskbytes += uint64(partend - begin) * sizeof(record);
+            storedtrails += uint64(partend - begin);
+            if (runs[part].size() > maxruns) {
+                merge_runs(part);
+            }
+        }
+        begin = partend;
+    }
+}
+
+void trail_disk_tier::merge_runs(unsigned part) {
+    vector<std::unique_ptr<run_reader>> readers;
+    for (unsigned r = 0; r < runs[part].size(); ++r) {
+        readers.emplace_back(new run_reader(runs[part][r]));
+    }
+    run_type merged;
+    merged.file = dir / (prefix + boost::lexical_cast<std::string>(part) + "_" + boost::lexical_cast<std::string>(serial++) + run_extension);
+    merged.count = 0;
+    std::ofstream ofs(merged.file.string().c_str(), std::ios::binary);
+    vector<record> out;
+    out.reserve(1 << 16);
+    while (true) {
+        // few runs: linear search for the smallest front
+        int best = -1;
+        for (unsigned r = 0; r < readers.size(); ++r) {
+            if (!readers[r]->done() && (best < 0 || readers[r]->front() < readers[best]->front())) {
+                best = int(r);
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        out.push_back(readers[best]->front());
+        readers[best]->pop();
+        if (out.size() == out.capacity()) {
+            ofs.write(reinterpret_cast<const char *>(&out[0]), std::streamsize(out.size() * sizeof(record)));
+            merged.count += out.size();
+            out.clear();
+        }
+    }
+    if (!out.empty()) {
+        ofs.write(reinterpret_cast<const char *>(&out[0]), std::streamsize(out.size() * sizeof(record)));
+        merged.count += out.size();
+    }
+    ofs.close();
+    if (!ofs) {
+        throw std::runtime_error("trail_disk_tier: write error on " + merged.file.string());
+    }
+    readers.clear();
+    for (unsigned r = 0; r < runs[part].size(); ++r) {
+        boost::filesystem::remove(runs[part][r].file);
+    }
+    runs[part].assign(1, merged);
+}
+
+storage_type::storage_type()
+    : overflow(new overflow_stripe[overflow_stripes]), totcoll(0), tmpptr(0), bucketcount(0), procmodn(1), memhardlimit(false), dpmask(0),
+      lenbits(32) {}
+
+storage_type::~storage_type() {}
+
+void storage_type::set_parameters(const birthday_parameters &parameters, uint32 distinguishedpointmask, uint32 maximumpathlength) {
+    procmodn = parameters.modn;
+    memhardlimit = parameters.memhardlimit;
+    dpmask = distinguishedpointmask;
+    // trails end at length at most maximumpathlength+1
+    lenbits = 1;
+    while (lenbits < 32 && (uint64(maximumpathlength) + 1) >> lenbits) {
+        ++lenbits;
+    }
+    if (!parameters.diskstorage.empty()) {
+        disk.reset(new trail_disk_tier(*this, parameters.diskstorage, parameters.modi, uint64(parameters.maxdisk) << 30, parameters.resume));
+    }
+}
+
 void storage_type::reserve_memory(uint64 m) {
+    if (disk) {
+        disk->reserve(m);
+        return;
+    }
     LOCK_STORAGE_MUTEX;
-    trail_hash.resize(m >> 5);
-    for (unsigned i = 0; i < trail_hash.size(); ++i) {
-        trail_hash[i].reserve(2 << 5);
+    bucketcount = (m + bucket_slots - 1) / bucket_slots;
+    if (bucketcount < probe_buckets) {
+        bucketcount = probe_buckets;
     }
+    taglines.reset(new tagline_type[bucketcount]);
+    slots.reset(new slot_type[bucketcount * bucket_slots]);
+    for (uint64 b = 0; b < bucketcount; ++b) {
+        for (unsigned i = 0; i < bucket_slots; ++i) {
+            taglines[b].tags[i].store(tag_empty, boost::memory_order_relaxed);
+        }
+    }
+    const uint64 chunks = (bucketcount + checkpoint_buckets - 1) / checkpoint_buckets;
+    dirty.reset(new boost::atomic<bool>[chunks]);
+    for (uint64 c = 0; c < chunks; ++c) {
+        dirty[c].store(false, boost::memory_order_relaxed);
+    }
+    const uint64 bitwords = (bucketcount + 63) / 64;
+    overflowbits.reset(new boost::atomic<uint64>[bitwords]);
+    for (uint64 w = 0; w < bitwords; ++w) {
+        overflowbits[w].store(0, boost::memory_order_relaxed);
+    }
+    for (unsigned i = 0; i < overflow_stripes; ++i) {
+        overflow[i].trails.clear();
+    }
+    imagefile.clear();
 }
 
-void storage_type::insert_trail(const trail_type &tr) {
-    LOCK_STORAGE_MUTEX;
-    uint32 hashindex = (tr.end[1] / procmodn) % trail_hash.size();
-    vector<trail_type>::const_iterator cit = trail_hash[hashindex].begin(), citend = trail_hash[hashindex].end();
+void storage_type::write_slot(uint64 s, const trail_type &tr) {
+    slot_type &slot = slots[s];
+    slot.words[0].store(tr.start[0], boost::memory_order_relaxed);
+    slot.words[1].store(tr.start[1], boost::memory_order_relaxed);
+    slot.words[2].store(encode_lencheck(tr), boost::memory_order_relaxed);
+}
 
-    for (; cit != citend; ++cit) {
-        if (cit->end[0] == tr.end[0] && cit->end[1] == tr.end[1] && cit->end[2] == tr.end[2]) {
-            if (tr != *cit) {
-                ++totcoll;
-                collisions.push_back(make_pair(tr, *cit));
+// read slot s if it holds a trail with fingerprint fp, returns false if it was replaced meanwhile
+bool storage_type::read_slot(uint64 s, tag_type fp, uint32 &start0, uint32 &start1, uint32 &lencheck) const {
+    const slot_type &slot = slots[s];
+    start0 = slot.words[0].load(boost::memory_order_relaxed);
+    start1 = slot.words[1].load(boost::memory_order_relaxed);
+    lencheck = slot.words[2].load(boost::memory_order_relaxed);
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+    return taglines[s / bucket_slots].tags[s % bucket_slots].load(boost::memory_order_relaxed) == fp;
+}
+
+// claim and write a slot for tr, returns the slot index or ~0 if tr went to the overflow store
+uint64 storage_type::claim_slot(uint64 home, const trail_type &tr) {
+    const tag_type fp = fingerprint(tr);
+    for (unsigned p = 0; p < probe_buckets; ++p) {
+        const uint64 b = (home + p) % bucketcount;
+        tagline_type &line = taglines[b];
+        for (unsigned i = 0; i < bucket_slots; ++i) {
+            tag_type tag = line.tags[i].load(boost::memory_order_relaxed);
+            if (tag == tag_empty && line.tags[i].compare_exchange_strong(tag, tag_busy, boost::memory_order_acquire)) {
+                write_slot(b * bucket_slots + i, tr);
+                line.tags[i].store(fp, boost::memory_order_seq_cst);
+                mark_dirty(b);
+                return b * bucket_slots + i;
             }
         }
     }
-    if (!memhardlimit || trail_hash[hashindex].size() < trail_hash[hashindex].capacity()) {
-        trail_hash[hashindex].push_back(tr);
-    } else {
-        unsigned i = (++tmpptr) % trail_hash[hashindex].size();
-        trail_hash[hashindex][i] = tr;
+    if (memhardlimit) {
+        tagline_type &line = taglines[home];
+        while (true) {
+            const unsigned i = (++tmpptr) % bucket_slots;
+            tag_type tag = line.tags[i].load(boost::memory_order_relaxed);
+            if (tag != tag_busy && line.tags[i].compare_exchange_strong(tag, tag_busy, boost::memory_order_acquire)) {
+                write_slot(home * bucket_slots + i, tr);
+                line.tags[i].store(fp, boost::memory_order_seq_cst);
+                mark_dirty(home);
+                return home * bucket_slots + i;
+            }
+        }
     }
+    add_overflow(home, tr);
+    return ~uint64(0);
 }
 
-void storage_type::insert_trails(const vector<trail_type> &trs) {
+// add tr to the overflow store, then mark its home bucket as spilled
+void storage_type::add_overflow(uint64 home, const trail_type &tr) {
+    {
+        overflow_stripe &stripe = overflow[home % overflow_stripes];
+        boost::lock_guard<boost::mutex> lock(stripe.mut);
+        stripe.trails[home].push_back(tr);
+    }
+    overflowbits[home / 64].fetch_or(uint64(1) << (home % 64), boost::memory_order_seq_cst);
+}
+
+void storage_type::add_collision(const trail_type &tr1, const trail_type &tr2) {
     LOCK_STORAGE_MUTEX;
-    vector<trail_type>::const_iterator cit, citend;
-    vector<trail_type>::const_iterator trsit = trs.begin(), trsend = trs.end();
-    for (; trsit != trsend; ++trsit) {
-        uint32 hashindex = (trsit->end[1] / procmodn) % trail_hash.size();
-        cit = trail_hash[hashindex].begin();
-        citend = trail_hash[hashindex].end();
-        for (; cit != citend; ++cit) {
-            if (cit->end[0] == trsit->end[0] && cit->end[1] == trsit->end[1] && cit->end[2] == trsit->end[2]) {
-                if (*trsit != *cit) {
-                    ++totcoll;
-                    collisions.push_back(make_pair(*trsit, *cit));
+    ++totcoll;
+    collisions.push_back(make_pair(tr1, tr2));
+}
+
+// report all stored trails other than slot own with the same end point as tr
+void storage_type::find_collisions(uint64 home, tag_type fp, uint64 own, const trail_type &tr) {
+    const uint32 lencheck = encode_lencheck(tr), checkmask = ~lenmask();
+    uint32 start0, start1, otherlencheck;
+    for (unsigned p = 0; p < probe_buckets; ++p) {
+        const uint64 b = (home + p) % bucketcount;
+        const tagline_type &line = taglines[b];
+        bool hasempty = false;
+        for (unsigned i = 0; i < bucket_slots; ++i) {
+            const tag_type tag = line.tags[i].load(boost::memory_order_seq_cst);
+            if (tag == tag_empty) {
+                hasempty = true;
+            }
+            if (tag != fp || b * bucket_slots + i == own) {
+                continue;
+            }
+            if (!read_slot(b * bucket_slots + i, fp, start0, start1, otherlencheck)) {
+                continue;
+            }
+            if ((otherlencheck & checkmask) != (lencheck & checkmask)) {
+                continue;
+            }
+            // reconstruct the stored trail, its end point is the one it matched
+            trail_type other;
+            other.start[0] = start0;
+            other.start[1] = start1;
+            other.start[2] = 0;
+            other.end[0] = tr.end[0];
+            other.end[1] = tr.end[1];
+            other.end[2] = tr.end[2];
+            other.len = otherlencheck & lenmask();
+            if (other != tr) {
+                add_collision(tr, other);
+            }
+        }
+        if (hasempty) {
+            break;
+        }
+    }
+    if (has_overflow(home)) {
+        vector<pair<trail_type, trail_type>> found;
+        {
+            overflow_stripe &stripe = overflow[home % overflow_stripes];
+            boost::lock_guard<boost::mutex> lock(stripe.mut);
+            const vector<trail_type> &spilled = stripe.trails[home];
+            vector<trail_type>::const_iterator cit = spilled.begin(), citend = spilled.end();
+            for (; cit != citend; ++cit) {
+                // tr itself may be in the overflow store, identical trails are never reported
+                if (cit->end[0] == tr.end[0] && cit->end[1] == tr.end[1] && cit->end[2] == tr.end[2] && *cit != tr) {
+                    found.push_back(make_pair(tr, *cit));
                 }
             }
         }
-        if (!memhardlimit || trail_hash[hashindex].size() < trail_hash[hashindex].capacity()) {
-            trail_hash[hashindex].push_back(*trsit);
-        } else {
-            unsigned i = (++tmpptr) % trail_hash[hashindex].size();
-            trail_hash[hashindex][i] = *trsit;
+        for (unsigned k = 0; k < found.size(); ++k) {
+            add_collision(found[k].first, found[k].second);
         }
     }
 }
 
+void storage_type::insert_trail(const trail_type &tr) {
+    // only trails ending in a distinguished point starting from a 64-bit starting point can be stored compactly
+    if ((tr.end[0] & dpmask) != 0 || tr.start[2] != 0) {
+        return;
+    }
+    if (disk) {
+        disk->append(tr);
+        return;
+    }
+    const uint64 home = home_bucket(tr);
+    const uint64 own = claim_slot(home, tr);
+    find_collisions(home, fingerprint(tr), own, tr);
+}
+
+void storage_type::insert_trails(const vector<trail_type> &trs) {
+    vector<trail_type>::const_iterator trsit = trs.begin(), trsend = trs.end();
+    for (; trsit != trsend; ++trsit) {
+        insert_trail(*trsit);
+    }
+}
+
 void storage_type::get_birthdaycollisions(vector<pair<trail_type, trail_type>> &coll, unsigned multiple_of) {
     LOCK_STORAGE_MUTEX;
     coll.clear();
@@ -115,13 +667,165 @@ unsigned storage_type::get_collqueuesize() {
     return k;
 }
 
-unsigned storage_type::get_totcoll() {
-    unsigned result;
-    {
-        LOCK_STORAGE_MUTEX;
-        result = totcoll;
+unsigned storage_type::get_totcoll() { return totcoll.load(); }
+
+std::string storage_type::disk_status() const { return disk ? disk->status() : std::string(); }
+
+void storage_type::checkpoint_header(uint32 header[8]) const {
+    header[0] = 0x56139080;
+    header[1] = 2; // version
+    header[2] = uint32(bucketcount);
+    header[3] = uint32(bucketcount >> 32);
+    header[4] = bucket_slots;
+    header[5] = lenbits;
+    header[6] = dpmask;
+    header[7] = procmodn;
+}
+
+void storage_type::checkpoint(const std::string &filename, vector<trail_type> &trails, vector<pair<trail_type, trail_type>> &coll) {
+    trails.clear();
+    if (disk) {
+        disk->buffered_trails(trails);
+    } else {
+        const uint64 headerbytes = 4096, tagbytes = bucketcount * sizeof(tagline_type);
+        const uint64 filebytes = headerbytes + tagbytes + bucketcount * bucket_slots * 12;
+        uint32 header[8], oldheader[8];
+        checkpoint_header(header);
+        // rewrite every chunk unless the file holds an earlier image of this table:
+        // written by this process or restored from, a file of another run with the same parameters does not count
+        bool whole = true;
+        if (filename == imagefile) {
+            std::ifstream ifs(filename.c_str(), std::ios::binary);
+            if (ifs.read(reinterpret_cast<char *>(oldheader), sizeof(oldheader)) && std::equal(header, header + 8, oldheader) &&
+                boost::filesystem::file_size(filename) == filebytes) {
+                whole = false;
+            }
+        }
+        if (whole) {
+            std::ofstream ofs(filename.c_str(), std::ios::binary | std::ios::trunc);
+            ofs.write(reinterpret_cast<const char *>(header), sizeof(header));
+            if (!ofs) {
+                throw std::runtime_error("storage_type::checkpoint(): could not create " + filename);
+            }
+            ofs.close();
+            boost::filesystem::resize_file(filename, filebytes);
+        }
+        std::fstream fs(filename.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+        vector<tag_type> tags(checkpoint_buckets * bucket_slots), tailtags((probe_buckets - 1) * bucket_slots);
+        vector<uint32> words(checkpoint_buckets * bucket_slots * 3);
+        for (uint64 c = 0; c * checkpoint_buckets < bucketcount; ++c) {
+            if (!dirty[c].exchange(false, boost::memory_order_acq_rel) && !whole) {
+                continue;
+            }
+            const uint64 b0 = c * checkpoint_buckets, bn = std::min<uint64>(checkpoint_buckets, bucketcount - b0);
+            const size_t n = size_t(bn * bucket_slots);
+            for (size_t k = 0; k < n; ++k) {
+                tags[k] = taglines[b0 + k / bucket_slots].tags[k % bucket_slots].load(boost::memory_order_relaxed);
+            }
+            boost::atomic_thread_fence(boost::memory_order_acquire);
+            for (size_t k = 0; k < n; ++k) {
+                const slot_type &slot = slots[b0 * bucket_slots + k];
+                for (unsigned w = 0; w < 3; ++w) {
+                    words[3 * k + w] = slot.words[w].load(boost::memory_order_relaxed);
+                }
+            }
+            boost::atomic_thread_fence(boost::memory_order_acquire);
+            for (size_t k = 0; k < n; ++k) {
+                const tag_type tag = taglines[b0 + k / bucket_slots].tags[k % bucket_slots].load(boost::memory_order_relaxed);
+                if (tag != tags[k] || tags[k] == tag_busy) {
+                    tags[k] = tag_dead;
+                    mark_dirty(b0 + k / bucket_slots);
+                }
+            }
+            // slots before tags: an interrupted checkpoint never has a tag without its slot
+            fs.seekp(std::streamoff(headerbytes + tagbytes + b0 * bucket_slots * 12));
+            fs.write(reinterpret_cast<const char *>(&words[0]), std::streamsize(n * 12));
+            fs.seekp(std::streamoff(headerbytes + b0 * sizeof(tagline_type)));
+            fs.write(reinterpret_cast<const char *>(&tags[0]), std::streamsize(n * sizeof(tag_type)));
+            // trails in this chunk may have probed past buckets just before it that were filled after they were copied
+            const uint64 tb0 = b0 - std::min<uint64>(probe_buckets - 1, b0);
+            const size_t tn = size_t((b0 - tb0) * bucket_slots);
+            if (tn != 0) {
+                fs.seekg(std::streamoff(headerbytes + tb0 * sizeof(tagline_type)));
+                fs.read(reinterpret_cast<char *>(&tailtags[0]), std::streamsize(tn * sizeof(tag_type)));
+                bool changed = false;
+                for (size_t k = 0; k < tn; ++k) {
+                    if (tailtags[k] == tag_empty &&
+                        taglines[tb0 + k / bucket_slots].tags[k % bucket_slots].load(boost::memory_order_acquire) != tag_empty) {
+                        tailtags[k] = tag_dead;
+                        mark_dirty(tb0 + k / bucket_slots);
+                        changed = true;
+                    }
+                }
+                if (changed) {
+                    fs.seekp(std::streamoff(headerbytes + tb0 * sizeof(tagline_type)));
+                    fs.write(reinterpret_cast<const char *>(&tailtags[0]), std::streamsize(tn * sizeof(tag_type)));
+                }
+            }
+        }
+        fs.close();
+        if (!fs) {
+            throw std::runtime_error("storage_type::checkpoint(): write error on " + filename);
+        }
+        imagefile = filename;
+    }
+    for (unsigned i = 0; i < overflow_stripes; ++i) {
+        boost::lock_guard<boost::mutex> lock(overflow[i].mut);
+        std::map<uint64, vector<trail_type>>::const_iterator it = overflow[i].trails.begin(), itend = overflow[i].trails.end();
+        for (; it != itend; ++it) {
+            trails.insert(trails.end(), it->second.begin(), it->second.end());
+        }
+    }
+    LOCK_STORAGE_MUTEX;
+    coll = collisions;
+}
+
+bool storage_type::restore(const std::string &filename, const vector<trail_type> &trails, const vector<pair<trail_type, trail_type>> &coll,
+                           unsigned collcount) {
+    if (!disk) {
+        const uint64 headerbytes = 4096, tagbytes = bucketcount * sizeof(tagline_type);
+        uint32 header[8], fileheader[8];
+        checkpoint_header(header);
+        std::ifstream ifs(filename.c_str(), std::ios::binary);
+        if (!ifs.read(reinterpret_cast<char *>(fileheader), sizeof(fileheader)) || !std::equal(header, header + 8, fileheader) ||
+            boost::filesystem::file_size(filename) != headerbytes + tagbytes + bucketcount * bucket_slots * 12) {
+            return false;
+        }
+        vector<tag_type> tags(checkpoint_buckets * bucket_slots);
+        vector<uint32> words(checkpoint_buckets * bucket_slots * 3);
+        for (uint64 b0 = 0; b0 < bucketcount; b0 += checkpoint_buckets) {
+            const size_t n = size_t(std::min<uint64>(checkpoint_buckets, bucketcount - b0) * bucket_slots);
+            ifs.seekg(std::streamoff(headerbytes + b0 * sizeof(tagline_type)));
+            ifs.read(reinterpret_cast<char *>(&tags[0]), std::streamsize(n * sizeof(tag_type)));
+            ifs.seekg(std::streamoff(headerbytes + tagbytes + b0 * bucket_slots * 12));
+            ifs.read(reinterpret_cast<char *>(&words[0]), std::streamsize(n * 12));
+            if (!ifs) {
+                throw std::runtime_error("storage_type::restore(): read error on " + filename);
+            }
+            for (size_t k = 0; k < n; ++k) {
+                slot_type &slot = slots[b0 * bucket_slots + k];
+                for (unsigned w = 0; w < 3; ++w) {
+                    slot.words[w].store(words[3 * k + w], boost::memory_order_relaxed);
+                }
+                // a slot that was being written holds no trail, but it must not become an empty slot in its bucket
+                taglines[b0 + k / bucket_slots].tags[k % bucket_slots].store(tags[k] == tag_busy ? tag_dead : tags[k],
+                                                                           boost::memory_order_relaxed);
+            }
+        }
+        boost::atomic_thread_fence(boost::memory_order_seq_cst);
+        imagefile = filename;
     }
-    return result;
+    for (size_t i = 0; i < trails.size(); ++i) {
+        if (disk) {
+            disk->append(trails[i]);
+        } else {
+            insert_trail(trails[i]);
+        }
+    }
+    LOCK_STORAGE_MUTEX;
+    collisions.insert(collisions.end(), coll.begin(), coll.end());
+    totcoll = collcount;
+    return true;
 }
 
 storage_type main_storage;
@@ -20,34 +20,170 @@
 #ifndef STORAGE_HPP
 #define STORAGE_HPP
 
-// to be extended to support hard drive storage
+#include <memory>
+#include <string>
+#include <map>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+
+/*
+
+Flat lock-free hash table of trails, indexed by their end point.
+
+The table consists of buckets of 32 slots, each bucket has one cache line of 16-bit tags:
+  0 = empty, 1 = being written, 2 = dead (trail lost by a checkpoint, see below),
+  otherwise a fingerprint of the end point of the trail in the slot.
+A trail is stored in the first empty slot of its home bucket or the next probe_buckets-1 buckets,
+a slot is claimed by a CAS on its tag, the trail is written and then the fingerprint is published.
+After publishing, the same buckets are scanned for trails with equal fingerprint and end point:
+as buckets never lose slots the scan can stop at the first bucket with an empty slot,
+and of two concurrent insertions of colliding trails at least one sees the other.
+Only slots with a matching fingerprint are read, a slot is re-checked after reading to skip slots being replaced.
+
+Slots hold compact trails of 12 bytes: the 64-bit starting point (start[2] is always 0)
+and one word with the trail length in the low lenbits bits and check bits of the end point in the remaining bits.
+The end point itself is not stored: trails only match if they have the same home bucket, fingerprint and check bits,
+and a matching stored trail gets the end point of the trail it was matched with.
+A false match (about 1 in 2^(16+checkbits) per stored trail in the probed buckets) only costs one failing collision walk.
+Trails that do not end in a distinguished point are not stored.
+
+The table is sized with load_percent of its slots for the planned trails, so probed buckets are rarely all full.
+When all probed buckets are full:
+- with memhardlimit a slot in the home bucket is replaced, like the old per-bucket replacement,
+- otherwise the trail goes to an overflow store, so maxmemory remains a soft limit.
+The overflow store is split into overflow_stripes parts by home bucket, each under its own mutex,
+and a bit per home bucket marks the buckets that spilled: only insertions into those buckets scan the overflow store.
+The bit is set after the trail is added and checked after the table scan, both sequentially consistent,
+so of two concurrent insertions of colliding trails at least one sees the other, as for the table itself.
+
+With --diskstorage the table is replaced by an external memory tier (trail_disk_tier in storage.cpp):
+RAM is an append buffer of trails with their full end point, a full buffer is sorted and handed to a flusher thread,
+while the other half of the RAM fills up. The flusher splits the buffer into 256 partitions by end[1],
+joins each partition with the sorted runs of that partition on disk to find collisions,
+and appends it as a new run. Partitions with too many runs are merged into a single run.
+Collisions are thus found when the buffer containing the second trail is flushed.
+Runs (.run2 files) hold 24-byte records: the full 96-bit end point, the 64-bit starting point and the length.
+Calling insert_trail before reserve_memory is an error. When the disk is full or a flush fails
+the status line shows it, with the number of trails that were lost by failed flushes.
+
+Checkpoints (--checkpointwait) write the table as a raw image: a 4096-byte header, all tag lines and then all slots,
+so the file can be read back (or mapped) directly. Every chunk of checkpoint_buckets buckets has a dirty flag
+that is set after a slot in it is published, a checkpoint only rewrites the dirty chunks of the previous image.
+The first checkpoint of a process writes the whole image unless the table was restored from that file,
+so chunks of an earlier run with the same parameters never survive in it.
+A chunk is copied like read_slot: tags, slots, then the tags again. Slots that changed meanwhile or were being written
+are written as dead and their chunk stays dirty: an empty slot in the image could hide trails that probed past its bucket,
+as find_collisions stops at the first bucket with an empty slot. For the same reason, after a chunk is copied, the empty
+slots of the last probe_buckets-1 buckets of the image before it are checked again and written as dead if they were filled.
+Dead slots are never matched, only replaced with memhardlimit.
+Trails outside the table (overflow store, disk tier buffers) are returned to the caller to be saved.
+With disk storage the runs are kept on resume instead of being removed.
+
+*/
+
+class trail_disk_tier;
 
 class storage_type {
   public:
-    storage_type()
-        : totcoll(0), tmpptr(0) {}
-    ~storage_type() {}
+    storage_type();
+    ~storage_type();
 
-    void set_parameters(const birthday_parameters &parameters) {
-        procmodn = parameters.modn;
-        memhardlimit = parameters.memhardlimit;
-    }
+    void set_parameters(const birthday_parameters &parameters, uint32 distinguishedpointmask, uint32 maximumpathlength);
 
+    // m is the number of trails in RAM: table slots or buffered trails with disk storage
     void reserve_memory(uint64 m);
     void insert_trail(const trail_type &tr);
     void insert_trails(const vector<trail_type> &trs);
     void get_birthdaycollisions(vector<pair<trail_type, trail_type>> &collisions, unsigned multiple_of = 1);
     unsigned get_collqueuesize();
     unsigned get_totcoll();
+    // status of the disk tier for the status line, empty without disk storage
+    std::string disk_status() const;
+
+    // incremental checkpoint of the table to filename, returns the trails outside the table and the queued collisions
+    void checkpoint(const std::string &filename, vector<trail_type> &trails, vector<pair<trail_type, trail_type>> &coll);
+    // load a checkpoint after reserve_memory, returns false if filename does not hold an image of this table
+    bool restore(const std::string &filename, const vector<trail_type> &trails, const vector<pair<trail_type, trail_type>> &coll,
+                 unsigned collcount);
+
+    static const unsigned bucket_slots = 32;
+    static const unsigned probe_buckets = 4;
+    // memory per table slot in bytes: compact slot and tag
+    static const unsigned bytes_per_trail = 14;
+    // the table is sized for at most this percentage of its slots in use by the planned trails:
+    // at 85% about 1 in 1000 trails finds its probe window full, at 90% already 1 in 300
+    static const unsigned load_percent = 85;
+    // the planned trails of a table of the given memory in bytes, and the table slots for the planned trails
+    static uint64 trails_for_memory(uint64 bytes) { return bytes / bytes_per_trail * load_percent / 100; }
+    static uint64 slots_for_trails(uint64 trails) { return trails * 100 / load_percent + 1; }
+    // with disk storage: RAM per buffered trail (two buffers of records) and disk space per stored trail
+    static const unsigned bytes_per_buffered_trail = 48;
+    static const unsigned bytes_per_disk_trail = 24;
+    // buckets per dirty flag of the checkpoint
+    static const unsigned checkpoint_buckets = 1024;
+    // parts of the overflow store, each with its own mutex
+    static const unsigned overflow_stripes = 64;
 
   private:
-    vector<vector<trail_type>> trail_hash;
+    friend class trail_disk_tier;
+    typedef boost::uint16_t tag_type;
+    static const tag_type tag_empty = 0, tag_busy = 1, tag_dead = 2;
+
+    struct slot_type {
+        boost::atomic<uint32> words[3];
+    };
+    struct alignas(64) tagline_type {
+        boost::atomic<tag_type> tags[bucket_slots];
+    };
+    // the overflow trails of the home buckets b with b % overflow_stripes equal to the stripe index
+    struct alignas(64) overflow_stripe {
+        boost::mutex mut;
+        std::map<uint64, vector<trail_type>> trails;
+    };
+
+    uint64 home_bucket(const trail_type &tr) const { return (tr.end[1] / procmodn) % bucketcount; }
+    static tag_type fingerprint(const trail_type &tr) {
+        const uint32 h = (tr.end[0] * 0x9E3779B1) ^ (tr.end[2] * 0x85EBCA77) ^ tr.end[1];
+        const tag_type fp = tag_type((h ^ (h >> 16)) & 0xFFFF);
+        return fp < 3 ? tag_type(fp + 3) : fp;
+    }
+    uint32 encode_lencheck(const trail_type &tr) const {
+        if (lenbits >= 32) {
+            return tr.len;
+        }
+        const uint32 h = (tr.end[0] ^ (tr.end[1] * 0xCC9E2D51) ^ (tr.end[2] * 0x1B873593)) * 0x9E3779B1;
+        return (h << lenbits) | tr.len;
+    }
+    uint32 lenmask() const { return lenbits >= 32 ? ~uint32(0) : ((uint32(1) << lenbits) - 1); }
+    void write_slot(uint64 s, const trail_type &tr);
+    bool read_slot(uint64 s, tag_type fp, uint32 &start0, uint32 &start1, uint32 &lencheck) const;
+    uint64 claim_slot(uint64 home, const trail_type &tr);
+    void find_collisions(uint64 home, tag_type fp, uint64 own, const trail_type &tr);
+    void add_collision(const trail_type &tr1, const trail_type &tr2);
+    void mark_dirty(uint64 b) { dirty[b / checkpoint_buckets].store(true, boost::memory_order_release); }
+    bool has_overflow(uint64 home) const { return (overflowbits[home / 64].load(boost::memory_order_seq_cst) >> (home % 64)) & 1; }
+    void add_overflow(uint64 home, const trail_type &tr);
+    void checkpoint_header(uint32 header[8]) const;
+
+    std::unique_ptr<tagline_type[]> taglines;
+    std::unique_ptr<slot_type[]> slots;
+    std::unique_ptr<boost::atomic<bool>[]> dirty;
+    std::unique_ptr<boost::atomic<uint64>[]> overflowbits;
+    std::unique_ptr<overflow_stripe[]> overflow;
     vector<pair<trail_type, trail_type>> collisions;
+
+    boost::atomic<unsigned> totcoll;
+    boost::atomic<uint32> tmpptr;
+    uint64 bucketcount;
     unsigned procmodn;
     bool memhardlimit;
-    uint32 tmpptr;
-
-    unsigned totcoll;
+    uint32 dpmask;
+    unsigned lenbits;
+    std::unique_ptr<trail_disk_tier> disk;
+    // the checkpoint file that holds an earlier image of this table, empty if none
+    std::string imagefile;
 };
 
 extern storage_type main_storage;
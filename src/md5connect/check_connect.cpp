@@ -0,0 +1,147 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+// check program for the lower path trie of md5_diffpathconnect:
+// the verdict of md5_connect for every lower path, also one carried over from the previous upper path,
+// must be the bit at which md5_connect_bits fails for that lower path, or connectable
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include <boost/lexical_cast.hpp>
+
+#include <hashclash/check.hpp>
+#include <hashclash/rng.hpp>
+
+#include "main.hpp"
+
+using namespace hashclash;
+using namespace std;
+
+// defined in main.cpp of md5_diffpathconnect
+boost::mutex mut;
+std::string workdir = ".";
+
+const unsigned t = 11;
+
+// sprinkle n random bitconditions over the rows [tbegin,tend) of path, mostly on the low bits
+void sprinkle(differentialpath &path, int tbegin, int tend, unsigned n) {
+    static const bitcondition conds[] = {bc_plus, bc_minus, bc_zero, bc_one, bc_prev, bc_prevn};
+    for (unsigned k = 0; k < n; ++k) {
+        const int i = tbegin + int(xrng128() % unsigned(tend - tbegin));
+        const unsigned b = (xrng128() & 1) ? xrng128() % 8 : xrng128() % 32;
+        path.setbitcondition(i, b, conds[xrng128() % 6]);
+    }
+}
+
+int main() {
+    seed(1);
+
+    // lower paths of Q_-3,...,Q_t in groups that share most of their bitconditions, so they share trie nodes
+    vector<differentialpath> lowers;
+    for (unsigned g = 0; g < 16; ++g) {
+        differentialpath proto;
+        proto.offset = 3;
+        proto.path.resize(t + 4);
+        sprinkle(proto, t - 3, t + 1, 3);
+        for (unsigned v = 0; v < 64; ++v) {
+            lowers.push_back(proto);
+            sprinkle(lowers.back(), t - 3, t + 1, xrng128() % 3);
+        }
+    }
+    sort(lowers.begin(), lowers.end(), diffpathlower_less());
+    lowdQt.resize(lowers.size());
+    lowdQtm1.resize(lowers.size());
+    lowdQtm2.resize(lowers.size());
+    lowdQtm3.resize(lowers.size());
+    for (unsigned j = 0; j < lowers.size(); ++j) {
+        lowdQt[j] = lowers[j][t].diff();
+        lowdQtm1[j] = lowers[j][t - 1].diff();
+        lowdQtm2[j] = lowers[j][t - 2].diff();
+        lowdQtm3[j] = lowers[j][t - 3].diff();
+    }
+
+    // a sequence of upper paths of Q_t+1,...,Q_t+4 where each differs little from the previous one,
+    // so lower paths keep their verdict from the previous upper path on the equal low bits
+    vector<differentialpath> uppers;
+    differentialpath upper;
+    upper.offset = -int(t + 1);
+    upper.path.resize(4);
+    for (unsigned j = 0; j < 40; ++j) {
+        if (j % 10 == 0) {
+            for (unsigned i = 0; i < 4; ++i) {
+                upper[t + 1 + i] = wordconditions();
+            }
+            sprinkle(upper, t + 1, t + 5, 2);
+        } else {
+            sprinkle(upper, t + 1, t + 5, 1);
+        }
+        uppers.push_back(upper);
+    }
+
+    path_container container;
+    container.t = t;
+    container.m_diff[md5_wt[t + 1]] = uint32(1) << 31;
+    container.noverify = true;
+    // a connected path is never good enough: md5_connect_bits stops before building full paths
+    container.Qcondstart = t + 4;
+    container.bestmaxtunnel = ~unsigned(0);
+
+    md5_connect_thread worker;
+    // the lower paths are not complete paths that cleanup() accepts, their tunnel strength only matters for bestmaxcomp
+    worker.lowerpathsmaxtunnel.assign(lowers.size(), 0);
+    unsigned rejected = 0, carried = 0, connectable = 0;
+    bool ok = true;
+    for (unsigned j = 0; j < uppers.size(); ++j) {
+        const vector<unsigned> countb = worker.countb;
+        worker.md5_connect(lowers, uppers[j], container);
+        unsigned trierejected = 0;
+        for (unsigned b = 0; b < 32; ++b) {
+            trierejected += worker.countb[b] - countb[b];
+        }
+        unsigned newrejected = 0;
+        for (unsigned i = 0; i < lowers.size(); ++i) {
+            // md5_connect left the dF values of this upper path for every lower path
+            const unsigned verdict = worker.md5_connect_bits(lowers, i, uppers[j], container);
+            if (worker.isgood[i] == 0) {
+                ok = ok && verdict == 32;
+                connectable += (verdict == 32);
+            } else {
+                ok = ok && verdict == unsigned(worker.isgood[i]) - 1;
+                ++rejected;
+            }
+        }
+        for (unsigned i = 0; i < lowers.size(); ++i) {
+            newrejected += (worker.isgood[i] != 0);
+        }
+        // lower paths without a verdict from this upper path kept the one of the previous upper path
+        carried += newrejected - trierejected;
+    }
+    unsigned sharedrejects = 0;
+    for (unsigned b = 0; b < 32; ++b) {
+        sharedrejects += worker.countbaborted[b];
+    }
+    check(ok, "trie verdicts equal the verdicts of md5_connect_bits");
+    check(rejected != 0 && connectable != 0, "lower paths that can and cannot be connected are covered");
+    check(carried != 0, "verdicts carried over from the previous upper path are covered");
+    check(sharedrejects != 0, "trie nodes that reject several lower paths are covered");
+    return check_result("connect trie");
+}
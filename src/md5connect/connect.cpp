@@ -55,7 +55,6 @@ booleanfunction *md5bf(unsigned t) {
 // uint32 dQtp1, dQtp2, dQtp3, dQtp4;
 // differentialpath newpath;
 
-// bool lastdFp1, lastdFp2, lastdFp3;
 void md5_connect_thread::connectbits(
     const connect_bitdata &in,
     vector<connect_bitdata> &out,
@@ -155,73 +154,6 @@ void md5_connect_thread::connectbits(
     } // dQt
 }
 
-void md5_connect_thread::connectbits2(const connect_bitdata &in, unsigned b, const differentialpath &lower, const differentialpath &upper) {
-    //	static bf_outcome bfo0, bfo1, bfo2, bfo3;
-    //	static bf_conditions bfc0, bfc1, bfc2, bfc3;
-    bitcondition Qt, Qtp1;
-    bitcondition Qtp2 = upper[t + 2][b];
-    bitcondition Qtp3 = upper[t + 3][b];
-    bitcondition Qtm1 = lower[t - 1][b];
-    bitcondition Qtm2 = lower[t - 2][b];
-    unsigned dQtbit = (in.dQt >> b) & 1;
-    unsigned dQtp1bit = (in.dQtp1 >> b) & 1;
-    /**** carry dQt ****/
-    for (unsigned dqt = 0; dqt <= dQtbit; ++dqt) {
-        if (dqt == 0) {
-            if (dQtbit == 0) {
-                Qt = bc_constant;
-            } else {
-                Qt = bc_minus;
-            }
-        } else {
-            Qt = bc_plus;
-        }
-
-        /**** bitconditions Ft ****/
-        bfo0 = Ft->outcome(Qt, Qtm1, Qtm2);
-        for (unsigned bfo0index = 0; bfo0index < bfo0.size(); ++bfo0index) {
-            if ((in.dFt - bfo0(bfo0index, b)) & (1 << b)) {
-                continue;
-            }
-            bfc0 = Ft->forwardconditions(Qt, Qtm1, Qtm2, bfo0[bfo0index]);
-
-            /**** carry dQtp1 ****/
-            lastdFp1 = true;
-            for (unsigned dqtp1 = 0; dqtp1 <= dQtp1bit; ++dqtp1) {
-                if (dqtp1 == 0) {
-                    if (dQtp1bit == 0) {
-                        Qtp1 = bc_constant;
-                    } else {
-                        Qtp1 = bc_minus;
-                    }
-                } else {
-                    Qtp1 = bc_plus;
-                }
-
-                /**** bitconditions Ftp1 ****/
-                bfo1 = Ftp1->outcome(Qtp1, bfc0.first, bfc0.second);
-                for (unsigned bfo1index = 0; bfo1index < bfo1.size(); ++bfo1index) {
-                    if ((in.dFtp1 - bfo1(bfo1index, b)) & (1 << b)) {
-                        continue;
-                    }
-                    bfc1 = Ftp1->forwardconditions(Qtp1, bfc0.first, bfc0.second, bfo1[bfo1index]);
-
-                    /**** bitconditions Ftp2 ****/
-                    lastdFp2 = true;
-                    bfo2 = Ftp2->outcome(Qtp2, bfc1.first, bfc1.second);
-                    for (unsigned bfo2index = 0; bfo2index < bfo2.size(); ++bfo2index) {
-                        if ((in.dFtp2 - bfo2(bfo2index, b)) & (1 << b)) {
-                            continue;
-                        }
-
-                        lastdFp3 = true;
-                    } // dFtp2
-                } // dFtp1
-            } // dQtp1
-        } // dFt
-    } // dQt
-}
-
 unsigned md5_connect_thread::md5_connect_bits(
     const vector<differentialpath> &lowers, unsigned index, const differentialpath &upper, path_container &container
 ) {
@@ -247,13 +179,6 @@ unsigned md5_connect_thread::md5_connect_bits(
         }
         if (bitdataresults[b + 1].size() == 0) {
             // they cannot be connected
-            // check whether dF[t+1][b], dF[t+2][b] or dF[t+3][b] were involved or not
-            lastdFp1 = false;
-            lastdFp2 = false;
-            lastdFp3 = false;
-            for (unsigned k = 0; k < bitdataresults[b].size(); ++k) {
-                connectbits2(bitdataresults[b][k], b, lower, upper);
-            }
             return b;
         }
 
@@ -293,7 +218,7 @@ unsigned md5_connect_thread::md5_connect_bits(
     vector<vector<unsigned>> cumtunnelstrength, cumbitconditions;
     unsigned maxtunnelstrength = 0, minconditions = 9999;
     if (container.Qcondstart > t + 3) {
-        if (tmppath.path.size() == 0) {
+        if (tmppath.tbegin() == tmppath.tend()) {
             tmppath.get(-3);
             tmppath.get(16);
             for (int i = -3; i <= 16; ++i) {
@@ -482,6 +407,116 @@ unsigned md5_connect_thread::md5_connect_bits(
     return 32;
 }
 
+// compute dFt, dFtp1, dFtp2 and dFtp3 of the lower paths [begin,end) for the current upper path
+// isgood[i] remains set if lower path i was processed for the previous upper path, bits 0..isgood[i]-1 of the upper path are equal
+// and the new dF values are equal to the old ones on these bits, see md5_connect_trie
+// the block is done in separate branch-free passes over the arrays so that the compiler can vectorize them
+void md5_connect_thread::md5_connect_dF(unsigned begin, unsigned end, unsigned bequal) {
+    const unsigned n = end - begin;
+    dTtblock.resize(n);
+    uint32 *dTt = dTtblock.data();
+    const uint32 *dQt = lowdQt.data() + begin, *dQtm1 = lowdQtm1.data() + begin;
+    const uint32 *dQtm2 = lowdQtm2.data() + begin, *dQtm3 = lowdQtm3.data() + begin;
+    for (unsigned k = 0; k < n; ++k) {
+        dTt[k] = dQtp1 - dQt[k];
+    }
+    best_rotated_difference(dTt, dTt, n, 32 - md5_rc[t]);
+
+    uint32 *outFt = dFt.data() + begin, *outFtp1 = dFtp1.data() + begin;
+    uint32 *outFtp2 = dFtp2.data() + begin, *outFtp3 = dFtp3.data() + begin;
+    unsigned char *good = isgood.data() + begin;
+    for (unsigned k = 0; k < n; ++k) {
+        const uint32 dFti = dTt[k] - dmt - dQtm3[k];
+        const uint32 dFtp1i = dTtp1 - dQtm2[k];
+        const uint32 dFtp2i = dTtp2 - dQtm1[k];
+        const uint32 dFtp3i = dTtp3 - dQt[k];
+        const uint32 g = good[k];
+        const uint32 mask = uint32(0xFFFFFFFF) >> ((32 - g) & 31);
+        const uint32 diff = (dFti ^ outFt[k]) | (dFtp1i ^ outFtp1[k]) | (dFtp2i ^ outFtp2[k]) | (dFtp3i ^ outFtp3[k]);
+        const bool keep = g != 0 && g <= bequal && (diff & mask) == 0 && begin + k >= isgoodbegin && begin + k < isgoodend;
+        good[k] = keep ? (unsigned char)(g) : 0;
+        outFt[k] = dFti;
+        outFtp1[k] = dFtp1i;
+        outFtp2[k] = dFtp2i;
+        outFtp3[k] = dFtp3i;
+    }
+}
+
+/*
+   Whether a lower path can be connected to the upper path is decided bit by bit from bit 0 upwards:
+   the set of reachable connect_bitdata after bit b only depends on the lower path through the bitconditions of Qt-2 and Qt-1
+   and the bits of dQt, dFt, dFtp1, dFtp2 and dFtp3 on bits 0..b.
+   Moreover, translating the starting dQt and dF values by multiples of 2^(b+1) translates the reachable set by the same amount.
+   So lower paths are grouped in a trie: the children of a node at depth b split its lower paths on these values of bit b,
+   and one reachable set is computed per node for its representative lower path trierep[b] and translated for each child.
+   All lower paths below a node with an empty reachable set cannot be connected, lower paths that reach depth 32
+   are connected by md5_connect_bits.
+*/
+void md5_connect_thread::md5_connect_trie(
+    const vector<differentialpath> &lowers, const differentialpath &upper, path_container &container, unsigned b, unsigned begin, unsigned end
+) {
+    if (b == 32) {
+        for (unsigned k = begin; k < end; ++k) {
+            ++countb[md5_connect_bits(lowers, trieindex[k], upper, container)];
+        }
+        return;
+    }
+
+    // sort the lower paths of this node on their values of bit b
+    triekeys.clear();
+    for (unsigned k = begin; k < end; ++k) {
+        const unsigned i = trieindex[k];
+        const uint32 key = ((lowdQt[i] >> b) & 1) | (((dFt[i] >> b) & 1) << 1) | (((dFtp1[i] >> b) & 1) << 2) |
+                           (((dFtp2[i] >> b) & 1) << 3) | (((dFtp3[i] >> b) & 1) << 4) | (uint32(lowers[i][t - 2][b]) << 8) |
+                           (uint32(lowers[i][t - 1][b]) << 16);
+        triekeys.push_back(make_pair(key, i));
+    }
+    sort(triekeys.begin(), triekeys.end());
+    vector<unsigned> &bounds = triebounds[b];
+    bounds.clear();
+    for (unsigned k = 0; k < triekeys.size(); ++k) {
+        trieindex[begin + k] = triekeys[k].second;
+        if (k == 0 || triekeys[k].first != triekeys[k - 1].first) {
+            bounds.push_back(begin + k);
+        }
+    }
+    bounds.push_back(end);
+
+    const unsigned r = trierep[b];
+    for (unsigned c = 0; c + 1 < bounds.size(); ++c) {
+        const unsigned cbegin = bounds[c], cend = bounds[c + 1];
+        const unsigned s = trieindex[cbegin];
+        const uint32 ddQt = lowdQt[s] - lowdQt[r];
+        const uint32 ddFt = dFt[s] - dFt[r], ddFtp1 = dFtp1[s] - dFtp1[r];
+        const uint32 ddFtp2 = dFtp2[s] - dFtp2[r], ddFtp3 = dFtp3[s] - dFtp3[r];
+        triefrontier[b + 1].clear();
+        for (unsigned k = 0; k < triefrontier[b].size(); ++k) {
+            connect_bitdata in = triefrontier[b][k];
+            in.dQt += ddQt;
+            in.dFt += ddFt;
+            in.dFtp1 += ddFtp1;
+            in.dFtp2 += ddFtp2;
+            in.dFtp3 += ddFtp3;
+            connectbits(in, triefrontier[b + 1], b, lowers[s], upper);
+        }
+        if (triefrontier[b + 1].size() == 0) {
+            // none of these lower paths can be connected
+            for (unsigned k = cbegin; k < cend; ++k) {
+                isgood[trieindex[k]] = b + 1;
+            }
+            countb[b] += cend - cbegin;
+            countbaborted[b] += cend - cbegin - 1;
+            ++countbdepth[b];
+            continue;
+        }
+        // remove duplicates
+        sort(triefrontier[b + 1].begin(), triefrontier[b + 1].end());
+        triefrontier[b + 1].erase(unique(triefrontier[b + 1].begin(), triefrontier[b + 1].end()), triefrontier[b + 1].end());
+        trierep[b + 1] = s;
+        md5_connect_trie(lowers, upper, container, b + 1, cbegin, cend);
+    }
+}
+
 void md5_connect_thread::md5_connect(
     const vector<differentialpath> &lowerpaths, const differentialpath &upperpath, path_container &container
 ) {
@@ -510,12 +545,7 @@ void md5_connect_thread::md5_connect(
             lowerpathsmaxtunnel[i] = totaltunnelstrength(tmp);
         }
     }
-    int uppercompl = 0;
-    for (int k = upperpath.tbegin(); k < upperpath.tend() && k < 64; ++k) {
-        if (k >= container.Qcondstart) {
-            uppercompl -= int(upperpath[k].hw());
-        }
-    }
+    const int uppercompl = upperpath_complexity(upperpath, container.Qcondstart);
     if (container.showstats && sw.time() > 60) {
         cout << endl << count << "\t" << countall << "\t" << double(countall) / double(count) << endl;
         for (unsigned b = 0; b <= 32; ++b) {
@@ -552,84 +582,70 @@ void md5_connect_thread::md5_connect(
     dQtp2 = upperpath[t + 2].diff();
     dQtp3 = upperpath[t + 3].diff();
     dQtp4 = upperpath[t + 4].diff();
-    uint32 dTtp1 = best_rotated_difference(dQtp2 - dQtp1, 32 - md5_rc[t + 1]) - dmtp1;
-    uint32 dTtp2 = best_rotated_difference(dQtp3 - dQtp2, 32 - md5_rc[t + 2]) - dmtp2;
-    uint32 dTtp3 = best_rotated_difference(dQtp4 - dQtp3, 32 - md5_rc[t + 3]) - dmtp3;
-    for (unsigned i = 0; i < lowerpaths.size(); ++i) {
-        uint32 dQt = lowdQt[i];
-        uint32 dTt = best_rotated_difference(dQtp1 - dQt, 32 - md5_rc[t]);
-        uint32 dFti = dTt - dmt - lowdQtm3[i];
-        uint32 dFtp1i = dTtp1 - lowdQtm2[i];
-        uint32 dFtp2i = dTtp2 - lowdQtm1[i];
-        uint32 dFtp3i = dTtp3 - dQt;
-        if (isgood[i] != 0) {
-            if (isgood[i] <= bequal) {
-                if (0 != ((dFti ^ dFt[i]) << (32 - isgood[i])) || 0 != ((dFtp1i ^ dFtp1[i]) << (32 - isgood[i])) ||
-                    0 != ((dFtp2i ^ dFtp2[i]) << (32 - isgood[i])) || 0 != ((dFtp3i ^ dFtp3[i]) << (32 - isgood[i]))) {
-                    isgood[i] = 0;
-                }
-            } else {
-                isgood[i] = 0;
-            }
-        }
-        dFt[i] = dFti;
-        dFtp1[i] = dFtp1i;
-        dFtp2[i] = dFtp2i;
-        dFtp3[i] = dFtp3i;
+    dTtp1 = best_rotated_difference(dQtp2 - dQtp1, 32 - md5_rc[t + 1]) - dmtp1;
+    dTtp2 = best_rotated_difference(dQtp3 - dQtp2, 32 - md5_rc[t + 2]) - dmtp2;
+    dTtp3 = best_rotated_difference(dQtp4 - dQtp3, 32 - md5_rc[t + 3]) - dmtp3;
+
+    unsigned lowerbegin = 0, lowerend = unsigned(lowerpaths.size());
+    if (!task.whole()) {
+        lowerbegin = std::min(task.subbegin, lowerend);
+        lowerend = std::min(task.subend, lowerend);
     }
-
-    countall += lowerpaths.size();
-    for (unsigned i = 0; i < lowerpaths.size(); ++i) {
-        if (isgood[i]) {
-            continue;
+    countall += lowerend - lowerbegin;
+#ifdef DONT_SKIP_LOWERPATHS
+    md5_connect_dF(lowerbegin, lowerend, 0);
+    for (unsigned i = lowerbegin; i < lowerend; ++i) {
+        // hand over the second half of the remaining lower paths to idle threads
+        if (pool != nullptr && lowerend - i >= 2 && pool->hungry()) {
+            const unsigned mid = i + (lowerend - i) / 2;
+            pool->split(poolworker, task_range(task.begin, task.begin + 1, mid, lowerend));
+            lowerend = mid;
         }
         if (lowerpathsmaxtunnel[i] + uppercompl <= container.bestmaxcomp) {
             continue;
         }
         ++count;
-        unsigned b = md5_connect_bits(lowerpaths, i, upperpath, container);
-        ++countb[b];
-#ifndef DONT_SKIP_LOWERPATHS
-        // skip all lowerpaths that have the same characteristics on the b lower bits
-        if (b < 32) {
-            isgood[i] = b + 1;
-
-            unsigned j = i + 1;
-            unsigned jmax = binary_search_lower_paths(lowerpaths, i, b) + 1;
-            countbdepth[b] += jmax - j;
-
-            uint32 maskt = 0;
-            for (unsigned k = 0; k < b; ++k) {
-                maskt |= 1 << k;
-            }
-            uint32 masktp1 = maskt;
-            uint32 masktp2 = maskt;
-            uint32 masktp3 = maskt;
-            maskt |= 1 << b;
-            if (lastdFp1) {
-                masktp1 |= 1 << b;
-            }
-            if (lastdFp2) {
-                masktp2 |= 1 << b;
-            }
-            if (lastdFp3) {
-                masktp3 |= 1 << b;
+        ++countb[md5_connect_bits(lowerpaths, i, upperpath, container)];
+    }
+#else
+    // the lower paths are processed in chunks of consecutive (thus similar) lower paths,
+    // between chunks the second half of the remaining lower paths is handed over to idle threads
+    static const unsigned trie_chunk = 1 << 12;
+    for (unsigned i = lowerbegin; i < lowerend;) {
+        if (pool != nullptr && lowerend - i >= 2 && pool->hungry()) {
+            const unsigned mid = i + (lowerend - i) / 2;
+            pool->split(poolworker, task_range(task.begin, task.begin + 1, mid, lowerend));
+            lowerend = mid;
+        }
+        const unsigned chunkend = std::min(lowerend, i + trie_chunk);
+        md5_connect_dF(i, chunkend, bequal);
+        trieindex.clear();
+        for (; i < chunkend; ++i) {
+            if (isgood[i]) {
+                continue;
             }
-
-            uint32 dFti = dFt[i] & maskt;
-            uint32 dFtp1i = dFtp1[i] & masktp1;
-            uint32 dFtp2i = dFtp2[i] & masktp2;
-            uint32 dFtp3i = dFtp3[i] & masktp3;
-            for (; j < jmax; ++j) {
-                // verify if dF for t,t+1,t+2,t+3 are equal on these bits
-                // if so skip this path
-                if (dFti == (dFt[j] & maskt) && dFtp1i == (dFtp1[j] & masktp1) && dFtp2i == (dFtp2[j] & masktp2) &&
-                    dFtp3i == (dFtp3[j] & masktp3)) {
-                    isgood[j] = b + 1;
-                    ++countbaborted[b];
-                }
+            if (lowerpathsmaxtunnel[i] + uppercompl <= container.bestmaxcomp) {
+                continue;
             }
+            trieindex.push_back(i);
         }
-#endif // DONT_SKIP_LOWERPATHS
+        if (trieindex.empty()) {
+            continue;
+        }
+        count += trieindex.size();
+        trierep[0] = trieindex[0];
+        triefrontier[0].clear();
+        triefrontier[0].push_back(connect_bitdata());
+        connect_bitdata &start = triefrontier[0].back();
+        start.dFt = dFt[trierep[0]];
+        start.dFtp1 = dFtp1[trierep[0]];
+        start.dFtp2 = dFtp2[trierep[0]];
+        start.dFtp3 = dFtp3[trierep[0]];
+        start.dQt = lowdQt[trierep[0]];
+        start.dQtp1 = dQtp1;
+        md5_connect_trie(lowerpaths, upperpath, container, 0, 0, unsigned(trieindex.size()));
     }
+#endif // DONT_SKIP_LOWERPATHS
+    isgoodbegin = lowerbegin;
+    isgoodend = lowerend;
 }
@@ -30,6 +30,7 @@
 #include <boost/lexical_cast.hpp>
 
 #include <hashclash/saveload_gz.hpp>
+#include <hashclash/pathfile.hpp>
 #include <hashclash/md5detail.hpp>
 #include <hashclash/rng.hpp>
 #include <hashclash/differentialpath.hpp>
@@ -40,77 +41,77 @@
 
 vector<uint32> lowdQt, lowdQtm1, lowdQtm2, lowdQtm3;
 
-void random_permutation(vector<differentialpath> &paths) {
-    // use a pseudo-random permutation fixed by the number of paths
-    seed(paths.size());
-    for (unsigned i = 0; i < paths.size(); ++i) {
-        unsigned k = xrng64() % paths.size();
-        paths[i].swap(paths[k]);
-    }
-    addseed(time(NULL));
-}
-
 inline std::string pathsstring(const std::string &basepath, unsigned modi, unsigned modn) {
     return workdir + "/" + basepath + "_" + boost::lexical_cast<std::string>(modi) + "of" + boost::lexical_cast<std::string>(modn);
 }
 
 progress_display *dostep_progress = 0;
-volatile unsigned dostep_index = 0;
+task_pool *dostep_pool = 0;
 struct dostep_thread {
-    dostep_thread(vector<differentialpath> &inlow, vector<differentialpath> &inhigh, path_container &out)
-        : pathsinlow(inlow), pathsinhigh(inhigh), container(out) {}
+    dostep_thread(vector<differentialpath> &inlow, vector<differentialpath> &inhigh, path_container &out, unsigned index)
+        : pathsinlow(inlow), pathsinhigh(inhigh), container(out), threadindex(index) {}
     vector<differentialpath> &pathsinlow;
     vector<differentialpath> &pathsinhigh;
     path_container &container;
+    unsigned threadindex;
     void operator()() {
         md5_connect_thread *worker = new md5_connect_thread;
         try {
-            vector<differentialpath> buf;
-            unsigned i = xrng128() % pathsinhigh.size();
-            while (true) {
-                buf.clear();
-                mut.lock();
-                if (dostep_index >= pathsinhigh.size()) {
-                    mut.unlock();
+            seed_thread(threadindex);
+            worker->pool = dostep_pool;
+            worker->poolworker = threadindex;
+            unsigned progress = 0;
+            while (dostep_pool->next(threadindex, worker->task)) {
+                if (container.stopsearch()) {
+                    dostep_pool->done(threadindex);
                     break;
                 }
-                unsigned cnt = std::max<unsigned>(1, std::min<unsigned>(128, (pathsinhigh.size() - dostep_index) / 128));
-                while (buf.size() != cnt) {
-                    while (pathsinhigh[i].tbegin() == pathsinhigh[i].tend()) {
-                        ++i;
-                        if (i == pathsinhigh.size()) {
-                            i = 0;
-                        }
-                    }
-                    buf.emplace_back(std::move(pathsinhigh[i]));
-                    pathsinhigh[i].clear();
+                if (!worker->task.whole()) {
+                    worker->md5_connect(pathsinlow, pathsinhigh[worker->task.begin], container);
+                    continue;
                 }
-                dostep_index += cnt;
-                (*dostep_progress) += cnt;
-                mut.unlock();
-                for (auto &ph : buf) {
-                    worker->md5_connect(pathsinlow, ph, container);
+                const task_range task = worker->task;
+                for (uint64 i = task.begin; i < task.end && !container.stopsearch(); ++i) {
+                    worker->task = task_range(i, i + 1);
+                    worker->md5_connect(pathsinlow, pathsinhigh[i], container);
                 }
+                progress += unsigned(task.end - task.begin);
+                if (mut.try_lock()) {
+                    (*dostep_progress) += progress;
+                    mut.unlock();
+                    progress = 0;
+                }
+            }
+            if (progress != 0) {
+                boost::lock_guard<boost::mutex> lock(mut);
+                (*dostep_progress) += progress;
             }
         } catch (std::exception &e) {
+            dostep_pool->done(threadindex);
             cerr << "Worker thread: caught exception:" << endl << e.what() << endl;
         } catch (...) {
+            dostep_pool->done(threadindex);
         }
         delete worker;
     }
 };
 void dostep_threaded(vector<differentialpath> &inlow, vector<differentialpath> &inhigh, path_container &out) {
-    dostep_index = 0;
     std::string tstring = "t=" + boost::lexical_cast<std::string>(out.t) + ": ";
     if (tstring.size() == 5) {
         tstring += " ";
     }
     dostep_progress = new progress_display(inhigh.size(), true, cout, tstring, "      ", "      ");
+    task_pool pool(inhigh.size(), out.threads, std::max<uint64>(1, std::min<uint64>(128, inhigh.size() / (128 * out.threads))));
+    dostep_pool = &pool;
+    out.searchtime.start();
+    out.start_postprocessing();
     boost::thread_group mythreads;
     for (unsigned i = 0; i < out.threads; ++i) {
-        mythreads.create_thread(dostep_thread(inlow, inhigh, out));
+        mythreads.create_thread(dostep_thread(inlow, inhigh, out, i));
     }
     mythreads.join_all();
+    out.finish_postprocessing();
+    dostep_pool = 0;
     if (dostep_progress->expected_count() != dostep_progress->count()) {
         *dostep_progress += dostep_progress->expected_count() - dostep_progress->count();
     }
@@ -138,7 +139,7 @@ void dostep(path_container &container) {
         try {
             hashclash::timer loadtime(true);
             cout << "Loading " << container.inputfilelow << "..." << flush;
-            load_gz(pathsinlow, binary_archive, container.inputfilelow);
+            load_paths(pathsinlow, container.inputfilelow);
             sort(pathsinlow.begin(), pathsinlow.end(), diffpathlower_less());
             cout << "done: " << pathsinlow.size() << ". (" << loadtime.time() << "s)" << endl;
         } catch (...) {
@@ -160,12 +161,8 @@ void dostep(path_container &container) {
         try {
             hashclash::timer loadtime(true);
             cout << "Loading " << container.inputfilehigh << "..." << flush;
-            vector<differentialpath> pathstmp2;
-            load_gz(pathstmp2, binary_archive, container.inputfilehigh);
-            random_permutation(pathstmp2);
-            for (unsigned j = modi; j < pathstmp2.size(); j += modn) {
-                pathsinhigh.push_back(std::move(pathstmp2[j]));
-            }
+            // from a path file only this part of the upper paths is decoded
+            load_paths_part(pathsinhigh, container.inputfilehigh, modi, modn);
             sort(pathsinhigh.begin(), pathsinhigh.end(), diffpathupper_less());
             cout << "done: " << pathsinhigh.size() << ". (" << loadtime.time() << "s)" << endl;
         } catch (...) {
@@ -175,7 +172,7 @@ void dostep(path_container &container) {
         try {
             hashclash::timer loadtime(true);
             cout << "Loading " << container.inputfilehigh << "..." << flush;
-            load_gz(pathsinhigh, binary_archive, container.inputfilehigh);
+            load_paths(pathsinhigh, container.inputfilehigh);
             sort(pathsinhigh.begin(), pathsinhigh.end(), diffpathupper_less());
             cout << "done: " << pathsinhigh.size() << ". (" << loadtime.time() << "s)" << endl;
         } catch (...) {
@@ -183,6 +180,23 @@ void dostep(path_container &container) {
         }
     }
 
+    // anytime mode: do the upper paths that allow the highest complexity first
+    // the stable sort keeps similar upper paths together within equal complexity
+    if (container.anytime()) {
+        vector<int> complexity(pathsinhigh.size());
+        vector<unsigned> order(pathsinhigh.size());
+        for (unsigned j = 0; j < pathsinhigh.size(); ++j) {
+            complexity[j] = upperpath_complexity(pathsinhigh[j], container.Qcondstart);
+            order[j] = j;
+        }
+        stable_sort(order.begin(), order.end(), [&complexity](unsigned l, unsigned r) { return complexity[l] > complexity[r]; });
+        vector<differentialpath> sorted(pathsinhigh.size());
+        for (unsigned j = 0; j < order.size(); ++j) {
+            sorted[j] = std::move(pathsinhigh[order[j]]);
+        }
+        pathsinhigh.swap(sorted);
+    }
+
     // wait until loading of inputfilelow is also finished
     mythreads.join_all();
 
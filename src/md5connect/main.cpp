@@ -22,6 +22,7 @@
 #include <fstream>
 #include <vector>
 #include <string>
+#include <algorithm>
 
 #include <boost/lexical_cast.hpp>
 #include <boost/program_options.hpp>
@@ -31,6 +32,7 @@
 #include <hashclash/sdr.hpp>
 #include <hashclash/timer.hpp>
 #include <hashclash/booleanfunction.hpp>
+#include <hashclash/rng.hpp>
 
 using namespace hashclash;
 using namespace std;
@@ -50,6 +52,7 @@ int main(int argc, char **argv) {
 
     try {
         path_container container;
+        uint32 rngseed = 0;
         vector<vector<int>> msgdiff(16);
 
         // Define program options
@@ -58,6 +61,8 @@ int main(int argc, char **argv) {
 
         int bestmaxcomp;
         unsigned mintunnel;
+        int postthreads;
+        string beststream;
         desc.add_options()
 			("help,h", "Show options.")
 			("mod,m"
@@ -74,11 +79,11 @@ int main(int argc, char **argv) {
 
 			("inputfilelow"
 				, po::value<string>(&container.inputfilelow)
-				, "Use specified inputfile for lower paths.")
+				, "Use specified inputfile for lower paths (.bin.gz or .paths).")
 
 			("inputfilehigh"
 				, po::value<string>(&container.inputfilehigh)
-				, "Use specified inputfile for upper paths.")
+				, "Use specified inputfile for upper paths (.bin.gz or .paths).")
 
 			("waitinputfile"
 				, po::bool_switch(&container.waitinputfile)
@@ -119,6 +124,31 @@ int main(int argc, char **argv) {
 			("threads"
 				, po::value<int>(&container.threads)->default_value(-1)
 				, "Number of worker threads.")
+			("postthreads"
+				, po::value<int>(&postthreads)->default_value(-1)
+				, "Number of threads that verify and enhance\n"
+				  "  connected paths (0 = on the connect threads).\n"
+				  "  Default is a quarter of the threads, at least 1.")
+			("seed"
+				, po::value<uint32>(&rngseed)
+				, "Seed for the random generators of all threads. Default is random.\n"
+				  "  Runs with the same seed and --threads 1 are reproducible.\n"
+				  "  Worker i always draws the same stream, but threads\n"
+				  "  take work as they become idle, so with more threads\n"
+				  "  the outcome also depends on the thread scheduling.")
+
+			("timelimit"
+				, po::value<double>(&container.timelimit)->default_value(0)
+				, "Stop after this many seconds (0 = no limit),\n"
+				  "  upper paths are done best first.")
+			("targetcomplexity"
+				, po::value<int>(&container.targetcomplexity)
+				, "Stop when a path with at least this complexity\n"
+				  "  is found, upper paths are done best first.")
+			("beststream"
+				, po::value<string>(&beststream)
+				, "Append every new best path to this path stream\n"
+				  "  (see md5_diffpathhelper --pathstream).")
 			;
 
         msg
@@ -139,6 +169,7 @@ int main(int argc, char **argv) {
         po::notify(vm);
         container.bestmaxcomp = bestmaxcomp;
         container.bestmaxtunnel = mintunnel;
+        container.hastarget = vm.count("targetcomplexity") > 0;
 
         // Process program options
         if (vm.count("help") || vm.count("tstep") == 0) {
@@ -183,6 +214,13 @@ int main(int argc, char **argv) {
         if (container.threads <= 0 || container.threads > boost::thread::hardware_concurrency()) {
             container.threads = boost::thread::hardware_concurrency();
         }
+        container.postthreads = (postthreads < 0) ? unsigned(std::max(1, container.threads / 4)) : unsigned(postthreads);
+        if (vm.count("seed")) {
+            seed(rngseed);
+        }
+        if (!beststream.empty()) {
+            container.beststreamwriter.reset(new pathstream_writer(beststream));
+        }
 
         // Start job with given parameters
         dostep(container);
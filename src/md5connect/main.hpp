@@ -25,6 +25,10 @@
 #include <string>
 #include <stdexcept>
 
+#include <memory>
+#include <deque>
+
+#include <boost/atomic.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/thread.hpp>
 
@@ -33,6 +37,8 @@
 #include <hashclash/differentialpath.hpp>
 #include <hashclash/booleanfunction.hpp>
 #include <hashclash/timer.hpp>
+#include <hashclash/taskpool.hpp>
+#include <hashclash/pathstream.hpp>
 
 using namespace hashclash;
 using namespace std;
@@ -43,6 +49,17 @@ class path_container;
 void dostep(path_container &container);
 bool check_path_collfind(const differentialpath &diffpath, const uint32 mdiff[16]);
 
+// upper bound on the complexity (#tunnels - #Qconds) contributed by the conditions of the upper path
+inline int upperpath_complexity(const differentialpath &upperpath, int Qcondstart) {
+    int uppercompl = 0;
+    for (int k = upperpath.tbegin(); k < upperpath.tend() && k < 64; ++k) {
+        if (k >= Qcondstart) {
+            uppercompl -= int(upperpath[k].hw());
+        }
+    }
+    return uppercompl;
+}
+
 struct connect_bitdata {
     uint32 dQt;
     uint32 dQtp1;
@@ -95,7 +112,7 @@ struct connect_bitdata {
 
 struct md5_connect_thread {
     md5_connect_thread()
-        : sw(true), countb(33, 0), countbaborted(33, 0), countbdepth(33, 0) {}
+        : sw(true), countb(33, 0), countbaborted(33, 0), countbdepth(33, 0), isgoodbegin(0), isgoodend(0), pool(nullptr), poolworker(0) {}
     void md5_connect(const vector<differentialpath> &lowerpaths, const differentialpath &upperpath, path_container &container);
     timer sw /*(true)*/;
     vector<unsigned> countb /*(33, 0)*/;
@@ -103,6 +120,8 @@ struct md5_connect_thread {
     vector<unsigned> countbdepth /*(33, 0)*/;
     uint64 count, countall;
     vector<unsigned char> isgood;
+    // the lower paths processed for the previous upper path, isgood is outdated outside this range
+    unsigned isgoodbegin, isgoodend;
     vector<int> lowerpathsmaxtunnel;
 
     unsigned
@@ -112,10 +131,9 @@ struct md5_connect_thread {
     vector<connect_bitdata> bitdatastart[32];
     vector<connect_bitdata> bitdataend[32];
     vector<byteconditions> bitdatanewcond[32];
-    differentialpath newpath2, tmppath;
+    fixeddifferentialpath newpath2, tmppath;
     unsigned bindex[32];
 
-    void connectbits2(const connect_bitdata &in, unsigned b, const differentialpath &lower, const differentialpath &upper);
     bf_outcome bfo0, bfo1, bfo2, bfo3;
     bf_conditions bfc0, bfc1, bfc2, bfc3;
 
@@ -132,7 +150,6 @@ struct md5_connect_thread {
     // bf_conditions bfc0, bfc1, bfc2, bfc3;
     bitcondition Qt, Qtp1;
     byteconditions newcond;
-    bool lastdFp1, lastdFp2, lastdFp3;
 
     unsigned t;
     booleanfunction *Ft;
@@ -142,40 +159,27 @@ struct md5_connect_thread {
     vector<uint32> dFt, dFtp1, dFtp2, dFtp3;
     uint32 dmt, dmtp1, dmtp2, dmtp3;
     uint32 dQtp1, dQtp2, dQtp3, dQtp4;
+    uint32 dTtp1, dTtp2, dTtp3;
     differentialpath newpath;
 
-    inline bool isinrange(const differentialpath &needle, const differentialpath &haystack, unsigned b) {
-        for (unsigned j = t - 2; j <= t; ++j) {
-            const wordconditions &nt = needle[j];
-            const wordconditions &ht = haystack[j];
-            unsigned k = 0;
-            while (k + 7 <= b) {
-                if (nt.bytes[k >> 3] != ht.bytes[k >> 3]) {
-                    return false;
-                }
-                k += 8;
-            }
-            for (; k <= b; ++k) {
-                if (nt[k] != ht[k]) {
-                    return false;
-                }
-            }
-        }
-        return true;
-    }
-    inline unsigned binary_search_lower_paths(const vector<differentialpath> &lowerpaths, unsigned i, unsigned b) {
-        const differentialpath &needle = lowerpaths[i];
-        unsigned l = i, u = lowerpaths.size() - 1;
-        while (l < u) {
-            unsigned j = (l + u + 1) >> 1;
-            if (isinrange(needle, lowerpaths[j], b)) {
-                l = j;
-            } else {
-                u = j - 1;
-            }
-        }
-        return l;
-    }
+    void md5_connect_dF(unsigned begin, unsigned end, unsigned bequal);
+    vector<uint32> dTtblock;
+
+    // bit-level trie over the lower paths trieindex[begin,end) that are equal on bits 0..b-1, see connect.cpp
+    void md5_connect_trie(
+        const vector<differentialpath> &lowers, const differentialpath &upper, path_container &container, unsigned b, unsigned begin, unsigned end
+    );
+    vector<unsigned> trieindex;
+    vector<pair<uint32, unsigned>> triekeys;
+    vector<unsigned> triebounds[32];
+    vector<connect_bitdata> triefrontier[33];
+    unsigned trierep[33];
+
+    // if pool is set then task is the current task (upper path) of worker poolworker:
+    // only the lower paths [task.subbegin,task.subend) are processed and part of them may be split off
+    task_pool *pool;
+    unsigned poolworker;
+    task_range task;
 };
 
 extern vector<uint32> lowdQt, lowdQtm1, lowdQtm2, lowdQtm3;
@@ -198,20 +202,126 @@ class path_container {
           bestmaxtunnel(0),
           showstats(false),
           bestmaxcomp(-1000),
-          threads(1) {
+          threads(1),
+          timelimit(0),
+          hastarget(false),
+          targetcomplexity(0),
+          stop(false),
+          postthreads(0),
+          postdone(false),
+          postduplicates(0),
+          postqueuefull(0) {
         for (unsigned k = 0; k < 16; ++k) {
             m_diff[k] = 0;
         }
     }
 
     ~path_container() {
+        finish_postprocessing();
         cout << "Best path: totcompl=" << bestmaxcomp << " tottunnel=" << bestmaxtunnel << ", totcond=" << bestpathcond << endl;
         if (!noverify) {
             cerr << "Verified: " << verifiedbad << " bad out of " << verified << endl;
         }
     }
 
-    void push_back(const differentialpath &fullpath) {
+    /*
+       Connected paths are post-processed: verified, enhanced and merged into the best paths.
+       With postthreads > 0 this is done by separate worker threads, so the connect threads only drop duplicates
+       and queue the path. When the queue is full the connect thread post-processes the path itself instead of waiting,
+       so no path is lost and the connect threads never stall on slow workers; these paths are counted.
+       Duplicates are found by a hash of the path in a direct-mapped table of 2^postseen_bits hashes (8MB),
+       so only a duplicate of a path whose slot has not been reused since is dropped.
+       With postthreads = 0 every path is post-processed directly on the connect thread without dropping duplicates.
+       Paths that cannot beat the best paths (which may have improved while they were queued) are rejected by the workers
+       before verification and enhancement. Without workers every connected path is verified before this rejection,
+       so verified and verifiedbad count all connected paths.
+    */
+    void push_back(const fixeddifferentialpath &fullpath) {
+        if (postthreads == 0) {
+            postprocess(fullpath.todifferentialpath());
+            return;
+        }
+        // 0 marks an empty slot
+        const uint64 h = path_hash(fullpath) | 1;
+        boost::unique_lock<boost::mutex> lock(postmut);
+        uint64 &seen = postseen[h >> (64 - postseen_bits)];
+        if (seen == h) {
+            ++postduplicates;
+            return;
+        }
+        seen = h;
+        if (postqueue.size() < postqueue_max) {
+            postqueue.push_back(fullpath);
+            postnotempty.notify_one();
+            return;
+        }
+        ++postqueuefull;
+        lock.unlock();
+        postprocess(fullpath.todifferentialpath());
+    }
+
+    void start_postprocessing() {
+        if (postthreads != 0) {
+            postseen.assign(size_t(1) << postseen_bits, 0);
+        }
+        for (unsigned i = 0; i < postthreads; ++i) {
+            postworkers.create_thread([this]() { postprocess_worker(); });
+        }
+    }
+
+    // process the remaining queued paths and stop the worker threads
+    void finish_postprocessing() {
+        {
+            boost::lock_guard<boost::mutex> lock(postmut);
+            postdone = true;
+            postnotempty.notify_all();
+        }
+        postworkers.join_all();
+        std::vector<uint64>().swap(postseen);
+        if (postduplicates != 0) {
+            cout << "Duplicate connected paths: " << postduplicates << endl;
+            postduplicates = 0;
+        }
+        if (postqueuefull != 0) {
+            cout << "Connected paths post-processed by the connect threads at a full queue: " << postqueuefull << endl;
+            postqueuefull = 0;
+        }
+    }
+
+    void postprocess_worker() {
+        fixeddifferentialpath path;
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(postmut);
+                while (postqueue.empty() && !postdone) {
+                    postnotempty.wait(lock);
+                }
+                if (postqueue.empty()) {
+                    return;
+                }
+                path = postqueue.front();
+                postqueue.pop_front();
+            }
+            try {
+                postprocess(path.todifferentialpath());
+            } catch (std::exception &e) {
+                cerr << "Post-processing thread: caught exception:" << endl << e.what() << endl;
+            } catch (...) {
+            }
+        }
+    }
+
+    static uint64 path_hash(const fixeddifferentialpath &path) {
+        uint64 h = 0xcbf29ce484222325ULL ^ uint32(-path.tbegin());
+        for (int t = path.tbegin(); t < path.tend(); ++t) {
+            for (unsigned k = 0; k < 4; ++k) {
+                h = (h ^ path[t].bytes[k].val) * 0x100000001b3ULL;
+            }
+        }
+        return h;
+    }
+
+    void postprocess(const differentialpath &fullpath) {
         differentialpath pathback = fullpath;
         try {
             cleanup(pathback);
@@ -223,14 +333,6 @@ class path_container {
             show_path(pathback, m_diff);
         }
 
-        if (!noverify && !test_path_fast(pathback, m_diff)) {
-            mut.lock();
-            ++verified;
-            ++verifiedbad;
-            mut.unlock();
-            return;
-        }
-
         unsigned tunnel = totaltunnelstrength(pathback);
         int tuncompl = tunnel;
         for (int k = pathback.tbegin(); k < pathback.tend() && k < 64; ++k) {
@@ -238,6 +340,18 @@ class path_container {
                 tuncompl -= int(pathback[k].hw());
             }
         }
+        // the workers reject paths that cannot beat the best paths before verifying them, see push_back
+        if (postthreads != 0 && (tuncompl < bestmaxcomp || tunnel < bestmaxtunnel)) {
+            return;
+        }
+
+        if (!noverify && !test_path_fast(pathback, m_diff)) {
+            mut.lock();
+            ++verified;
+            ++verifiedbad;
+            mut.unlock();
+            return;
+        }
         if (tuncompl < bestmaxcomp) {
             return;
         }
@@ -289,6 +403,7 @@ class path_container {
             mut.lock();
             ++verified;
             bestpaths.push_back(pathback);
+            append_beststream(pathback, false, tuncompl, tunnel, cond);
             if (hw(uint32(bestpaths.size())) == 1) {
                 save_gz(bestpaths, workdir + "/bestpaths", binary_archive);
                 save_gz(
@@ -333,6 +448,10 @@ class path_container {
             workdir + "/bestpaths_t" + boost::lexical_cast<string>(tunnel) + "_c" + boost::lexical_cast<string>(cond),
             binary_archive
         );
+        append_beststream(pathback, true, tuncompl, tunnel, cond);
+        if (hastarget && bestmaxcomp >= targetcomplexity && !stop.exchange(true)) {
+            cout << "Target complexity reached, stopping." << endl;
+        }
         save_gz(pathback, workdir + "/bestpath_new", binary_archive);
         save_gz(bestpaths, workdir + "/bestpaths_new", binary_archive);
         try {
@@ -354,6 +473,27 @@ class path_container {
         mut.unlock();
     }
 
+    // called under mut
+    void append_beststream(const differentialpath &path, bool supersede, int complexity, unsigned tunnel, unsigned cond) {
+        if (!beststreamwriter) {
+            return;
+        }
+        try {
+            beststreamwriter->append(path, supersede, complexity, tunnel, cond);
+        } catch (std::exception &e) {
+            cerr << e.what() << endl;
+        }
+    }
+
+    // anytime mode: true once the time limit or the target complexity has been reached
+    bool stopsearch() {
+        if (timelimit > 0 && !stop && searchtime.time() > timelimit && !stop.exchange(true)) {
+            cout << "Time limit reached, stopping." << endl;
+        }
+        return stop;
+    }
+    bool anytime() const { return timelimit > 0 || hastarget; }
+
     uint32 m_diff[16];
 
     unsigned t;
@@ -375,6 +515,24 @@ class path_container {
     volatile unsigned bestmaxtunnel;
     volatile int bestmaxcomp;
     int threads;
+
+    double timelimit;
+    bool hastarget;
+    int targetcomplexity;
+    boost::atomic<bool> stop;
+    hashclash::timer searchtime;
+    std::unique_ptr<pathstream_writer> beststreamwriter;
+
+    unsigned postthreads;
+    static const size_t postqueue_max = 1 << 12;
+    static const unsigned postseen_bits = 20;
+    boost::mutex postmut;
+    boost::condition_variable postnotempty;
+    std::deque<fixeddifferentialpath> postqueue;
+    std::vector<uint64> postseen;
+    bool postdone;
+    uint64 postduplicates, postqueuefull;
+    boost::thread_group postworkers;
 };
 
 struct diffpathlower_less : public std::binary_function<differentialpath, differentialpath, bool> {
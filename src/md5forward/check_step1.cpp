@@ -0,0 +1,120 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+// check program for step 1 of md5_diffpathforward: the paths it builds from the cached step 0 output
+// equal those it builds from the saved paths0 files, and with --mod it uses the paths0 files of all processes
+
+#include <unistd.h>
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <hashclash/check.hpp>
+#include <hashclash/rng.hpp>
+#include <hashclash/pathfile.hpp>
+#include <hashclash/saveload_gz.hpp>
+
+#include "main.hpp"
+
+using namespace hashclash;
+using namespace std;
+
+// defined in main.cpp of md5_diffpathforward
+boost::mutex mut;
+std::string workdir;
+
+// first step differentials as step 0 would find them for some IHV
+step1diffs_type random_step1diffs(unsigned n) {
+    step1diffs_type diffs;
+    while (diffs.size() < n) {
+        const uint32 Q1a = xrng128(), Q1b = Q1a + (uint32(1) << (xrng128() % 32)) - (uint32(1) << (xrng128() % 32));
+        const uint32 Fa = xrng128(), Fb = Fa ^ (xrng128() & xrng128() & xrng128());
+        auto &v = diffs[make_pair(sdr(Q1a, Q1b), sdr(Fa, Fb))];
+        v.second.first |= Q1a;
+        v.second.second = (v.first == 0) ? Q1a : (v.second.second & Q1a);
+        v.first += 1 + xrng128() % 1000;
+    }
+    return diffs;
+}
+
+vector<differentialpath> step1_output(path_container_autobalance &container) {
+    dostep(container);
+    vector<differentialpath> paths;
+    load_paths(paths, paths_filename(pathsstring("paths1", container.modi, container.modn)));
+    return paths;
+}
+
+bool same(const differentialpath &l, const differentialpath &r) {
+    return l.tbegin() == r.tbegin() && l.path.size() == r.path.size() && (l.path.empty() || l == r);
+}
+
+bool same(const vector<differentialpath> &l, const vector<differentialpath> &r) {
+    if (l.size() != r.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < l.size(); ++i) {
+        if (!same(l[i], r[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    seed(1);
+    const string dir = argc > 1 ? argv[1] : ".";
+    workdir = dir + "/check_step1." + to_string(::getpid());
+    boost::filesystem::create_directories(workdir);
+
+    path_container_autobalance container;
+    container.t = 1;
+    for (unsigned k = 0; k < 4; ++k) {
+        container.IHV1[k] = xrng128();
+        container.IHV2[k] = container.IHV1[k] + (k == 0 ? 0 : uint32(1) << 31);
+    }
+    container.m_diff[4] = uint32(1) << 31;
+
+    // the step 0 output of two processes of a run with --mod 2
+    const step1diffs_type part0 = random_step1diffs(3000), part1 = random_step1diffs(2000);
+    step1diffs_type all = part0;
+    combine_step1diffs(all, part1);
+
+    save_gz(all, pathsstring("paths0", 0, 1), binary_archive);
+    const vector<differentialpath> fromfile = step1_output(container);
+    check(!fromfile.empty(), "step 1 builds paths");
+
+    step1diffscache = all;
+    const vector<differentialpath> fromcache = step1_output(container);
+    check(step1diffscache.empty(), "step 1 takes the cached step 0 output");
+    check(same(fromcache, fromfile), "step 1 output with the cache equals that without");
+
+    // process 0 of --mod 2 only has its own share in memory, step 1 must still combine both paths0 files
+    save_gz(part0, pathsstring("paths0", 0, 2), binary_archive);
+    save_gz(part1, pathsstring("paths0", 1, 2), binary_archive);
+    container.modn = 2;
+    step1diffscache = part0;
+    const vector<differentialpath> frommod = step1_output(container);
+    check(same(frommod, fromfile), "step 1 output with --mod 2 equals that without --mod");
+
+    boost::filesystem::remove_all(workdir);
+    return check_result("check_step1");
+}
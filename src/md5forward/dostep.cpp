@@ -28,8 +28,10 @@
 #include <time.h>
 
 #include <boost/lexical_cast.hpp>
+#include <boost/atomic.hpp>
 
 #include <hashclash/saveload_gz.hpp>
+#include <hashclash/pathfile.hpp>
 #include <hashclash/md5detail.hpp>
 #include <hashclash/rng.hpp>
 #include <hashclash/differentialpath.hpp>
@@ -38,81 +40,242 @@
 
 #include "main.hpp"
 
+#ifdef HASHCLASH_HAVE_AVX2
+#include <hashclash/simd/simd_avx256.h>
+
+union simd_word_t {
+    SIMD_WORD v;
+    uint32 w[SIMD_VECSIZE];
+};
+#endif
+
 using namespace hashclash;
 using namespace std;
 
 void random_permutation(vector<differentialpath> &paths) {
-    // use a pseudo-random permutation fixed by the number of paths
-    seed(paths.size());
-    for (unsigned i = 0; i < paths.size(); ++i) {
-        unsigned k = xrng64() % paths.size();
-        paths[i].swap(paths[k]);
+    // the pseudo-random permutation fixed by the number of paths that load_paths_part() also uses,
+    // the same swap shuffle as earlier versions, so paths keep their order and modi/modn part
+    vector<uint64> perm;
+    path_permutation(perm, paths.size());
+    vector<differentialpath> permuted(paths.size());
+    for (size_t i = 0; i < perm.size(); ++i) {
+        permuted[i].swap(paths[size_t(perm[i])]);
     }
-    addseed(time(NULL));
-}
-
-inline std::string pathsstring(const std::string &basepath, unsigned modi, unsigned modn) {
-    return workdir + "/" + basepath + "_" + boost::lexical_cast<std::string>(modi) + "of" + boost::lexical_cast<std::string>(modn);
+    paths.swap(permuted);
 }
 
 // map: (dQ1, dF1) => (count, Q1_set0, Q1_set1)
-typedef map<pair<sdr, sdr>, pair<unsigned, pair<uint32, uint32>>> step1diffs_type;
-void generate_step1diffs(step1diffs_type &step1diffs, const path_container_autobalance &container) {
-    const unsigned m = container.modn;
-    const unsigned i = container.modi;
-    const uint32 *m_diff = container.m_diff;
 
-    uint32 Q1[4], Q2[4];
-    Q1[0] = container.IHV1[0];
-    Q1[1] = container.IHV1[3];
-    Q1[2] = container.IHV1[2];
-    Q1[3] = container.IHV1[1];
-    Q2[0] = container.IHV2[0];
-    Q2[1] = container.IHV2[3];
-    Q2[2] = container.IHV2[2];
-    Q2[3] = container.IHV2[1];
+// per-thread open-addressing hash table with the same contents as step1diffs_type
+// avoids the std::map lookup for each of the 2^32 values of T
+class step1diffs_hashtable {
+  public:
+    struct entry {
+        uint32 dQ1mask, dQ1sign, dFmask, dFsign;
+        uint32 count, Q1set0, Q1set1, used;
+    };
+
+    step1diffs_hashtable()
+        : table(1 << 16), size(0) {}
+
+    static inline uint64 hash(uint32 dQ1mask, uint32 dQ1sign, uint32 dFmask, uint32 dFsign) {
+        uint64 h = (uint64(dQ1mask) << 32) ^ uint64(dQ1sign);
+        h *= 0x9E3779B97F4A7C15ULL;
+        h ^= ((uint64(dFmask) << 32) ^ uint64(dFsign)) * 0xC2B2AE3D27D4EB4FULL;
+        return h ^ (h >> 29);
+    }
 
-    step1diffs_type::iterator step1diffs_it, step1diffs_it2;
-    uint32 Ta = md5_ff(Q1[3], Q1[2], Q1[1]) + Q1[0] + md5_ac[0];
-    uint32 Tb = md5_ff(Q2[3], Q2[2], Q2[1]) + Q2[0] + md5_ac[0] + m_diff[0];
+    inline void insert(uint32 dQ1mask, uint32 dQ1sign, uint32 dFmask, uint32 dFsign, uint32 count, uint32 Q1set0, uint32 Q1set1) {
+        const uint64 tmask = table.size() - 1;
+        uint64 i = hash(dQ1mask, dQ1sign, dFmask, dFsign) & tmask;
+        while (true) {
+            entry &e = table[i];
+            if (!e.used) {
+                e.dQ1mask = dQ1mask;
+                e.dQ1sign = dQ1sign;
+                e.dFmask = dFmask;
+                e.dFsign = dFsign;
+                e.count = count;
+                e.Q1set0 = Q1set0;
+                e.Q1set1 = Q1set1;
+                e.used = 1;
+                if (++size > (table.size() >> 1)) {
+                    grow();
+                }
+                return;
+            }
+            if (e.dQ1mask == dQ1mask && e.dQ1sign == dQ1sign && e.dFmask == dFmask && e.dFsign == dFsign) {
+                e.count += count;
+                e.Q1set0 |= Q1set0;
+                e.Q1set1 &= Q1set1;
+                return;
+            }
+            i = (i + 1) & tmask;
+        }
+    }
 
-    uint64 endcount = uint64(1) << 32;
-    uint64 count = 0;
-    unsigned k = 0;
-    progress_display show_progress(endcount, true, cout, "t=0:  ", "      ", "      ");
-    uint32 Q1a, Fa, Q1b, Fb;
-    sdr dQ1, dF;
-    pair<sdr, sdr> index;
-    for (uint64 count = 0; count < endcount; ++count, ++show_progress, ++Ta, ++Tb) {
-        ++k;
-        if (k == m) {
-            k = 0;
+    // Q1a is both the Q1_set0 and Q1_set1 value of a single sample
+    inline void insert(uint32 Q1a, uint32 Q1b, uint32 Fa, uint32 Fb) { insert(Q1a ^ Q1b, Q1b & ~Q1a, Fa ^ Fb, Fb & ~Fa, 1, Q1a, Q1a); }
+
+    void grow() {
+        vector<entry> oldtable(table.size() << 1);
+        oldtable.swap(table);
+        size = 0;
+        for (auto &e : oldtable) {
+            if (e.used) {
+                insert(e.dQ1mask, e.dQ1sign, e.dFmask, e.dFsign, e.count, e.Q1set0, e.Q1set1);
+            }
         }
-        if (k != i) {
-            continue;
+    }
+
+    vector<entry> table;
+    uint64 size;
+};
+
+struct step1diffs_thread {
+    step1diffs_thread(const path_container_autobalance &in, vector<step1diffs_hashtable> &out, unsigned threadidx)
+        : container(in), tables(out), ti(threadidx) {}
+    const path_container_autobalance &container;
+    vector<step1diffs_hashtable> &tables;
+    unsigned ti;
+
+    static const uint64 chunksize = uint64(1) << 24;
+    static boost::atomic<uint64> chunkindex;
+    static progress_display *show_progress;
+
+    void operator()() {
+        try {
+            generate();
+        } catch (std::exception &e) {
+            cerr << "Worker thread: caught exception:" << endl << e.what() << endl;
+        } catch (...) {
+            cerr << "Worker thread: caught unknown exception!" << endl;
         }
+    }
 
-        Q1a = rotate_left(Ta, 7) + Q1[Qoff + 0];
-        Fa = md5_ff(Q1a, Q1[Qoff + 0], Q1[Qoff - 1]);
-        Q1b = rotate_left(Tb, 7) + Q2[Qoff + 0];
-        Fb = md5_ff(Q1b, Q2[Qoff + 0], Q2[Qoff - 1]);
-        dQ1.set(Q1a, Q1b);
-        dF.set(Fa, Fb);
-
-        index.first = dQ1;
-        index.second = dF;
-        step1diffs_it = step1diffs.find(index);
-        if (step1diffs_it == step1diffs.end()) {
-            pair<unsigned, pair<uint32, uint32>> tmp;
-            tmp.first = 1;
-            tmp.second.first = Q1a;
-            tmp.second.second = Q1a;
-            step1diffs[index] = tmp;
-        } else {
-            ++step1diffs_it->second.first;
-            step1diffs_it->second.second.first |= Q1a;
-            step1diffs_it->second.second.second &= Q1a;
+    void generate() {
+        const uint64 m = container.modn;
+        const uint64 i = container.modi;
+        const uint32 *m_diff = container.m_diff;
+        step1diffs_hashtable &table = tables[ti];
+
+        uint32 Q1[4], Q2[4];
+        Q1[0] = container.IHV1[0];
+        Q1[1] = container.IHV1[3];
+        Q1[2] = container.IHV1[2];
+        Q1[3] = container.IHV1[1];
+        Q2[0] = container.IHV2[0];
+        Q2[1] = container.IHV2[3];
+        Q2[2] = container.IHV2[2];
+        Q2[3] = container.IHV2[1];
+        const uint32 Ta0 = md5_ff(Q1[3], Q1[2], Q1[1]) + Q1[0] + md5_ac[0];
+        const uint32 Tb0 = md5_ff(Q2[3], Q2[2], Q2[1]) + Q2[0] + md5_ac[0] + m_diff[0];
+
+        const uint64 endcount = uint64(1) << 32;
+        while (true) {
+            const uint64 cbegin = (chunkindex++) * chunksize;
+            if (cbegin >= endcount) {
+                break;
+            }
+            const uint64 cend = cbegin + chunksize;
+            // only do work with (count+1) % m == i, as the original sequential loop
+            uint64 count = cbegin + ((i + m - 1 - (cbegin % m)) % m);
+#ifdef HASHCLASH_HAVE_AVX2
+            simd_word_t counts, Q1a, Q1b, Fa, Fb;
+            for (unsigned j = 0; j < SIMD_VECSIZE; ++j) {
+                counts.w[j] = uint32(count + j * m);
+            }
+            const SIMD_WORD Q1_0 = SIMD_WTOV(Q1[Qoff + 0]), Q1_m1 = SIMD_WTOV(Q1[Qoff - 1]);
+            const SIMD_WORD Q2_0 = SIMD_WTOV(Q2[Qoff + 0]), Q2_m1 = SIMD_WTOV(Q2[Qoff - 1]);
+            for (; count + (SIMD_VECSIZE - 1) * m < cend; count += SIMD_VECSIZE * m) {
+                SIMD_WORD Ta = SIMD_ADD_VW(counts.v, Ta0);
+                SIMD_WORD Tb = SIMD_ADD_VW(counts.v, Tb0);
+                Q1a.v = SIMD_ADD_VV(SIMD_ROL_V(Ta, 7), Q1_0);
+                Q1b.v = SIMD_ADD_VV(SIMD_ROL_V(Tb, 7), Q2_0);
+                Fa.v = SIMD_XOR_VV(Q1_m1, SIMD_AND_VV(Q1a.v, SIMD_XOR_VV(Q1_0, Q1_m1)));
+                Fb.v = SIMD_XOR_VV(Q2_m1, SIMD_AND_VV(Q1b.v, SIMD_XOR_VV(Q2_0, Q2_m1)));
+                for (unsigned j = 0; j < SIMD_VECSIZE; ++j) {
+                    table.insert(Q1a.w[j], Q1b.w[j], Fa.w[j], Fb.w[j]);
+                }
+                counts.v = SIMD_ADD_VW(counts.v, uint32(SIMD_VECSIZE * m));
+            }
+#endif
+            for (; count < cend; count += m) {
+                uint32 Q1a = rotate_left(Ta0 + uint32(count), 7) + Q1[Qoff + 0];
+                uint32 Fa = md5_ff(Q1a, Q1[Qoff + 0], Q1[Qoff - 1]);
+                uint32 Q1b = rotate_left(Tb0 + uint32(count), 7) + Q2[Qoff + 0];
+                uint32 Fb = md5_ff(Q1b, Q2[Qoff + 0], Q2[Qoff - 1]);
+                table.insert(Q1a, Q1b, Fa, Fb);
+            }
+
+            boost::lock_guard<boost::mutex> lock(mut);
+            (*show_progress) += chunksize;
+        }
+    }
+};
+boost::atomic<uint64> step1diffs_thread::chunkindex(0);
+progress_display *step1diffs_thread::show_progress = 0;
+
+// merge all per-thread tables: thread j collects all entries with (hash >> 32) == j mod threads
+// each key ends up in exactly one merged table, so no locking is required
+// the partition uses the high hash bits, the table slots use the low bits
+struct step1diffs_merge_thread {
+    step1diffs_merge_thread(vector<step1diffs_hashtable> &in, vector<step1diffs_hashtable> &out, unsigned threadidx)
+        : tables(in), merged(out), ti(threadidx) {}
+    vector<step1diffs_hashtable> &tables;
+    vector<step1diffs_hashtable> &merged;
+    unsigned ti;
+
+    void operator()() {
+        const uint64 n = merged.size();
+        for (auto &table : tables) {
+            for (auto &e : table.table) {
+                if (e.used && (step1diffs_hashtable::hash(e.dQ1mask, e.dQ1sign, e.dFmask, e.dFsign) >> 32) % n == ti) {
+                    merged[ti].insert(e.dQ1mask, e.dQ1sign, e.dFmask, e.dFsign, e.count, e.Q1set0, e.Q1set1);
+                }
+            }
+        }
+    }
+};
+
+void generate_step1diffs(step1diffs_type &step1diffs, const path_container_autobalance &container) {
+    const unsigned threads = container.threads > 0 ? unsigned(container.threads) : 1;
+
+    progress_display show_progress(uint64(1) << 32, true, cout, "t=0:  ", "      ", "      ");
+    step1diffs_thread::chunkindex = 0;
+    step1diffs_thread::show_progress = &show_progress;
+
+    vector<step1diffs_hashtable> tables(threads);
+    boost::thread_group mythreads;
+    for (unsigned j = 0; j < threads; ++j) {
+        mythreads.create_thread(step1diffs_thread(container, tables, j));
+    }
+    mythreads.join_all();
+
+    vector<step1diffs_hashtable> merged(threads);
+    for (unsigned j = 0; j < threads; ++j) {
+        mythreads.create_thread(step1diffs_merge_thread(tables, merged, j));
+    }
+    mythreads.join_all();
+    tables.clear();
+
+    pair<sdr, sdr> index;
+    pair<unsigned, pair<uint32, uint32>> value;
+    for (auto &table : merged) {
+        for (auto &e : table.table) {
+            if (!e.used) {
+                continue;
+            }
+            index.first.mask = e.dQ1mask;
+            index.first.sign = e.dQ1sign;
+            index.second.mask = e.dFmask;
+            index.second.sign = e.dFsign;
+            value.first = e.count;
+            value.second.first = e.Q1set0;
+            value.second.second = e.Q1set1;
+            step1diffs.insert(step1diffs.end(), make_pair(index, value));
         }
+        vector<step1diffs_hashtable::entry>().swap(table.table);
     }
 }
 
@@ -131,13 +294,18 @@ void combine_step1diffs(step1diffs_type &global_step1diffs, const step1diffs_typ
     }
 }
 
-void dostep0(const path_container_autobalance &container) {
-    // map: (dQ1, dF1) => (count, Q1_set0, Q1_set1)
-    map<pair<sdr, sdr>, pair<unsigned, pair<uint32, uint32>>> step1diffs;
-    map<pair<sdr, sdr>, pair<unsigned, pair<uint32, uint32>>>::iterator step1diffs_it, step1diffs_it2;
+step1diffs_type step1diffscache;
+void dostep0(const path_container_autobalance &container, bool savetocache) {
+    step1diffs_type step1diffs;
 
     cout << "Searching first step differentials: " << endl;
     generate_step1diffs(step1diffs, container);
+    // with --mod step 1 combines the paths0 files of all processes, so they are always saved
+    if (savetocache && container.modn == 1) {
+        step1diffscache.swap(step1diffs);
+        cout << "Cached " << step1diffscache.size() << " first step differentials." << endl;
+        return;
+    }
     hashclash::save_gz(step1diffs, pathsstring("paths0", container.modi, container.modn), binary_archive);
     cout << "Saved " << step1diffs.size() << " first step differentials." << endl;
 }
@@ -152,11 +320,15 @@ void dostep1(const path_container_autobalance &container) {
     if (modi != 0) {
         return;
     }
-    for (unsigned j = 0; j < modn; ++j) {
-        cout << "Loading " << pathsstring("paths0", j, modn) << "..." << flush;
-        hashclash::load_gz(step1diffs2, pathsstring("paths0", j, modn), binary_archive);
-        cout << "done." << endl;
-        combine_step1diffs(step1diffs, step1diffs2);
+    if (modn == 1 && step1diffscache.size() != 0) {
+        step1diffs.swap(step1diffscache);
+    } else {
+        for (unsigned j = 0; j < modn; ++j) {
+            cout << "Loading " << pathsstring("paths0", j, modn) << "..." << flush;
+            hashclash::load_gz(step1diffs2, pathsstring("paths0", j, modn), binary_archive);
+            cout << "done." << endl;
+            combine_step1diffs(step1diffs, step1diffs2);
+        }
     }
 
     unsigned count_max = 0;
@@ -207,7 +379,7 @@ void dostep1(const path_container_autobalance &container) {
         }
     }
     cout << "Saving " << goodpaths.size() << " paths..." << flush;
-    save_gz(goodpaths, pathsstring("paths1", modi, modn), binary_archive);
+    save_paths(goodpaths, pathsstring("paths1", modi, modn), container.pathfile);
     cout << "done." << endl;
     if (goodpaths.size() > 0) {
         show_path(goodpaths[0], container.m_diff);
@@ -215,35 +387,40 @@ void dostep1(const path_container_autobalance &container) {
 }
 
 progress_display *dostep_progress = 0;
-volatile unsigned dostep_index = 0;
+task_pool *dostep_pool = 0;
 struct dostep_thread {
-    dostep_thread(vector<differentialpath> &in, path_container_autobalance &out)
-        : pathsin(in), container(out) {}
+    dostep_thread(vector<differentialpath> &in, path_container_autobalance &out, unsigned index)
+        : pathsin(in), container(out), threadindex(index) {}
     vector<differentialpath> &pathsin;
     path_container_autobalance &container;
+    unsigned threadindex;
     md5_forward_thread worker;
     void operator()() {
         try {
-            while (true) {
-                mut.lock();
-
-                unsigned i = dostep_index;
-                if (i >= pathsin.size()) {
-                    mut.unlock();
-                    break;
-                }
-                unsigned cnt = std::max<unsigned>(1, std::min<unsigned>(16, (pathsin.size() - i) / 128));
-                unsigned iend = i + cnt;
-
-                if (cnt != 0) {
-                    (*dostep_progress) += cnt;
+            seed_thread(threadindex);
+            worker.pool = dostep_pool;
+            worker.poolworker = threadindex;
+            unsigned progress = 0;
+            while (dostep_pool->next(threadindex, worker.task)) {
+                if (!worker.task.whole()) {
+                    worker.md5_forward_differential_step(pathsin[worker.task.begin], container);
+                    continue;
                 }
-                dostep_index = iend;
-                mut.unlock();
-
-                for (; i < iend; ++i) {
+                const task_range task = worker.task;
+                for (uint64 i = task.begin; i < task.end; ++i) {
+                    worker.task = task_range(i, i + 1);
                     worker.md5_forward_differential_step(pathsin[i], container);
                 }
+                progress += unsigned(task.end - task.begin);
+                if (mut.try_lock()) {
+                    (*dostep_progress) += progress;
+                    mut.unlock();
+                    progress = 0;
+                }
+            }
+            if (progress != 0) {
+                boost::lock_guard<boost::mutex> lock(mut);
+                (*dostep_progress) += progress;
             }
             if (container.main_container != nullptr) {
                 if (container.estimatefactor != 0) {
@@ -253,14 +430,15 @@ struct dostep_thread {
                 }
             }
         } catch (std::exception &e) {
+            dostep_pool->done(threadindex);
             cerr << "Worker thread: caught exception:" << endl << e.what() << endl;
         } catch (...) {
+            dostep_pool->done(threadindex);
             cerr << "Worker thread: caught unknown exception!" << endl;
         }
     }
 };
 void dostep_threaded(vector<differentialpath> &in, path_container_autobalance &out) {
-    dostep_index = 0;
     std::string tstring = "t=" + boost::lexical_cast<std::string>(out.t) + ": ";
     if (tstring.size() == 5) {
         tstring += " ";
@@ -270,14 +448,23 @@ void dostep_threaded(vector<differentialpath> &in, path_container_autobalance &o
     } else {
         dostep_progress = new progress_display(in.size(), true, cout, tstring, "      ", "      ");
     }
+    task_pool pool(in.size(), out.threads, std::max<uint64>(1, std::min<uint64>(16, in.size() / (128 * out.threads))));
+    dostep_pool = &pool;
 
+    if (out.estimatefactor == 0) {
+        out.begin_shards();
+    }
     vector<path_container_autobalance> helpcontainers(out.threads, out);
     boost::thread_group mythreads;
     for (unsigned i = 0; i < out.threads; ++i) {
         helpcontainers[i].main_container = &out;
-        mythreads.create_thread(dostep_thread(in, helpcontainers[i]));
+        if (out.shards) {
+            helpcontainers[i].shard = out.shards->new_shard();
+        }
+        mythreads.create_thread(dostep_thread(in, helpcontainers[i], i));
     }
     mythreads.join_all();
+    dostep_pool = 0;
     if (dostep_progress->expected_count() != dostep_progress->count()) {
         *dostep_progress += dostep_progress->expected_count() - dostep_progress->count();
     }
@@ -285,39 +472,23 @@ void dostep_threaded(vector<differentialpath> &in, path_container_autobalance &o
 }
 
 vector<differentialpath> pathscache;
-void dostep(path_container_autobalance &container, bool savetocache) {
+void load_inputpaths(const path_container_autobalance &container, vector<differentialpath> &pathsin) {
     const unsigned t = container.t;
     const unsigned modn = container.modn;
     const unsigned modi = container.modi;
 
-    cout << endl;
-    cout << "==================== Step " << t << " ====================" << endl;
-
-    if (t == 0 && !container.normalt01) {
-        dostep0(container);
-        return;
-    }
-    if (t == 1 && !container.normalt01) {
-        dostep1(container);
-        return;
-    }
-
-    vector<differentialpath> pathsin, pathstmp, pathsout;
+    vector<differentialpath> pathstmp;
     if (pathscache.size() != 0) {
         pathsin.swap(pathscache);
         random_permutation(pathsin);
     } else if (container.inputfile.size() == 0) {
         for (unsigned k = 0; k < modn; ++k) {
             try {
-                std::string filename = pathsstring("paths" + boost::lexical_cast<std::string>(t - 1), k, modn);
+                std::string filename = paths_filename(pathsstring("paths" + boost::lexical_cast<std::string>(t - 1), k, modn));
                 hashclash::timer loadtime(true);
                 cout << "Loading " << filename << "..." << flush;
-                load_gz(pathstmp, filename, binary_archive);
-                random_permutation(pathstmp);
-                for (unsigned j = modi; j < pathstmp.size(); j += modn) {
-                    pathsin.push_back(pathstmp[j]);
-                }
-                cout << "done: " << pathstmp.size() << " (work:" << pathsin.size() << "). (" << loadtime.time() << "s)" << endl;
+                uint64 total = load_paths_part(pathsin, filename, modi, modn);
+                cout << "done: " << total << " (work:" << pathsin.size() << "). (" << loadtime.time() << "s)" << endl;
             } catch (...) {
                 cout << "failed." << endl;
             }
@@ -327,11 +498,7 @@ void dostep(path_container_autobalance &container, bool savetocache) {
         try {
             hashclash::timer loadtime(true);
             cout << "Loading " << container.inputfile << "..." << flush;
-            load_gz(pathstmp, binary_archive, container.inputfile);
-            random_permutation(pathstmp);
-            for (unsigned j = modi; j < pathstmp.size(); j += modn) {
-                pathsin.push_back(pathstmp[j]);
-            }
+            load_paths_part(pathsin, container.inputfile, modi, modn);
             cout << "done: " << pathsin.size() << ". (" << loadtime.time() << "s)" << endl;
         } catch (...) {
             failed = true;
@@ -358,12 +525,9 @@ void dostep(path_container_autobalance &container, bool savetocache) {
             std::cout << endl;
         }
     }
+}
 
-    std::string tstring = "t=" + boost::lexical_cast<std::string>(t) + ": ";
-    if (tstring.size() == 5) {
-        tstring += " ";
-    }
-
+void estimate_maxcond(vector<differentialpath> &pathsin, path_container_autobalance &container) {
     if (container.estimatefactor != 0) {
         cout << "Estimating maxcond for upper bound " << unsigned(double(container.ubound) * container.estimatefactor)
              << " (=" << container.ubound << " * " << container.estimatefactor << ")..." << endl;
@@ -371,10 +535,37 @@ void dostep(path_container_autobalance &container, bool savetocache) {
         container.finish_estimate();
         cout << "Found maxcond = " << container.maxcond << endl;
     }
+}
 
+void dostep(path_container_autobalance &container, bool savetocache) {
+    const unsigned t = container.t;
+
+    cout << endl;
+    cout << "==================== Step " << t << " ====================" << endl;
+
+    if (t == 0 && !container.normalt01) {
+        dostep0(container, savetocache);
+        return;
+    }
+    if (t == 1 && !container.normalt01) {
+        dostep1(container);
+        return;
+    }
+
+    vector<differentialpath> pathsin;
+    load_inputpaths(container, pathsin);
+    estimate_maxcond(pathsin, container);
     dostep_threaded(pathsin, container);
+    vector<differentialpath>().swap(pathsin);
+    save_results(container, savetocache);
+}
+
+void save_results(path_container_autobalance &container, bool savetocache) {
+    const unsigned t = container.t;
+    const unsigned modn = container.modn;
+    const unsigned modi = container.modi;
 
-    pathstmp.swap(pathsout);
+    vector<differentialpath> pathsout;
     container.export_results(pathsout);
 
     unsigned condcount = 0, mincond = container.pathsout.size() + 1;
@@ -406,14 +597,15 @@ void dostep(path_container_autobalance &container, bool savetocache) {
     if (splitsave <= 1) {
         hashclash::timer savetime(true);
         std::string filenameout = pathsstring("paths" + boost::lexical_cast<std::string>(t), modi, modn);
-        save_gz(pathsout, filenameout, binary_archive);
+        save_paths(pathsout, filenameout, container.pathfile);
         cout << "done. (" << savetime.time() << "s)" << endl;
         return;
     }
     boost::thread_group mythreads;
     unsigned threads = std::min<unsigned>(container.threads, splitsave);
     for (unsigned j = 0; j < threads; ++j) {
-        mythreads.create_thread([t, j, splitsave, threads, &pathsout]() {
+        const bool pathfile = container.pathfile;
+        mythreads.create_thread([t, j, splitsave, threads, pathfile, &pathsout]() {
             vector<differentialpath> pathsouti;
             pathsouti.reserve(size_t(double(pathsout.size()) / double(splitsave) + 2));
             for (unsigned i = j; i < splitsave; i += threads) {
@@ -422,7 +614,7 @@ void dostep(path_container_autobalance &container, bool savetocache) {
                 for (size_t k = i; k < pathsout.size(); k += splitsave) {
                     pathsouti.emplace_back(std::move(pathsout[k]));
                 }
-                save_gz(pathsouti, filenameout, binary_archive);
+                save_paths(pathsouti, filenameout, pathfile);
                 cout << " " << i;
             }
         });
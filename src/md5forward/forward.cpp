@@ -34,6 +34,15 @@ using namespace hashclash;
 using namespace std;
 
 void md5_forward_thread::md5_forward_differential_step(const differentialpath &path, path_container_autobalance &outpaths) {
+    md5_forward_differential_step_tmpl(path, outpaths);
+}
+
+void md5_forward_thread::md5_forward_differential_step(const fixeddifferentialpath &path, path_container_autobalance &outpaths) {
+    md5_forward_differential_step_tmpl(path, outpaths);
+}
+
+template <class path_type>
+void md5_forward_thread::md5_forward_differential_step_tmpl(const path_type &path, path_container_autobalance &outpaths) {
     const unsigned t = outpaths.t;
     const unsigned &maxcond = outpaths.maxcond;
     const unsigned maxsdrs = outpaths.maxsdrs;
@@ -95,6 +104,10 @@ void md5_forward_thread::md5_forward_differential_step(const differentialpath &p
            (count_sdrs(Qtdiff, w + 1) - mincount <= maxsdrs)) {
         ++w;
     }
+    // maxcond can decrease meanwhile, a subtask uses the weight of the sdr list its range was taken from
+    if (!task.whole()) {
+        w = task.subparam;
+    }
     table_sdrs(sdrs, Qtdiff, w);
 
     // we have to keep Q_0 intact if t=0
@@ -103,9 +116,19 @@ void md5_forward_thread::md5_forward_differential_step(const differentialpath &p
         sdrs.push_back(path[0].getsdr());
     }
 
-    vector<sdr>::const_iterator cit = sdrs.begin(), citend = sdrs.end();
-    for (; cit != citend; ++cit) {
-        sdr sdrQt = *cit;
+    size_t sdrbegin = 0, sdrend = sdrs.size();
+    if (!task.whole()) {
+        sdrbegin = std::min<size_t>(task.subbegin, sdrs.size());
+        sdrend = std::min<size_t>(task.subend, sdrs.size());
+    }
+    for (size_t si = sdrbegin; si < sdrend; ++si) {
+        // hand over the second half of the remaining sdrs to idle threads
+        if (pool != nullptr && sdrend - si >= 2 && pool->hungry()) {
+            const size_t mid = si + (sdrend - si) / 2;
+            pool->split(poolworker, task_range(task.begin, task.begin + 1, uint32(mid), uint32(sdrend), w));
+            sdrend = mid;
+        }
+        sdr sdrQt = sdrs[si];
         unsigned hwQt = sdrQt.hw();
         if (hwQt < minweight) {
             continue;
@@ -130,7 +153,6 @@ void md5_forward_thread::md5_forward_differential_step(const differentialpath &p
             foutcomes[b] = F->outcome(Qtb[b], Qtm1b[b], Qtm2b[b]);
             unsigned fsize = foutcomes[b].size();
             if (fsize > 1) {
-                fdiv[b] = cnt;
                 if (fsize == 2) {
                     cnt <<= 1;
                 } else if (fsize == 3) {
@@ -154,25 +176,11 @@ void md5_forward_thread::md5_forward_differential_step(const differentialpath &p
         newpathQtm2 = path[int(t) - 2];
 
         std::reverse(bval.begin(), bval.end());
-        for (uint32 k = 0; k < cnt; ++k) {
-            uint32 m = k;
-            uint32 dF = dF_fixed;
-            for (unsigned j = 0; j < bval.size(); ++j) {
-                const unsigned b = bval[j];
-                unsigned i = 0;
-                while (m >= fdiv[b]) {
-                    m -= fdiv[b];
-                    ++i;
-                }
-                const bf_conditions &newconditions = F->forwardconditions(Qtb[b], Qtm1b[b], Qtm2b[b], foutcomes[b][i]);
-                newpathQt.set(b, newconditions.first);
-                newpathQtm1.set(b, newconditions.second);
-                newpathQtm2.set(b, newconditions.third);
-                dF += foutcomes[b](i, b);
-            }
+        expansion.prepare(*F, Qtb, Qtm1b, Qtm2b, foutcomes, bval, false);
+        const unsigned basecost = totprecond + expansion.fixedcost(newpathQt, newpathQtm1, newpathQtm2);
+        expansion.enumerate(newpathQt, newpathQtm1, newpathQtm2, dF_fixed, basecost, maxcond, [&](uint32 dF, unsigned ncond) {
             uint32 dT = dF + Qtm3diff + m_diff_t;
             newpathQtp1 = naf(Qtdiff + best_rotated_difference(dT, md5_rc[t]));
-            unsigned ncond = totprecond + newpathQt.hw() + newpathQtm1.hw() + newpathQtm2.hw();
             if (outpaths.includenaf) {
                 if (outpaths.halfnafweight) {
                     ncond += (newpathQtp1.hw() >> 1);
@@ -183,6 +191,6 @@ void md5_forward_thread::md5_forward_differential_step(const differentialpath &p
             if (ncond <= maxcond) {
                 outpaths.push_back(newpath, ncond);
             }
-        } // for cnt
+        });
     } // for sdrs
 }
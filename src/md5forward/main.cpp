@@ -29,6 +29,7 @@
 #include <hashclash/sdr.hpp>
 #include <hashclash/timer.hpp>
 #include <hashclash/booleanfunction.hpp>
+#include <hashclash/rng.hpp>
 
 #include "main.hpp"
 
@@ -50,6 +51,8 @@ int main(int argc, char **argv) {
 
     try {
         path_container_autobalance container;
+        uint32 rngseed = 0;
+        bool pipeline = false, pipelinesave = false;
         vector<vector<int>> msgdiff(16);
 
         // Define program options
@@ -72,7 +75,7 @@ int main(int argc, char **argv) {
 
 			("inputfile,f"
 				, po::value<string>(&container.inputfile)->default_value("")
-				, "Use specified inputfile.")
+				, "Use specified inputfile (.bin.gz or .paths).")
 
 			("showinputpaths,s"
 				, po::bool_switch(&container.showinputpaths)
@@ -80,7 +83,12 @@ int main(int argc, char **argv) {
 
 			("splitsave"
 				, po::value<unsigned>(&container.splitsave)->default_value(1)
-				, "Split set of output paths and save into N files.\n")
+				, "Split set of output paths and save into N files.")
+
+			("pathfile"
+				, po::bool_switch(&container.pathfile)
+				, "Save output paths as indexed path files (.paths) instead of .bin.gz,\n"
+				  "the next step then only decodes its own part of them.\n")
 
 			("tstep,t"
 				, po::value<unsigned>(&container.t)
@@ -90,6 +98,14 @@ int main(int argc, char **argv) {
 				, po::value<unsigned>(&container.trange)->default_value(0)
 				, "Number of additional steps to perform.")
 
+			("pipeline"
+				, po::bool_switch(&pipeline)
+				, "Perform all steps of trange concurrently,\n\tonly keeping the paths of the last step.")
+
+			("pipelinesave"
+				, po::bool_switch(&pipelinesave)
+				, "Also save the paths of intermediate steps\n\tin pipelined mode.")
+
 			("maxconditions,c"
 				, po::value<unsigned>(&container.maxcond)->default_value(2176)
 				, "Limit total amount of bitconditions.")
@@ -156,6 +172,13 @@ int main(int argc, char **argv) {
 			("threads"
 				, po::value<int>(&container.threads)->default_value(-1)
 				, "Number of worker threads")
+			("seed"
+				, po::value<uint32>(&rngseed)
+				, "Seed for the random generators of all threads. Default is random.\n"
+				  "  Runs with the same seed and --threads 1 are reproducible.\n"
+				  "  Worker i always draws the same stream, but threads\n"
+				  "  take work as they become idle, so with more threads\n"
+				  "  the outcome also depends on the thread scheduling.")
 			("uct"
 				, po::value<int>(&container.uct)->default_value(-4)
 				, "Disallow condition: Q_t[b] = c")
@@ -257,11 +280,17 @@ int main(int argc, char **argv) {
         if (container.threads <= 0 || container.threads > boost::thread::hardware_concurrency()) {
             container.threads = boost::thread::hardware_concurrency();
         }
+        if (vm.count("seed")) {
+            seed(rngseed);
+        }
 
         // Start job with given parameters
         container.set_parameters();
+        vector<path_container_autobalance> pipelinesteps;
+        pipelinesteps.reserve(container.trange);
         for (unsigned tt = container.t; tt < container.t + container.trange; ++tt) {
-            path_container_autobalance containertmp = container;
+            pipelinesteps.push_back(container);
+            path_container_autobalance &containertmp = pipelinesteps.back();
             containertmp.t = tt;
 
             if (tt == 1 && container.ubound > 0) {
@@ -276,10 +305,19 @@ int main(int argc, char **argv) {
                 containertmp.ubound >>= 0;
             }
 
+            // the special methods for t=0,1 cannot be pipelined
+            if (pipeline && (tt >= 2 || container.normalt01)) {
+                continue;
+            }
             dostep(containertmp, true);
+            pipelinesteps.pop_back();
         }
         container.t += container.trange;
-        dostep(container);
+        if (pipelinesteps.empty()) {
+            dostep(container);
+        } else {
+            dostep_pipelined(pipelinesteps, container, pipelinesave);
+        }
     } catch (exception &e) {
         cout << "Runtime: " << runtime.time() << endl;
         cerr << "Caught exception!!:" << endl << e.what() << endl;
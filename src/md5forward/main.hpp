@@ -23,29 +23,69 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <memory>
+#include <map>
+#include <utility>
 
 #include <boost/filesystem/operations.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/thread.hpp>
 
 #include <hashclash/differentialpath.hpp>
 #include <hashclash/booleanfunction.hpp>
+#include <hashclash/bfexpansion.hpp>
+#include <hashclash/pathshards.hpp>
+#include <hashclash/taskpool.hpp>
 
 using namespace hashclash;
 using namespace std;
 
 extern boost::mutex mut;
 extern std::string workdir;
+inline std::string pathsstring(const std::string &basepath, unsigned modi, unsigned modn) {
+    return workdir + "/" + basepath + "_" + boost::lexical_cast<std::string>(modi) + "of" + boost::lexical_cast<std::string>(modn);
+}
+
+// first step differentials: (dQ1, dF1) -> (count, (Q1 bits that can be 0, bits that can be 1))
+typedef map<pair<sdr, sdr>, pair<unsigned, pair<uint32, uint32>>> step1diffs_type;
+// the step 0 output of this process, kept in memory for step 1 of a run without --mod
+extern step1diffs_type step1diffscache;
+void combine_step1diffs(step1diffs_type &global_step1diffs, const step1diffs_type &step1diffs);
+
 class path_container_autobalance;
 void dostep(path_container_autobalance &container, bool savetocache = false);
+void dostep_threaded(vector<differentialpath> &in, path_container_autobalance &out);
+void load_inputpaths(const path_container_autobalance &container, vector<differentialpath> &pathsin);
+void estimate_maxcond(vector<differentialpath> &pathsin, path_container_autobalance &container);
+void save_results(path_container_autobalance &container, bool savetocache = false);
+
+// run steps[0].t, ..., steps.back().t, container.t concurrently as a pipeline:
+// only the output of the final step container.t is kept and saved (intermediate steps too if savesteps)
+void dostep_pipelined(vector<path_container_autobalance> &steps, path_container_autobalance &container, bool savesteps = false);
+
+// handle a path accepted by intermediate pipelined step 'stage'
+struct pipeline_worker;
+void pipeline_push_back(pipeline_worker &worker, unsigned stage, const fixeddifferentialpath &path, unsigned cond);
 
 struct md5_forward_thread {
+    md5_forward_thread()
+        : pool(nullptr), poolworker(0) {}
     void md5_forward_differential_step(const hashclash::differentialpath &path, path_container_autobalance &container);
-    differentialpath newpath;
+    void md5_forward_differential_step(const fixeddifferentialpath &path, path_container_autobalance &container);
+    template <class path_type>
+    void md5_forward_differential_step_tmpl(const path_type &path, path_container_autobalance &container);
+    fixeddifferentialpath newpath;
     vector<sdr> sdrs;
     bitcondition Qtb[32], Qtm1b[32], Qtm2b[32];
     vector<unsigned> bval;
-    uint32 fdiv[32];
     bf_outcome foutcomes[32];
+    bf_expansion expansion;
+
+    // if pool is set then task is the current task (item) of worker poolworker:
+    // only the sdrs [task.subbegin,task.subend) of Q_t are processed and part of them may be split off
+    task_pool *pool;
+    unsigned poolworker;
+    task_range task;
 };
 
 class path_container_autobalance {
@@ -61,6 +101,7 @@ class path_container_autobalance {
           maxsdrs(1),
           maxcond(2176),
           tbegin(-3),
+          pathfile(false),
           ubound(0),
           estimatefactor(0),
           noverify(false),
@@ -84,7 +125,10 @@ class path_container_autobalance {
           uct(-4),
           ucb(-1),
           ucc('.'),
-          main_container(nullptr) {
+          main_container(nullptr),
+          shard(nullptr),
+          pipeline(nullptr),
+          pipelinestage(0) {
         if (uct < -3 || uct > 64 || ucb < 0 || ucb > 32 ||
             (ucc != '0' && ucc != '1' && ucc != '^' && ucc != '!' && ucc != 'm' && ucc != '#')) {
             uct = -4;
@@ -100,7 +144,7 @@ class path_container_autobalance {
     }
 
     ~path_container_autobalance() {
-        if (main_container != nullptr) {
+        if (main_container != nullptr || pipeline != nullptr) {
             return;
         }
         cerr << "Autobalance parameters: maxcond=" << maxcond << " (ab#:" << count_balanced << ")" << endl;
@@ -194,22 +238,28 @@ class path_container_autobalance {
         }
     }
 
-    void push_back(const differentialpath &path, unsigned cond = 0) {
+    unsigned path_cond(const fixeddifferentialpath &path) const {
+        unsigned cond = 0;
+        for (int k = max(tbegin, path.tbegin()); k <= int(t); ++k) {
+            cond += path[k].hw();
+        }
+        if (includenaf) {
+            if (halfnafweight) {
+                cond += (path[t + 1].hw() >> 1);
+            } else {
+                cond += path[t + 1].hw();
+            }
+        }
+        return cond;
+    }
+
+    void push_back(const fixeddifferentialpath &path, unsigned cond = 0) {
         if (!test_uc(path)) {
             return;
         }
 
         if (cond == 0) {
-            for (int k = max(tbegin, path.tbegin()); k <= int(t); ++k) {
-                cond += path[k].hw();
-            }
-            if (includenaf) {
-                if (halfnafweight) {
-                    cond += (path[t + 1].hw() >> 1);
-                } else {
-                    cond += path[t + 1].hw();
-                }
-            }
+            cond = path_cond(path);
         }
         if (cond > maxcond) {
             return;
@@ -277,50 +327,100 @@ class path_container_autobalance {
         if (!noverify) {
             ++verified;
         }
+        if (pipeline != nullptr) {
+            pipeline_push_back(*pipeline, pipelinestage, path, cond);
+            return;
+        }
+        if (shard != nullptr) {
+            if (shards->push_back(*shard, path, cond)) {
+                ++count;
+            }
+            maxcond = std::min(maxcond, shard->get_maxcond());
+            return;
+        }
         if (ubound == 0) {
             pathsout[cond].push_back(path);
             ++size;
             ++count;
-            if (main_container != nullptr && size >= 1024) {
-                push_back_flush_main();
-            }
             return;
         }
         if (pathsout[cond].size() < ubound) {
             pathsout[cond].push_back(path);
             ++size, ++count;
-            if (main_container != nullptr && size >= 1024) {
-                push_back_flush_main();
-            }
-            if (main_container == nullptr) {
-                autobalance();
-            }
+            autobalance();
         }
     }
 
+    // use per-thread shards for the paths of the helper containers, see begin_shards()
+    void begin_shards() {
+        shards = std::make_shared<path_shards>(unsigned(pathsout.size()), maxcond, ubound);
+    }
+
+    // merge the shards of all helper containers into pathsout
+    void merge_shards() {
+        if (!shards) {
+            return;
+        }
+        shards->merge(pathsout);
+        maxcond = std::min(maxcond, shards->maxcond());
+        count_balanced += shards->count_balanced();
+        size = 0;
+        for (unsigned c = 0; c <= maxcond && c < pathsout.size(); ++c) {
+            size += unsigned(pathsout[c].size());
+        }
+        shards.reset();
+    }
+
+    void lower_maxcond(unsigned newmaxcond) {
+        if (newmaxcond < maxcond) {
+            maxcond = newmaxcond;
+        }
+        if (shards) {
+            shards->lower_maxcond(newmaxcond);
+        }
+    }
+
+    // publish the remaining paths of this helper container and pass its statistics to the main container
     void push_back_flush_main() {
         if (main_container == nullptr) {
             return;
         }
-        boost::lock_guard<boost::mutex> lock(mut);
-        for (unsigned i = 0; i < pathsout.size(); ++i) {
-            if (i <= main_container->maxcond) {
-                main_container->size += pathsout[i].size();
-                for (auto &p : pathsout[i]) {
-                    main_container->pathsout[i].emplace_back(std::move(p));
-                }
-            }
-            pathsout[i].clear();
+        if (shard != nullptr) {
+            shards->publish(*shard);
+            maxcond = std::min(maxcond, shard->get_maxcond());
         }
-        size = 0;
+        boost::lock_guard<boost::mutex> lock(mut);
         main_container->count += count;
         count = 0;
         main_container->verified += verified;
         verified = 0;
         main_container->verifiedbad += verifiedbad;
         verifiedbad = 0;
-        main_container->autobalance();
-        maxcond = main_container->maxcond;
+    }
+
+    // same as autobalance() but on condcount,
+    // used by intermediate pipelined steps that do not store paths, only the number of paths per condition count
+    void autobalance_count() {
+        if (ubound == 0 || size <= ubound) {
+            return;
+        }
+        ++count_balanced;
+        unsigned newsize = 0;
+        unsigned k = 0;
+        while (k < condcount.size() && k <= maxcond && newsize + condcount[k] <= ubound) {
+            newsize += condcount[k];
+            ++k;
+        }
+        if (newsize != 0) {
+            size = newsize;
+            maxcond = k - 1;
+        } else {
+            size = condcount[k];
+            maxcond = k;
+        }
+        for (unsigned j = maxcond + 1; j < condcount.size(); ++j) {
+            condcount[j] = 0;
+        }
     }
 
     void autobalance() {
@@ -343,20 +443,21 @@ class path_container_autobalance {
                 }
             }
             for (unsigned j = maxcond + 2; j < pathsout.size(); ++j) {
-                pathsout[j].clear();
+                packedpaths().swap(pathsout[j]);
             }
         }
     }
 
     void export_results(vector<differentialpath> &outpaths) {
+        merge_shards();
         outpaths.clear();
         outpaths.reserve(ubound);
         for (unsigned k = 0; k < pathsout.size() && k <= maxcond; ++k) {
             if (ubound > 0 && outpaths.size() + pathsout[k].size() > ubound) {
                 pathsout[k].resize(ubound - outpaths.size());
             }
-            for (auto &p : pathsout[k]) {
-                outpaths.emplace_back(std::move(p));
+            for (size_t i = 0; i < pathsout[k].size(); ++i) {
+                outpaths.emplace_back(pathsout[k].todifferentialpath(i));
             }
         }
         unsigned hbound = unsigned(double(ubound) * fillfraction);
@@ -368,13 +469,13 @@ class path_container_autobalance {
                 length = pathsout[k].size();
             }
             for (size_t i = 0; i < length; ++i) {
-                outpaths.emplace_back(std::move(pathsout[k][i]));
+                outpaths.emplace_back(pathsout[k].todifferentialpath(i));
             }
             ++k;
         }
     }
 
-    bool test_uc(const differentialpath &path) {
+    bool test_uc(const fixeddifferentialpath &path) {
         if (ucb != -1 && uct >= path.tbegin() + 1 && uct < path.tend() - 1) {
             switch (ucc) {
             default:
@@ -505,13 +606,14 @@ class path_container_autobalance {
     std::string inputfile;
     bool showinputpaths;
     bool normalt01;
+    bool pathfile;
 
     double estimatefactor;
     unsigned ubound;
     unsigned size;
     unsigned count, count_balanced;
     vector<unsigned> condcount;
-    vector<vector<differentialpath>> pathsout;
+    vector<packedpaths> pathsout;
 
     double fillfraction;
 
@@ -521,6 +623,15 @@ class path_container_autobalance {
     char ucc;
 
     path_container_autobalance *main_container;
+
+    // shared by the main container and its helper containers during dostep_threaded,
+    // each helper container stores its paths in its own shard
+    std::shared_ptr<path_shards> shards;
+    path_shards::shard *shard;
+
+    // set for helper containers of intermediate pipelined steps
+    pipeline_worker *pipeline;
+    unsigned pipelinestage;
 };
 
 #endif // MAIN_HPP
@@ -0,0 +1,695 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+/*
+
+Pipelined mode for --trange:
+
+All steps run concurrently on one pool of worker threads.
+An intermediate step does not store its output paths: it only counts them per condition count to autobalance its maxcond,
+and passes its output paths on to the next step through a bounded lock-free queue.
+Workers prefer the later steps, and a worker that finds the next queue full helps to empty it,
+so the number of paths in flight stays bounded by the queue capacities.
+
+As the input of later steps is not known in advance:
+- their estimate for maxcond is done on a sample: the first input paths are only estimated and kept aside
+  until the sample is large enough, after which they are processed as normal
+- each step projects its final distribution over condition counts from the fraction of its input processed so far
+  and only forwards paths within the cutoff that would fit in the autobalance target amount;
+  a queued path is dropped if its condition count exceeds the current cutoff of the step that produced it
+
+Since the cutoffs are projections, the resulting set of paths can differ from the sequential mode.
+
+*/
+
+#include <cstddef>
+#include <vector>
+#include <string>
+#include <memory>
+#include <iostream>
+#include <stdexcept>
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <hashclash/saveload_gz.hpp>
+#include <hashclash/pathfile.hpp>
+#include <hashclash/rng.hpp>
+#include <hashclash/progress_display.hpp>
+#include <hashclash/timer.hpp>
+
+#include "main.hpp"
+
+using namespace hashclash;
+using namespace std;
+
+struct pipeline_item {
+    fixeddifferentialpath path;
+    unsigned cond;
+};
+
+// bounded lock-free multi-producer multi-consumer queue
+// each cell has a sequence number telling whether it is ready to be written (== pos) or read (== pos+1) in the current round
+class path_pipe {
+  public:
+    path_pipe(unsigned logcapacity)
+        : cells(new cell[size_t(1) << logcapacity]), mask((size_t(1) << logcapacity) - 1), enqueuepos(0), dequeuepos(0) {
+        for (size_t i = 0; i <= mask; ++i) {
+            cells[i].sequence.store(i, boost::memory_order_relaxed);
+        }
+    }
+
+    bool try_push(const fixeddifferentialpath &path, unsigned cond) {
+        size_t pos = enqueuepos.load(boost::memory_order_relaxed);
+        while (true) {
+            cell &c = cells[pos & mask];
+            const std::ptrdiff_t diff = std::ptrdiff_t(c.sequence.load(boost::memory_order_acquire)) - std::ptrdiff_t(pos);
+            if (diff == 0) {
+                if (enqueuepos.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) {
+                    c.item.path = path;
+                    c.item.cond = cond;
+                    c.sequence.store(pos + 1, boost::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuepos.load(boost::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(pipeline_item &item) {
+        size_t pos = dequeuepos.load(boost::memory_order_relaxed);
+        while (true) {
+            cell &c = cells[pos & mask];
+            const std::ptrdiff_t diff = std::ptrdiff_t(c.sequence.load(boost::memory_order_acquire)) - std::ptrdiff_t(pos + 1);
+            if (diff == 0) {
+                if (dequeuepos.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) {
+                    item = c.item;
+                    c.sequence.store(pos + mask + 1, boost::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeuepos.load(boost::memory_order_relaxed);
+            }
+        }
+    }
+
+    // only reliable once all producers are finished
+    bool empty() const { return dequeuepos.load() == enqueuepos.load(); }
+
+  private:
+    struct cell {
+        boost::atomic<size_t> sequence;
+        pipeline_item item;
+    };
+    std::unique_ptr<cell[]> cells;
+    const size_t mask;
+    char pad0[64];
+    boost::atomic<size_t> enqueuepos;
+    char pad1[64];
+    boost::atomic<size_t> dequeuepos;
+};
+
+struct pipeline_stage {
+    pipeline_stage()
+        : container(nullptr),
+          active(0),
+          pending(0),
+          done(false),
+          received(0),
+          processed(0),
+          dropped(0),
+          forwarded(0),
+          cutoff(0),
+          projected(0),
+          sampling(false),
+          samplesize(0),
+          estimated(0),
+          estimatedmaxcond(0) {}
+
+    path_container_autobalance *container;
+    // input queue, except for the first step which reads the input paths
+    std::unique_ptr<path_pipe> in;
+    // number of workers currently processing an input path of this step
+    boost::atomic<unsigned> active;
+    // number of output paths held by workers that are not yet forwarded
+    boost::atomic<unsigned> pending;
+    boost::atomic<bool> done;
+    boost::atomic<uint64> received, processed, dropped, forwarded;
+    // only output paths with condition count up to cutoff are forwarded
+    boost::atomic<unsigned> cutoff;
+    // projected total number of forwarded paths, protected by mut
+    double projected;
+
+    // estimate of maxcond on a sample of the input, the sample and estimatecount are protected by mut
+    boost::atomic<bool> sampling;
+    packedpaths sample;
+    boost::atomic<size_t> samplesize;
+    vector<uint64> estimatecount;
+    uint64 estimated;
+    unsigned estimatedmaxcond;
+
+    // intermediate output file for --pipelinesave
+    std::unique_ptr<pathfile_writer> checkpoint;
+    boost::mutex checkpointmut;
+};
+
+struct pipeline_state {
+    pipeline_state(unsigned steps, double estimatefactor)
+        : stages(steps), pathsin(nullptr), inputindex(0), estimatefactor(estimatefactor), failed(false) {}
+
+    // true if step k > 0 will not receive any more input
+    bool input_done(unsigned k) const { return stages[k - 1].done && stages[k - 1].pending == 0 && stages[k].in->empty(); }
+
+    // a step is done when all its input is done and no worker is processing an input path of it
+    // the order of checks matters: workers increase active before they take an input path
+    // and decrease pending only after they forwarded the paths
+    void update_done() {
+        for (unsigned k = 0; k < stages.size(); ++k) {
+            pipeline_stage &stage = stages[k];
+            if (stage.done) {
+                continue;
+            }
+            if (k == 0) {
+                boost::lock_guard<boost::mutex> lock(mut);
+                if (inputindex < pathsin->size()) {
+                    return;
+                }
+            } else {
+                if (!input_done(k)) {
+                    return;
+                }
+                if (stage.sampling) {
+                    boost::lock_guard<boost::mutex> lock(mut);
+                    update_sampling(k);
+                    if (stage.sampling) {
+                        return;
+                    }
+                }
+                if (stage.samplesize != 0) {
+                    return;
+                }
+            }
+            if (stage.active != 0) {
+                return;
+            }
+            stage.done = true;
+        }
+    }
+
+    // total number of input paths of step k > 0 as far as known
+    // requires lock on mut
+    double expected_input(unsigned k) const {
+        return stages[k - 1].done ? double(stages[k - 1].forwarded) : stages[k - 1].projected;
+    }
+
+    // end the sampling of step k > 0 once the sample is 1/16-th of its (projected) input or all of its input,
+    // and set maxcond as finish_estimate() would have on the whole input
+    // requires lock on mut
+    void update_sampling(unsigned k) {
+        pipeline_stage &stage = stages[k];
+        if (!stage.sampling) {
+            return;
+        }
+        const double expected = expected_input(k);
+        const bool complete = input_done(k) && stage.estimated + stage.dropped == stage.received;
+        if (!complete && (expected == 0 || double(stage.estimated) < expected / 16)) {
+            return;
+        }
+        path_container_autobalance &container = *stage.container;
+        const double fraction = (!complete && expected > double(stage.estimated)) ? double(stage.estimated) / expected : 1.0;
+        const double uboundf = double(container.ubound) * estimatefactor * fraction;
+        double newsize = 0;
+        unsigned c = 0;
+        while (c < stage.estimatecount.size() && newsize + double(stage.estimatecount[c]) <= uboundf) {
+            newsize += double(stage.estimatecount[c]);
+            ++c;
+        }
+        unsigned maxcond = (newsize != 0) ? c - 1 : c;
+        if (container.includenaf) {
+            maxcond += container.halfnafweight ? (container.nafestweight >> 1) : container.nafestweight;
+        }
+        container.lower_maxcond(maxcond);
+        stage.estimatedmaxcond = container.maxcond;
+        stage.sampling = false;
+    }
+
+    // project the final distribution over condition counts of step k from the fraction of its input processed so far,
+    // and set the cutoff such that the projected number of forwarded paths fits in the autobalance target amount
+    // requires lock on mut
+    void update_cutoff(unsigned k) {
+        pipeline_stage &stage = stages[k];
+        const path_container_autobalance &container = *stage.container;
+        const double processed = (k == 0) ? double(inputindex) : double(stage.processed);
+        const double expected = (k == 0) ? double(pathsin->size()) : expected_input(k);
+        const double fraction = (expected > processed && expected > 0) ? processed / expected : 1.0;
+        const unsigned maxcond = std::min<unsigned>(container.maxcond, unsigned(container.condcount.size()) - 1);
+        if (container.ubound == 0) {
+            stage.cutoff = maxcond;
+            stage.projected = fraction > 0 ? double(container.count) / fraction : 0;
+            return;
+        }
+        const double limit = double(container.ubound) * fraction;
+        double sum = 0, total = 0;
+        unsigned cutoff = 0;
+        bool full = false;
+        for (unsigned c = 0; c <= maxcond; ++c) {
+            total += container.condcount[c];
+            if (full || container.condcount[c] == 0) {
+                continue;
+            }
+            if (sum != 0 && sum + container.condcount[c] > limit) {
+                full = true;
+                continue;
+            }
+            sum += container.condcount[c];
+            cutoff = c;
+        }
+        stage.cutoff = cutoff;
+        // the cutoff rises as the fraction grows, until the target amount is reached
+        stage.projected = fraction > 0 ? std::min(double(container.ubound), total / fraction) : 0;
+    }
+
+    vector<pipeline_stage> stages;
+    vector<differentialpath> *pathsin;
+    size_t inputindex;
+    std::unique_ptr<progress_display> progress;
+    double estimatefactor;
+    boost::atomic<bool> failed;
+};
+
+struct pipeline_worker {
+    pipeline_worker(pipeline_state &pipelinestate, unsigned index)
+        : state(pipelinestate),
+          threadindex(index),
+          workers(pipelinestate.stages.size()),
+          pending(pipelinestate.stages.size()),
+          checkpointbuf(pipelinestate.stages.size()) {
+        const unsigned last = unsigned(state.stages.size()) - 1;
+        helpers.reserve(last + 1);
+        estimators.reserve(last + 1);
+        for (unsigned k = 0; k <= last; ++k) {
+            helpers.push_back(*state.stages[k].container);
+            helpers[k].main_container = state.stages[k].container;
+            if (k < last) {
+                helpers[k].pipeline = this;
+                helpers[k].pipelinestage = k;
+            } else {
+                helpers[k].shard = helpers[k].shards->new_shard();
+            }
+            // only counts, it never autobalances nor reports as a main container
+            estimators.push_back(helpers[k]);
+            estimators[k].main_container = nullptr;
+            estimators[k].shard = nullptr;
+            estimators[k].pipeline = this;
+            estimators[k].estimatefactor = 1;
+            estimators[k].ubound = ~0u;
+        }
+    }
+
+    void operator()() {
+        try {
+            seed_thread(threadindex);
+            run();
+        } catch (std::exception &e) {
+            state.failed = true;
+            cerr << "Worker thread: caught exception:" << endl << e.what() << endl;
+        } catch (...) {
+            state.failed = true;
+            cerr << "Worker thread: caught unknown exception!" << endl;
+        }
+    }
+
+    void run() {
+        const unsigned last = unsigned(state.stages.size()) - 1;
+        while (!state.stages[last].done && !state.failed) {
+            // prefer later steps to keep the queues short
+            bool busy = false;
+            for (unsigned k = last; k >= 1 && !busy; --k) {
+                busy = process(k);
+            }
+            if (!busy) {
+                busy = process_input();
+            }
+            if (!busy) {
+                // out of work: forward the remaining output paths
+                for (unsigned k = 0; k < last; ++k) {
+                    if (!pending[k].empty()) {
+                        flush(k);
+                        busy = true;
+                    }
+                }
+            }
+            if (!busy) {
+                state.update_done();
+                boost::this_thread::yield();
+            }
+        }
+        for (unsigned k = 0; k < last; ++k) {
+            flush(k);
+            flush_checkpoint(k);
+        }
+        helpers[last].push_back_flush_main();
+    }
+
+    // process a batch of input paths of the first step
+    bool process_input() {
+        pipeline_stage &stage = state.stages[0];
+        ++stage.active;
+        size_t i, iend;
+        {
+            boost::lock_guard<boost::mutex> lock(mut);
+            const size_t size = state.pathsin->size();
+            i = state.inputindex;
+            if (i >= size) {
+                --stage.active;
+                return false;
+            }
+            iend = i + std::max<size_t>(1, std::min<size_t>(16, (size - i) / 128));
+            (*state.progress) += iend - i;
+            state.inputindex = iend;
+        }
+        for (; i < iend; ++i) {
+            workers[0].md5_forward_differential_step((*state.pathsin)[i], helpers[0]);
+        }
+        --stage.active;
+        return true;
+    }
+
+    // process one input path of step k > 0, sampled paths first
+    bool process(unsigned k) {
+        pipeline_stage &stage = state.stages[k];
+        pipeline_item item;
+        bool sampled = false;
+        ++stage.active;
+        if (!stage.sampling && stage.samplesize != 0) {
+            boost::lock_guard<boost::mutex> lock(mut);
+            if (!stage.sample.empty()) {
+                stage.sample.get(stage.sample.size() - 1, item.path);
+                stage.sample.pop_back();
+                --stage.samplesize;
+                sampled = true;
+            }
+        }
+        if (!sampled) {
+            if (!stage.in->try_pop(item)) {
+                --stage.active;
+                return false;
+            }
+            ++stage.received;
+            if (item.cond > state.stages[k - 1].cutoff) {
+                ++stage.dropped;
+                ++stage.processed;
+                --stage.active;
+                return true;
+            }
+            if (stage.sampling) {
+                estimate(k, item);
+                --stage.active;
+                return true;
+            }
+        }
+        if (helpers[k].maxcond > stage.container->maxcond) {
+            boost::lock_guard<boost::mutex> lock(mut);
+            helpers[k].maxcond = std::min(helpers[k].maxcond, stage.container->maxcond);
+        }
+        workers[k].md5_forward_differential_step(item.path, helpers[k]);
+        ++stage.processed;
+        --stage.active;
+        return true;
+    }
+
+    // estimate an input path of step k and keep it aside
+    void estimate(unsigned k, const pipeline_item &item) {
+        pipeline_stage &stage = state.stages[k];
+        path_container_autobalance &estimator = estimators[k];
+        workers[k].md5_forward_differential_step(item.path, estimator);
+        boost::lock_guard<boost::mutex> lock(mut);
+        for (unsigned i = 0; i < estimator.condcount.size(); ++i) {
+            if (estimator.condcount[i]) {
+                stage.estimatecount[i] += estimator.condcount[i];
+                estimator.condcount[i] = 0;
+            }
+        }
+        estimator.size = 0;
+        // the sample is part of the input, so the estimate on the whole input cannot exceed the estimate on the sample so far
+        const double uboundf = double(stage.container->ubound) * state.estimatefactor;
+        double newsize = 0;
+        unsigned c = 0;
+        while (c < stage.estimatecount.size() && newsize + double(stage.estimatecount[c]) <= uboundf) {
+            newsize += double(stage.estimatecount[c]);
+            ++c;
+        }
+        estimator.maxcond = std::min(estimator.maxcond, (newsize != 0) ? c - 1 : c);
+        ++stage.estimated;
+        stage.sample.push_back(item.path);
+        ++stage.samplesize;
+        state.update_sampling(k);
+    }
+
+    void push_back(unsigned k, const fixeddifferentialpath &path, unsigned cond) {
+        path_container_autobalance &helper = helpers[k];
+        helper.condcount[cond] += 1;
+        ++helper.size, ++helper.count;
+        pending[k].emplace_back();
+        pending[k].back().path = path;
+        pending[k].back().cond = cond;
+        ++state.stages[k].pending;
+        if (pending[k].size() >= 1024) {
+            flush(k);
+        }
+    }
+
+    // sync the counts of step k with its main container and forward the output paths within the new cutoff
+    void flush(unsigned k) {
+        pipeline_stage &stage = state.stages[k];
+        path_container_autobalance &helper = helpers[k];
+        path_container_autobalance &main = *stage.container;
+        unsigned cutoff;
+        {
+            boost::lock_guard<boost::mutex> lock(mut);
+            for (unsigned i = 0; i < helper.condcount.size(); ++i) {
+                if (i <= main.maxcond) {
+                    main.size += helper.condcount[i];
+                    main.condcount[i] += helper.condcount[i];
+                }
+                helper.condcount[i] = 0;
+            }
+            helper.size = 0;
+            main.count += helper.count;
+            helper.count = 0;
+            main.verified += helper.verified;
+            helper.verified = 0;
+            main.verifiedbad += helper.verifiedbad;
+            helper.verifiedbad = 0;
+            main.autobalance_count();
+            helper.maxcond = main.maxcond;
+            state.update_cutoff(k);
+            cutoff = stage.cutoff;
+        }
+
+        vector<pipeline_item> items;
+        items.swap(pending[k]);
+        path_pipe &pipe = *state.stages[k + 1].in;
+        for (auto &item : items) {
+            if (item.cond > cutoff) {
+                continue;
+            }
+            if (stage.checkpoint) {
+                checkpointbuf[k].emplace_back(item.path.todifferentialpath());
+            }
+            while (!pipe.try_push(item.path, item.cond)) {
+                if (state.failed) {
+                    throw std::runtime_error("pipeline_worker::flush(): pipeline failed");
+                }
+                // the next step is lagging behind: help out instead of waiting
+                if (!process(k + 1)) {
+                    boost::this_thread::yield();
+                }
+            }
+            ++stage.forwarded;
+        }
+        stage.pending -= unsigned(items.size());
+        // reuse the allocated buffer
+        items.clear();
+        if (pending[k].empty()) {
+            pending[k].swap(items);
+        }
+        flush_checkpoint(k);
+    }
+
+    void flush_checkpoint(unsigned k) {
+        if (checkpointbuf[k].empty()) {
+            return;
+        }
+        pipeline_stage &stage = state.stages[k];
+        boost::lock_guard<boost::mutex> lock(stage.checkpointmut);
+        for (auto &p : checkpointbuf[k]) {
+            stage.checkpoint->push_back(p);
+        }
+        checkpointbuf[k].clear();
+    }
+
+    pipeline_state &state;
+    unsigned threadindex;
+    vector<md5_forward_thread> workers;
+    vector<path_container_autobalance> helpers, estimators;
+    vector<vector<pipeline_item>> pending;
+    vector<vector<differentialpath>> checkpointbuf;
+};
+
+void pipeline_push_back(pipeline_worker &worker, unsigned stage, const fixeddifferentialpath &path, unsigned cond) {
+    worker.push_back(stage, path, cond);
+}
+
+// keep only the forwarded paths within the final cutoff of an intermediate step and save them as in the sequential mode
+void save_checkpoint(const path_container_autobalance &container, unsigned cutoff, const std::string &checkpointfile) {
+    hashclash::timer savetime(true);
+    std::string filenameout = pathsstring("paths" + boost::lexical_cast<std::string>(container.t), container.modi, container.modn);
+    cout << "Saving paths of step " << container.t << "..." << flush;
+    uint64 saved = 0;
+    {
+        pathfile_reader reader(checkpointfile);
+        differentialpath path;
+        fixeddifferentialpath fpath;
+        if (container.pathfile) {
+            // stream the selected paths directly into the output path file
+            pathfile_writer writer(filenameout + ".paths");
+            while (reader.next(path)) {
+                fpath = path;
+                if (container.path_cond(fpath) <= cutoff) {
+                    writer.push_back(path);
+                }
+            }
+            writer.close();
+            saved = writer.size();
+        } else {
+            vector<differentialpath> pathsout;
+            while (reader.next(path)) {
+                fpath = path;
+                if (container.path_cond(fpath) <= cutoff) {
+                    pathsout.push_back(path);
+                }
+            }
+            save_gz(pathsout, filenameout, binary_archive);
+            saved = pathsout.size();
+        }
+    }
+    boost::filesystem::remove(checkpointfile);
+    cout << "done: " << saved << " paths. (" << savetime.time() << "s)" << endl;
+}
+
+void dostep_pipelined(vector<path_container_autobalance> &steps, path_container_autobalance &container, bool savesteps) {
+    const unsigned last = unsigned(steps.size());
+
+    cout << endl;
+    cout << "==================== Steps " << steps[0].t << "-" << container.t << " (pipelined) ====================" << endl;
+
+    vector<differentialpath> pathsin;
+    load_inputpaths(steps[0], pathsin);
+    // later steps are estimated on a sample
+    const double estimatefactor = steps[0].estimatefactor;
+    estimate_maxcond(pathsin, steps[0]);
+    for (unsigned k = 1; k < last; ++k) {
+        steps[k].estimatefactor = 0;
+    }
+    container.estimatefactor = 0;
+    container.begin_shards();
+
+    pipeline_state state(last + 1, estimatefactor);
+    state.pathsin = &pathsin;
+    vector<std::string> checkpointfiles(last);
+    for (unsigned k = 0; k <= last; ++k) {
+        pipeline_stage &stage = state.stages[k];
+        stage.container = (k < last) ? &steps[k] : &container;
+        if (k > 0) {
+            stage.in.reset(new path_pipe(12));
+            stage.sampling = (estimatefactor != 0);
+            stage.estimatecount.resize(stage.container->condcount.size());
+        }
+        if (k < last && savesteps) {
+            checkpointfiles[k] = pathsstring("paths" + boost::lexical_cast<std::string>(steps[k].t), steps[k].modi, steps[k].modn) + ".pipeline.paths";
+            stage.checkpoint.reset(new pathfile_writer(checkpointfiles[k]));
+        }
+    }
+
+    std::string tstring = "t=" + boost::lexical_cast<std::string>(steps[0].t) + ": ";
+    if (tstring.size() == 5) {
+        tstring += " ";
+    }
+    state.progress.reset(new progress_display(pathsin.size(), true, cout, tstring, "      ", "      "));
+
+    vector<std::unique_ptr<pipeline_worker>> workers;
+    boost::thread_group mythreads;
+    try {
+        for (unsigned i = 0; i < unsigned(container.threads); ++i) {
+            workers.emplace_back(new pipeline_worker(state, i));
+            pipeline_worker *worker = workers.back().get();
+            mythreads.create_thread([worker]() { (*worker)(); });
+        }
+    } catch (...) {
+        // the started workers use state and workers: stop them before these go out of scope
+        state.failed = true;
+        mythreads.join_all();
+        throw;
+    }
+    mythreads.join_all();
+    workers.clear();
+    if (state.progress->expected_count() != state.progress->count()) {
+        *state.progress += state.progress->expected_count() - state.progress->count();
+    }
+    state.progress.reset();
+    vector<differentialpath>().swap(pathsin);
+
+    if (state.failed) {
+        throw std::runtime_error("dostep_pipelined(): a worker thread failed");
+    }
+    container.merge_shards();
+
+    for (unsigned k = 0; k <= last; ++k) {
+        pipeline_stage &stage = state.stages[k];
+        cout << "t=" << stage.container->t << ": ";
+        if (k > 0) {
+            cout << "received " << stage.received << " paths (dropped " << stage.dropped << "), ";
+            if (estimatefactor != 0) {
+                cout << "estimated maxcond=" << stage.estimatedmaxcond << " on " << stage.estimated << " paths, ";
+            }
+        }
+        cout << "maxcond=" << stage.container->maxcond;
+        if (k < last) {
+            cout << ", forwarded " << stage.forwarded << " paths (cutoff=" << stage.cutoff << ")";
+        }
+        cout << endl;
+    }
+    for (unsigned k = 0; k < last; ++k) {
+        if (state.stages[k].checkpoint) {
+            state.stages[k].checkpoint->close();
+            state.stages[k].checkpoint.reset();
+            save_checkpoint(steps[k], state.stages[k].cutoff, checkpointfiles[k]);
+        }
+    }
+
+    save_results(container);
+}
@@ -0,0 +1,141 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+// check program for the lane code of the collision finding tunnels (md5_diffpathhelper --findcollision):
+// for every SIMD version built, the tunnel values are visited in the order of the scalar loops,
+// and the candidates that pass Q_{t+1} and the rotation of step t, with their Q_x and Q_{t+1}, are those of the scalar loops
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include <hashclash/check.hpp>
+#include <hashclash/rng.hpp>
+#include <hashclash/md5detail.hpp>
+
+#include <hashclash/simd/simd_scalar.h>
+#include "check_tunnel_lanes.cinc"
+
+using namespace hashclash;
+using namespace std;
+
+std::vector<lanes_version> &lanes_versions() {
+    static std::vector<lanes_version> versions;
+    return versions;
+}
+
+// the tunnel loop of do_step23-25 one candidate at a time
+void scalar_case(const lanes_case &c, lanes_result &r) {
+    const unsigned x = (c.t == 23) ? 4 : (c.t == 24) ? 9 : 14;
+    vector<uint32> values;
+    uint32 cur = 0;
+    if (c.zerofirst) {
+        values.push_back(0);
+        while ((cur = (cur - 1) & c.mask) != 0) {
+            values.push_back(cur);
+        }
+    } else {
+        do {
+            cur = (cur - 1) & c.mask;
+            values.push_back(cur);
+        } while (cur != 0);
+    }
+    for (uint32 v : values) {
+        r.order.push_back(v);
+        ++r.candidates;
+        const uint32 Qx = (x == 14) ? c.Qxvalue + v : c.Qxvalue ^ v;
+        const uint32 T = rotate_right(c.Qxp1 - Qx, md5_rc[x]) - md5_ff(Qx, c.Qxm1, c.Qxm2) + c.Tc;
+        const uint32 Qtp1 = c.Qt + rotate_left(T, md5_rc[c.t]);
+        if (c.Qtp1value != ((Qtp1 & c.Qtp1mask) ^ (c.Qtp1prev & c.Qt))) {
+            continue;
+        }
+        const uint32 R1 = Qtp1 - c.Qt, R2 = R1 + c.dR;
+        if (rotate_right(R2, md5_rc[c.t]) - rotate_right(R1, md5_rc[c.t]) != c.dT) {
+            continue;
+        }
+        r.survivors.push_back(v);
+        r.survivors.push_back(Qx);
+        r.survivors.push_back(Qtp1);
+    }
+}
+
+// a random word with about n of its bits set
+uint32 sparse(unsigned n) {
+    uint32 w = 0;
+    for (unsigned k = 0; k < n; ++k) {
+        w |= uint32(1) << (xrng128() % 32);
+    }
+    return w;
+}
+
+lanes_case random_case(unsigned t) {
+    lanes_case c;
+    c.t = t;
+    c.mask = sparse(xrng128() % 13);
+    c.zerofirst = (xrng128() & 1) != 0;
+    c.Qxvalue = xrng128();
+    c.Qxp1 = xrng128();
+    c.Qxm1 = xrng128();
+    c.Qxm2 = xrng128();
+    c.Tc = xrng128();
+    c.Qt = xrng128();
+    // few conditions on Q_{t+1}, so that a good part of the candidates passes
+    c.Qtp1mask = sparse(xrng128() % 4);
+    c.Qtp1prev = c.Qtp1mask & sparse(2);
+    c.Qtp1value = xrng128() & c.Qtp1mask;
+    // a small difference that mostly rotates without carries, or none
+    if (xrng128() & 1) {
+        c.dT = c.dR = 0;
+    } else {
+        c.dT = uint32(1) << (xrng128() % 32);
+        c.dR = rotate_left(c.dT, md5_rc[t]);
+        if (xrng128() & 1) {
+            c.dT = 0 - c.dT;
+            c.dR = 0 - c.dR;
+        }
+    }
+    return c;
+}
+
+int main() {
+    seed(1);
+    check(lanes_versions().size() >= 1, "the plain C lane code is built");
+    uint64 survivors = 0;
+    for (unsigned i = 0; i < 3000; ++i) {
+        const lanes_case c = random_case(23 + i % 3);
+        lanes_result expected;
+        expected.candidates = 0;
+        scalar_case(c, expected);
+        survivors += expected.survivors.size() / 3;
+        for (const lanes_version &v : lanes_versions()) {
+            lanes_result r;
+            r.candidates = 0;
+            v.run(c, r);
+            const string what = v.name + " (" + to_string(v.lanes) + " lanes), step " + to_string(c.t) + ", case " + to_string(i);
+            check(r.order == expected.order, what + ": tunnel values in the order of the scalar loop");
+            check(r.candidates == expected.candidates, what + ": number of candidates");
+            check(r.survivors == expected.survivors, what + ": surviving candidates and their Q states");
+        }
+    }
+    check(survivors > 1000, "enough candidates survive to compare the lanes");
+    for (const lanes_version &v : lanes_versions()) {
+        cout << "checked " << v.name << " (" << v.lanes << " lanes)" << endl;
+    }
+    return check_result("check_tunnel_lanes");
+}
@@ -0,0 +1,56 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+#ifndef CHECK_TUNNEL_LANES_HPP
+#define CHECK_TUNNEL_LANES_HPP
+
+#include <vector>
+#include <string>
+
+#include <hashclash/types.hpp>
+
+using hashclash::uint32;
+using hashclash::uint64;
+
+// a tunnel on Q_x at step t = 23, 24 or 25 (x = 4, 9 or 14) as in do_step23-25 of collisionfinding.cpp
+struct lanes_case {
+    unsigned t;
+    uint32 mask;
+    bool zerofirst;
+    uint32 Qxvalue, Qxp1, Qxm1, Qxm2, Tc;
+    uint32 Qt, Qtp1mask, Qtp1value, Qtp1prev, dT, dR;
+};
+
+// the values of the tunnel in the order they are visited, the number of candidates
+// and (tunnel value, Q_x, Q_{t+1}) of each candidate for which Q_{t+1} and the rotation of step t are ok
+struct lanes_result {
+    std::vector<uint32> order;
+    uint64 candidates;
+    std::vector<uint32> survivors;
+};
+
+// the lane code of one SIMD version, see check_tunnel_lanes.cinc
+struct lanes_version {
+    std::string name;
+    unsigned lanes;
+    void (*run)(const lanes_case &, lanes_result &);
+};
+std::vector<lanes_version> &lanes_versions();
+
+#endif // CHECK_TUNNEL_LANES_HPP
@@ -0,0 +1,26 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+// the lane code of check_tunnel_lanes for avx512, built if the lane code of md5_diffpathhelper can use it
+
+#include <hashclash/config.h>
+#ifdef HASHCLASH_HAVE_AVX512_F
+#include <hashclash/simd/simd_avx512.h>
+#include "check_tunnel_lanes.cinc"
+#endif
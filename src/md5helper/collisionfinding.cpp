@@ -20,20 +20,34 @@
 #include <cmath>
 #include <algorithm>
 #include <map>
+#include <memory>
 #include <stdexcept>
 
 #define MD5DETAIL_INLINE_IMPL
 #include <hashclash/saveload_gz.hpp>
+#include <hashclash/pathfile.hpp>
+#include <hashclash/pathstream.hpp>
 #include <hashclash/md5detail.hpp>
 #include <hashclash/differentialpath.hpp>
 #include <hashclash/booleanfunction.hpp>
 #include <hashclash/rng.hpp>
 #include <hashclash/timer.hpp>
 
+#include <boost/atomic.hpp>
 #include <boost/lexical_cast.hpp>
 
 #include "main.hpp"
 
+#include <hashclash/config.h>
+#if defined(HASHCLASH_HAVE_AVX512_F)
+#include <hashclash/simd/simd_avx512.h>
+#elif defined(HASHCLASH_HAVE_AVX2)
+#include <hashclash/simd/simd_avx256.h>
+#else
+#include <hashclash/simd/simd_scalar.h>
+#endif
+#include "tunnel_lanes.hpp"
+
 // #define CPUPERFORMANCE
 #ifdef CPUPERFORMANCE
 #include <hashclash/cpuperformance.hpp>
@@ -47,6 +61,8 @@
 #endif
 
 uint64 tendcount = 0, t61count = 0;
+// set to make the worker threads return from their search
+boost::atomic<bool> collfind_stop(false);
 // vector<uint64> testcounts(1<<20,0);
 // #define DOTESTCOUNTS
 #ifdef DOTESTCOUNTS
@@ -303,63 +319,71 @@ void collisionfinding_thread::do_step25() {
 
     uint32 pT25 = md5_gg(Q[offset + 25], Q[offset + 24], Q[offset + 23]) + Q[offset + 22] + md5_ac[25];
 
-    uint32 Q14tcur = 0;
-    do {
-        Q14tcur -= 1;
-        Q14tcur &= Q14tmask;
-        Q[offset + 14] = Q14value + Q14tcur;
-        Q[offset + 3] = Q3value + Q14tcur;
-
-        uint32 R14 = Q[offset + 15] - Q[offset + 14];
-        m[14] = rotate_right(R14, md5_rc[14]) - md5_ff(Q[offset + 14], Q[offset + 13], Q[offset + 12]) - Q[offset + 11] - md5_ac[14];
-        uint32 T25 = pT25 + m[14];
-        uint32 R25 = rotate_left(T25, md5_rc[25]);
-
-        TESTCOUNT(16);
-        Q[offset + 26] = Q[offset + 25] + R25;
-        if (Qvalue[offset + 26] != ((Q[offset + 26] & Qvaluemask[offset + 26]) ^ (Qprev[offset + 26] & Q[offset + 25]))) {
-            continue;
-        }
-        TESTCOUNT(17);
-        uint32 T25b = T25 + dT[offset + 25];
-        uint32 R25b = rotate_left(T25b, md5_rc[25]);
-        if (R25b - R25 != dR[offset + 25]) {
-            continue;
-        }
-        TESTCOUNT(18);
-
-        mut.lock();
-        ++tendcount;
-        if (hw(uint32(tendcount)) == 1) {
-            cout << tendcount << " " << t61count << endl;
-        }
-        mut.unlock();
-
-        uint32 R3 = Q[offset + 4] - Q[offset + 3];
-        m[3] = rotate_right(R3, md5_rc[3]) - md5_ff(Q[offset + 3], Q[offset + 2], Q[offset + 1]) - Q[offset + 0] - md5_ac[3];
-        uint32 T26 = md5_gg(Q[offset + 26], Q[offset + 25], Q[offset + 24]) + Q[offset + 23] + md5_ac[26] + m[3];
-        uint32 R26 = rotate_left(T26, 14);
-        Q[offset + 27] = Q[offset + 26] + R26;
-        if (Qvalue[offset + 27] != ((Q[offset + 27] & Qvaluemask[offset + 27]) ^ (Qprev[offset + 27] & Q[offset + 26]))) {
-            continue;
-        }
+    tunnel_step_lanes step;
+    step.Qxvalue = Q14value;
+    step.Qxp1 = Q[offset + 15];
+    step.Qxm1 = Q[offset + 13];
+    step.Qxm2 = Q[offset + 12];
+    step.Tc = pT25 - Q[offset + 11] - md5_ac[14];
+    step.Qt = Q[offset + 25];
+    step.Qtp1mask = Qvaluemask[offset + 26];
+    step.Qtp1testval = Qvalue[offset + 26] ^ (Qprev[offset + 26] & Q[offset + 25]);
+    step.dT = dT[offset + 25];
+    step.dR = dR[offset + 25];
+
+    tunnel_lanes Q14lanes(Q14tmask);
+    lanes_type Q14tval[lanes_words];
+    unsigned idx[lanes_block];
+    while (unsigned n = Q14lanes.next(Q14tval)) {
+        const unsigned s = step.check<17, 9, true>(Q14tval, n, idx);
+        candidates[25] += n;
+        survivors[25] += s;
+        for (unsigned j = 0; j < s; ++j) {
+            const uint32 Q14tcur = tunnel_lanes::value(Q14tval, idx[j]);
+            Q[offset + 14] = Q14value + Q14tcur;
+            Q[offset + 3] = Q3value + Q14tcur;
+
+            uint32 R14 = Q[offset + 15] - Q[offset + 14];
+            m[14] = rotate_right(R14, md5_rc[14]) - md5_ff(Q[offset + 14], Q[offset + 13], Q[offset + 12]) - Q[offset + 11] - md5_ac[14];
+            uint32 T25 = pT25 + m[14];
+            Q[offset + 26] = Q[offset + 25] + rotate_left(T25, md5_rc[25]);
+
+            TESTCOUNT(18);
+
+            mut.lock();
+            ++tendcount;
+            if (hw(uint32(tendcount)) == 1) {
+                cout << tendcount << " " << t61count << endl;
+            }
+            mut.unlock();
+
+            uint32 R3 = Q[offset + 4] - Q[offset + 3];
+            m[3] = rotate_right(R3, md5_rc[3]) - md5_ff(Q[offset + 3], Q[offset + 2], Q[offset + 1]) - Q[offset + 0] - md5_ac[3];
+            uint32 T26 = md5_gg(Q[offset + 26], Q[offset + 25], Q[offset + 24]) + Q[offset + 23] + md5_ac[26] + m[3];
+            uint32 R26 = rotate_left(T26, 14);
+            Q[offset + 27] = Q[offset + 26] + R26;
+            if (Qvalue[offset + 27] != ((Q[offset + 27] & Qvaluemask[offset + 27]) ^ (Qprev[offset + 27] & Q[offset + 26]))) {
+                continue;
+            }
 
-        uint32 R8 = Q[offset + 9] - Q[offset + 8];
-        m[8] = rotate_right(R8, md5_rc[8]) - md5_ff(Q[offset + 8], Q[offset + 7], Q[offset + 6]) - Q[offset + 5] - md5_ac[8];
-        uint32 T27 = md5_gg(Q[offset + 27], Q[offset + 26], Q[offset + 25]) + Q[offset + 24] + md5_ac[27] + m[8];
-        uint32 R27 = rotate_left(T27, 20);
-        Q[offset + 28] = Q[offset + 27] + R27;
-        if (Qvalue[offset + 28] != ((Q[offset + 28] & Qvaluemask[offset + 28]) ^ (Qprev[offset + 28] & Q[offset + 27]))) {
-            continue;
-        }
+            uint32 R8 = Q[offset + 9] - Q[offset + 8];
+            m[8] = rotate_right(R8, md5_rc[8]) - md5_ff(Q[offset + 8], Q[offset + 7], Q[offset + 6]) - Q[offset + 5] - md5_ac[8];
+            uint32 T27 = md5_gg(Q[offset + 27], Q[offset + 26], Q[offset + 25]) + Q[offset + 24] + md5_ac[27] + m[8];
+            uint32 R27 = rotate_left(T27, 20);
+            Q[offset + 28] = Q[offset + 27] + R27;
+            if (Qvalue[offset + 28] != ((Q[offset + 28] & Qvaluemask[offset + 28]) ^ (Qprev[offset + 28] & Q[offset + 27]))) {
+                continue;
+            }
 
 #if 0
 		if (verifyconds() <= 28)
 			cerr << verifyconds() << endl;
 #endif
-        do_step26();
-
-    } while (Q14tcur != 0);
+            do_step26();
+        }
+    }
+    Q[offset + 14] = Q14value;
+    Q[offset + 3] = Q3value;
 }
 
 void collisionfinding_thread::do_step24() {
@@ -371,39 +395,43 @@ void collisionfinding_thread::do_step24() {
 
     uint32 pT24 = md5_gg(Q[offset + 24], Q[offset + 23], Q[offset + 22]) + Q[offset + 21] + md5_ac[24];
 
-    uint32 Q9tcur = 0;
-    do {
-        Q9tcur -= 1;
-        Q9tcur &= Q9tmask;
-        Q[offset + 9] = Q9tcur ^ Q9value;
-
-        uint32 R9 = Q[offset + 10] - Q[offset + 9];
-        m[9] = rotate_right(R9, md5_rc[9]) - md5_ff(Q[offset + 9], Q[offset + 8], Q[offset + 7]) - Q[offset + 6] - md5_ac[9];
-
-        uint32 T24 = pT24 + m[9];
-        uint32 R24 = rotate_left(T24, md5_rc[24]);
-
-        TESTCOUNT(13);
-        Q[offset + 25] = Q[offset + 24] + R24;
-        if (Qvalue[offset + 25] != ((Q[offset + 25] & Qvaluemask[offset + 25]) ^ (Qprev[offset + 25] & Q[offset + 24]))) {
-            continue;
-        }
-        TESTCOUNT(14);
-
-        uint32 T24b = T24 + dT[offset + 24];
-        uint32 R24b = rotate_left(T24b, md5_rc[24]);
-        if (R24b - R24 != dR[offset + 24]) {
-            continue;
-        }
-        TESTCOUNT(15);
+    tunnel_step_lanes step;
+    step.Qxvalue = Q9value;
+    step.Qxp1 = Q[offset + 10];
+    step.Qxm1 = Q[offset + 8];
+    step.Qxm2 = Q[offset + 7];
+    step.Tc = pT24 - Q[offset + 6] - md5_ac[9];
+    step.Qt = Q[offset + 24];
+    step.Qtp1mask = Qvaluemask[offset + 25];
+    step.Qtp1testval = Qvalue[offset + 25] ^ (Qprev[offset + 25] & Q[offset + 24]);
+    step.dT = dT[offset + 24];
+    step.dR = dR[offset + 24];
+
+    tunnel_lanes Q9lanes(Q9tmask);
+    lanes_type Q9tval[lanes_words];
+    unsigned idx[lanes_block];
+    while (unsigned n = Q9lanes.next(Q9tval)) {
+        const unsigned s = step.check<12, 5, false>(Q9tval, n, idx);
+        candidates[24] += n;
+        survivors[24] += s;
+        for (unsigned j = 0; j < s; ++j) {
+            Q[offset + 9] = tunnel_lanes::value(Q9tval, idx[j]) ^ Q9value;
+
+            uint32 R9 = Q[offset + 10] - Q[offset + 9];
+            m[9] = rotate_right(R9, md5_rc[9]) - md5_ff(Q[offset + 9], Q[offset + 8], Q[offset + 7]) - Q[offset + 6] - md5_ac[9];
+            uint32 T24 = pT24 + m[9];
+            Q[offset + 25] = Q[offset + 24] + rotate_left(T24, md5_rc[24]);
+            TESTCOUNT(15);
 
 #if 0
-		if (verifyconds() <= 25)
-			cerr << verifyconds() << endl;
+			if (verifyconds() <= 25)
+				cerr << verifyconds() << endl;
 #else
-        do_step25();
+            do_step25();
 #endif
-    } while (Q9tcur != 0);
+        }
+    }
+    Q[offset + 9] = Q9value;
 }
 
 void collisionfinding_thread::do_step23() {
@@ -416,40 +444,43 @@ void collisionfinding_thread::do_step23() {
 
     uint32 pT23 = md5_gg(Q[offset + 23], Q[offset + 22], Q[offset + 21]) + Q[offset + 20] + md5_ac[23];
 
-    uint32 Q4tcur = 0;
-    do {
-        Q4tcur -= 1;
-        Q4tcur &= Q4tmask;
-        Q[offset + 4] = Q4tcur ^ Q4value;
-
-        uint32 R4 = Q[offset + 5] - Q[offset + 4];
-        m[4] = rotate_right(R4, md5_rc[4]) - md5_ff(Q[offset + 4], Q[offset + 3], Q[offset + 2]) - Q[offset + 1] - md5_ac[4];
-
-        uint32 T23 = pT23 + m[4];
-        uint32 R23 = rotate_left(T23, md5_rc[23]);
-
-        TESTCOUNT(10);
-        Q[offset + 24] = Q[offset + 23] + R23;
-        if (Qvalue[offset + 24] != ((Q[offset + 24] & Qvaluemask[offset + 24]) ^ (Qprev[offset + 24] & Q[offset + 23]))) {
-            continue;
-        }
-        TESTCOUNT(11);
-
-        uint32 T23b = T23 + dT[offset + 23];
-        uint32 R23b = rotate_left(T23b, md5_rc[23]);
-        if (R23b - R23 != dR[offset + 23]) {
-            continue;
-        }
-        TESTCOUNT(12);
+    tunnel_step_lanes step;
+    step.Qxvalue = Q4value;
+    step.Qxp1 = Q[offset + 5];
+    step.Qxm1 = Q[offset + 3];
+    step.Qxm2 = Q[offset + 2];
+    step.Tc = pT23 - Q[offset + 1] - md5_ac[4];
+    step.Qt = Q[offset + 23];
+    step.Qtp1mask = Qvaluemask[offset + 24];
+    step.Qtp1testval = Qvalue[offset + 24] ^ (Qprev[offset + 24] & Q[offset + 23]);
+    step.dT = dT[offset + 23];
+    step.dR = dR[offset + 23];
+
+    tunnel_lanes Q4lanes(Q4tmask);
+    lanes_type Q4tval[lanes_words];
+    unsigned idx[lanes_block];
+    while (unsigned n = Q4lanes.next(Q4tval)) {
+        const unsigned s = step.check<7, 20, false>(Q4tval, n, idx);
+        candidates[23] += n;
+        survivors[23] += s;
+        for (unsigned j = 0; j < s; ++j) {
+            Q[offset + 4] = tunnel_lanes::value(Q4tval, idx[j]) ^ Q4value;
+
+            uint32 R4 = Q[offset + 5] - Q[offset + 4];
+            m[4] = rotate_right(R4, md5_rc[4]) - md5_ff(Q[offset + 4], Q[offset + 3], Q[offset + 2]) - Q[offset + 1] - md5_ac[4];
+            uint32 T23 = pT23 + m[4];
+            Q[offset + 24] = Q[offset + 23] + rotate_left(T23, md5_rc[23]);
+            TESTCOUNT(12);
 
 #if 0
-		if (verifyconds() <= 24)
-			cerr << verifyconds() << endl;
+			if (verifyconds() <= 24)
+				cerr << verifyconds() << endl;
 #else
-        do_step24();
+            do_step24();
 #endif
-
-    } while (Q4tcur != 0);
+        }
+    }
+    Q[offset + 4] = Q4value;
 }
 
 void collisionfinding_thread::do_step21() {
@@ -472,8 +503,13 @@ void collisionfinding_thread::do_step21() {
     m[15] = T15 - md5_ff(Q[offset + 15], Q[offset + 14], Q[offset + 13]) - Q[offset + 12] - md5_ac[15];
 
     uint32 pT21 = md5_gg(Q[offset + 21], Q[offset + 20], Q[offset + 19]) + Q[offset + 18] + md5_ac[21];
-    uint32 pT22 = Q[offset + 19] + md5_ac[22] + m[15];
 
+    const uint32 Q22testval = Qvalue[offset + 22] ^ (Qprev[offset + 22] & Q[offset + 21]);
+    const uint32 Q12mask = Qvaluemask[offset + 12] & ~rotate_left(Q8tmask, 22);
+    const uint32 Q13testval = Qvalue[offset + 13] ^ (Q[offset + 13] & Qvaluemask[offset + 13]);
+
+    lanes_type Q9tval[lanes_words], Q8tval[lanes_words], ok[lanes_words];
+    unsigned Q9idx[lanes_block], Q8idx[lanes_block];
     uint32 Q10tcur = 0;
     do {
         Q10tcur -= 1;
@@ -483,77 +519,77 @@ void collisionfinding_thread::do_step21() {
         uint32 R10 = Q[offset + 11] - Q[offset + 10];
         uint32 pT10 = rotate_right(R10, md5_rc[10]) - md5_ac[10] - Q[offset + 7];
 
-        uint32 Q9tcur = 0;
-        do {
-            Q9tcur -= 1;
-            Q9tcur &= Q9tmask;
-            Q[offset + 9] = Q9tcur ^ Q9value;
-
-            m[10] = pT10 - md5_ff(Q[offset + 10], Q[offset + 9], Q[offset + 8]);
-            uint32 T21 = pT21 + m[10];
-            uint32 R21 = rotate_left(T21, md5_rc[21]);
-
-            TESTCOUNT(3);
-            Q[offset + 22] = Q[offset + 21] + R21;
-            if (Qvalue[offset + 22] != ((Q[offset + 22] & Qvaluemask[offset + 22]) ^ (Qprev[offset + 22] & Q[offset + 21]))) {
-                continue;
-            }
-
-            //			TESTCOUNT(4);
-            uint32 T21b = T21 + dT[offset + 21];
-            uint32 R21b = rotate_left(T21b, md5_rc[21]);
-            if (R21b - R21 != dR[offset + 21]) {
-                continue;
+        tunnel_lanes Q9lanes(Q9tmask);
+        while (unsigned n9 = Q9lanes.next(Q9tval)) {
+            for (unsigned i = 0; i * SIMD_VECSIZE < n9; ++i) {
+                SIMD_WORD Q9 = SIMD_XOR_VW(Q9tval[i].v, Q9value);
+                SIMD_WORD T21 = SIMD_SUB_VV(SIMD_WTOV(pT21 + pT10), lanes_ff(Q[offset + 10], Q9, Q[offset + 8]));
+                SIMD_WORD R21 = SIMD_ROL_V(T21, 9);
+                ok[i].v = SIMD_AND_VV(
+                    lanes_checkcond(SIMD_ADD_VW(R21, Q[offset + 21]), Qvaluemask[offset + 22], Q22testval),
+                    LANES_CHECKROT(T21, R21, 9, dT[offset + 21], dR[offset + 21])
+                );
             }
-            //			TESTCOUNT(5);
-
-            UPDATE(22);
-            uint32 Q8tcur = 0;
-            do {
-                Q8tcur -= 1;
-                Q8tcur &= Q8tmask;
-                Q[offset + 8] = Q8tcur ^ Q8value;
-
-                uint32 T11 = md5_ff(Q[offset + 11], Q[offset + 10], Q[offset + 9]) + Q[offset + 8] + m[11] + md5_ac[11];
-                uint32 R11 = rotate_left(T11, md5_rc[11]);
-                uint32 Q12 = Q[offset + 11] + R11;
-                //				TESTCOUNT(6);
-                if (Qvalue[offset + 12] !=
-                    ((Q12 & Qvaluemask[offset + 12] & ~rotate_left(Q8tmask, 22)) ^ (Qprev[offset + 12] & Q[offset + 11]))) {
-                    continue;
-                }
-                if (Qvalue[offset + 13] != ((Q[offset + 13] & Qvaluemask[offset + 13]) ^ (Qprev[offset + 13] & Q12))) {
-                    continue;
-                }
-                //				TESTCOUNT(7);
-                Q[offset + 12] = Q12;
-                uint32 R15 = Q[offset + 16] - Q[offset + 15];
-                m[15] =
-                    rotate_right(R15, md5_rc[15]) - md5_ff(Q[offset + 15], Q[offset + 14], Q[offset + 13]) - Q[offset + 12] - md5_ac[15];
-
-                // uint32 T22 = md5_gg(Q[offset+22], Q[offset+21], Q[offset+20]) + pT22;
-                uint32 T22 = md5_gg(Q[offset + 22], Q[offset + 21], Q[offset + 20]) + Q[offset + 19] + m[15] + md5_ac[22];
-                uint32 R22 = rotate_left(T22, md5_rc[22]);
-                Q[offset + 23] = Q[offset + 22] + R22;
-                if (Qvalue[offset + 23] != ((Q[offset + 23] & Qvaluemask[offset + 23]) ^ (Qprev[offset + 23] & Q[offset + 22]))) {
-                    continue;
-                }
-                //				TESTCOUNT(8);
-                uint32 T22b = T22 + dT[offset + 22];
-                uint32 R22b = rotate_left(T22b, md5_rc[22]);
-                if (R22b - R22 != dR[offset + 22]) {
-                    continue;
-                }
-                //				TESTCOUNT(9);
+            const unsigned s9 = lanes_compact(ok, n9, Q9idx);
+            candidates[21] += n9;
+            survivors[21] += s9;
+            for (unsigned j9 = 0; j9 < s9; ++j9) {
+                Q[offset + 9] = tunnel_lanes::value(Q9tval, Q9idx[j9]) ^ Q9value;
+
+                m[10] = pT10 - md5_ff(Q[offset + 10], Q[offset + 9], Q[offset + 8]);
+                uint32 T21 = pT21 + m[10];
+                Q[offset + 22] = Q[offset + 21] + rotate_left(T21, md5_rc[21]);
+
+                UPDATE(22);
+                // Q12 = Q11 + RL(pT11 + Q8, 22), T22 = pT22 - Q12 as m15 = pT15 - Q12
+                const uint32 pT11 = md5_ff(Q[offset + 11], Q[offset + 10], Q[offset + 9]) + m[11] + md5_ac[11];
+                const uint32 pT15 = rotate_right(Q[offset + 16] - Q[offset + 15], md5_rc[15]) -
+                                    md5_ff(Q[offset + 15], Q[offset + 14], Q[offset + 13]) - md5_ac[15];
+                const uint32 pT22 = md5_gg(Q[offset + 22], Q[offset + 21], Q[offset + 20]) + Q[offset + 19] + md5_ac[22] + pT15;
+                const uint32 Q12testval = Qvalue[offset + 12] ^ (Qprev[offset + 12] & Q[offset + 11]);
+                const uint32 Q23testval = Qvalue[offset + 23] ^ (Qprev[offset + 23] & Q[offset + 22]);
+
+                tunnel_lanes Q8lanes(Q8tmask);
+                while (unsigned n8 = Q8lanes.next(Q8tval)) {
+                    for (unsigned i = 0; i * SIMD_VECSIZE < n8; ++i) {
+                        SIMD_WORD Q8 = SIMD_XOR_VW(Q8tval[i].v, Q8value);
+                        SIMD_WORD Q12 = SIMD_ADD_VW(SIMD_ROL_V(SIMD_ADD_VW(Q8, pT11), 22), Q[offset + 11]);
+                        SIMD_WORD T22 = SIMD_SUB_VV(SIMD_WTOV(pT22), Q12);
+                        SIMD_WORD R22 = SIMD_ROL_V(T22, 14);
+                        ok[i].v = SIMD_AND_VV(
+                            SIMD_AND_VV(lanes_checkcond(Q12, Q12mask, Q12testval), lanes_checkcond(Q12, Qprev[offset + 13], Q13testval)),
+                            SIMD_AND_VV(
+                                lanes_checkcond(SIMD_ADD_VW(R22, Q[offset + 22]), Qvaluemask[offset + 23], Q23testval),
+                                LANES_CHECKROT(T22, R22, 14, dT[offset + 22], dR[offset + 22])
+                            )
+                        );
+                    }
+                    const unsigned s8 = lanes_compact(ok, n8, Q8idx);
+                    candidates[22] += n8;
+                    survivors[22] += s8;
+                    for (unsigned j8 = 0; j8 < s8; ++j8) {
+                        Q[offset + 8] = tunnel_lanes::value(Q8tval, Q8idx[j8]) ^ Q8value;
+
+                        uint32 T11 = md5_ff(Q[offset + 11], Q[offset + 10], Q[offset + 9]) + Q[offset + 8] + m[11] + md5_ac[11];
+                        Q[offset + 12] = Q[offset + 11] + rotate_left(T11, md5_rc[11]);
+                        uint32 R15 = Q[offset + 16] - Q[offset + 15];
+                        m[15] = rotate_right(R15, md5_rc[15]) - md5_ff(Q[offset + 15], Q[offset + 14], Q[offset + 13]) - Q[offset + 12] -
+                                md5_ac[15];
+                        uint32 T22 = md5_gg(Q[offset + 22], Q[offset + 21], Q[offset + 20]) + Q[offset + 19] + m[15] + md5_ac[22];
+                        Q[offset + 23] = Q[offset + 22] + rotate_left(T22, md5_rc[22]);
 
 #if 0
-				if (verifyconds() <= 23)
-					cerr << verifyconds() << endl;
+						if (verifyconds() <= 23)
+							cerr << verifyconds() << endl;
 #else
-                do_step23();
+                        do_step23();
 #endif
-            } while (Q8tcur != 0);
-        } while (Q9tcur != 0);
+                    }
+                }
+                Q[offset + 8] = Q8value;
+            }
+        }
+        Q[offset + 9] = Q9value;
     } while (Q10tcur != 0);
     Q[offset + 12] = Q12val;
 }
@@ -575,6 +611,8 @@ void collisionfinding_thread::do_step20() {
 
     uint32 pT20 = md5_gg(Q[offset + 20], Q[offset + 19], Q[offset + 18]) + Q[offset + 17] + md5_ac[20];
     uint32 testQ21val = Qvalue[offset + 21] ^ (Qprev[offset + 21] & Q[offset + 20]);
+    lanes_type Q4tval[lanes_words], ok[lanes_words];
+    unsigned idx[lanes_block];
     uint32 Q14tcur = 0;
     do {
         Q14tcur -= 1;
@@ -592,38 +630,38 @@ void collisionfinding_thread::do_step20() {
             uint32 pT5 = rotate_right(R5, md5_rc[5]) - md5_ac[5] - Q[offset + 2];
             uint32 p2T20 = pT20 + pT5;
 
-            uint32 Q4tcur = 0;
-            do {
-                Q[offset + 4] = Q4tcur ^ Q4value;
-                Q4tcur -= 1;
-                Q4tcur &= Q4tmask;
-
-                uint32 T20 = p2T20 - md5_ff(Q[offset + 5], Q[offset + 4], Q[offset + 3]);
-                uint32 Q21 = Q[offset + 20] + rotate_left(T20, 5);
-                if (testQ21val != (Q21 & Qvaluemask[offset + 21])) {
-                    continue;
+            tunnel_lanes Q4lanes(Q4tmask, true);
+            while (unsigned n = Q4lanes.next(Q4tval)) {
+                for (unsigned i = 0; i * SIMD_VECSIZE < n; ++i) {
+                    SIMD_WORD Q4 = SIMD_XOR_VW(Q4tval[i].v, Q4value);
+                    SIMD_WORD T20 = SIMD_SUB_VV(SIMD_WTOV(p2T20), lanes_ff(Q[offset + 5], Q4, Q[offset + 3]));
+                    SIMD_WORD R20 = SIMD_ROL_V(T20, 5);
+                    ok[i].v = SIMD_AND_VV(
+                        lanes_checkcond(SIMD_ADD_VW(R20, Q[offset + 20]), Qvaluemask[offset + 21], testQ21val),
+                        LANES_CHECKROT(T20, R20, 5, dT[offset + 20], dR[offset + 20])
+                    );
                 }
-                Q[offset + 21] = Q21;
-                TESTCOUNT(1);
+                const unsigned s = lanes_compact(ok, n, idx);
+                candidates[20] += n;
+                survivors[20] += s;
+                for (unsigned j = 0; j < s; ++j) {
+                    Q[offset + 4] = tunnel_lanes::value(Q4tval, idx[j]) ^ Q4value;
 
-                uint32 R20 = rotate_left(T20, 5);
-                uint32 T20b = T20 + dT[offset + 20];
-                uint32 R20b = rotate_left(T20b, md5_rc[20]);
-                if (R20b - R20 != dR[offset + 20]) {
-                    continue;
-                }
-                TESTCOUNT(2);
+                    uint32 T20 = p2T20 - md5_ff(Q[offset + 5], Q[offset + 4], Q[offset + 3]);
+                    Q[offset + 21] = Q[offset + 20] + rotate_left(T20, 5);
+                    TESTCOUNT(2);
 
-                m[5] = pT5 - md5_ff(Q[offset + 5], Q[offset + 4], Q[offset + 3]);
+                    m[5] = pT5 - md5_ff(Q[offset + 5], Q[offset + 4], Q[offset + 3]);
 
 #if 0
-				if (verifyconds() <= 21)
-					cerr << verifyconds() << endl;
+					if (verifyconds() <= 21)
+						cerr << verifyconds() << endl;
 #else
-                do_step21();
+                    do_step21();
 #endif
-
-            } while (Q4tcur != 0);
+                }
+            }
+            Q[offset + 4] = Q4lanes.last() ^ Q4value;
         } while (Q5tcur != 0);
     } while (Q14tcur != 0);
 }
@@ -648,7 +686,6 @@ void collisionfinding_thread::do_step18() {
     uint32 Q12cur = 0;
     uint32 Q8mask = (~Qvaluemask[offset + 8]) & (~Qprev[offset + 9]);
     //	uint32 Q8add = ~Q8mask + 1;
-    uint32 Q8cur = 0;
 
     uint32 Q8corr = Q8mask & rotate_right(Qvaluemask[offset + 19], 14);
     uint32 Q8mask2 = Q8mask & ~Q8corr;
@@ -659,6 +696,8 @@ void collisionfinding_thread::do_step18() {
     uint32 pT19 = Q[offset + 16] + md5_ac[19];
     uint32 Q19testval = Qvalue[offset + 19] ^ (Qprev[offset + 19] & Q[offset + 18]);
     unsigned testcount = 0;
+    lanes_type Q8val[lanes_words], ok[lanes_words];
+    unsigned idx[lanes_block], idx19[lanes_block];
 
     uint32 Q8pvalue = Qvalue[offset + 8] ^ (Qprev[offset + 8] & Q[offset + 7]) ^ (xrng128() & Q8pmask);
     Q8pcur = 0;
@@ -697,13 +736,15 @@ void collisionfinding_thread::do_step18() {
                         Q12cur -= 1;
                         Q12cur &= Q12mask;
                         Q[offset + 12] = Q12cur ^ Q12value;
+                        if (collfind_stop) {
+                            return;
+                        }
 
                         uint32 R11 = Q[offset + 12] - Q[offset + 11];
                         uint32 T11 = rotate_right(R11, md5_rc[11]) - pT11;
                         uint32 test = pT18 + T11;
 
                         uint32 Q8value = Q[offset + 8] ^ (rotate_right(Q19testval, 14) & Q8corr);
-                        Q8cur = 0;
 
                         /* fast rough test to see if we can correct bad bits */
                         /*						uint32 testT18 = test - Q8value;
@@ -728,66 +769,75 @@ void collisionfinding_thread::do_step18() {
 
                         // UPDATE(19);
                         /*** CRITICAL PART ***/
-                        do {
-                            Q8cur -= 1;
-                            Q8cur &= Q8mask2;
-
-                            uint32 T18 = test - (Q8cur ^ Q8value);
-                            uint32 Q19 = Q[offset + 18] + rotate_left(T18, 14);
-                            if ((Q19 ^ Q19testval) & Q19uncorr) {
-                                continue;
-                            }
-                            uint32 corr = rotate_right(Q19 ^ Q19testval, 14) & Q8corr;
-                            T18 = test - (Q8cur ^ Q8value ^ corr);
-                            Q19 = Q[offset + 18] + rotate_left(T18, 14);
-                            if (Q19testval != (Q19 & Qvaluemask[offset + 19])) {
-                                continue;
+                        tunnel_lanes Q8lanes(Q8mask2);
+                        while (unsigned n = Q8lanes.next(Q8val)) {
+                            for (unsigned i = 0; i * SIMD_VECSIZE < n; ++i) {
+                                SIMD_WORD Q8 = SIMD_XOR_VW(Q8val[i].v, Q8value);
+                                SIMD_WORD Q19 = SIMD_ADD_VW(SIMD_ROL_V(SIMD_SUB_VV(SIMD_WTOV(test), Q8), 14), Q[offset + 18]);
+                                SIMD_WORD bad = SIMD_XOR_VW(Q19, Q19testval);
+                                SIMD_WORD corr = SIMD_AND_VW(SIMD_ROR_V(bad, 14), Q8corr);
+                                SIMD_WORD T18 = SIMD_SUB_VV(SIMD_WTOV(test), SIMD_XOR_VV(Q8, corr));
+                                SIMD_WORD R18 = SIMD_ROL_V(T18, 14);
+                                ok[i].v = SIMD_AND_VV(
+                                    SIMD_AND_VV(
+                                        lanes_checkcond(bad, Q19uncorr, 0),
+                                        lanes_checkcond(SIMD_ADD_VW(R18, Q[offset + 18]), Qvaluemask[offset + 19], Q19testval)
+                                    ),
+                                    LANES_CHECKROT(T18, R18, 14, dT[offset + 18], dR[offset + 18])
+                                );
                             }
-                            // UPDATE(20);
-
-                            UPDATE(19);
-                            uint32 p2T19 = pT19 + md5_gg(Q19, Q[offset + 18], Q[offset + 17]);
-                            uint32 Q20testval = Qvalue[offset + 20] ^ (Qprev[offset + 20] & Q19);
-                            for (Q1Q2m0it = Q1Q2m0withm1ok.begin(); Q1Q2m0it != Q1Q2m0withm1ok.end(); ++Q1Q2m0it) {
-                                uint32 T19 = p2T19 + Q1Q2m0it->third;
-                                uint32 Q20 = Q19 + rotate_left(T19, 20);
-                                if (Q20testval != (Q20 & Qvaluemask[offset + 20])) {
-                                    continue;
-                                }
-                                // UPDATE(21);
-                                /*** END CRITICAL PART ***/
-                                Q[offset + 20] = Q20;
-
-                                uint32 R18 = rotate_left(T18, 14);
-                                uint32 T18b = T18 + dT[offset + 18];
-                                uint32 R18b = rotate_left(T18b, md5_rc[18]);
-                                if (R18b - R18 != dR[offset + 18]) {
-                                    continue;
-                                }
-
-                                uint32 R19 = rotate_left(T19, md5_rc[19]);
-                                uint32 T19b = T19 + dT[offset + 19];
-                                uint32 R19b = rotate_left(T19b, md5_rc[19]);
-                                if (R19b - R19 != dR[offset + 19]) {
-                                    continue;
-                                }
-
-                                Q[offset + 19] = Q19;
-                                Q[offset + 8] = Q8cur ^ Q8value ^ corr;
-                                m[11] = T11 - Q[offset + 8];
-
-                                Q[offset + 1] = Q1Q2m0it->first;
-                                Q[offset + 2] = Q1Q2m0it->second;
-                                m[0] = Q1Q2m0it->third;
+                            const unsigned s = lanes_compact(ok, n, idx);
+                            candidates[18] += n;
+                            survivors[18] += s;
+                            for (unsigned j = 0; j < s; ++j) {
+                                const uint32 Q8cur = tunnel_lanes::value(Q8val, idx[j]);
+                                uint32 T18 = test - (Q8cur ^ Q8value);
+                                uint32 Q19 = Q[offset + 18] + rotate_left(T18, 14);
+                                uint32 corr = rotate_right(Q19 ^ Q19testval, 14) & Q8corr;
+                                T18 = test - (Q8cur ^ Q8value ^ corr);
+                                Q19 = Q[offset + 18] + rotate_left(T18, 14);
+
+                                UPDATE(19);
+                                uint32 p2T19 = pT19 + md5_gg(Q19, Q[offset + 18], Q[offset + 17]);
+                                uint32 Q20testval = Qvalue[offset + 20] ^ (Qprev[offset + 20] & Q19);
+                                for (size_t k = 0; k < Q1withm1ok.size(); k += lanes_block) {
+                                    const unsigned n19 = unsigned(std::min<size_t>(lanes_block, Q1withm1ok.size() - k));
+                                    for (unsigned i = 0; i * SIMD_VECSIZE < n19; ++i) {
+                                        lanes_type m0;
+                                        std::memcpy(&m0, &m0withm1ok[k + i * SIMD_VECSIZE], sizeof(m0));
+                                        SIMD_WORD T19 = SIMD_ADD_VW(m0.v, p2T19);
+                                        SIMD_WORD R19 = SIMD_ROL_V(T19, 20);
+                                        ok[i].v = SIMD_AND_VV(
+                                            lanes_checkcond(SIMD_ADD_VW(R19, Q19), Qvaluemask[offset + 20], Q20testval),
+                                            LANES_CHECKROT(T19, R19, 20, dT[offset + 19], dR[offset + 19])
+                                        );
+                                    }
+                                    const unsigned s19 = lanes_compact(ok, n19, idx19);
+                                    candidates[19] += n19;
+                                    survivors[19] += s19;
+                                    for (unsigned j19 = 0; j19 < s19; ++j19) {
+                                        const size_t l = k + idx19[j19];
+                                        uint32 T19 = p2T19 + m0withm1ok[l];
+                                        Q[offset + 20] = Q19 + rotate_left(T19, 20);
+                                        Q[offset + 19] = Q19;
+                                        Q[offset + 8] = Q8cur ^ Q8value ^ corr;
+                                        m[11] = T11 - Q[offset + 8];
+
+                                        Q[offset + 1] = Q1withm1ok[l];
+                                        Q[offset + 2] = Q2withm1ok[l];
+                                        m[0] = m0withm1ok[l];
 #if 0
-								if (verifyconds() <= 20)
-									cerr << verifyconds() << endl;
+										if (verifyconds() <= 20)
+											cerr << verifyconds() << endl;
 #else
-                                do_step20();
+                                        do_step20();
 #endif
-                                ++testcount;
+                                        ++testcount;
+                                    }
+                                }
+                                /*** END CRITICAL PART ***/
                             }
-                        } while (Q8cur != 0);
+                        }
                         if (testcount == 0) {
                             return;
                         }
@@ -815,10 +865,12 @@ void collisionfinding_thread::do_step17() {
     uint32 Q6cur = 0;
     uint32 Q7mask = ~Qvaluemask[offset + 7];
     //	uint32 Q7add = Qvaluemask[offset+7]+1;
-    uint32 Q7cur = 0;
 
     uint32 pT17 = md5_gg(Q[offset + 17], Q[offset + 16], Q[offset + 15]) + Q[offset + 14] + md5_ac[17];
     uint32 Q3value = Qvalue[offset + 3] ^ (Qprev[offset + 3] & Q[offset + 2]);
+    uint32 Q18testval = Qvalue[offset + 18] ^ (Qprev[offset + 18] & Q[offset + 17]);
+    lanes_type Q7val[lanes_words], ok[lanes_words];
+    unsigned idx[lanes_block];
 
     /* do not iterate over all values of Q3 */
     Q3value ^= xrng128() & Q3mask;
@@ -850,6 +902,9 @@ void collisionfinding_thread::do_step17() {
                     Q6cur -= 1;
                     Q6cur &= Q6mask;
                     Q[offset + 6] = Q6cur ^ Q6value;
+                    if (collfind_stop) {
+                        return;
+                    }
 
                     uint32 pT6 = md5_ff(Q[offset + 6], Q[offset + 5], Q[offset + 4]) + Q[offset + 3] + md5_ac[6];
                     uint32 Q7value = Qvalue[offset + 7] ^ (Qprev[offset + 7] & Q[offset + 6]);
@@ -866,31 +921,33 @@ void collisionfinding_thread::do_step17() {
                         continue;
                     }
 
-                    Q7cur = 0;
-                    do {
-                        Q7cur -= 1;
-                        Q7cur &= Q7mask;
-                        Q[offset + 7] = Q7cur ^ Q7value;
-
-                        uint32 R6 = Q[offset + 7] - Q[offset + 6];
-                        uint32 T6 = rotate_right(R6, md5_rc[6]);
-                        m[6] = T6 - pT6;
-                        uint32 T17 = pT17 + m[6];
-                        uint32 R17 = rotate_left(T17, md5_rc[17]);
-                        Q[offset + 18] = Q[offset + 17] + R17;
-                        if (Qvalue[offset + 18] != ((Q[offset + 18] & Qvaluemask[offset + 18]) ^ (Qprev[offset + 18] & Q[offset + 17]))) {
-                            continue;
+                    tunnel_lanes Q7lanes(Q7mask);
+                    while (unsigned n = Q7lanes.next(Q7val)) {
+                        for (unsigned i = 0; i * SIMD_VECSIZE < n; ++i) {
+                            SIMD_WORD Q7 = SIMD_XOR_VW(Q7val[i].v, Q7value);
+                            SIMD_WORD T17 = SIMD_ADD_VW(SIMD_ROR_V(SIMD_SUB_VW(Q7, Q[offset + 6]), 17), pT17 - pT6);
+                            SIMD_WORD R17 = SIMD_ROL_V(T17, 9);
+                            ok[i].v = SIMD_AND_VV(
+                                lanes_checkcond(SIMD_ADD_VW(R17, Q[offset + 17]), Qvaluemask[offset + 18], Q18testval),
+                                LANES_CHECKROT(T17, R17, 9, dT[offset + 17], dR[offset + 17])
+                            );
                         }
-
-                        uint32 T17b = T17 + dT[offset + 17];
-                        uint32 R17b = rotate_left(T17b, md5_rc[17]);
-                        if (R17b - R17 != dR[offset + 17]) {
-                            continue;
+                        const unsigned s = lanes_compact(ok, n, idx);
+                        candidates[17] += n;
+                        survivors[17] += s;
+                        for (unsigned j = 0; j < s; ++j) {
+                            Q[offset + 7] = tunnel_lanes::value(Q7val, idx[j]) ^ Q7value;
+
+                            uint32 R6 = Q[offset + 7] - Q[offset + 6];
+                            uint32 T6 = rotate_right(R6, md5_rc[6]);
+                            m[6] = T6 - pT6;
+                            uint32 T17 = pT17 + m[6];
+                            Q[offset + 18] = Q[offset + 17] + rotate_left(T17, md5_rc[17]);
+
+                            do_step18();
                         }
-
-                        do_step18();
-
-                    } while (Q7cur != 0);
+                    }
+                    Q[offset + 7] = Q7value;
                 } while (Q6cur != 0);
             } while (Q5cur != 0);
         } while (Q4cur != 0);
@@ -940,7 +997,9 @@ void collisionfinding_thread::do_step16() {
                 continue;
             }
 
-            Q1Q2m0withm1ok.clear();
+            Q1withm1ok.clear();
+            Q2withm1ok.clear();
+            m0withm1ok.clear();
             uint32 Q1mask = ~Qvaluemask[offset + 1];
             //			uint32 Q1add = ~Q1mask + 1;
             uint32 Q1val = Q[offset + 1];
@@ -969,9 +1028,13 @@ void collisionfinding_thread::do_step16() {
                 uint32 m0 = rotate_right(Q1 - Q[offset + 0], md5_rc[0]) - md5_ff(Q[offset + 0], Q[offset - 1], Q[offset - 2]) -
                             Q[offset - 3] - md5_ac[0];
 
-                Q1Q2m0withm1ok.push_back(make_triple(Q1, Q2, m0));
-            } while (Q1cur != 0 && Q1Q2m0withm1ok.size() < (1 << 20));
-            //			cout << "Q1Q2m0withm1ok: " << Q1Q2m0withm1ok.size() << endl;
+                Q1withm1ok.push_back(Q1);
+                Q2withm1ok.push_back(Q2);
+                m0withm1ok.push_back(m0);
+            } while (Q1cur != 0 && Q1withm1ok.size() < (1 << 20));
+            //			cout << "Q1Q2m0withm1ok: " << Q1withm1ok.size() << endl;
+            // pad m0withm1ok to whole SIMD words for the lanes of step 19
+            m0withm1ok.resize((Q1withm1ok.size() + SIMD_VECSIZE - 1) / SIMD_VECSIZE * SIMD_VECSIZE, 0);
 
             if (isinfinite) {
                 cout << "." << flush;
@@ -1209,14 +1272,21 @@ void collisionfinding_thread::filltables() {
     cout << "25: Q14Q3m14tunnel  = " << hw(Q14Q3m14tunnel) << endl;
 }
 
+// incremented whenever the paths are replaced by new paths from the path stream
+boost::atomic<unsigned> collfind_pathsversion(0);
+// lane counters of all stopped worker threads (under mut)
+uint64 collfind_candidates[64], collfind_survivors[64];
+
 struct collfind_thread {
-    collfind_thread(const vector<differentialpath> &paths, parameters_type &params)
-        : diffpaths(paths), parameters(params) {}
+    collfind_thread(const vector<differentialpath> &paths, parameters_type &params, unsigned index)
+        : diffpaths(paths), parameters(params), threadindex(index) {}
     const vector<differentialpath> &diffpaths;
     const parameters_type &parameters;
+    unsigned threadindex;
     collisionfinding_thread worker;
     void operator()() {
         try {
+            seed_thread(threadindex);
             for (unsigned i = 0; i < 16; ++i) {
                 worker.m_diff[i] = parameters.m_diff[i];
             }
@@ -1238,10 +1308,15 @@ struct collfind_thread {
             counter_man.add_performance_counter(worker.cpu_step_t[25], "Step t=25");
 #endif
             timer sw(true);
+            unsigned pathsversion = collfind_pathsversion;
             try {
                 worker.findcollision(diffpaths, false);
-                while (true) {
+                while (!collfind_stop) {
                     worker.findcollision(diffpaths);
+                    if (pathsversion != collfind_pathsversion) {
+                        pathsversion = collfind_pathsversion;
+                        worker.findcollision(diffpaths, false);
+                    }
                     if (sw.time() > 300) {
                         sw.start();
 #ifdef CPUPERFORMANCE
@@ -1263,6 +1338,12 @@ struct collfind_thread {
                         worker.findcollision(diffpaths, false);
                     }
                 }
+                mut.lock();
+                for (unsigned t = 0; t < 64; ++t) {
+                    collfind_candidates[t] += worker.candidates[t];
+                    collfind_survivors[t] += worker.survivors[t];
+                }
+                mut.unlock();
             } catch (...) {
 #ifdef CPUPERFORMANCE
                 for (unsigned t = 0; t + 1 < 64; ++t) {
@@ -1278,10 +1359,88 @@ struct collfind_thread {
         }
     }
 };
-void collfind_threaded(const vector<differentialpath> &paths, parameters_type &parameters) {
+// overwrite steps of all paths by the partial path overrule (as --combinepaths), if it is not empty
+void collfind_combine(vector<differentialpath> &paths, const differentialpath &overrule) {
+    for (auto &p : paths) {
+        for (int t = overrule.tbegin(); t < overrule.tend(); ++t) {
+            p[t] = overrule[t];
+        }
+    }
+}
+
+// let the worker threads search for parameters.benchmark seconds, then stop them and show the lane counters of each step
+void collfind_benchmark(boost::thread_group &mythreads, const parameters_type &parameters) {
+    timer sw(true);
+    boost::this_thread::sleep(boost::posix_time::seconds(parameters.benchmark));
+    collfind_stop = true;
+    mythreads.join_all();
+    const double time = sw.time();
+    cout << endl
+         << "Benchmark: " << parameters.threads << " thread(s), " << time << "s, " << SIMD_VECSIZE
+         << " lanes (" LANES_STR(SIMD_VERSION) ")" << endl;
+    for (unsigned t = 17; t <= 25; ++t) {
+        cout << "t=" << t << ":\t" << collfind_candidates[t] << " candidates\t" << uint64(double(collfind_candidates[t]) / time)
+             << " candidates/s\t" << collfind_survivors[t] << " passed" << endl;
+    }
+}
+
+// the paths of all files given by -j, each file holds a vector of paths or a single path
+void collfind_loadjoined(vector<differentialpath> &paths, const vector<string> &files) {
+    vector<differentialpath> joinvec;
+    for (unsigned i = 0; i < files.size(); ++i) {
+        joinvec.clear();
+        try {
+            load_paths(joinvec, files[i]);
+        } catch (...) {
+            joinvec.resize(1);
+            try {
+                load_gz(joinvec.front(), binary_archive, files[i]);
+            } catch (...) {
+                cerr << "Warning: could not load path(s) in '" << files[i] << "'!" << endl;
+                continue;
+            }
+        }
+        for (unsigned j = 0; j < joinvec.size(); ++j) {
+            paths.emplace_back(std::move(joinvec[j]));
+        }
+    }
+}
+
+// with a path stream the worker threads run on paths while the stream is followed:
+// when new paths have been appended they replace paths (under mut) and the workers switch to them
+// streampaths are the paths read from the stream so far (not yet overwritten by overrule),
+// joinedpaths are added to them
+void collfind_threaded(
+    vector<differentialpath> &paths,
+    parameters_type &parameters,
+    pathstream_reader *stream,
+    vector<differentialpath> &streampaths,
+    const vector<differentialpath> &joinedpaths,
+    const differentialpath &overrule
+) {
     boost::thread_group mythreads;
     for (unsigned i = 0; i < parameters.threads; ++i) {
-        mythreads.create_thread(collfind_thread(paths, parameters));
+        mythreads.create_thread(collfind_thread(paths, parameters, i));
+    }
+    if (parameters.benchmark != 0) {
+        collfind_benchmark(mythreads, parameters);
+        return;
+    }
+    while (stream != nullptr) {
+        boost::this_thread::sleep(boost::posix_time::seconds(1));
+        if (!stream->update(streampaths) || streampaths.empty()) {
+            continue;
+        }
+        vector<differentialpath> newpaths = streampaths;
+        newpaths.insert(newpaths.end(), joinedpaths.begin(), joinedpaths.end());
+        collfind_combine(newpaths, overrule);
+        mut.lock();
+        paths.swap(newpaths);
+        cout << endl
+             << "Loaded " << paths.size() << " paths from " << parameters.pathstream << ": totcompl=" << stream->complexity
+             << " tottunnel=" << stream->tunnel << ", totcond=" << stream->cond << endl;
+        mut.unlock();
+        ++collfind_pathsversion;
     }
     mythreads.join_all();
 }
@@ -1295,7 +1454,7 @@ int collisionfinding(parameters_type &parameters) {
     vector<differentialpath> vecpath;
     bool failed = true;
     try {
-        load_gz(vecpath, binary_archive, parameters.infile1);
+        load_paths(vecpath, parameters.infile1);
         failed = false;
     } catch (...) {
     }
@@ -1308,6 +1467,36 @@ int collisionfinding(parameters_type &parameters) {
         } catch (...) {
         }
     }
+    std::unique_ptr<pathstream_reader> stream;
+    vector<differentialpath> streampaths, joinedpaths;
+    differentialpath overrule;
+    if (!parameters.pathstream.empty()) {
+        // paths of other connect runs given by -j are searched next to the streamed paths
+        collfind_loadjoined(joinedpaths, parameters.files);
+        // inputfile1 is optional, inputfile2 is a partial path to overwrite all streamed paths with
+        if (!parameters.infile2.empty()) {
+            vector<differentialpath> vecpath2;
+            try {
+                load_paths(vecpath2, parameters.infile2);
+                overrule = vecpath2.front();
+            } catch (...) {
+                load_gz(overrule, binary_archive, parameters.infile2);
+            }
+        }
+        stream.reset(new pathstream_reader(parameters.pathstream));
+        if (failed || vecpath.size() == 0) {
+            cout << "Waiting for paths in " << parameters.pathstream << "..." << flush;
+            while (!stream->update(streampaths) || streampaths.empty()) {
+                boost::this_thread::sleep(boost::posix_time::seconds(1));
+            }
+            cout << "done (totcompl=" << stream->complexity << " tottunnel=" << stream->tunnel << ", totcond=" << stream->cond << ")."
+                 << endl;
+            vecpath = streampaths;
+            vecpath.insert(vecpath.end(), joinedpaths.begin(), joinedpaths.end());
+            collfind_combine(vecpath, overrule);
+            failed = false;
+        }
+    }
     if (failed || vecpath.size() == 0) {
         cerr << "Error: could not load path(s) in '" << parameters.infile1 << "'!" << endl;
         return 1;
@@ -1315,7 +1504,7 @@ int collisionfinding(parameters_type &parameters) {
     show_path(vecpath[0], parameters.m_diff);
     cout << "Starting..." << endl;
 
-    collfind_threaded(vecpath, parameters);
+    collfind_threaded(vecpath, parameters, stream.get(), streampaths, joinedpaths, overrule);
     //	collisionfinding_thread worker;
     //	for (unsigned i = 0; i < 16; ++i)
     //		worker.m_diff[i] = parameters.m_diff[i];
@@ -22,6 +22,7 @@
 #include <map>
 
 #include <hashclash/saveload_gz.hpp>
+#include <hashclash/pathfile.hpp>
 #include <hashclash/differentialpath.hpp>
 #include <hashclash/md5detail.hpp>
 #include <hashclash/booleanfunction.hpp>
@@ -125,7 +126,7 @@ int split(parameters_type &parameters) {
     vector<differentialpath> vecpath, splitvec;
     cout << "Loading " << parameters.infile1 << "..." << flush;
     try {
-        load_gz(vecpath, binary_archive, parameters.infile1);
+        load_paths(vecpath, parameters.infile1);
         cout << "done (loaded " << vecpath.size() << " paths)." << endl;
     } catch (...) {
         cout << "failed." << endl;
@@ -169,7 +170,7 @@ int join(parameters_type &parameters) {
         joinvec.clear();
         cout << "Loading " << parameters.files[i] << "..." << flush;
         try {
-            load_gz(joinvec, binary_archive, parameters.files[i]);
+            load_paths(joinvec, parameters.files[i]);
             cout << "done (loaded " << joinvec.size() << " paths)." << endl;
             for (unsigned j = 0; j < joinvec.size(); ++j) {
                 vecpath.emplace_back(std::move(joinvec[j]));
@@ -216,7 +217,7 @@ int combinepaths(parameters_type &parameters) {
     differentialpath overrulepath;
     cout << "Loading " << parameters.infile1 << "..." << flush;
     try {
-        load_gz(vecpath, binary_archive, parameters.infile1);
+        load_paths(vecpath, parameters.infile1);
         cout << "done (loaded " << vecpath.size() << " paths)." << endl;
     } catch (...) {
         cout << "failed." << endl;
@@ -227,7 +228,7 @@ int combinepaths(parameters_type &parameters) {
     }
     cout << "Loading " << parameters.infile2 << "..." << flush;
     try {
-        load_gz(vecpath2, binary_archive, parameters.infile2);
+        load_paths(vecpath2, parameters.infile2);
         cout << "done (loaded " << vecpath2.size() << " paths)." << endl;
         overrulepath = vecpath2.front();
     } catch (...) {
@@ -273,7 +274,7 @@ int negatepaths(parameters_type &parameters) {
     vector<differentialpath> vecpath;
     cout << "Loading " << parameters.infile1 << "..." << flush;
     try {
-        load_gz(vecpath, binary_archive, parameters.infile1);
+        load_paths(vecpath, parameters.infile1);
         cout << "done (loaded " << vecpath.size() << " paths)." << endl;
     } catch (...) {
         cout << "failed." << endl;
@@ -311,6 +312,19 @@ int convert(parameters_type &parameters) {
     differentialpath path;
     vector<differentialpath> vecpath;
     bool failed = true;
+    if (failed && is_pathfile(parameters.infile1)) {
+        cout << "Trying to read vector of differential paths in path file format..." << flush;
+        try {
+            load_pathfile(vecpath, parameters.infile1);
+            failed = false;
+            cout << "success." << endl;
+            cout << "Trying to save vector of differential paths in binary..." << flush;
+            save_gz(vecpath, binary_archive, parameters.infile1 + ".bin.gz");
+            cout << "success." << endl;
+        } catch (...) {
+            cout << "failed." << endl;
+        }
+    }
     if (failed) {
         cout << "Trying to read vector of differential paths in binary..." << flush;
         try {
@@ -321,6 +335,9 @@ int convert(parameters_type &parameters) {
                 cout << "Trying to save vector of differential paths in text..." << flush;
                 save_gz(vecpath, text_archive, parameters.infile1 + ".txt.gz");
                 cout << "success." << endl;
+                cout << "Trying to save vector of differential paths in path file format..." << flush;
+                save_pathfile(vecpath, parameters.infile1 + ".paths");
+                cout << "success." << endl;
             }
         } catch (...) {
             cout << "failed." << endl;
@@ -49,6 +49,7 @@ int main(int argc, char **argv) {
 
     try {
         parameters_type parameters;
+        uint32 rngseed = 0;
         vector<vector<int>> msgdiff(16);
 
         // Define program options
@@ -67,7 +68,8 @@ int main(int argc, char **argv) {
 			("upperpaths",			"Write all partial upper diff. paths\n")
 			("findcollision",		"Find nearcollision using path\n"
 									"   given by inputfile1\n")
-			("convert",				"Convert files between binary and text\n")
+			("convert",				"Convert files between binary, text\n"
+									"   and indexed path file (.paths)\n")
 			("split", po::value<unsigned>(&parameters.split),
 									"Split inputfile1 in given # files\n")
 			("join,j", po::value<vector<string> >(&parameters.files),
@@ -97,6 +99,16 @@ int main(int argc, char **argv) {
 			("outputfile2"
 				, po::value<string>(&parameters.outfile2)->default_value("")
 				, "Set outputfile 2.")
+			("pathstream"
+				, po::value<string>(&parameters.pathstream)->default_value("")
+				, "With findcollision: follow this path stream of\n"
+				  "  md5_diffpathconnect --beststream, new paths\n"
+				  "  are overwritten by inputfile2 and used at once,\n"
+				  "  together with the paths of the -j files.")
+			("benchmark"
+				, po::value<unsigned>(&parameters.benchmark)->default_value(0)
+				, "With findcollision: search for this many seconds,\n"
+				  "  then show the candidates/s of steps 17-25.")
 			("pathtyperange"
 				, po::value<unsigned>(&parameters.pathtyperange)->default_value(0)
 				, "Increases potential # diffs eliminated per n.c.")
@@ -108,6 +120,13 @@ int main(int argc, char **argv) {
 			("threads"
 				, po::value<int>(&parameters.threads)->default_value(-1)
 				, "Number of worker threads")
+			("seed"
+				, po::value<uint32>(&rngseed)
+				, "Seed for the random generators of all threads. Default is random.\n"
+				  "  Runs with the same seed and --threads 1 are reproducible.\n"
+				  "  Worker i always draws the same stream, but threads\n"
+				  "  take work as they become idle, so with more threads\n"
+				  "  the outcome also depends on the thread scheduling.")
 			;
 
         msg
@@ -155,6 +174,9 @@ int main(int argc, char **argv) {
         if (parameters.threads <= 0 || parameters.threads > boost::thread::hardware_concurrency()) {
             parameters.threads = boost::thread::hardware_concurrency();
         }
+        if (vm.count("seed")) {
+            seed(rngseed);
+        }
 
         if (vm.count("startnearcollision")) {
             return startnearcollision(parameters);
@@ -44,9 +44,11 @@ void save_block(ostream &o, uint32 block[]);
 struct parameters_type {
     uint32 m_diff[16];
     string infile1, infile2, outfile1, outfile2;
+    string pathstream;
     unsigned split;
     unsigned skipnc;
     unsigned pathtyperange;
+    unsigned benchmark;
     vector<string> files;
     int threads;
 
@@ -73,7 +75,11 @@ int partialpathfromfile(parameters_type &parameters);
 
 struct collisionfinding_thread {
     collisionfinding_thread()
-        : testcounts(1 << 20, 0) {}
+        : testcounts(1 << 20, 0) {
+        for (unsigned t = 0; t < 64; ++t) {
+            candidates[t] = survivors[t] = 0;
+        }
+    }
 
     int verifyconds();
     void do_step26();
@@ -100,12 +106,14 @@ struct collisionfinding_thread {
 
     uint64 cpu_step_t[64];
     vector<uint64> testcounts /*(1<<20,0)*/;
+    // tunnel candidates evaluated in lanes at step t and the number that passed the conditions of step t
+    uint64 candidates[64], survivors[64];
 
-    differentialpath diffpath;
+    fixeddifferentialpath diffpath;
     uint32 m_diff[16];
 
-    vector<triple<uint32, uint32, uint32>> Q1Q2m0withm1ok;
-    vector<triple<uint32, uint32, uint32>>::const_iterator Q1Q2m0it, Q1Q2m0itend;
+    // values of Q1, Q2 and m0 with m1 ok, as separate arrays for the lanes of step 19
+    vector<uint32> Q1withm1ok, Q2withm1ok, m0withm1ok;
 
     static const int offset = 3;
     uint32 m[16];
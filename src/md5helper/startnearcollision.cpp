@@ -489,7 +489,7 @@ int startnearcollision(parameters_type &parameters) {
     for (unsigned i = 0; i < rotateddiff.size(); ++i) {
         uint32 dR = rotateddiff[i].first;
         wordconditions Q1 = naf(lowerpath[0].diff() + dR);
-        rotateddiff[i].second = check_rotation(dR, dT, md5_rc[0], lowerpath[0], Q1, 1 << 12);
+        rotateddiff[i].second = check_rotation(dR, dT, md5_rc[0], lowerpath[0], Q1);
         if (rotateddiff[i].second > bestrot) {
             lowerpath[1] = Q1;
             bestrot = rotateddiff[i].second;
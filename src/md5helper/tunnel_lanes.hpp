@@ -0,0 +1,139 @@
+/**************************************************************************\
+|
+|    Copyright (C) 2009 Marc Stevens
+|
+|    This program is free software: you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation, either version 3 of the License, or
+|    (at your option) any later version.
+|
+|    This program is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+|
+\**************************************************************************/
+
+#ifndef TUNNEL_LANES_HPP
+#define TUNNEL_LANES_HPP
+
+#include <hashclash/types.hpp>
+
+/*
+   The tunnel loops of steps 17-25 evaluate their candidates in SIMD lanes.
+   The values of a tunnel are enumerated in blocks of lanes_block values, in the same order as a scalar loop would,
+   then the next state word of all lanes is computed and its bitconditions and rotation are checked with mask compares.
+   The indices of the surviving lanes are compacted and only these are recomputed in scalar code to continue with the next step,
+   so the search visits exactly the same states as with one candidate at a time.
+   The SIMD words are chosen at compile time: AVX-512 (16 lanes), AVX2 (8 lanes) or plain C (simd_scalar.h, 4 lanes).
+*/
+
+// one of the SIMD headers has to be included first, it decides the number of lanes.
+// the code is put in a namespace per SIMD version, so objects built for different versions can be linked together
+#define LANES_STR2(a) #a
+#define LANES_STR(a) LANES_STR2(a)
+#define LANES_NAMESPACE2(a) lanes_##a
+#define LANES_NAMESPACE(a) LANES_NAMESPACE2(a)
+
+namespace LANES_NAMESPACE(SIMD_VERSION) {
+
+using hashclash::uint32;
+
+const unsigned lanes_block = 256;
+const unsigned lanes_words = lanes_block / SIMD_VECSIZE;
+
+union lanes_type {
+    SIMD_WORD v;
+    uint32 w[SIMD_VECSIZE];
+};
+
+inline SIMD_WORD lanes_ff(SIMD_WORD b, SIMD_WORD c, SIMD_WORD d) { return SIMD_XOR_VV(d, SIMD_AND_VV(b, SIMD_XOR_VV(c, d))); }
+inline SIMD_WORD lanes_ff(SIMD_WORD b, uint32 c, uint32 d) { return SIMD_XOR_VW(SIMD_AND_VW(b, c ^ d), d); }
+inline SIMD_WORD lanes_ff(uint32 b, SIMD_WORD c, uint32 d) { return SIMD_XOR_VW(SIMD_AND_VW(SIMD_XOR_VW(c, d), b), d); }
+
+// all-one lanes where (Q & mask) == testval
+inline SIMD_WORD lanes_checkcond(SIMD_WORD Q, uint32 mask, uint32 testval) { return SIMD_EQ_VV(SIMD_AND_VW(Q, mask), SIMD_WTOV(testval)); }
+
+// all-one lanes where rotating T + dT gives R + dR, with R the rotation of T by rc
+#define LANES_CHECKROT(T, R, rc, dT, dR) SIMD_EQ_VV(SIMD_SUB_VV(SIMD_ROL_V(SIMD_ADD_VW(T, dT), rc), R), SIMD_WTOV(dR))
+
+// store the indices of the lanes j < n with ok[j] != 0 in idx, returns their number
+inline unsigned lanes_compact(const lanes_type ok[], unsigned n, unsigned idx[]) {
+    unsigned s = 0;
+    for (unsigned j = 0; j < n; ++j) {
+        idx[s] = j;
+        s += (ok[j / SIMD_VECSIZE].w[j % SIMD_VECSIZE] != 0) ? 1 : 0;
+    }
+    return s;
+}
+
+// enumerates the values of a tunnel mask in the order of the scalar loops: mask, (mask-1)&mask, ..., 0
+// with zerofirst the order is 0, mask, (mask-1)&mask, ..., lowest bit of mask
+class tunnel_lanes {
+  public:
+    tunnel_lanes(uint32 mask, bool zerofirst = false)
+        : mask(mask), cur(0), zerofirst(zerofirst), done(false) {}
+
+    // the next block of at most lanes_block values, returns the number of values (0 if done)
+    unsigned next(lanes_type val[]) {
+        unsigned n = 0;
+        if (zerofirst && !done && cur == 0) {
+            val[0].w[0] = 0;
+            n = 1;
+        }
+        while (!done && n < lanes_block) {
+            cur = (cur - 1) & mask;
+            if (cur == 0) {
+                done = true;
+                if (zerofirst) {
+                    break;
+                }
+            }
+            val[n / SIMD_VECSIZE].w[n % SIMD_VECSIZE] = cur;
+            ++n;
+        }
+        return n;
+    }
+
+    // the last value of the enumeration
+    uint32 last() const { return zerofirst ? (mask & (0 - mask)) : 0; }
+
+    static uint32 value(const lanes_type val[], unsigned j) { return val[j / SIMD_VECSIZE].w[j % SIMD_VECSIZE]; }
+
+  private:
+    uint32 mask, cur;
+    bool zerofirst, done;
+};
+
+/*
+   Lanes of a tunnel on Q_x that only changes m_x, at the step t of round 2 that uses m_x:
+     Q_x = Qxvalue ^ tunnel (or Qxvalue + tunnel), m_x = RR(Q_{x+1} - Q_x, rcx) - F(Q_x, Q_{x-1}, Q_{x-2}) - Q_{x-3} - AC_x,
+     T_t = pT_t + m_x, Q_{t+1} = Q_t + RL(T_t, rct)
+   returns the number of lanes for which Q_{t+1} and the rotation of step t are ok, their indices are stored in idx.
+*/
+struct tunnel_step_lanes {
+    uint32 Qxvalue, Qxp1, Qxm1, Qxm2;
+    uint32 Tc; // pT_t - Q_{x-3} - AC_x
+    uint32 Qt, Qtp1mask, Qtp1testval, dT, dR;
+
+    template <unsigned rcx, unsigned rct, bool additive>
+    unsigned check(const lanes_type val[], unsigned n, unsigned idx[]) const {
+        lanes_type ok[lanes_words];
+        for (unsigned i = 0; i * SIMD_VECSIZE < n; ++i) {
+            SIMD_WORD Qx = additive ? SIMD_ADD_VW(val[i].v, Qxvalue) : SIMD_XOR_VW(val[i].v, Qxvalue);
+            SIMD_WORD T = SIMD_ADD_VW(SIMD_SUB_VV(SIMD_ROR_V(SIMD_SUB_VV(SIMD_WTOV(Qxp1), Qx), rcx), lanes_ff(Qx, Qxm1, Qxm2)), Tc);
+            SIMD_WORD R = SIMD_ROL_V(T, rct);
+            ok[i].v = SIMD_AND_VV(lanes_checkcond(SIMD_ADD_VW(R, Qt), Qtp1mask, Qtp1testval), LANES_CHECKROT(T, R, rct, dT, dR));
+        }
+        return lanes_compact(ok, n, idx);
+    }
+};
+
+} // namespace LANES_NAMESPACE(SIMD_VERSION)
+
+using namespace LANES_NAMESPACE(SIMD_VERSION);
+
+#endif // TUNNEL_LANES_HPP
@@ -460,11 +460,7 @@ int main(int argc, char **argv) {
     }
     if (!seedstr.empty()) {
         cout << "Using seed: " << seedstr << endl;
-        seed(0);
-        for (unsigned i = 0; i < seedstr.size(); ++i) {
-            seed32_1 ^= seedstr[i];
-            xrng128();
-        }
+        seed_string(seedstr);
     }
     if (maxruntime <= 0) {
         maxruntime = -1;